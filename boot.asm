@@ -59,8 +59,9 @@ _start:
 	; high-level kernel is entered. It's best to minimize the early
 	; environment where crucial features are offline. Note that the
 	; processor is not fully initialized yet: Features such as floating
-	; point instructions and instruction set extensions are not initialized
-	; yet. The GDT should be loaded here. Paging should be enabled here.
+	; point instructions and instruction set extensions are only enabled by
+	; fpu_init() in kernel_main. The GDT should be loaded here. Paging
+	; should be enabled here.
 	; C++ features such as global constructors and exceptions will require
 	; runtime support to work as well.
   
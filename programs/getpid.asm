@@ -0,0 +1,55 @@
+; getpid.asm - example user program, run as a boot module by exec
+;
+; "make programs" links it for the user range into bin/getpid.elf, then
+; "make run MODULES=bin/getpid.elf" boots with it and "exec getpid.elf"
+; starts it. exec passes the number of arguments at [esp] and the numbers
+; above it: [esp + 4] = round trips, default 100000.
+; Prints a line, then times getpid through int 0x80 and exits with the
+; average TSC cycles per round trip.
+
+; call numbers, see src/syscall.h
+%define SYS_EXIT 0
+%define SYS_WRITE 1
+%define SYS_GETPID 2
+
+%define DEFAULT_LOOPS 100000
+
+section .rodata
+greeting: db "getpid: timing int 0x80 from an ELF module"
+greeting_length equ $ - greeting
+
+section .data
+loops: dd DEFAULT_LOOPS
+
+section .text
+global _start
+_start:
+    cmp dword [esp], 0
+    je .greet
+    mov eax, [esp + 4]
+    test eax, eax           ; no division by 0 round trips
+    jz .greet
+    mov [loops], eax
+.greet:
+    mov eax, SYS_WRITE
+    mov ebx, greeting
+    mov esi, greeting_length
+    int 0x80
+
+    mov ebp, [loops]
+    mov ebx, ebp            ; counts down, int 0x80 preserves EBX and EBP
+    rdtsc
+    mov esi, eax
+    mov edi, edx
+.loop:
+    mov eax, SYS_GETPID
+    int 0x80
+    dec ebx
+    jnz .loop
+    rdtsc
+    sub eax, esi
+    sbb edx, edi
+    div ebp                 ; average over all round trips
+    mov ebx, eax
+    mov eax, SYS_EXIT
+    int 0x80
@@ -0,0 +1,238 @@
+#include "acpi.h"
+#include "kmem.h"
+
+// The BIOS data area stores the EBDA segment at this address
+#define BDA_EBDA_SEGMENT 0x40E
+#define EBDA_SEARCH_LENGTH 1024
+#define BIOS_AREA_START 0xE0000
+#define BIOS_AREA_END 0x100000
+
+#define RSDP_V1_LENGTH 20
+
+// MADT layout: header, local APIC address, flags, then variable entries
+#define MADT_ENTRIES_OFFSET (sizeof(AcpiSdtHeader) + 8)
+#define MADT_FLAG_PCAT_COMPAT 0x1
+#define MADT_TYPE_LAPIC 0
+#define MADT_TYPE_IOAPIC 1
+#define MADT_TYPE_SOURCE_OVERRIDE 2
+#define MADT_TYPE_LAPIC_OVERRIDE 5
+#define MADT_LAPIC_ENABLED 0x1
+#define MADT_LAPIC_ONLINE_CAPABLE 0x2
+
+// room for the tables acpi_init() copies, FACP, APIC, HPET and the like
+// take a few hundred bytes each
+#define ACPI_COPY_SIZE 8192
+#define ACPI_MAX_TABLES 32
+
+static const AcpiRsdp *rsdp = NULL;
+static bool found = false;
+static bool searched = false;
+
+// copies of the tables the root table lists, the firmware's own may lie
+// above 1 GiB where paging leaves the kernel nothing mapped
+static uint8_t tableCopies[ACPI_COPY_SIZE] __attribute__((aligned(8)));
+static const AcpiSdtHeader *tables[ACPI_MAX_TABLES];
+static size_t tableCount = 0;
+
+static AcpiMadtInfo madtInfo;
+static bool madtParsed = false;
+static bool madtValid = false;
+
+// sums up length bytes, valid ACPI structures sum to zero
+static uint8_t acpi_checksum(const void *data, size_t length) {
+  return checksum8OS(data, length);
+}
+
+static bool signature_equals(const char *a, const char *b, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    if (a[i] != b[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// scans [start, end) on 16 byte boundaries for a valid RSDP
+static const AcpiRsdp *rsdp_scan(uintptr_t start, uintptr_t end) {
+  for (uintptr_t addr = start; addr + RSDP_V1_LENGTH <= end; addr += 16) {
+    const AcpiRsdp *candidate = (const AcpiRsdp *)addr;
+    if (!signature_equals(candidate->signature, "RSD PTR ", 8)) {
+      continue;
+    }
+    if (acpi_checksum(candidate, RSDP_V1_LENGTH) != 0) {
+      continue;
+    }
+    if (candidate->revision >= 2 &&
+        acpi_checksum(candidate, candidate->length) != 0) {
+      continue;
+    }
+    return candidate;
+  }
+  return NULL;
+}
+
+static bool table_valid(const AcpiSdtHeader *table) {
+  return table != NULL && table->length >= sizeof(AcpiSdtHeader) &&
+         acpi_checksum(table, table->length) == 0;
+}
+
+// copies the valid tables a root table points to that fit
+static void copy_tables(const AcpiSdtHeader *root, bool isXsdt) {
+  // the root table is followed by an array of 32-bit (RSDT) or 64-bit (XSDT)
+  // physical table pointers
+  const uint8_t *entries = (const uint8_t *)root + sizeof(AcpiSdtHeader);
+  size_t entrySize = isXsdt ? 8 : 4;
+  size_t count = (root->length - sizeof(AcpiSdtHeader)) / entrySize;
+  size_t used = 0;
+
+  for (size_t i = 0; i < count && tableCount < ACPI_MAX_TABLES; i++) {
+    uint64_t address;
+    if (isXsdt) {
+      address = *(const uint64_t *)(entries + i * entrySize);
+    } else {
+      address = *(const uint32_t *)(entries + i * entrySize);
+    }
+    if (address == 0 || (address >> 32) != 0) {
+      continue;
+    }
+    const AcpiSdtHeader *table = (const AcpiSdtHeader *)(uintptr_t)address;
+    if (!table_valid(table) || table->length > ACPI_COPY_SIZE - used) {
+      continue;
+    }
+    memcpyOS(tableCopies + used, table, table->length);
+    tables[tableCount++] = (const AcpiSdtHeader *)(tableCopies + used);
+    used += (table->length + 7) & ~7u;
+  }
+}
+
+bool acpi_init(void) {
+  if (searched) {
+    return found;
+  }
+  searched = true;
+
+  // hide the constant address from the compiler, it would otherwise assume
+  // that page zero can never be dereferenced
+  uintptr_t bda = BDA_EBDA_SEGMENT;
+  __asm__("" : "+r"(bda));
+  uintptr_t ebda = (uintptr_t)(*(volatile uint16_t *)bda) << 4;
+  if (ebda != 0) {
+    rsdp = rsdp_scan(ebda, ebda + EBDA_SEARCH_LENGTH);
+  }
+  if (rsdp == NULL) {
+    rsdp = rsdp_scan(BIOS_AREA_START, BIOS_AREA_END);
+  }
+  if (rsdp == NULL) {
+    return false;
+  }
+
+  // prefer the XSDT, but only if it lies in our 32-bit address space
+  if (rsdp->revision >= 2 && rsdp->xsdtAddress != 0 &&
+      (rsdp->xsdtAddress >> 32) == 0) {
+    const AcpiSdtHeader *xsdt =
+        (const AcpiSdtHeader *)(uintptr_t)rsdp->xsdtAddress;
+    if (table_valid(xsdt) && signature_equals(xsdt->signature, "XSDT", 4)) {
+      copy_tables(xsdt, true);
+      found = true;
+      return true;
+    }
+  }
+
+  const AcpiSdtHeader *rsdt =
+      (const AcpiSdtHeader *)(uintptr_t)rsdp->rsdtAddress;
+  if (table_valid(rsdt) && signature_equals(rsdt->signature, "RSDT", 4)) {
+    copy_tables(rsdt, false);
+    found = true;
+    return true;
+  }
+  return false;
+}
+
+const AcpiSdtHeader *acpi_find_table(const char *signature) {
+  if (!acpi_init()) {
+    return NULL;
+  }
+  for (size_t i = 0; i < tableCount; i++) {
+    if (signature_equals(tables[i]->signature, signature, 4)) {
+      return tables[i];
+    }
+  }
+  return NULL;
+}
+
+const AcpiRsdp *acpi_rsdp(void) {
+  acpi_init();
+  return rsdp;
+}
+
+// unaligned little endian reads from MADT entries
+static uint16_t read16(const uint8_t *p) { return (uint16_t)(p[0] | p[1] << 8); }
+
+static uint32_t read32(const uint8_t *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
+
+const AcpiMadtInfo *acpi_madt(void) {
+  if (madtParsed) {
+    return madtValid ? &madtInfo : NULL;
+  }
+  madtParsed = true;
+
+  const AcpiSdtHeader *madt = acpi_find_table("APIC");
+  if (madt == NULL || madt->length < MADT_ENTRIES_OFFSET) {
+    return NULL;
+  }
+  const uint8_t *table = (const uint8_t *)madt;
+  madtInfo.lapicAddress = read32(table + sizeof(AcpiSdtHeader));
+  madtInfo.legacyPics =
+      (read32(table + sizeof(AcpiSdtHeader) + 4) & MADT_FLAG_PCAT_COMPAT) != 0;
+  for (uint32_t irq = 0; irq < ACPI_ISA_IRQS; irq++) {
+    madtInfo.isaGsi[irq] = irq;
+    madtInfo.isaFlags[irq] = 0;
+  }
+
+  // entries are {type, length, data...}
+  const uint8_t *entry = table + MADT_ENTRIES_OFFSET;
+  const uint8_t *end = table + madt->length;
+  while (entry + 2 <= end && entry[1] >= 2 && entry + entry[1] <= end) {
+    switch (entry[0]) {
+    case MADT_TYPE_LAPIC: {
+      uint32_t flags = read32(entry + 4);
+      if ((flags & (MADT_LAPIC_ENABLED | MADT_LAPIC_ONLINE_CAPABLE)) &&
+          madtInfo.cpuCount < ACPI_MAX_CPUS) {
+        madtInfo.cpuApicIds[madtInfo.cpuCount++] = entry[3];
+      }
+      break;
+    }
+    case MADT_TYPE_IOAPIC:
+      if (madtInfo.ioapicCount < ACPI_MAX_IOAPICS) {
+        AcpiIoapic *ioapic = &madtInfo.ioapics[madtInfo.ioapicCount++];
+        ioapic->id = entry[2];
+        ioapic->address = read32(entry + 4);
+        ioapic->gsiBase = read32(entry + 8);
+      }
+      break;
+    case MADT_TYPE_SOURCE_OVERRIDE:
+      // bus 0 (ISA) source IRQ is wired to another GSI or polarity/trigger
+      if (entry[2] == 0 && entry[3] < ACPI_ISA_IRQS) {
+        madtInfo.isaGsi[entry[3]] = read32(entry + 4);
+        madtInfo.isaFlags[entry[3]] = read16(entry + 8);
+      }
+      break;
+    case MADT_TYPE_LAPIC_OVERRIDE: {
+      uint32_t high = read32(entry + 8);
+      if (high == 0) {
+        madtInfo.lapicAddress = read32(entry + 4);
+      }
+      break;
+    }
+    default:
+      break;
+    }
+    entry += entry[1];
+  }
+
+  madtValid = true;
+  return &madtInfo;
+}
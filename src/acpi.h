@@ -0,0 +1,144 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+/**
+ * @file acpi.h
+ * @brief Discovery of ACPI tables (RSDP, RSDT/XSDT and the tables they list).
+ *
+ * acpi_init() runs before paging and reads the firmware's tables through
+ * their physical addresses. It keeps copies of the listed tables in kernel
+ * memory, because paging maps only the first GiB of RAM for the kernel and
+ * firmware often puts the tables near the top of RAM.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Root System Description Pointer (ACPI 2.0 layout).
+ */
+typedef struct {
+  char signature[8];     /**< "RSD PTR " */
+  uint8_t checksum;      /**< Checksum of the first 20 bytes. */
+  char oemId[6];         /**< OEM identifier. */
+  uint8_t revision;      /**< 0 for ACPI 1.0, 2 for ACPI 2.0+. */
+  uint32_t rsdtAddress;  /**< Physical address of the RSDT. */
+  uint32_t length;       /**< Length of the whole structure (ACPI 2.0+). */
+  uint64_t xsdtAddress;  /**< Physical address of the XSDT (ACPI 2.0+). */
+  uint8_t extendedChecksum; /**< Checksum of the whole structure. */
+  uint8_t reserved[3];   /**< Reserved. */
+} __attribute__((packed)) AcpiRsdp;
+
+/**
+ * @brief Header shared by all ACPI system description tables.
+ */
+typedef struct {
+  char signature[4];     /**< Table signature, e.g. "HPET". */
+  uint32_t length;       /**< Length of the table including the header. */
+  uint8_t revision;      /**< Table revision. */
+  uint8_t checksum;      /**< All bytes of the table sum to zero. */
+  char oemId[6];         /**< OEM identifier. */
+  char oemTableId[8];    /**< OEM table identifier. */
+  uint32_t oemRevision;  /**< OEM revision. */
+  uint32_t creatorId;    /**< Vendor ID of the table creator. */
+  uint32_t creatorRevision; /**< Revision of the table creator. */
+} __attribute__((packed)) AcpiSdtHeader;
+
+/**
+ * @brief ACPI Generic Address Structure.
+ */
+typedef struct {
+  uint8_t addressSpaceId;   /**< 0 = system memory, 1 = system I/O. */
+  uint8_t registerBitWidth; /**< Register width in bits. */
+  uint8_t registerBitOffset; /**< Register offset in bits. */
+  uint8_t accessSize;       /**< Access size. */
+  uint64_t address;         /**< Address of the register block. */
+} __attribute__((packed)) AcpiGenericAddress;
+
+/**
+ * @brief The HPET description table.
+ */
+typedef struct {
+  AcpiSdtHeader header;       /**< Common table header ("HPET"). */
+  uint32_t eventTimerBlockId; /**< Hardware revision and capabilities. */
+  AcpiGenericAddress baseAddress; /**< MMIO base of the HPET block. */
+  uint8_t hpetNumber;         /**< Sequence number of this HPET. */
+  uint16_t minimumTick;       /**< Minimum periodic tick in counter cycles. */
+  uint8_t pageProtection;     /**< Page protection attributes. */
+} __attribute__((packed)) AcpiHpetTable;
+
+/** @brief Most CPUs (Local APICs) recorded from the MADT. */
+#define ACPI_MAX_CPUS 16
+
+/** @brief Most IOAPICs recorded from the MADT. */
+#define ACPI_MAX_IOAPICS 4
+
+/** @brief Number of ISA IRQ lines that interrupt source overrides apply to. */
+#define ACPI_ISA_IRQS 16
+
+// MPS INTI flags of interrupt source overrides
+#define ACPI_MADT_POLARITY_MASK 0x3
+#define ACPI_MADT_POLARITY_LOW 0x3
+#define ACPI_MADT_TRIGGER_MASK 0xC
+#define ACPI_MADT_TRIGGER_LEVEL 0xC
+
+/**
+ * @brief One IOAPIC described by the MADT.
+ */
+typedef struct {
+  uint8_t id;       /**< IOAPIC ID. */
+  uint32_t address; /**< Physical MMIO base. */
+  uint32_t gsiBase; /**< First global system interrupt it handles. */
+} AcpiIoapic;
+
+/**
+ * @brief The interrupt topology, decoded from the MADT ("APIC") table.
+ */
+typedef struct {
+  uint32_t lapicAddress;   /**< Physical base of the Local APICs. */
+  bool legacyPics;         /**< An 8259 pair is present (PCAT_COMPAT). */
+  uint32_t cpuCount;       /**< Number of usable CPUs in cpuApicIds. */
+  uint8_t cpuApicIds[ACPI_MAX_CPUS]; /**< Local APIC IDs of usable CPUs. */
+  uint32_t ioapicCount;    /**< Number of entries in ioapics. */
+  AcpiIoapic ioapics[ACPI_MAX_IOAPICS]; /**< The IOAPICs. */
+  uint32_t isaGsi[ACPI_ISA_IRQS];   /**< GSI each ISA IRQ is wired to. */
+  uint16_t isaFlags[ACPI_ISA_IRQS]; /**< MPS INTI flags of each ISA IRQ. */
+} AcpiMadtInfo;
+
+/**
+ * @brief Locates the RSDP and the root table (XSDT or RSDT).
+ *
+ * @return true If a valid RSDP and root table were found.
+ * @details Searches the first KiB of the EBDA and the BIOS area
+ * 0xE0000-0xFFFFF and copies the tables the root table lists. Call it
+ * before paging_init(). The result is cached, repeated calls are cheap.
+ */
+bool acpi_init(void);
+
+/**
+ * @brief Finds an ACPI table by its signature.
+ *
+ * @param signature The four character table signature, e.g. "HPET".
+ * @return const AcpiSdtHeader* The kernel's copy of the table, or NULL if
+ * it is absent, corrupt or did not fit.
+ */
+const AcpiSdtHeader *acpi_find_table(const char *signature);
+
+/**
+ * @brief Decodes the MADT.
+ *
+ * @return const AcpiMadtInfo* The interrupt topology, or NULL without a MADT.
+ * @details Parsed once and cached. ISA IRQs without an interrupt source
+ * override are identity mapped (IRQ n is GSI n, edge triggered, active high).
+ */
+const AcpiMadtInfo *acpi_madt(void);
+
+/**
+ * @brief Returns the RSDP found by acpi_init().
+ *
+ * @return const AcpiRsdp* The RSDP, or NULL if ACPI is unavailable.
+ */
+const AcpiRsdp *acpi_rsdp(void);
+
+#endif
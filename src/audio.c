@@ -1,5 +1,6 @@
 #include "audio.h"
 #include "io.h"
+#include "sched.h"
 #include "time.h"
 
 /**
@@ -51,7 +52,7 @@ void playNote(Note note) {
 }
 
 void playSong(Note *notes, size_t length) {
-    for (size_t i = 0; i < length; i++) {
+    for (size_t i = 0; i < length && !thread_should_stop(); i++) {
         playNote(notes[i]);
     }
 }
@@ -10,6 +10,22 @@
 #include "multiboot.h"
 #include "art.h"
 #include "audio.h"
+#include "rtc.h"
+#include "latbench.h"
+#include "parbench.h"
+#include "interrupts.h"
+#include "irqsoff.h"
+#include "fpu.h"
+#include "cpufeatures.h"
+#include "sched.h"
+#include "jobs.h"
+#include "percpu.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "sysbench.h"
+#include "modules.h"
+#include "forkbench.h"
+#include "ipcbench.h"
 
 #define COMMAND_LIST_LENGTH 64
 
@@ -97,6 +113,27 @@ void helpHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
   }
 }
 
+// busy share of every online CPU since it came up, idle is halted time
+static void printCpuUtilisation(void) {
+  char line[128] = "CPU utilisation:";
+  for (uint32_t i = 0; i < smp_cpu_count(); i++) {
+    const SmpCpu *cpu = smp_cpu(i);
+    if (cpu->state != SMP_CPU_ONLINE) {
+      continue;
+    }
+    uint32_t busy = percpu_busy_permille(i);
+    appendString(line, " cpu");
+    appendDecimal(line, i, 0);
+    appendString(line, " ");
+    appendDecimal(line, busy / 10u, 0);
+    appendString(line, ".");
+    appendDecimal(line, busy % 10u, 0);
+    appendString(line, "%");
+  }
+  appendString(line, " busy");
+  terminalWriteLine(line);
+}
+
 /**
  * @brief Handles the uptime command.
  *
@@ -112,6 +149,7 @@ void uptimeHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
   char buffer[256];
   formatUptime(buffer, sizeof(buffer));
   terminalWriteLine(buffer);
+  printCpuUtilisation();
 }
 
 /**
@@ -192,6 +230,21 @@ void sysinfoHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
   char uptimeBuffer[256];
   formatUptime(uptimeBuffer, sizeof(uptimeBuffer));
   terminalWriteLine(uptimeBuffer);
+  printCpuUtilisation();
+  concat("Tick source: ", timer_source_name(), uptimeBuffer);
+  terminalWriteLine(uptimeBuffer);
+  concat("Interrupt controller: ", irq_controller_name(), uptimeBuffer);
+  terminalWriteLine(uptimeBuffer);
+  static const char *fpuMethods[] = {"none", "fnsave", "fxsave", "xsave"};
+  uptimeBuffer[0] = '\0';
+  appendString(uptimeBuffer, "FPU state: ");
+  appendString(uptimeBuffer, fpuMethods[fpu_save_method()]);
+  appendString(uptimeBuffer, ", ");
+  appendDecimal(uptimeBuffer, fpu_state_size(), 0);
+  appendString(uptimeBuffer, " bytes, ");
+  appendDecimal(uptimeBuffer, fpu_lazy_switches(), 0);
+  appendString(uptimeBuffer, " lazy switches");
+  terminalWriteLine(uptimeBuffer);
   terminalWriteLine("");
   
   // Memory Information
@@ -314,6 +367,370 @@ void musicHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
   terminalWriteLine("Song finished!");
 }
 
+/**
+ * @brief Handles the clocks command.
+ * @param cmd The split command input.
+ * @param buf The buffer to store the command output.
+ * @details Lists the registered clock and event sources and cross-checks the
+ * TSC against the HPET.
+ */
+void clocksHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
+  (void)cmd; // Suppress unused parameter warning
+  (void)buf; // Suppress unused parameter warning
+  printClocksToTerminal();
+}
+
+/**
+ * @brief Handles the date command.
+ * @param cmd The split command input.
+ * @param buf The buffer to store the command output.
+ * @details Prints the wall-clock time derived from the boot time CMOS read.
+ */
+void dateHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
+  (void)cmd; // Suppress unused parameter warning
+  (void)buf; // Suppress unused parameter warning
+
+  char dateBuffer[64];
+  rtc_format_date(dateBuffer);
+  terminalWriteLine(dateBuffer);
+}
+
+/**
+ * @brief Handles the latbench command.
+ * @param cmd The split command input.
+ * @param buf The buffer to store the command output.
+ * @details Usage: latbench [sleep] [load] [interval_us] [loops]. The first
+ * number is the interval, the second the number of loops.
+ */
+void latbenchHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
+  (void)buf; // Suppress unused parameter warning
+
+  LatbenchMode mode = LATBENCH_TIMER;
+  bool load = false;
+  uint32_t intervalUs = 1000;
+  uint32_t loops = 1000;
+  int numbers = 0;
+
+  for (int i = 1; i < NUM_SUBSTRINGS && cmd[i][0] != '\0'; i++) {
+    uint32_t value;
+    if (strcmpOS(cmd[i], "sleep") == 0) {
+      mode = LATBENCH_SLEEP;
+    } else if (strcmpOS(cmd[i], "load") == 0) {
+      load = true;
+    } else if (numbers < 2 && decimalStringToUint32(cmd[i], &value)) {
+      if (numbers++ == 0) {
+        intervalUs = value;
+      } else {
+        loops = value;
+      }
+    } else {
+      terminalWriteLine("Usage: latbench [sleep] [load] [interval_us] [loops]");
+      return;
+    }
+  }
+  runLatencyBenchmark(mode, intervalUs, loops, load);
+}
+
+/**
+ * @brief Handles the irqstat command.
+ * @param cmd The split command input.
+ * @param buf The buffer to store the command output.
+ * @details Shows per-vector interrupt counts, rates and handler cycles.
+ */
+void irqstatHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
+  (void)cmd; // Suppress unused parameter warning
+  (void)buf; // Suppress unused parameter warning
+  printIrqStatsToTerminal();
+}
+
+// appends "min <min>, avg <avg> cycles" of one entry path measurement
+static void appendEntryCycles(char *line, const IrqEntryBenchmark *result) {
+  appendString(line, "min ");
+  appendDecimal(line, result->min, 0);
+  appendString(line, ", avg ");
+  appendDecimal(line, result->avg, 0);
+  appendString(line, " cycles");
+}
+
+/**
+ * @brief Handles the irqbench command.
+ * @param cmd The split command input.
+ * @param buf The buffer to store the command output.
+ * @details Usage: irqbench [loops]. Compares the round trip of a software
+ * interrupt through the full and through the lean interrupt entry.
+ */
+void irqbenchHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
+  (void)buf; // Suppress unused parameter warning
+
+  uint32_t loops = 10000;
+  if (cmd[1][0] != '\0' && (!decimalStringToUint32(cmd[1], &loops) || loops == 0)) {
+    terminalWriteLine("Usage: irqbench [loops]");
+    return;
+  }
+
+  IrqEntryBenchmark full, fast;
+  irq_entry_benchmark(loops, &full, &fast);
+
+  char line[128] = "Interrupt round trip, empty handler, ";
+  appendDecimal(line, loops, 0);
+  appendString(line, " loops:");
+  terminalWriteLine(line);
+  line[0] = '\0';
+  appendString(line, "  full entry (pusha, segments): ");
+  appendEntryCycles(line, &full);
+  terminalWriteLine(line);
+  line[0] = '\0';
+  appendString(line, "  fast entry (eax/ecx/edx):     ");
+  appendEntryCycles(line, &fast);
+  terminalWriteLine(line);
+  line[0] = '\0';
+  appendString(line, "  saved per interrupt: ");
+  appendDecimal(line, full.avg > fast.avg ? full.avg - fast.avg : 0, 0);
+  appendString(line, " cycles (avg)");
+  terminalWriteLine(line);
+}
+
+/**
+ * @brief Handles the irqsoff command.
+ * @param cmd The split command input.
+ * @param buf The buffer to store the command output.
+ * @details Usage: irqsoff [start|stop|reset]. Without an argument the
+ * longest interrupts-disabled sections are listed.
+ */
+void irqsoffHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
+  (void)buf; // Suppress unused parameter warning
+
+  if (cmd[1][0] == '\0') {
+    printIrqsoffToTerminal();
+  } else if (strcmpOS(cmd[1], "start") == 0) {
+    irqsoff_set_tracing(true);
+    terminalWriteLine("irqsoff tracing started");
+  } else if (strcmpOS(cmd[1], "stop") == 0) {
+    irqsoff_set_tracing(false);
+    terminalWriteLine("irqsoff tracing stopped");
+  } else if (strcmpOS(cmd[1], "reset") == 0) {
+    irqsoff_reset();
+    terminalWriteLine("irqsoff records cleared");
+  } else {
+    terminalWriteLine("Usage: irqsoff [start|stop|reset]");
+  }
+}
+
+/**
+ * @brief Handles the cpuinfo command.
+ * @param cmd The split command input.
+ * @param buf The buffer to store the command output.
+ * @details Shows what CPUID reported and which kernel routines were chosen.
+ */
+void cpuinfoHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
+  (void)cmd; // Suppress unused parameter warning
+  (void)buf; // Suppress unused parameter warning
+  printCpuInfoToTerminal();
+}
+
+/**
+ * @brief Handles the ps command.
+ * @param cmd The split command input.
+ * @param buf The buffer to store the command output.
+ * @details Lists the kernel threads with their state and CPU time.
+ */
+void psHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
+  (void)cmd; // Suppress unused parameter warning
+  (void)buf; // Suppress unused parameter warning
+  printThreadsToTerminal();
+}
+
+// parses "3" or "%3", without an argument the latest job is meant
+static bool parseJobId(char *arg, uint32_t *id) {
+  if (arg[0] == '\0') {
+    *id = jobs_latest();
+    return *id != 0;
+  }
+  if (arg[0] == '%') {
+    arg++;
+  }
+  return decimalStringToUint32(arg, id);
+}
+
+/**
+ * @brief Handles the smp command.
+ * @param cmd The split command input.
+ * @param buf The buffer to store the command output.
+ * @details Lists the CPUs and whether they came online.
+ */
+void smpHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
+  (void)cmd; // Suppress unused parameter warning
+  (void)buf; // Suppress unused parameter warning
+  printSmpToTerminal();
+}
+
+/**
+ * @brief Handles the parbench command.
+ * @param cmd The split command input.
+ * @param buf The buffer to store the command output.
+ * @details Times fill, checksum and render on one CPU and on the task pool.
+ */
+void parbenchHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
+  (void)cmd; // Suppress unused parameter warning
+  (void)buf; // Suppress unused parameter warning
+  runParallelBenchmark();
+}
+
+/**
+ * @brief Handles the lockstat command.
+ * @param cmd The split command input.
+ * @param buf The buffer to store the command output.
+ * @details Usage: lockstat [on|off|reset]. Without argument the most
+ * contended locks are listed.
+ */
+void lockstatHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
+  (void)buf; // Suppress unused parameter warning
+
+  if (cmd[1][0] == '\0') {
+    printLockstatToTerminal();
+  } else if (strcmpOS(cmd[1], "on") == 0) {
+    lockstat_set_enabled(true);
+    terminalWriteLine("lock contention statistics on");
+  } else if (strcmpOS(cmd[1], "off") == 0) {
+    lockstat_set_enabled(false);
+    terminalWriteLine("lock contention statistics off");
+  } else if (strcmpOS(cmd[1], "reset") == 0) {
+    lockstat_reset();
+    terminalWriteLine("lock statistics cleared");
+  } else {
+    terminalWriteLine("Usage: lockstat [on|off|reset]");
+  }
+}
+
+/**
+ * @brief Handles the sysbench command.
+ * @param cmd The split command input.
+ * @param buf The buffer to store the command output.
+ * @details Usage: sysbench [round trips]. Compares the system call gates
+ * and runs the isolation checks.
+ */
+void sysbenchHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
+  (void)buf; // Suppress unused parameter warning
+
+  uint32_t loops = SYSBENCH_DEFAULT_LOOPS;
+  if (cmd[1][0] != '\0' && (!decimalStringToUint32(cmd[1], &loops) || loops == 0)) {
+    terminalWriteLine("Usage: sysbench [round trips]");
+    return;
+  }
+  runSyscallBenchmark(loops);
+}
+
+/**
+ * @brief Handles the exec command.
+ * @param cmd The split command input.
+ * @param buf The buffer to store the command output.
+ * @details Usage: exec [module [numbers...]]. Without argument the boot
+ * modules are listed, else the module is run as a user program with the
+ * numbers on its stack.
+ */
+void execHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
+  (void)buf; // Suppress unused parameter warning
+
+  if (cmd[1][0] == '\0') {
+    printModulesToTerminal();
+    return;
+  }
+  const BootModule *module = modules_find(cmd[1]);
+  if (module == NULL) {
+    terminalWriteLine("exec: no such module");
+    return;
+  }
+  uint32_t args[MODULE_MAX_ARGS];
+  uint32_t argCount = 0;
+  for (; argCount < NUM_SUBSTRINGS - 2 && cmd[argCount + 2][0] != '\0';
+       argCount++) {
+    if (argCount == MODULE_MAX_ARGS ||
+        !decimalStringToUint32(cmd[argCount + 2], &args[argCount])) {
+      terminalWriteLine("Usage: exec [module [numbers...]], up to 7 numbers");
+      return;
+    }
+  }
+  runModuleProgram(module, args, argCount);
+}
+
+/**
+ * @brief Handles the forkbench command.
+ * @param cmd The split command input.
+ * @param buf The buffer to store the command output.
+ * @details Usage: forkbench [max pages]. Times copy-on-write and copying
+ * forks of growing processes.
+ */
+void forkbenchHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
+  (void)buf; // Suppress unused parameter warning
+
+  uint32_t maxPages = FORKBENCH_DEFAULT_PAGES;
+  if (cmd[1][0] != '\0' && (!decimalStringToUint32(cmd[1], &maxPages) || maxPages == 0)) {
+    terminalWriteLine("Usage: forkbench [max pages]");
+    return;
+  }
+  runForkBenchmark(maxPages);
+}
+
+/**
+ * @brief Handles the ipcbench command.
+ * @param cmd The split command input.
+ * @param buf The buffer to store the command output.
+ * @details Usage: ipcbench [round trips]. Times ping-pong between two
+ * processes with messages in registers and with pages moved along.
+ */
+void ipcbenchHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
+  (void)buf; // Suppress unused parameter warning
+
+  uint32_t roundTrips = IPCBENCH_DEFAULT_ROUND_TRIPS;
+  if (cmd[1][0] != '\0' && (!decimalStringToUint32(cmd[1], &roundTrips) || roundTrips == 0)) {
+    terminalWriteLine("Usage: ipcbench [round trips]");
+    return;
+  }
+  runIpcBenchmark(roundTrips);
+}
+
+/**
+ * @brief Handles the jobs command.
+ * @param cmd The split command input.
+ * @param buf The buffer to store the command output.
+ * @details Lists the background jobs started with `cmd &`.
+ */
+void jobsHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
+  (void)cmd; // Suppress unused parameter warning
+  (void)buf; // Suppress unused parameter warning
+  printJobsToTerminal();
+}
+
+/**
+ * @brief Handles the fg command.
+ * @param cmd The split command input.
+ * @param buf The buffer to store the command output.
+ * @details Usage: fg [job]. Waits for the job and shows its output meanwhile.
+ */
+void fgHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
+  (void)buf; // Suppress unused parameter warning
+
+  uint32_t id;
+  if (!parseJobId(cmd[1], &id) || !jobs_foreground(id)) {
+    terminalWriteLine("fg: no such job");
+  }
+}
+
+/**
+ * @brief Handles the kill command.
+ * @param cmd The split command input.
+ * @param buf The buffer to store the command output.
+ * @details Usage: kill [job]. The job stops at its next sleep or check.
+ */
+void killHandler(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf) {
+  (void)buf; // Suppress unused parameter warning
+
+  uint32_t id;
+  if (!parseJobId(cmd[1], &id) || !jobs_kill(id)) {
+    terminalWriteLine("kill: no such running job");
+  }
+}
+
 // docs see header file
 void initCommands() {
   commandList[0].name = "shutdown";
@@ -357,14 +774,106 @@ void initCommands() {
   commandList[9].help = "Play a melody using the PC speaker.";
   commandList[9].handlerFuncPtr = &musicHandler;
 
-  commandList[10].name = NULL;
-  commandList[10].handlerFuncPtr = NULL;
+  commandList[10].name = "clocks";
+  commandList[10].help = "List clock and event sources (TSC, HPET, Local APIC, PIT) and the TSC drift against the HPET.";
+  commandList[10].handlerFuncPtr = &clocksHandler;
+
+  commandList[11].name = "date";
+  commandList[11].help = "Display the current date and time (UTC).";
+  commandList[11].handlerFuncPtr = &dateHandler;
+
+  commandList[12].name = "latbench";
+  commandList[12].help = "Measure timer wakeup latency (min/avg/max and histogram).\n"
+                         "latbench [sleep] [load] [interval_us] [loops]";
+  commandList[12].handlerFuncPtr = &latbenchHandler;
+
+  commandList[13].name = "irqstat";
+  commandList[13].help = "Display per-vector interrupt counts, rates per second, handler cycles (avg/max) and CPU share.";
+  commandList[13].handlerFuncPtr = &irqstatHandler;
+
+  commandList[14].name = "irqbench";
+  commandList[14].help = "Compare the cycles of the full and the fast interrupt entry path.\n"
+                         "irqbench [loops]";
+  commandList[14].handlerFuncPtr = &irqbenchHandler;
+
+  commandList[15].name = "irqsoff";
+  commandList[15].help = "Show the longest interrupts-disabled sections and where they started and ended.\n"
+                         "irqsoff [start|stop|reset]";
+  commandList[15].handlerFuncPtr = &irqsoffHandler;
+
+  commandList[16].name = "cpuinfo";
+  commandList[16].help = "Display the CPU vendor, model, feature flags, cache hierarchy and the memcpy/memset/... variants selected for it.";
+  commandList[16].handlerFuncPtr = &cpuinfoHandler;
+
+  commandList[17].name = "ps";
+  commandList[17].help = "List kernel threads with their state, CPU time, CPU share, switches and preemptions.";
+  commandList[17].handlerFuncPtr = &psHandler;
+
+  commandList[18].name = "jobs";
+  commandList[18].help = "List background jobs. Append & to a command to run it in the background.";
+  commandList[18].handlerFuncPtr = &jobsHandler;
+
+  commandList[19].name = "fg";
+  commandList[19].help = "Wait for a background job and show its output.\n"
+                         "Usage: fg [job], default is the latest job.";
+  commandList[19].handlerFuncPtr = &fgHandler;
+
+  commandList[20].name = "kill";
+  commandList[20].help = "Ask a background job to stop.\n"
+                         "Usage: kill [job], default is the latest job.";
+  commandList[20].handlerFuncPtr = &killHandler;
+
+  commandList[21].name = "smp";
+  commandList[21].help = "List the CPUs with their APIC ID, bring-up state, boot time and the work they ran.";
+  commandList[21].handlerFuncPtr = &smpHandler;
+
+  commandList[22].name = "parbench";
+  commandList[22].help = "Time fill, checksum and render on one CPU and on all CPUs through the task pool.";
+  commandList[22].handlerFuncPtr = &parbenchHandler;
+
+  commandList[23].name = "lockstat";
+  commandList[23].help = "Show acquisitions, contention and spin time per lock.\n"
+                         "Usage: lockstat [on|off|reset]";
+  commandList[23].handlerFuncPtr = &lockstatHandler;
+
+  commandList[24].name = "sysbench";
+  commandList[24].help = "Time system calls from ring 3 through int 0x80 and sysenter and check that\n"
+                         "programs are isolated. Usage: sysbench [round trips], default 100000.";
+  commandList[24].handlerFuncPtr = &sysbenchHandler;
+
+  commandList[25].name = "exec";
+  commandList[25].help = "List the boot modules or run an ELF module as a user program.\n"
+                         "Usage: exec [module [numbers...]], the numbers are passed on its stack.";
+  commandList[25].handlerFuncPtr = &execHandler;
+
+  commandList[26].name = "forkbench";
+  commandList[26].help = "Time forks of processes with 16 pages up to [max pages] of heap, copy-on-write\n"
+                         "against copying, and the writes after them. Usage: forkbench [max pages], default 4096.";
+  commandList[26].handlerFuncPtr = &forkbenchHandler;
+
+  commandList[27].name = "ipcbench";
+  commandList[27].help = "Time IPC ping-pong between two processes, register messages synchronous and\n"
+                         "asynchronous and messages moving 1 to 1024 pages. Usage: ipcbench [round trips], default 10000.";
+  commandList[27].handlerFuncPtr = &ipcbenchHandler;
+
+  commandList[28].name = NULL;
+  commandList[28].handlerFuncPtr = NULL;
 }
 
 // docs see header file
 void commandHandler(char splitCommandBuffer[NUM_SUBSTRINGS][LEN_SUBSTRINGS],
                     size_t numSubstrings) {
-  (void)numSubstrings; // Suppress unused parameter warning
+  // a trailing & (alone or attached to the last word) runs the command as a
+  // background job
+  bool background = false;
+  if (numSubstrings > 0 && numSubstrings <= NUM_SUBSTRINGS) {
+    char *last = splitCommandBuffer[numSubstrings - 1];
+    size_t length = strlenOS(last);
+    if (length > 0 && last[length - 1] == '&') {
+      last[length - 1] = '\0';
+      background = true;
+    }
+  }
 
   for (int i = 0; i < COMMAND_LIST_LENGTH; i++) {
     if (commandList[i].name == NULL) {
@@ -376,7 +885,20 @@ void commandHandler(char splitCommandBuffer[NUM_SUBSTRINGS][LEN_SUBSTRINGS],
         continue;
       }
       terminalStartCommand();
-      commandList[i].handlerFuncPtr(splitCommandBuffer, buffer);
+      if (background) {
+        uint32_t id = jobs_start(commandList[i].handlerFuncPtr, splitCommandBuffer);
+        char line[64] = "";
+        if (id == 0) {
+          appendString(line, "Too many jobs");
+        } else {
+          appendString(line, "[");
+          appendDecimal(line, id, 0);
+          appendString(line, "] started");
+        }
+        terminalWriteLine(line);
+      } else {
+        commandList[i].handlerFuncPtr(splitCommandBuffer, buffer);
+      }
       terminalEndCommand();
       return;
     }
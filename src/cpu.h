@@ -0,0 +1,285 @@
+#ifndef CPU_H
+#define CPU_H
+
+/**
+ * @file cpu.h
+ * @brief Thin wrappers around privileged x86 instructions.
+ *
+ * These helpers are static inline so that hot paths (timestamps, MSR writes
+ * when re-arming timers) compile down to the bare instruction.
+ */
+
+#include "irqsoff.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Model specific registers used by the kernel
+#define MSR_IA32_APIC_BASE 0x1B
+#define MSR_IA32_TSC_DEADLINE 0x6E0
+#define MSR_IA32_SYSENTER_CS 0x174
+#define MSR_IA32_SYSENTER_ESP 0x175
+#define MSR_IA32_SYSENTER_EIP 0x176
+
+/**
+ * @brief Executes CPUID for the given leaf and subleaf.
+ *
+ * @param leaf The value loaded into EAX.
+ * @param subleaf The value loaded into ECX.
+ * @param eax Receives EAX.
+ * @param ebx Receives EBX.
+ * @param ecx Receives ECX.
+ * @param edx Receives EDX.
+ */
+static inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *eax,
+                         uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+  __asm__ volatile("cpuid"
+                   : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                   : "a"(leaf), "c"(subleaf));
+}
+
+/**
+ * @brief Reads a model specific register.
+ *
+ * @param msr The MSR index.
+ * @return uint64_t The 64-bit MSR value.
+ */
+static inline uint64_t rdmsr(uint32_t msr) {
+  uint32_t low, high;
+  __asm__ volatile("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+  return ((uint64_t)high << 32) | low;
+}
+
+/**
+ * @brief Writes a model specific register.
+ *
+ * @param msr The MSR index.
+ * @param value The 64-bit value to write.
+ */
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+  __asm__ volatile("wrmsr"
+                   :
+                   : "c"(msr), "a"((uint32_t)value),
+                     "d"((uint32_t)(value >> 32))
+                   : "memory");
+}
+
+/**
+ * @brief Reads the time stamp counter.
+ *
+ * @return uint64_t The current TSC value.
+ */
+static inline uint64_t rdtsc(void) {
+  uint32_t low, high;
+  __asm__ volatile("rdtsc" : "=a"(low), "=d"(high));
+  return ((uint64_t)high << 32) | low;
+}
+
+// Control register bits
+#define CR0_MP (1u << 1)  // monitor coprocessor: wait/fwait honours TS
+#define CR0_EM (1u << 2)  // emulate FPU: every FPU instruction faults
+#define CR0_TS (1u << 3)  // task switched: next FPU/SSE use raises #NM
+#define CR0_NE (1u << 5)  // native x87 error reporting
+#define CR0_WP (1u << 16) // write protect: read-only pages bind ring 0 too
+#define CR0_PG (1u << 31) // paging
+#define CR4_PSE (1u << 4) // 4 MiB pages
+#define CR4_PGE (1u << 7) // global pages survive CR3 writes
+#define CR4_OSFXSR (1u << 9)
+#define CR4_OSXMMEXCPT (1u << 10)
+#define CR4_OSXSAVE (1u << 18)
+
+/**
+ * @brief Reads CR0.
+ *
+ * @return uint32_t The value of CR0.
+ */
+static inline uint32_t read_cr0(void) {
+  uint32_t value;
+  __asm__ volatile("mov %%cr0, %0" : "=r"(value));
+  return value;
+}
+
+/**
+ * @brief Writes CR0.
+ *
+ * @param value The new value of CR0.
+ */
+static inline void write_cr0(uint32_t value) {
+  __asm__ volatile("mov %0, %%cr0" : : "r"(value) : "memory");
+}
+
+/**
+ * @brief Reads CR4.
+ *
+ * @return uint32_t The value of CR4.
+ */
+static inline uint32_t read_cr4(void) {
+  uint32_t value;
+  __asm__ volatile("mov %%cr4, %0" : "=r"(value));
+  return value;
+}
+
+/**
+ * @brief Writes CR4.
+ *
+ * @param value The new value of CR4.
+ */
+static inline void write_cr4(uint32_t value) {
+  __asm__ volatile("mov %0, %%cr4" : : "r"(value) : "memory");
+}
+
+/**
+ * @brief Reads CR2, the address of the last page fault.
+ *
+ * @return uint32_t The faulting linear address.
+ */
+static inline uint32_t read_cr2(void) {
+  uint32_t value;
+  __asm__ volatile("mov %%cr2, %0" : "=r"(value));
+  return value;
+}
+
+/**
+ * @brief Reads CR3.
+ *
+ * @return uint32_t The physical address of the page directory.
+ */
+static inline uint32_t read_cr3(void) {
+  uint32_t value;
+  __asm__ volatile("mov %%cr3, %0" : "=r"(value));
+  return value;
+}
+
+/**
+ * @brief Writes CR3, flushing all non-global TLB entries.
+ *
+ * @param value The physical address of the new page directory.
+ */
+static inline void write_cr3(uint32_t value) {
+  __asm__ volatile("mov %0, %%cr3" : : "r"(value) : "memory");
+}
+
+/**
+ * @brief Drops the TLB entry of one page.
+ *
+ * @param address Any address inside the page.
+ */
+static inline void invlpg(uint32_t address) {
+  __asm__ volatile("invlpg (%0)" : : "r"(address) : "memory");
+}
+
+/**
+ * @brief Writes an extended control register (XCR).
+ *
+ * @param xcr The XCR index, 0 for XCR0.
+ * @param value The 64-bit value to write.
+ */
+static inline void xsetbv(uint32_t xcr, uint64_t value) {
+  __asm__ volatile("xsetbv"
+                   :
+                   : "c"(xcr), "a"((uint32_t)value),
+                     "d"((uint32_t)(value >> 32))
+                   : "memory");
+}
+
+/** @brief The interrupt flag in EFLAGS. */
+#define EFLAGS_IF (1u << 9)
+
+// The interrupt flag helpers below report every transition to the irqsoff
+// tracer together with the calling function and line. They are macros so the
+// call site is the caller, not this header.
+
+/**
+ * @brief Disables interrupts and returns the previous EFLAGS.
+ *
+ * @return uint32_t The EFLAGS value to pass to irq_restore().
+ */
+#define irq_save() irq_save_at(__func__, __LINE__)
+
+/**
+ * @brief Restores the interrupt flag saved by irq_save().
+ *
+ * @param flags The EFLAGS value returned by irq_save().
+ */
+#define irq_restore(flags) irq_restore_at((flags), __func__, __LINE__)
+
+/**
+ * @brief Disables interrupts (cli).
+ */
+#define irq_disable() irq_disable_at(__func__, __LINE__)
+
+/**
+ * @brief Enables interrupts (sti).
+ */
+#define irq_enable() irq_enable_at(__func__, __LINE__)
+
+/**
+ * @brief Enables interrupts and halts until the next one (sti; hlt).
+ *
+ * @details sti takes effect after the following instruction, so an interrupt
+ * that is already pending wakes the hlt instead of being missed.
+ */
+#define irq_enable_and_halt() irq_enable_and_halt_at(__func__, __LINE__)
+
+static inline uint32_t irq_save_at(const char *func, uint32_t line) {
+  uint32_t flags;
+  __asm__ volatile("pushf\n\tpop %0\n\tcli" : "=r"(flags) : : "memory");
+  if (irqsoffTracing && (flags & EFLAGS_IF)) {
+    irqsoff_disabled(func, line);
+  }
+  return flags;
+}
+
+static inline void irq_restore_at(uint32_t flags, const char *func,
+                                  uint32_t line) {
+  if (irqsoffTracing && (flags & EFLAGS_IF)) {
+    irqsoff_enabled(func, line);
+  }
+  __asm__ volatile("push %0\n\tpopf" : : "r"(flags) : "memory", "cc");
+}
+
+static inline void irq_disable_at(const char *func, uint32_t line) {
+  __asm__ volatile("cli" ::: "memory");
+  if (irqsoffTracing) {
+    irqsoff_disabled(func, line);
+  }
+}
+
+static inline void irq_enable_at(const char *func, uint32_t line) {
+  if (irqsoffTracing) {
+    irqsoff_enabled(func, line);
+  }
+  __asm__ volatile("sti" ::: "memory");
+}
+
+static inline void irq_enable_and_halt_at(const char *func, uint32_t line) {
+  if (irqsoffTracing) {
+    irqsoff_enabled(func, line);
+  }
+  __asm__ volatile("sti\n\thlt" ::: "memory");
+}
+
+/**
+ * @brief Hints the CPU that it is in a spin-wait loop.
+ */
+static inline void cpu_relax(void) { __asm__ volatile("pause" ::: "memory"); }
+
+/**
+ * @brief Arms address monitoring for cpu_mwait() (MONITOR).
+ *
+ * @param addr Any address in the cache line to watch.
+ */
+static inline void cpu_monitor(const volatile void *addr) {
+  __asm__ volatile("monitor" : : "a"(addr), "c"(0), "d"(0) : "memory");
+}
+
+/**
+ * @brief Waits until the monitored line is written or an event arrives (MWAIT).
+ *
+ * @details May return early (interrupts, other events), callers always
+ * re-check their condition.
+ */
+static inline void cpu_mwait(void) {
+  __asm__ volatile("mwait" : : "a"(0), "c"(0) : "memory");
+}
+
+#endif
@@ -0,0 +1,306 @@
+#include "cpufeatures.h"
+#include "cpu.h"
+#include "kmem.h"
+#include "str.h"
+#include "terminal.h"
+
+// leaf 1 EDX
+#define CPUID1_EDX_FPU (1u << 0)
+#define CPUID1_EDX_PSE (1u << 3)
+#define CPUID1_EDX_TSC (1u << 4)
+#define CPUID1_EDX_APIC (1u << 9)
+#define CPUID1_EDX_SEP (1u << 11)
+#define CPUID1_EDX_PGE (1u << 13)
+#define CPUID1_EDX_SSE (1u << 25)
+#define CPUID1_EDX_SSE2 (1u << 26)
+// leaf 1 ECX
+#define CPUID1_ECX_SSE3 (1u << 0)
+#define CPUID1_ECX_MONITOR (1u << 3)
+#define CPUID1_ECX_SSSE3 (1u << 9)
+#define CPUID1_ECX_SSE41 (1u << 19)
+#define CPUID1_ECX_SSE42 (1u << 20)
+#define CPUID1_ECX_POPCNT (1u << 23)
+#define CPUID1_ECX_TSC_DEADLINE (1u << 24)
+#define CPUID1_ECX_XSAVE (1u << 26)
+#define CPUID1_ECX_AVX (1u << 28)
+#define CPUID1_ECX_RDRAND (1u << 30)
+#define CPUID1_ECX_HYPERVISOR (1u << 31)
+// leaf 7 subleaf 0 EBX
+#define CPUID7_EBX_AVX2 (1u << 5)
+#define CPUID7_EBX_ERMS (1u << 9)
+// leaf 0x80000001 ECX
+#define CPUIDX1_ECX_TOPOEXT (1u << 22)
+// leaf 0x80000007 EDX
+#define CPUIDX7_EDX_INVARIANT_TSC (1u << 8)
+
+static CpuFeatures features;
+
+static void copy_register(char *dest, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    dest[i] = (char)(value >> (i * 8));
+  }
+}
+
+static void add_cache(uint32_t level, CpuCacheType type, uint32_t sizeKb,
+                      uint32_t ways, uint32_t lineSize) {
+  if (features.cacheCount >= CPU_MAX_CACHES || sizeKb == 0) {
+    return;
+  }
+  CpuCache *cache = &features.caches[features.cacheCount++];
+  cache->level = (uint8_t)level;
+  cache->type = type;
+  cache->sizeKb = sizeKb;
+  cache->ways = ways;
+  cache->lineSize = lineSize;
+}
+
+// leaf 4 (Intel) and 0x8000001D (AMD) share one layout, one subleaf per cache
+static bool read_deterministic_caches(uint32_t leaf) {
+  for (uint32_t sub = 0; sub < CPU_MAX_CACHES; sub++) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(leaf, sub, &eax, &ebx, &ecx, &edx);
+    uint32_t type = eax & 0x1F;
+    if (type == 0) {
+      break;
+    }
+    uint32_t ways = ((ebx >> 22) & 0x3FF) + 1;
+    uint32_t partitions = ((ebx >> 12) & 0x3FF) + 1;
+    uint32_t lineSize = (ebx & 0xFFF) + 1;
+    uint32_t sets = ecx + 1;
+    bool fully = (eax & (1u << 9)) != 0;
+    CpuCacheType kind = type == 1   ? CPU_CACHE_DATA
+                        : type == 2 ? CPU_CACHE_INSTRUCTION
+                                    : CPU_CACHE_UNIFIED;
+    add_cache((eax >> 5) & 0x7, kind,
+              ways * partitions * lineSize * sets / 1024, fully ? 0 : ways,
+              lineSize);
+  }
+  return features.cacheCount > 0;
+}
+
+// associativity encoding of the legacy AMD L2/L3 descriptors
+static uint32_t amd_ways(uint32_t code) {
+  static const uint32_t ways[16] = {0, 1, 2, 3, 4, 6, 8, 0,
+                                    16, 0, 32, 48, 64, 96, 128, 0};
+  return ways[code & 0xF];
+}
+
+static void read_legacy_amd_caches(void) {
+  uint32_t eax, ebx, ecx, edx;
+  if (features.maxExtendedLeaf >= 0x80000005) {
+    cpuid(0x80000005, 0, &eax, &ebx, &ecx, &edx);
+    // L1 descriptors: size KiB [31:24], ways [23:16] (0xFF = fully), line [7:0]
+    uint32_t dWays = (ecx >> 16) & 0xFF;
+    uint32_t iWays = (edx >> 16) & 0xFF;
+    add_cache(1, CPU_CACHE_DATA, ecx >> 24, dWays == 0xFF ? 0 : dWays,
+              ecx & 0xFF);
+    add_cache(1, CPU_CACHE_INSTRUCTION, edx >> 24, iWays == 0xFF ? 0 : iWays,
+              edx & 0xFF);
+  }
+  if (features.maxExtendedLeaf >= 0x80000006) {
+    cpuid(0x80000006, 0, &eax, &ebx, &ecx, &edx);
+    // L2 size in KiB [31:16], L3 size in 512 KiB units [31:18]
+    add_cache(2, CPU_CACHE_UNIFIED, ecx >> 16, amd_ways(ecx >> 12),
+              ecx & 0xFF);
+    add_cache(3, CPU_CACHE_UNIFIED, (edx >> 18) * 512, amd_ways(edx >> 12),
+              edx & 0xFF);
+  }
+}
+
+void cpu_features_init(void) {
+  uint32_t eax, ebx, ecx, edx;
+
+  cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+  features.maxLeaf = eax;
+  copy_register(features.vendor, ebx);
+  copy_register(features.vendor + 4, edx);
+  copy_register(features.vendor + 8, ecx);
+  features.vendor[12] = '\0';
+
+  if (features.maxLeaf >= 1) {
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    uint32_t family = (eax >> 8) & 0xF;
+    uint32_t model = (eax >> 4) & 0xF;
+    if (family == 0xF) {
+      family += (eax >> 20) & 0xFF;
+    }
+    if (family == 0x6 || family >= 0xF) {
+      model |= ((eax >> 16) & 0xF) << 4;
+    }
+    features.family = family;
+    features.model = model;
+    features.stepping = eax & 0xF;
+
+    features.fpu = (edx & CPUID1_EDX_FPU) != 0;
+    features.tsc = (edx & CPUID1_EDX_TSC) != 0;
+    features.pse = (edx & CPUID1_EDX_PSE) != 0;
+    features.pge = (edx & CPUID1_EDX_PGE) != 0;
+    features.apic = (edx & CPUID1_EDX_APIC) != 0;
+    // the Pentium Pro reports SEP without implementing it
+    features.sep = (edx & CPUID1_EDX_SEP) != 0 &&
+                   !(family == 6 && model < 3 && features.stepping < 3);
+    features.sse = (edx & CPUID1_EDX_SSE) != 0;
+    features.sse2 = (edx & CPUID1_EDX_SSE2) != 0;
+    features.sse3 = (ecx & CPUID1_ECX_SSE3) != 0;
+    features.monitor = (ecx & CPUID1_ECX_MONITOR) != 0;
+    features.ssse3 = (ecx & CPUID1_ECX_SSSE3) != 0;
+    features.sse41 = (ecx & CPUID1_ECX_SSE41) != 0;
+    features.sse42 = (ecx & CPUID1_ECX_SSE42) != 0;
+    features.popcnt = (ecx & CPUID1_ECX_POPCNT) != 0;
+    features.tscDeadline = (ecx & CPUID1_ECX_TSC_DEADLINE) != 0;
+    features.xsave = (ecx & CPUID1_ECX_XSAVE) != 0;
+    features.avx = (ecx & CPUID1_ECX_AVX) != 0;
+    features.rdrand = (ecx & CPUID1_ECX_RDRAND) != 0;
+    features.hypervisor = (ecx & CPUID1_ECX_HYPERVISOR) != 0;
+  }
+
+  if (features.maxLeaf >= 7) {
+    cpuid(7, 0, &eax, &ebx, &ecx, &edx);
+    features.avx2 = (ebx & CPUID7_EBX_AVX2) != 0;
+    features.erms = (ebx & CPUID7_EBX_ERMS) != 0;
+  }
+
+  cpuid(0x80000000, 0, &eax, &ebx, &ecx, &edx);
+  features.maxExtendedLeaf = eax >= 0x80000000 ? eax : 0;
+
+  bool topoext = false;
+  if (features.maxExtendedLeaf >= 0x80000001) {
+    cpuid(0x80000001, 0, &eax, &ebx, &ecx, &edx);
+    topoext = (ecx & CPUIDX1_ECX_TOPOEXT) != 0;
+  }
+  if (features.maxExtendedLeaf >= 0x80000004) {
+    // three leaves of 16 characters each, in EAX, EBX, ECX, EDX order
+    for (uint32_t i = 0; i < 3; i++) {
+      char *part = features.brand + i * 16;
+      cpuid(0x80000002 + i, 0, &eax, &ebx, &ecx, &edx);
+      copy_register(part, eax);
+      copy_register(part + 4, ebx);
+      copy_register(part + 8, ecx);
+      copy_register(part + 12, edx);
+    }
+    features.brand[48] = '\0';
+  }
+  if (features.maxExtendedLeaf >= 0x80000007) {
+    cpuid(0x80000007, 0, &eax, &ebx, &ecx, &edx);
+    features.invariantTsc = (edx & CPUIDX7_EDX_INVARIANT_TSC) != 0;
+  }
+
+  features.cacheCount = 0;
+  bool found = false;
+  if (features.maxLeaf >= 4) {
+    found = read_deterministic_caches(4);
+  }
+  if (!found && topoext && features.maxExtendedLeaf >= 0x8000001D) {
+    found = read_deterministic_caches(0x8000001D);
+  }
+  if (!found) {
+    read_legacy_amd_caches();
+  }
+}
+
+const CpuFeatures *cpu_features(void) { return &features; }
+
+// appends " name" if the feature is present
+static void append_flag(char *line, bool present, const char *name) {
+  if (present) {
+    appendString(line, " ");
+    appendString(line, name);
+  }
+}
+
+// the brand string is often padded with leading spaces
+static const char *skip_spaces(const char *str) {
+  while (*str == ' ') {
+    str++;
+  }
+  return str;
+}
+
+void printCpuInfoToTerminal(void) {
+  char line[160] = "Vendor:   ";
+  appendString(line, features.vendor);
+  if (features.hypervisor) {
+    appendString(line, " (hypervisor)");
+  }
+  terminalWriteLine(line);
+
+  if (features.brand[0] != '\0') {
+    line[0] = '\0';
+    appendString(line, "Model:    ");
+    appendString(line, skip_spaces(features.brand));
+    terminalWriteLine(line);
+  }
+
+  line[0] = '\0';
+  appendString(line, "Family:   ");
+  appendDecimal(line, features.family, 0);
+  appendString(line, ", model ");
+  appendDecimal(line, features.model, 0);
+  appendString(line, ", stepping ");
+  appendDecimal(line, features.stepping, 0);
+  terminalWriteLine(line);
+
+  line[0] = '\0';
+  appendString(line, "Features:");
+  append_flag(line, features.fpu, "fpu");
+  append_flag(line, features.tsc, "tsc");
+  append_flag(line, features.invariantTsc, "invariant-tsc");
+  append_flag(line, features.apic, "apic");
+  append_flag(line, features.tscDeadline, "tsc-deadline");
+  append_flag(line, features.monitor, "monitor");
+  append_flag(line, features.sse, "sse");
+  append_flag(line, features.sse2, "sse2");
+  append_flag(line, features.sse3, "sse3");
+  append_flag(line, features.ssse3, "ssse3");
+  append_flag(line, features.sse41, "sse4.1");
+  append_flag(line, features.sse42, "sse4.2");
+  terminalWriteLine(line);
+  line[0] = '\0';
+  appendString(line, "         ");
+  append_flag(line, features.pse, "pse");
+  append_flag(line, features.pge, "pge");
+  append_flag(line, features.sep, "sep");
+  append_flag(line, features.popcnt, "popcnt");
+  append_flag(line, features.xsave, "xsave");
+  append_flag(line, features.avx, "avx");
+  append_flag(line, features.avx2, "avx2");
+  append_flag(line, features.erms, "erms");
+  append_flag(line, features.rdrand, "rdrand");
+  terminalWriteLine(line);
+
+  static const char *cacheTypes[] = {"d", "i", ""};
+  for (uint32_t i = 0; i < features.cacheCount; i++) {
+    const CpuCache *cache = &features.caches[i];
+    line[0] = '\0';
+    appendString(line, "Cache:    L");
+    appendDecimal(line, cache->level, 0);
+    appendString(line, cacheTypes[cache->type]);
+    appendDecimal(line, cache->sizeKb, 7);
+    appendString(line, " KiB, ");
+    if (cache->ways == 0) {
+      appendString(line, "fully associative");
+    } else {
+      appendDecimal(line, cache->ways, 0);
+      appendString(line, "-way");
+    }
+    appendString(line, ", ");
+    appendDecimal(line, cache->lineSize, 0);
+    appendString(line, " byte lines");
+    terminalWriteLine(line);
+  }
+
+  line[0] = '\0';
+  appendString(line, "Kernels:  memcpy ");
+  appendString(line, kmem_impl_name(KMEM_MEMCPY));
+  appendString(line, ", memset ");
+  appendString(line, kmem_impl_name(KMEM_MEMSET));
+  appendString(line, ", fill16 ");
+  appendString(line, kmem_impl_name(KMEM_FILL16));
+  terminalWriteLine(line);
+  line[0] = '\0';
+  appendString(line, "          strlen ");
+  appendString(line, kmem_impl_name(KMEM_STRLEN));
+  appendString(line, ", checksum8 ");
+  appendString(line, kmem_impl_name(KMEM_CHECKSUM8));
+  terminalWriteLine(line);
+}
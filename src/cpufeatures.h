@@ -0,0 +1,102 @@
+#ifndef CPUFEATURES_H
+#define CPUFEATURES_H
+
+/**
+ * @file cpufeatures.h
+ * @brief CPUID decoding: vendor, model, feature flags and caches.
+ *
+ * CPUID is executed once at boot and the result is kept in a ::CpuFeatures
+ * structure. Code that picks an implementation depending on the CPU (see
+ * kmem.h) reads the flags from there instead of issuing CPUID itself.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @brief Most cache levels/types kept in ::CpuFeatures. */
+#define CPU_MAX_CACHES 8
+
+/**
+ * @brief Kind of a cache.
+ */
+typedef enum {
+  CPU_CACHE_DATA,        /**< Data cache. */
+  CPU_CACHE_INSTRUCTION, /**< Instruction cache. */
+  CPU_CACHE_UNIFIED,     /**< Unified cache. */
+} CpuCacheType;
+
+/**
+ * @brief One level of the cache hierarchy.
+ */
+typedef struct {
+  uint8_t level;     /**< Cache level, 1 = L1. */
+  CpuCacheType type; /**< Data, instruction or unified. */
+  uint32_t sizeKb;   /**< Total size in KiB. */
+  uint32_t ways;     /**< Associativity, 0 = fully associative. */
+  uint32_t lineSize; /**< Line size in bytes. */
+} CpuCache;
+
+/**
+ * @brief Everything the kernel knows about the CPU it runs on.
+ */
+typedef struct {
+  char vendor[13];  /**< e.g. "GenuineIntel", "AuthenticAMD". */
+  char brand[49];   /**< Brand string, empty if not reported. */
+  uint32_t maxLeaf; /**< Highest standard CPUID leaf. */
+  uint32_t maxExtendedLeaf; /**< Highest 0x8000xxxx leaf. */
+  uint32_t family;   /**< Display family (base + extended). */
+  uint32_t model;    /**< Display model (base + extended). */
+  uint32_t stepping; /**< Stepping. */
+
+  bool fpu;          /**< x87 FPU. */
+  bool tsc;          /**< Time stamp counter. */
+  bool pse;          /**< 4 MiB pages. */
+  bool pge;          /**< Global pages. */
+  bool apic;         /**< On-chip Local APIC. */
+  bool sep;          /**< SYSENTER/SYSEXIT instructions. */
+  bool sse;          /**< SSE. */
+  bool sse2;         /**< SSE2. */
+  bool sse3;         /**< SSE3. */
+  bool ssse3;        /**< Supplemental SSE3. */
+  bool sse41;        /**< SSE4.1. */
+  bool sse42;        /**< SSE4.2. */
+  bool popcnt;       /**< POPCNT instruction. */
+  bool avx;          /**< AVX (CPU support, see fpu.h for OS support). */
+  bool avx2;         /**< AVX2. */
+  bool erms;         /**< Enhanced rep movsb/stosb. */
+  bool rdrand;       /**< RDRAND instruction. */
+  bool xsave;        /**< XSAVE family. */
+  bool tscDeadline;  /**< Local APIC TSC-deadline mode. */
+  bool monitor;      /**< MONITOR/MWAIT instructions. */
+  bool invariantTsc; /**< TSC runs at a constant rate in all states. */
+  bool hypervisor;   /**< Running under a hypervisor. */
+
+  uint32_t cacheCount;              /**< Valid entries in caches. */
+  CpuCache caches[CPU_MAX_CACHES];  /**< Sorted by level as reported. */
+} CpuFeatures;
+
+/**
+ * @brief Executes CPUID and fills the feature structure.
+ *
+ * @details Should run before anything that asks for features, it is cheap
+ * and idempotent. The cache hierarchy comes from leaf 4 (Intel), leaf
+ * 0x8000001D (AMD with topology extensions) or the legacy AMD leaves
+ * 0x80000005/6.
+ */
+void cpu_features_init(void);
+
+/**
+ * @brief Returns the detected CPU features.
+ *
+ * @return const CpuFeatures* The features, all zero before
+ * cpu_features_init().
+ */
+const CpuFeatures *cpu_features(void);
+
+/**
+ * @brief Prints vendor, model, features, caches and the selected kernel
+ * routines to the terminal.
+ */
+void printCpuInfoToTerminal(void);
+
+#endif
@@ -0,0 +1,192 @@
+#include "elf.h"
+#include "kmem.h"
+#include <stddef.h>
+
+#define PAGE_MASK (PAGE_SIZE - 1)
+
+// segments end where the stack of the process starts
+#define ELF_USER_LIMIT (USER_STACK_TOP - USER_STACK_PAGES * PAGE_SIZE)
+
+static const uint8_t elfMagic[4] = {0x7F, 'E', 'L', 'F'};
+
+static const char *const statusNames[] = {
+    "loaded",
+    "truncated",
+    "not an ELF file",
+    "not a 32-bit i386 file",
+    "not an executable with loadable segments",
+    "segment or entry outside the user range",
+    "out of memory"};
+
+static uint32_t min_address(uint32_t a, uint32_t b) { return a < b ? a : b; }
+static uint32_t max_address(uint32_t a, uint32_t b) { return a > b ? a : b; }
+
+// the page at virt backed by a frame of the process' own, what an earlier
+// segment put there is kept, NULL without memory
+static uint8_t *private_page(AddressSpace *space, uint32_t virt, bool writable,
+                             bool withData, ElfImage *loaded) {
+  uint32_t entry = as_lookup(space, virt);
+  uint32_t flags = writable ? PTE_WRITABLE : 0;
+  if ((entry & PTE_PRESENT) != 0 && (entry & PTE_BORROWED) == 0) {
+    uint32_t frame = entry & ~PAGE_MASK;
+    if (writable && (entry & PTE_WRITABLE) == 0 &&
+        !as_map(space, virt, frame, flags)) {
+      return NULL;
+    }
+    return (uint8_t *)frame;
+  }
+
+  uint32_t frame = frame_alloc();
+  if (frame == 0) {
+    return NULL;
+  }
+  if ((entry & PTE_PRESENT) != 0) {
+    // a page of the image shared by an earlier segment, this one needs
+    // another view of it
+    memcpyOS((void *)frame, (const void *)(entry & ~PAGE_MASK), PAGE_SIZE);
+    loaded->sharedPages--;
+    loaded->copiedPages++;
+  } else {
+    memsetOS((void *)frame, 0, PAGE_SIZE);
+    if (withData) {
+      loaded->copiedPages++;
+    } else {
+      loaded->zeroedPages++;
+    }
+  }
+  if (!as_map(space, virt, frame, flags)) {
+    frame_free(frame);
+    return NULL;
+  }
+  return (uint8_t *)frame;
+}
+
+static ElfStatus load_segment(AddressSpace *space, const uint8_t *image,
+                              uint32_t size, const ElfProgramHeader *segment,
+                              ElfImage *loaded) {
+  bool writable = (segment->flags & ELF_PF_W) != 0;
+  uint32_t start = segment->vaddr;
+  uint32_t fileEnd = start + segment->filesz;
+  uint32_t memEnd = start + segment->memsz;
+  // file pages line up with the virtual pages, the frames of the image can
+  // be mapped as they are
+  bool shareable = !writable && ((uint32_t)image & PAGE_MASK) == 0 &&
+                   (segment->offset & PAGE_MASK) == (start & PAGE_MASK);
+
+  for (uint32_t page = start & ~PAGE_MASK; page < memEnd; page += PAGE_SIZE) {
+    uint32_t pageEnd = page + PAGE_SIZE;
+    // offset of the page in the file, only meaningful when shareable
+    uint32_t pageOffset = segment->offset - (start - page);
+    // past fileEnd the page must show zeroes, not what follows in the file.
+    // The frames behind the end of a boot module are never handed out
+    // (paging.c), so the last one may be shared as well
+    if (shareable && page < fileEnd &&
+        (pageEnd <= fileEnd || memEnd == fileEnd) && pageOffset < size &&
+        (as_lookup(space, page) & PTE_PRESENT) == 0) {
+      if (!as_map(space, page, (uint32_t)image + pageOffset, PTE_BORROWED)) {
+        return ELF_NO_MEMORY;
+      }
+      loaded->sharedPages++;
+      continue;
+    }
+
+    bool withData = page < fileEnd && pageEnd > start;
+    uint8_t *frame = private_page(space, page, writable, withData, loaded);
+    if (frame == NULL) {
+      return ELF_NO_MEMORY;
+    }
+    if (withData) {
+      uint32_t from = max_address(page, start);
+      memcpyOS(frame + (from - page), image + segment->offset + (from - start),
+               min_address(pageEnd, fileEnd) - from);
+    }
+    // zero fill, the frame may hold a copy of a shared page past fileEnd
+    uint32_t zeroFrom = max_address(page, fileEnd);
+    uint32_t zeroTo = min_address(pageEnd, memEnd);
+    if (zeroFrom < zeroTo) {
+      memsetOS(frame + (zeroFrom - page), 0, zeroTo - zeroFrom);
+    }
+  }
+  return ELF_OK;
+}
+
+// headers, bounds and addresses of all segments, before anything is mapped
+static ElfStatus check_image(const uint8_t *image, uint32_t size,
+                             const ElfHeader *header) {
+  if (size < sizeof(ElfHeader)) {
+    return ELF_TRUNCATED;
+  }
+  for (uint32_t i = 0; i < sizeof(elfMagic); i++) {
+    if (header->ident[i] != elfMagic[i]) {
+      return ELF_BAD_MAGIC;
+    }
+  }
+  if (header->ident[4] != ELF_CLASS_32 || header->ident[5] != ELF_DATA_LSB ||
+      header->machine != ELF_MACHINE_386) {
+    return ELF_NOT_I386;
+  }
+  if (header->type != ELF_TYPE_EXEC) {
+    return ELF_NOT_EXECUTABLE;
+  }
+  if (header->phentsize < sizeof(ElfProgramHeader) ||
+      (uint64_t)header->phoff + (uint64_t)header->phnum * header->phentsize >
+          size) {
+    return ELF_TRUNCATED;
+  }
+
+  uint32_t loadCount = 0;
+  for (uint32_t i = 0; i < header->phnum; i++) {
+    const ElfProgramHeader *segment =
+        (const ElfProgramHeader *)(image + header->phoff +
+                                   i * header->phentsize);
+    if (segment->type != ELF_PT_LOAD || segment->memsz == 0) {
+      continue;
+    }
+    if (segment->filesz > segment->memsz ||
+        (uint64_t)segment->offset + segment->filesz > size) {
+      return ELF_TRUNCATED;
+    }
+    if (segment->vaddr < USER_BASE ||
+        (uint64_t)segment->vaddr + segment->memsz > ELF_USER_LIMIT) {
+      return ELF_BAD_ADDRESS;
+    }
+    loadCount++;
+  }
+  if (loadCount == 0) {
+    return ELF_NOT_EXECUTABLE;
+  }
+  if (header->entry < USER_BASE || header->entry >= ELF_USER_LIMIT) {
+    return ELF_BAD_ADDRESS;
+  }
+  return ELF_OK;
+}
+
+ElfStatus elf_load(UserProcess *proc, const uint8_t *image, uint32_t size,
+                   ElfImage *loaded) {
+  const ElfHeader *header = (const ElfHeader *)image;
+  ElfStatus status = check_image(image, size, header);
+  if (status != ELF_OK) {
+    return status;
+  }
+
+  loaded->entry = header->entry;
+  loaded->sharedPages = 0;
+  loaded->copiedPages = 0;
+  loaded->zeroedPages = 0;
+  for (uint32_t i = 0; i < header->phnum && status == ELF_OK; i++) {
+    const ElfProgramHeader *segment =
+        (const ElfProgramHeader *)(image + header->phoff +
+                                   i * header->phentsize);
+    if (segment->type == ELF_PT_LOAD && segment->memsz != 0) {
+      status = load_segment(proc->space, image, size, segment, loaded);
+    }
+  }
+  return status;
+}
+
+const char *elf_status_string(ElfStatus status) {
+  if ((uint32_t)status >= sizeof(statusNames) / sizeof(statusNames[0])) {
+    return "unknown error";
+  }
+  return statusNames[status];
+}
@@ -0,0 +1,111 @@
+#ifndef ELF_H
+#define ELF_H
+
+/**
+ * @file elf.h
+ * @brief Loader of ELF32 executables into the address space of a process.
+ *
+ * Only statically linked i386 executables (ET_EXEC) are taken, linked for
+ * the user range. Each PT_LOAD segment is mapped at its virtual address:
+ *
+ * - Pages of read-only segments whose file offset matches the virtual
+ *   address modulo the page size are not copied, the process gets the
+ *   frames of the image itself, read-only and borrowed. That needs a page
+ *   aligned image, boot modules are (MBALIGN in boot.asm).
+ * - Pages of writable segments, and pages a read-only segment only fills
+ *   partly before its zero-filled part, get a fresh frame and a copy.
+ * - Pages past the file data of a segment are zeroed frames.
+ *
+ * The image must stay in place as long as processes loaded from it run.
+ */
+
+#include "user.h"
+#include <stdint.h>
+
+#define ELF_CLASS_32 1        /**< e_ident[4], 32-bit objects. */
+#define ELF_DATA_LSB 1        /**< e_ident[5], little endian. */
+#define ELF_TYPE_EXEC 2       /**< e_type of an executable. */
+#define ELF_MACHINE_386 3     /**< e_machine of i386. */
+#define ELF_PT_LOAD 1         /**< p_type of a segment to map. */
+#define ELF_PF_W 0x2          /**< p_flags bit, segment is writable. */
+
+/**
+ * @brief ELF32 file header.
+ */
+typedef struct {
+  uint8_t ident[16];  /**< Magic, class, data encoding, version. */
+  uint16_t type;      /**< ELF_TYPE_EXEC for executables. */
+  uint16_t machine;   /**< ELF_MACHINE_386. */
+  uint32_t version;   /**< 1. */
+  uint32_t entry;     /**< Virtual address of the first instruction. */
+  uint32_t phoff;     /**< File offset of the program headers. */
+  uint32_t shoff;     /**< File offset of the section headers. */
+  uint32_t flags;     /**< Machine specific, 0 on i386. */
+  uint16_t ehsize;    /**< Size of this header. */
+  uint16_t phentsize; /**< Size of one program header. */
+  uint16_t phnum;     /**< Number of program headers. */
+  uint16_t shentsize; /**< Size of one section header. */
+  uint16_t shnum;     /**< Number of section headers. */
+  uint16_t shstrndx;  /**< Section holding the section names. */
+} __attribute__((packed)) ElfHeader;
+
+/**
+ * @brief ELF32 program header, describes one segment.
+ */
+typedef struct {
+  uint32_t type;   /**< ELF_PT_LOAD for segments to map. */
+  uint32_t offset; /**< File offset of the segment's data. */
+  uint32_t vaddr;  /**< Virtual address it is mapped at. */
+  uint32_t paddr;  /**< Unused. */
+  uint32_t filesz; /**< Bytes taken from the file. */
+  uint32_t memsz;  /**< Bytes in memory, zeroes after filesz. */
+  uint32_t flags;  /**< ELF_PF_W and the read/execute bits. */
+  uint32_t align;  /**< Alignment, a multiple of the page size for loading. */
+} __attribute__((packed)) ElfProgramHeader;
+
+/**
+ * @brief Why elf_load() failed.
+ */
+typedef enum {
+  ELF_OK,             /**< Loaded. */
+  ELF_TRUNCATED,      /**< Headers or segment data beyond the image. */
+  ELF_BAD_MAGIC,      /**< Not an ELF file. */
+  ELF_NOT_I386,       /**< Not 32-bit little endian i386 code. */
+  ELF_NOT_EXECUTABLE, /**< Not ET_EXEC or no PT_LOAD segment. */
+  ELF_BAD_ADDRESS,    /**< Segment or entry outside the program's range. */
+  ELF_NO_MEMORY       /**< No frames for copies or page tables. */
+} ElfStatus;
+
+/**
+ * @brief What elf_load() mapped.
+ */
+typedef struct {
+  uint32_t entry;       /**< First instruction. */
+  uint32_t sharedPages; /**< Frames of the image mapped directly. */
+  uint32_t copiedPages; /**< Fresh frames holding data of the image. */
+  uint32_t zeroedPages; /**< Fresh frames without data of the image. */
+} ElfImage;
+
+/**
+ * @brief Maps an executable into a process that was not started yet.
+ *
+ * @param proc The process, from user_process_create().
+ * @param image The file, identity mapped.
+ * @param size Its size in bytes.
+ * @param loaded Receives the entry point and the page counts.
+ * @return ElfStatus ELF_OK, else release the process, part of the
+ * segments may be mapped.
+ * @details Segments may reach up to the stack, they must not overlap it.
+ */
+ElfStatus elf_load(UserProcess *proc, const uint8_t *image, uint32_t size,
+                   ElfImage *loaded);
+
+/**
+ * @brief Describes an ElfStatus.
+ *
+ * @param status The status.
+ * @return const char* Text for error messages.
+ */
+const char *elf_status_string(ElfStatus status);
+
+#endif
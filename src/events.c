@@ -0,0 +1,62 @@
+#include "events.h"
+#include "cpu.h"
+#include "sync.h"
+#include <stddef.h>
+
+// each type is queued at most once, so EVENT_COUNT slots always suffice
+static volatile uint8_t queue[EVENT_COUNT];
+static volatile uint32_t queueHead = 0;
+static volatile uint32_t queueCount = 0;
+static volatile uint32_t queuedTypes = 0;
+static volatile bool ticksWanted = false;
+
+// the main loop, once threads run
+static WaitQueue waiters = WAITQUEUE_INIT;
+
+void event_post(EventType type) {
+  uint32_t flags = irq_save();
+  if ((queuedTypes & (1u << type)) == 0) {
+    queuedTypes |= 1u << type;
+    queue[(queueHead + queueCount) % EVENT_COUNT] = (uint8_t)type;
+    queueCount++;
+    waitqueue_wake_one(&waiters);
+  }
+  irq_restore(flags);
+}
+
+// interrupts must be disabled
+static bool event_take(EventType *type) {
+  if (queueCount == 0) {
+    return false;
+  }
+  *type = (EventType)queue[queueHead];
+  queueHead = (queueHead + 1) % EVENT_COUNT;
+  queueCount--;
+  queuedTypes &= ~(1u << *type);
+  return true;
+}
+
+bool event_poll(EventType *type) {
+  uint32_t flags = irq_save();
+  bool taken = event_take(type);
+  irq_restore(flags);
+  return taken;
+}
+
+EventType event_wait(void) {
+  EventType type;
+  uint32_t flags = irq_save();
+  while (!event_take(&type)) {
+    waitqueue_wait(&waiters);
+  }
+  irq_restore(flags);
+  return type;
+}
+
+void events_want_ticks(bool wanted) { ticksWanted = wanted; }
+
+void events_tick(void) {
+  if (ticksWanted) {
+    event_post(EVENT_TIMER);
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+/**
+ * @file events.h
+ * @brief Event queue the kernel main loop sleeps on.
+ *
+ * Interrupt handlers, softirqs and threads post events, the main loop takes
+ * them out one at a time and otherwise sleeps: blocked in the scheduler once
+ * threads run (the idle thread halts), halting itself before that. Events
+ * carry no payload and a type is queued at most once, the handler looks at
+ * the actual source (the key buffer, the job output rings, ...), so the
+ * queue can never overflow and a burst of keys costs one wakeup.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief What happened.
+ */
+typedef enum {
+  EVENT_KEY,    /**< Keys are waiting in the key buffer. */
+  EVENT_TIMER,  /**< A tick passed, only while events_want_ticks() is set. */
+  EVENT_MODE,   /**< The operating mode changed, see modeManager.h. */
+  EVENT_WORK,   /**< Deferred work: leftover softirqs or job output. */
+  EVENT_COUNT   /**< Number of event types. */
+} EventType;
+
+/**
+ * @brief Queues an event unless one of the same type is already queued.
+ *
+ * @param type The event type.
+ * @details Safe to call from interrupt handlers.
+ */
+void event_post(EventType type);
+
+/**
+ * @brief Takes the oldest event without waiting.
+ *
+ * @param type Receives the event type.
+ * @return true If there was one.
+ */
+bool event_poll(EventType *type);
+
+/**
+ * @brief Takes the oldest event, sleeping until there is one.
+ *
+ * @return EventType The event type.
+ */
+EventType event_wait(void);
+
+/**
+ * @brief Turns the per-tick ::EVENT_TIMER on or off.
+ *
+ * @param wanted Whether every timer tick posts an event (e.g. for the
+ * frame updates of a visual mode).
+ */
+void events_want_ticks(bool wanted);
+
+/**
+ * @brief Posts ::EVENT_TIMER if ticks are wanted, called by timer_irq().
+ */
+void events_tick(void);
+
+#endif
@@ -0,0 +1,89 @@
+#include "forkbench.h"
+#include "paging.h"
+#include "str.h"
+#include "terminal.h"
+#include "user.h"
+#include <stddef.h>
+
+// where the program finds its heap, the same as in userprogs.asm
+#define FORKBENCH_HEAP 0x50000000u
+// smallest heap, each further size is four times as large
+#define FORKBENCH_MIN_PAGES 16
+// what the program reports, see userprogs.asm
+#define MEASURE_FORK 0
+#define MEASURE_WRITE 1
+// page tables, stacks and the like besides the heaps
+#define FORKBENCH_SPARE_FRAMES 64
+
+// in userprogs.asm, linked for the user range
+extern uint8_t user_fork_bench[];
+
+// runs the program once with a heap of pages, 0 if it failed
+static uint32_t run_fork(uint32_t pages, bool eager, uint32_t measure) {
+  UserProcess *proc = user_process_create();
+  if (proc == NULL) {
+    return 0;
+  }
+  uint32_t args[3] = {pages, eager ? 1 : 0, measure};
+  if (!user_process_map_builtin(proc) ||
+      !as_map_zeroed(proc->space, FORKBENCH_HEAP, pages, PTE_WRITABLE) ||
+      !user_process_start(proc, "forkbench", (uint32_t)user_fork_bench, args,
+                          3)) {
+    user_process_release(proc);
+    return 0;
+  }
+  int32_t cycles = user_process_wait(proc);
+  return cycles > 0 ? (uint32_t)cycles : 0;
+}
+
+// a cycle count, or "failed"
+static void append_cycles(char *line, uint32_t cycles, size_t width) {
+  if (cycles != 0) {
+    appendDecimal(line, cycles, width);
+    return;
+  }
+  for (size_t len = 6; len < width; len++) {
+    appendString(line, " ");
+  }
+  appendString(line, "failed");
+}
+
+void runForkBenchmark(uint32_t maxPages) {
+  if (!user_available()) {
+    terminalWriteLine("User mode needs paging with 4 MiB pages (PSE)");
+    return;
+  }
+
+  terminalWriteLine("Fork of a process with a heap, TSC cycles. The child then writes to");
+  terminalWriteLine("every heap page, the cycles per page are shown as WRITE.");
+  terminalWriteLine("  PAGES    KIB   COW FORK  COPY FORK  COW WRITE COPY WRITE");
+  CowStats before;
+  as_cow_stats(&before);
+  char line[128];
+  for (uint32_t pages = FORKBENCH_MIN_PAGES; pages <= maxPages; pages *= 4) {
+    line[0] = '\0';
+    appendDecimal(line, pages, 7);
+    appendDecimal(line, pages * (PAGE_SIZE / 1024), 7);
+    // the heap, and its copy with an eager fork
+    if (2 * pages + FORKBENCH_SPARE_FRAMES > frame_free_count()) {
+      appendString(line, "  not enough free memory");
+      terminalWriteLine(line);
+      break;
+    }
+    append_cycles(line, run_fork(pages, false, MEASURE_FORK), 11);
+    append_cycles(line, run_fork(pages, true, MEASURE_FORK), 11);
+    append_cycles(line, run_fork(pages, false, MEASURE_WRITE), 11);
+    append_cycles(line, run_fork(pages, true, MEASURE_WRITE), 11);
+    terminalWriteLine(line);
+  }
+
+  CowStats after;
+  as_cow_stats(&after);
+  line[0] = '\0';
+  appendString(line, "copy-on-write faults: ");
+  appendDecimal(line, after.copies - before.copies, 0);
+  appendString(line, " copied, ");
+  appendDecimal(line, after.reuses - before.reuses, 0);
+  appendString(line, " reused the last reference");
+  terminalWriteLine(line);
+}
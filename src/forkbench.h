@@ -0,0 +1,28 @@
+#ifndef FORKBENCH_H
+#define FORKBENCH_H
+
+/**
+ * @file forkbench.h
+ * @brief Fork latency against process size, copy-on-write against copying.
+ *
+ * A built-in program (userprogs.asm) with a heap of a given number of
+ * pages forks, once sharing the pages copy-on-write and once copying them
+ * right away. The parent times the fork call, the child then writes to
+ * every heap page and times that, which is where copy-on-write pays for
+ * the pages that are really touched.
+ */
+
+#include <stdint.h>
+
+/** @brief Largest heap tried when the command gives no limit, 16 MiB. */
+#define FORKBENCH_DEFAULT_PAGES 4096
+
+/**
+ * @brief Forks processes of growing size and prints the cycles.
+ *
+ * @param maxPages Largest heap in pages, sizes that do not fit into the
+ * free memory are skipped.
+ */
+void runForkBenchmark(uint32_t maxPages);
+
+#endif
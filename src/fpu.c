@@ -0,0 +1,251 @@
+#include "fpu.h"
+#include "cpu.h"
+#include "interrupts.h"
+#include "percpu.h"
+#include <stddef.h>
+
+#define CPUID1_EDX_FPU (1u << 0)
+#define CPUID1_EDX_FXSR (1u << 24)
+#define CPUID1_EDX_SSE (1u << 25)
+#define CPUID1_ECX_XSAVE (1u << 26)
+#define CPUID1_ECX_AVX (1u << 28)
+
+// XCR0 state components
+#define XCR0_X87 (1u << 0)
+#define XCR0_SSE (1u << 1)
+#define XCR0_AVX (1u << 2)
+
+#define FXSAVE_SIZE 512
+#define FNSAVE_SIZE 108
+#define MXCSR_DEFAULT 0x1F80 // all SIMD exceptions masked, round to nearest
+
+#define NM_VECTOR 7
+
+static FpuSaveMethod method = FPU_SAVE_NONE;
+static uint32_t stateSize = 0;
+static uint64_t xsaveMask = 0;
+static bool sse = false;
+// CR4 bits and XCR0 fpu_init() chose, the other CPUs copy them
+static uint32_t cr4Bits = 0;
+static uint64_t xcr0 = 0;
+static uint64_t lazySwitches = 0;
+
+// the boot code's context
+static uint8_t bootArea[FPU_STATE_SIZE] __attribute__((aligned(FPU_STATE_ALIGN)));
+static FpuContext bootContext;
+
+static inline void clts(void) { __asm__ volatile("clts" ::: "memory"); }
+
+static inline void stts(void) { write_cr0(read_cr0() | CR0_TS); }
+
+static void fpu_save(FpuContext *ctx) {
+  switch (method) {
+  case FPU_SAVE_XSAVE:
+    __asm__ volatile("xsave (%0)"
+                     :
+                     : "r"(ctx->area), "a"((uint32_t)xsaveMask),
+                       "d"((uint32_t)(xsaveMask >> 32))
+                     : "memory");
+    break;
+  case FPU_SAVE_FXSAVE:
+    __asm__ volatile("fxsave (%0)" : : "r"(ctx->area) : "memory");
+    break;
+  case FPU_SAVE_FNSAVE:
+    __asm__ volatile("fnsave (%0)" : : "r"(ctx->area) : "memory");
+    break;
+  default:
+    break;
+  }
+}
+
+static void fpu_restore(FpuContext *ctx) {
+  if (!ctx->initialized) {
+    // first use: a clean state instead of whatever the last owner left
+    __asm__ volatile("fninit" ::: "memory");
+    if (sse) {
+      uint32_t mxcsr = MXCSR_DEFAULT;
+      __asm__ volatile("ldmxcsr %0" : : "m"(mxcsr));
+    }
+    ctx->initialized = true;
+    return;
+  }
+  switch (method) {
+  case FPU_SAVE_XSAVE:
+    __asm__ volatile("xrstor (%0)"
+                     :
+                     : "r"(ctx->area), "a"((uint32_t)xsaveMask),
+                       "d"((uint32_t)(xsaveMask >> 32))
+                     : "memory");
+    break;
+  case FPU_SAVE_FXSAVE:
+    __asm__ volatile("fxrstor (%0)" : : "r"(ctx->area) : "memory");
+    break;
+  case FPU_SAVE_FNSAVE:
+    __asm__ volatile("frstor (%0)" : : "r"(ctx->area) : "memory");
+    break;
+  default:
+    break;
+  }
+}
+
+// #NM: the running context touched the FPU while CR0.TS was set. The
+// contexts live in the CPU's own block, another CPU's registers are none of
+// its business
+static void fpu_nm_handler(registers_t *regs, void *ctx) {
+  (void)regs;
+  (void)ctx;
+  clts();
+  FpuContext *owner = this_cpu_read(fpuOwner);
+  FpuContext *current = this_cpu_read(fpuCurrent);
+  if (owner == current) {
+    return;
+  }
+  if (owner != NULL) {
+    fpu_save(owner);
+  }
+  if (current != NULL) {
+    fpu_restore(current);
+  }
+  this_cpu_write(fpuOwner, current);
+  lazySwitches++;
+}
+
+bool fpu_init(void) {
+  uint32_t eax, ebx, ecx, edx;
+  cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+  if (!(edx & CPUID1_EDX_FPU)) {
+    return false;
+  }
+
+  write_cr0((read_cr0() & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+  method = FPU_SAVE_FNSAVE;
+  stateSize = FNSAVE_SIZE;
+
+  if ((edx & CPUID1_EDX_FXSR) && (edx & CPUID1_EDX_SSE)) {
+    cr4Bits |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    write_cr4(read_cr4() | cr4Bits);
+    sse = true;
+    method = FPU_SAVE_FXSAVE;
+    stateSize = FXSAVE_SIZE;
+  }
+
+  if (sse && (ecx & CPUID1_ECX_XSAVE)) {
+    cr4Bits |= CR4_OSXSAVE;
+    write_cr4(read_cr4() | cr4Bits);
+    uint64_t mask = XCR0_X87 | XCR0_SSE;
+    if (ecx & CPUID1_ECX_AVX) {
+      mask |= XCR0_AVX;
+    }
+    xsetbv(0, mask);
+    xcr0 = mask;
+    // leaf 0xD reports the save area size for the components now enabled
+    cpuid(0xD, 0, &eax, &ebx, &ecx, &edx);
+    if (ebx != 0 && ebx <= FPU_STATE_SIZE) {
+      method = FPU_SAVE_XSAVE;
+      stateSize = ebx;
+      xsaveMask = mask;
+    } else {
+      xcr0 = XCR0_X87 | XCR0_SSE;
+      xsetbv(0, xcr0);
+    }
+  }
+
+  __asm__ volatile("fninit" ::: "memory");
+  if (sse) {
+    uint32_t mxcsr = MXCSR_DEFAULT;
+    __asm__ volatile("ldmxcsr %0" : : "m"(mxcsr));
+  }
+
+  irq_register(NM_VECTOR, fpu_nm_handler, NULL);
+  irq_set_name(NM_VECTOR, "fpu-#NM");
+
+  // the boot code owns the freshly initialized registers
+  fpu_context_init(&bootContext, bootArea);
+  bootContext.initialized = true;
+  this_cpu_write(fpuCurrent, &bootContext);
+  this_cpu_write(fpuOwner, &bootContext);
+  return true;
+}
+
+void fpu_cpu_init(void) {
+  if (method == FPU_SAVE_NONE) {
+    return;
+  }
+  write_cr0((read_cr0() & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+  write_cr4(read_cr4() | cr4Bits);
+  if (cr4Bits & CR4_OSXSAVE) {
+    xsetbv(0, xcr0);
+  }
+  __asm__ volatile("fninit" ::: "memory");
+  if (sse) {
+    uint32_t mxcsr = MXCSR_DEFAULT;
+    __asm__ volatile("ldmxcsr %0" : : "m"(mxcsr));
+  }
+}
+
+FpuSaveMethod fpu_save_method(void) { return method; }
+
+uint32_t fpu_state_size(void) { return stateSize; }
+
+uint64_t fpu_lazy_switches(void) { return lazySwitches; }
+
+void fpu_context_init(FpuContext *ctx, void *area) {
+  ctx->area = (uint8_t *)area;
+  ctx->initialized = false;
+}
+
+void fpu_switch(FpuContext *ctx) {
+  if (method == FPU_SAVE_NONE) {
+    return;
+  }
+  this_cpu_write(fpuCurrent, ctx);
+  if (this_cpu_read(fpuOwner) == ctx) {
+    clts();
+  } else {
+    stts();
+  }
+}
+
+FpuContext *fpu_current(void) { return this_cpu_read(fpuCurrent); }
+
+void fpu_context_release(FpuContext *ctx) {
+  uint32_t flags = irq_save();
+  if (this_cpu_read(fpuOwner) == ctx) {
+    this_cpu_write(fpuOwner, NULL);
+  }
+  if (this_cpu_read(fpuCurrent) == ctx) {
+    this_cpu_write(fpuCurrent, NULL);
+  }
+  irq_restore(flags);
+}
+
+void kernel_fpu_begin(void) {
+  if (method == FPU_SAVE_NONE) {
+    return;
+  }
+  uint32_t flags = irq_save();
+  this_cpu_inc(kernelFpuDepth);
+  if (this_cpu_read(kernelFpuDepth) > 1) {
+    return; // nested, the outer section already saved and disabled
+  }
+  this_cpu_write(kernelFpuFlags, flags);
+  clts();
+  FpuContext *owner = this_cpu_read(fpuOwner);
+  if (owner != NULL) {
+    fpu_save(owner);
+    this_cpu_write(fpuOwner, NULL);
+  }
+}
+
+void kernel_fpu_end(void) {
+  if (method == FPU_SAVE_NONE || this_cpu_read(kernelFpuDepth) == 0) {
+    return;
+  }
+  this_cpu_dec(kernelFpuDepth);
+  if (this_cpu_read(kernelFpuDepth) > 0) {
+    return;
+  }
+  // nobody owns the registers now, the next user reloads through #NM
+  stts();
+  irq_restore(this_cpu_read(kernelFpuFlags));
+}
@@ -0,0 +1,137 @@
+#ifndef FPU_H
+#define FPU_H
+
+/**
+ * @file fpu.h
+ * @brief x87 FPU and SSE initialization with lazy state switching.
+ *
+ * The FPU/SSE register state belongs to one context at a time (the owner).
+ * Switching contexts only sets CR0.TS, the state is saved and restored in
+ * the #NM handler when the new context actually executes an FPU or SSE
+ * instruction. Contexts that never touch the FPU, and interrupt handlers,
+ * never pay for a save.
+ *
+ * Kernel code that wants to use SIMD registers outside of a context brackets
+ * it with kernel_fpu_begin() and kernel_fpu_end(). That works on every CPU:
+ * the running context, the owner and the nesting depth are kept in the
+ * CPU's ::PerCpu block.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @brief Largest save area fpu_init() will configure, in bytes. */
+#define FPU_STATE_SIZE 1024
+
+/** @brief Required alignment of a save area (XSAVE needs 64 bytes). */
+#define FPU_STATE_ALIGN 64
+
+/**
+ * @brief How the FPU state is saved and restored.
+ */
+typedef enum {
+  FPU_SAVE_NONE,   /**< No FPU. */
+  FPU_SAVE_FNSAVE, /**< x87 only (fnsave/frstor). */
+  FPU_SAVE_FXSAVE, /**< x87 + SSE (fxsave/fxrstor). */
+  FPU_SAVE_XSAVE,  /**< All XCR0 components (xsave/xrstor). */
+} FpuSaveMethod;
+
+/**
+ * @brief The FPU state of one execution context.
+ */
+typedef struct {
+  uint8_t *area;    /**< FPU_STATE_SIZE bytes, FPU_STATE_ALIGN aligned. */
+  bool initialized; /**< False until the context first used the FPU. */
+} FpuContext;
+
+/**
+ * @brief Enables the FPU, SSE and (if present) XSAVE, and installs #NM.
+ *
+ * @return true If an FPU was found.
+ * @details Sets CR0.MP/NE and clears EM, sets CR4.OSFXSR/OSXMMEXCPT and
+ * OSXSAVE, and programs XCR0 with x87, SSE and AVX state. The boot code
+ * becomes the first context.
+ */
+bool fpu_init(void);
+
+/**
+ * @brief Enables the FPU on another CPU the way fpu_init() did on the BSP.
+ *
+ * @details Only sets the control registers and resets the FPU. Lazy
+ * switching stays a BSP thing, the other CPUs run without contexts and
+ * only use the FPU inside kernel_fpu_begin() sections.
+ */
+void fpu_cpu_init(void);
+
+/**
+ * @brief Returns how FPU state is saved.
+ *
+ * @return FpuSaveMethod The method chosen by fpu_init().
+ */
+FpuSaveMethod fpu_save_method(void);
+
+/**
+ * @brief Returns the size of the FPU state in use.
+ *
+ * @return uint32_t Bytes of the save area that are written.
+ */
+uint32_t fpu_state_size(void);
+
+/**
+ * @brief Returns how often #NM moved FPU state between contexts.
+ *
+ * @return uint64_t The number of lazy switches.
+ */
+uint64_t fpu_lazy_switches(void);
+
+/**
+ * @brief Prepares the FPU state of a new context.
+ *
+ * @param ctx The context.
+ * @param area Its save area of FPU_STATE_SIZE bytes, FPU_STATE_ALIGN aligned.
+ * @details The state is initialized (fninit, default MXCSR) on first use.
+ */
+void fpu_context_init(FpuContext *ctx, void *area);
+
+/**
+ * @brief Makes ctx the running context.
+ *
+ * @param ctx The context that runs next.
+ * @details Called on every context switch. Only sets or clears CR0.TS, the
+ * actual save and restore is deferred to the first FPU instruction.
+ */
+void fpu_switch(FpuContext *ctx);
+
+/**
+ * @brief Returns the running context.
+ *
+ * @return FpuContext* The context set by the last fpu_switch(), the boot
+ * context right after fpu_init(), NULL without an FPU.
+ */
+FpuContext *fpu_current(void);
+
+/**
+ * @brief Forgets a context that is going away.
+ *
+ * @param ctx The context, its live state is dropped without a save.
+ */
+void fpu_context_release(FpuContext *ctx);
+
+/**
+ * @brief Allows kernel code to use FPU and SIMD registers.
+ *
+ * @details Saves the state of the current owner, then disables interrupts
+ * until kernel_fpu_end(), so keep the section short. Sections may nest, only
+ * the outermost pair does the work.
+ */
+void kernel_fpu_begin(void);
+
+/**
+ * @brief Ends a section started with kernel_fpu_begin().
+ *
+ * @details The registers are left dirty, the next context that uses the FPU
+ * reloads its state through #NM.
+ */
+void kernel_fpu_end(void);
+
+#endif
@@ -0,0 +1,275 @@
+#include "gcov.h"
+#include "serial.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// The structures below mirror what GCC emits for -fprofile-arcs (see
+// libgcov/gcov-io.h of the compiler in use), their layout changes between
+// GCC releases.
+#if __GNUC__ >= 15
+#define GCOV_COUNTERS 10
+#elif __GNUC__ >= 14
+#define GCOV_COUNTERS 9
+#elif __GNUC__ >= 10
+#define GCOV_COUNTERS 8
+#elif __GNUC__ >= 7
+#define GCOV_COUNTERS 9
+#else
+#error "the kernel gcov runtime needs GCC 7 or newer"
+#endif
+
+// since GCC 12 record lengths are counted in bytes instead of words
+#if __GNUC__ >= 12
+#define GCOV_UNIT_SIZE 4
+#else
+#define GCOV_UNIT_SIZE 1
+#endif
+
+#define GCOV_DATA_MAGIC 0x67636461u // "gcda"
+#define GCOV_TAG_FUNCTION 0x01000000u
+#define GCOV_TAG_FUNCTION_LENGTH 3
+#define GCOV_TAG_COUNTER_BASE 0x01a10000u
+#define GCOV_TAG_OBJECT_SUMMARY 0xa1000000u
+#define GCOV_TAG_SUMMARY_LENGTH 2
+#define GCOV_TAG_FOR_COUNTER(counter) (GCOV_TAG_COUNTER_BASE + ((counter) << 17))
+
+// index of the arc (edge) counters, the ones -fprofile-use needs
+#define GCOV_COUNTER_ARCS 0
+
+// hex bytes per line of the dump
+#define GCOV_DUMP_LINE 32
+
+typedef int64_t gcov_type;
+
+struct gcov_info;
+
+typedef void (*gcov_merge_fn)(gcov_type *, unsigned int);
+
+struct gcov_ctr_info {
+  unsigned int num;
+  gcov_type *values;
+};
+
+struct gcov_fn_info {
+  const struct gcov_info *key;
+  unsigned int ident;
+  unsigned int lineno_checksum;
+  unsigned int cfg_checksum;
+  struct gcov_ctr_info ctrs[];
+};
+
+struct gcov_info {
+  unsigned int version;
+  struct gcov_info *next;
+  unsigned int stamp;
+#if __GNUC__ >= 12
+  unsigned int checksum;
+#endif
+  const char *filename;
+  gcov_merge_fn merge[GCOV_COUNTERS];
+  unsigned int n_functions;
+  const struct gcov_fn_info *const *functions;
+};
+
+// the linker script collects the constructors between these symbols
+typedef void (*gcov_ctor_fn)(void);
+extern gcov_ctor_fn __init_array_start[];
+extern gcov_ctor_fn __init_array_end[];
+
+static struct gcov_info *infos = NULL;
+static uint32_t infoCount = 0;
+
+// hex output state of the object being dumped
+static char lineBuffer[GCOV_DUMP_LINE * 2 + 1];
+static uint32_t lineFill = 0;
+static uint32_t bytesWritten = 0;
+
+void __gcov_init(struct gcov_info *info);
+void __gcov_exit(void);
+void __gcov_merge_add(gcov_type *counters, unsigned int count);
+
+// called by the constructor of every instrumented object file
+void __gcov_init(struct gcov_info *info) {
+  info->next = infos;
+  infos = info;
+  infoCount++;
+}
+
+// called by the destructors, the kernel never runs them
+void __gcov_exit(void) {}
+
+// merging with earlier runs happens on the host, never in the kernel
+void __gcov_merge_add(gcov_type *counters, unsigned int count) {
+  (void)counters;
+  (void)count;
+}
+
+void gcov_init(void) {
+  for (gcov_ctor_fn *ctor = __init_array_start; ctor < __init_array_end;
+       ctor++) {
+    (*ctor)();
+  }
+}
+
+uint32_t gcov_object_count(void) { return infoCount; }
+
+// a counter kind is present in an object iff it has a merge function
+static bool counter_active(const struct gcov_info *info, uint32_t counter) {
+  return info->merge[counter] != NULL;
+}
+
+void gcov_reset(void) {
+  for (struct gcov_info *info = infos; info != NULL; info = info->next) {
+    for (uint32_t f = 0; f < info->n_functions; f++) {
+      const struct gcov_fn_info *fn = info->functions[f];
+      if (fn == NULL || fn->key != info) {
+        continue;
+      }
+      const struct gcov_ctr_info *ctr = fn->ctrs;
+      for (uint32_t c = 0; c < GCOV_COUNTERS; c++) {
+        if (!counter_active(info, c)) {
+          continue;
+        }
+        for (uint32_t v = 0; v < ctr->num; v++) {
+          ctr->values[v] = 0;
+        }
+        ctr++;
+      }
+    }
+  }
+}
+
+static void flush_line(void) {
+  if (lineFill == 0) {
+    return;
+  }
+  lineBuffer[lineFill] = '\0';
+  serial_write(lineBuffer);
+  serial_putc('\n');
+  lineFill = 0;
+}
+
+static void put_byte(uint8_t byte) {
+  static const char digits[] = "0123456789abcdef";
+  lineBuffer[lineFill++] = digits[byte >> 4];
+  lineBuffer[lineFill++] = digits[byte & 0xF];
+  bytesWritten++;
+  if (lineFill == GCOV_DUMP_LINE * 2) {
+    flush_line();
+  }
+}
+
+// .gcda files are little endian words on x86
+static void put_u32(uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    put_byte((uint8_t)(value >> (i * 8)));
+  }
+}
+
+// 64-bit counters are stored low word first
+static void put_u64(uint64_t value) {
+  put_u32((uint32_t)value);
+  put_u32((uint32_t)(value >> 32));
+}
+
+static void put_decimal(uint32_t value) {
+  char digits[11];
+  int length = 0;
+  do {
+    digits[length++] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  while (length > 0) {
+    serial_putc(digits[--length]);
+  }
+}
+
+// the largest arc counter of the whole program, part of every summary
+static uint32_t program_sum_max(void) {
+  uint64_t max = 0;
+  for (struct gcov_info *info = infos; info != NULL; info = info->next) {
+    if (!counter_active(info, GCOV_COUNTER_ARCS)) {
+      continue;
+    }
+    for (uint32_t f = 0; f < info->n_functions; f++) {
+      const struct gcov_fn_info *fn = info->functions[f];
+      if (fn == NULL || fn->key != info) {
+        continue;
+      }
+      const struct gcov_ctr_info *arcs = &fn->ctrs[0];
+      for (uint32_t v = 0; v < arcs->num; v++) {
+        if ((uint64_t)arcs->values[v] > max) {
+          max = (uint64_t)arcs->values[v];
+        }
+      }
+    }
+  }
+  return max > UINT32_MAX ? UINT32_MAX : (uint32_t)max;
+}
+
+// same record order as libgcov's write_one_data()
+static void dump_info(const struct gcov_info *info, uint32_t sumMax) {
+  put_u32(GCOV_DATA_MAGIC);
+  put_u32(info->version);
+  put_u32(info->stamp);
+#if __GNUC__ >= 12
+  put_u32(info->checksum);
+#endif
+
+  put_u32(GCOV_TAG_OBJECT_SUMMARY);
+  put_u32(GCOV_TAG_SUMMARY_LENGTH * GCOV_UNIT_SIZE);
+  put_u32(1); // runs
+  put_u32(sumMax);
+
+  for (uint32_t f = 0; f < info->n_functions; f++) {
+    const struct gcov_fn_info *fn = info->functions[f];
+    // functions emitted by another object (COMDAT) get an empty record
+    if (fn == NULL || fn->key != info) {
+      put_u32(GCOV_TAG_FUNCTION);
+      put_u32(0);
+      continue;
+    }
+    put_u32(GCOV_TAG_FUNCTION);
+    put_u32(GCOV_TAG_FUNCTION_LENGTH * GCOV_UNIT_SIZE);
+    put_u32(fn->ident);
+    put_u32(fn->lineno_checksum);
+    put_u32(fn->cfg_checksum);
+
+    const struct gcov_ctr_info *ctr = fn->ctrs;
+    for (uint32_t c = 0; c < GCOV_COUNTERS; c++) {
+      if (!counter_active(info, c)) {
+        continue;
+      }
+      put_u32(GCOV_TAG_FOR_COUNTER(c));
+      put_u32(ctr->num * 2 * GCOV_UNIT_SIZE);
+      for (uint32_t v = 0; v < ctr->num; v++) {
+        put_u64((uint64_t)ctr->values[v]);
+      }
+      ctr++;
+    }
+  }
+  put_u32(0); // end of file
+}
+
+void gcov_dump(void) {
+  if (infoCount == 0) {
+    return;
+  }
+  uint32_t sumMax = program_sum_max();
+  serial_write("gcov-dump ");
+  put_decimal(infoCount);
+  serial_write(" objects\n");
+  for (const struct gcov_info *info = infos; info != NULL; info = info->next) {
+    serial_write("gcov-begin ");
+    serial_write(info->filename);
+    serial_putc('\n');
+    lineFill = 0;
+    bytesWritten = 0;
+    dump_info(info, sumMax);
+    flush_line();
+    serial_write("gcov-end ");
+    put_decimal(bytesWritten);
+    serial_putc('\n');
+  }
+  serial_write("gcov-done\n");
+}
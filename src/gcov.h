@@ -0,0 +1,51 @@
+#ifndef GCOV_H
+#define GCOV_H
+
+/**
+ * @file gcov.h
+ * @brief Freestanding gcov runtime for profile-guided builds.
+ *
+ * A kernel compiled with -fprofile-arcs (make pgo-gen) counts how often
+ * every branch is taken. The compiler emits one constructor per object
+ * file that registers its counters through __gcov_init(). Instead of
+ * libgcov writing .gcda files, gcov_dump() sends the .gcda contents as hex
+ * over the serial port, and tools/gcov-extract.py turns the log back into
+ * files for -fprofile-use (make pgo-use).
+ *
+ * In a normal build nothing registers, gcov_init() and gcov_dump() do
+ * nothing. This file and serial.c are never instrumented themselves.
+ */
+
+#include <stdint.h>
+
+/**
+ * @brief Runs the constructors of the kernel image (.init_array).
+ *
+ * @details Only instrumented objects have constructors, they register their
+ * counters with the runtime. Must run before the first gcov_dump().
+ */
+void gcov_init(void);
+
+/**
+ * @brief Returns how many object files registered counters.
+ *
+ * @return uint32_t 0 in a build without -fprofile-arcs.
+ */
+uint32_t gcov_object_count(void);
+
+/**
+ * @brief Zeroes all counters, e.g. to leave the boot path out of a profile.
+ */
+void gcov_reset(void);
+
+/**
+ * @brief Writes the .gcda data of every registered object to COM1.
+ *
+ * @details Each object is framed by "gcov-begin <path>" and
+ * "gcov-end <bytes>" lines with the data as hex in between. Called from
+ * systemShutdown(), so a training run that ends with shutdown leaves its
+ * whole profile in the serial log.
+ */
+void gcov_dump(void);
+
+#endif
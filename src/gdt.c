@@ -4,16 +4,35 @@
 #include "terminal.h"
 #include <sys/types.h>
 
-// Define the size of the GDT in bytes
-#define GDT_SIZE (3 * 8)
+// Define the size of the GDT in bytes: null, kernel code and data, user
+// code and data, then one data segment and one TSS per CPU
+#define GDT_SIZE ((GDT_TSS_FIRST + GDT_PERCPU_COUNT) * 8)
 /**
  * @brief Represents the Global Descriptor Table (GDT) in memory.
  *
  * This array holds the GDT entries, including the null segment, code segment,
- * and data segment.
+ * data segment, the user segments, the per-CPU segments and the TSSs.
  */
 uint8_t gdt[GDT_SIZE];
 
+/**
+ * @brief A TSS with room below ESP0.
+ *
+ * SYSENTER_ESP points at the ESP0 field, so for the first instruction of
+ * the sysenter stub the stack pointer is inside the TSS. An NMI arriving
+ * right then, or the single step trap of a program that set TF, pushes its
+ * frame over prevTask and the guard words instead of over whatever happens
+ * to lie in front of the TSS.
+ */
+typedef struct {
+  uint32_t guard[8];
+  Tss tss;
+} __attribute__((aligned(64))) CpuTss;
+
+static CpuTss cpuTss[GDT_PERCPU_COUNT];
+
+_Static_assert(sizeof(Tss) == 104, "the CPU expects a 104 byte TSS");
+
 /**
  * @brief Represents the GDT descriptor.
  *
@@ -57,15 +76,57 @@ void gdtInit() {
   GdtEntry dataEntry = {
       .base = 0, .limit = 0xFFFFF, .access_byte = 0x92, .flags = 0x0C};
 
-  // Create the 3 entries in our GDT array.
+  // the same two segments for ring 3
+  // - Access: present, ring3, executable, readable / writable
+  GdtEntry userCodeEntry = {
+      .base = 0, .limit = 0xFFFFF, .access_byte = 0xFA, .flags = 0x0C};
+  GdtEntry userDataEntry = {
+      .base = 0, .limit = 0xFFFFF, .access_byte = 0xF2, .flags = 0x0C};
+
+  // Create the 5 flat entries in our GDT array.
   gdtEntry(&gdt[0], nullEntry);
-  gdtEntry(&gdt[8], codeEntry);
-  gdtEntry(&gdt[16], dataEntry);
+  gdtEntry(&gdt[GDT_KERNEL_CODE], codeEntry);
+  gdtEntry(&gdt[GDT_KERNEL_DATA], dataEntry);
+  gdtEntry(&gdt[GDT_USER_CODE & ~3], userCodeEntry);
+  gdtEntry(&gdt[GDT_USER_DATA & ~3], userDataEntry);
 
   // Set up the GDT descriptor with the proper limit and base address.
   gdtDesc.limit = sizeof(gdt) - 1;
   gdtDesc.base = (uint32_t)&gdt;
 
+  gdtLoad();
+}
+
+// documentation see gdt.h
+uint16_t gdtSetPerCpuSegment(uint32_t cpu, uint32_t base, uint32_t limit) {
+  // byte granular data segment, present, ring0, writable, 32 bit
+  GdtEntry perCpuEntry = {
+      .base = base, .limit = limit, .access_byte = 0x92, .flags = 0x04};
+  uint32_t index = GDT_PERCPU_FIRST + cpu;
+  gdtEntry(&gdt[index * 8], perCpuEntry);
+  return (uint16_t)(index * 8);
+}
+
+// documentation see gdt.h
+uint32_t *gdtLoadTss(uint32_t cpu) {
+  Tss *tss = &cpuTss[cpu].tss;
+  tss->ss0 = GDT_KERNEL_DATA;
+  tss->esp0 = 0;
+  tss->iomapBase = sizeof(Tss);
+
+  // byte granular, present, ring0, 32-bit TSS (available)
+  GdtEntry tssEntry = {.base = (uint32_t)tss,
+                       .limit = sizeof(Tss) - 1,
+                       .access_byte = 0x89,
+                       .flags = 0x00};
+  uint32_t index = GDT_TSS_FIRST + cpu;
+  gdtEntry(&gdt[index * 8], tssEntry);
+  __asm__ volatile("ltr %w0" : : "r"((uint16_t)(index * 8)) : "memory");
+  return &tss->esp0;
+}
+
+// Load the GDT on the calling CPU and reload all segment registers.
+void gdtLoad() {
   // Use inline assembly to load the new GDT.
   __asm__ volatile("lgdt (%0)" : : "r"(&gdtDesc));
 
@@ -78,9 +139,9 @@ void gdtInit() {
       "mov %%ax, %%fs\n"
       "mov %%ax, %%gs\n"
       "mov %%ax, %%ss\n"
-      "jmp $0x08, $.reload\n" // Far jump: 0x08 is the selector for the code
-                              // segment
-      ".reload:\n"
+      "jmp $0x08, $1f\n" // Far jump: 0x08 is the selector for the code
+                         // segment
+      "1:\n"
       :
       :
       : "ax");
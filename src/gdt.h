@@ -62,4 +62,78 @@ void printGdtInfoToTerminal();
  */
 void gdtInit();
 
+/** @brief Selector of the ring 0 code segment. */
+#define GDT_KERNEL_CODE 0x08
+
+/** @brief Selector of the ring 0 data segment. */
+#define GDT_KERNEL_DATA 0x10
+
+/**
+ * @brief Selector of the ring 3 code segment, RPL 3 included.
+ *
+ * @details SYSEXIT derives the user selectors from the kernel code selector
+ * (+16 and +24), so the four flat segments have to stay in this order.
+ */
+#define GDT_USER_CODE 0x1B
+
+/** @brief Selector of the ring 3 data segment, RPL 3 included. */
+#define GDT_USER_DATA 0x23
+
+/** @brief GDT index of the first per-CPU segment, see percpu.h. */
+#define GDT_PERCPU_FIRST 5
+
+/** @brief Number of per-CPU segments reserved in the GDT. */
+#define GDT_PERCPU_COUNT 16
+
+/**
+ * @brief Points the per-CPU segment of a CPU at its data block.
+ *
+ * @param cpu The CPU index, below GDT_PERCPU_COUNT.
+ * @param base Linear address of the block.
+ * @param limit Size of the block minus one, in bytes.
+ * @return uint16_t The selector the CPU loads into GS.
+ */
+uint16_t gdtSetPerCpuSegment(uint32_t cpu, uint32_t base, uint32_t limit);
+
+/** @brief GDT index of the first TSS, one per CPU like the per-CPU segments. */
+#define GDT_TSS_FIRST (GDT_PERCPU_FIRST + GDT_PERCPU_COUNT)
+
+/**
+ * @brief 32-bit task state segment.
+ *
+ * @details Hardware task switching is not used, the CPU only reads SS0:ESP0
+ * from it, the kernel stack it switches to when an interrupt or `int 0x80`
+ * arrives in ring 3. There is no I/O permission bitmap, so every port access
+ * from ring 3 faults.
+ */
+typedef struct {
+  uint32_t prevTask; /**< Unused. */
+  uint32_t esp0;     /**< Kernel stack for entries from ring 3. */
+  uint32_t ss0;      /**< Its segment, GDT_KERNEL_DATA. */
+  uint32_t unused[22]; /**< Ring 1/2 stacks and the register save area. */
+  uint16_t trap;     /**< Debug trap on task switch, 0. */
+  uint16_t iomapBase; /**< Offset of the I/O bitmap, past the end. */
+} Tss;
+
+/**
+ * @brief Sets up the TSS of a CPU and loads it into its task register.
+ *
+ * @param cpu The CPU index, below GDT_PERCPU_COUNT, must be the caller.
+ * @return uint32_t* The ESP0 field, see gdtSetKernelStack(). SYSENTER_ESP
+ * points at it as well, the sysenter entry stub loads ESP from there.
+ * @details The entry stubs turn the task register into the per-CPU selector
+ * of an entry from ring 3 (`str`, minus the distance of both GDT ranges), so
+ * every CPU that may run user code needs its TSS loaded.
+ */
+uint32_t *gdtLoadTss(uint32_t cpu);
+
+/**
+ * @brief Loads the GDT built by gdtInit() on the calling CPU.
+ *
+ * @details Also reloads all segment registers, GS included, so percpu_init()
+ * has to follow. Application processors call this when they come up, they
+ * share the BSP's GDT.
+ */
+void gdtLoad();
+
 #endif
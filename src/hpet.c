@@ -0,0 +1,263 @@
+#include "hpet.h"
+#include "acpi.h"
+#include "cpu.h"
+#include "interrupts.h"
+#include <stddef.h>
+
+// HPET register offsets
+#define HPET_REG_CAPABILITIES 0x000
+#define HPET_REG_CONFIG 0x010
+#define HPET_REG_INT_STATUS 0x020
+#define HPET_REG_COUNTER 0x0F0
+#define HPET_REG_TIMER_CONFIG(n) (0x100 + 0x20 * (n))
+#define HPET_REG_TIMER_COMPARATOR(n) (0x108 + 0x20 * (n))
+
+// general capabilities (low dword) and configuration bits
+#define HPET_CAP_COUNT_64BIT (1u << 13)
+#define HPET_CAP_NUM_TIMERS(cap) ((((cap) >> 8) & 0x1F) + 1)
+#define HPET_CFG_ENABLE (1u << 0)
+#define HPET_CFG_LEGACY_ROUTE (1u << 1)
+
+// timer configuration bits
+#define HPET_TN_INT_ENABLE (1u << 2)
+#define HPET_TN_PERIODIC (1u << 3)
+#define HPET_TN_PERIODIC_CAP (1u << 4)
+#define HPET_TN_SETVAL (1u << 6)
+#define HPET_TN_32BIT (1u << 8)
+
+// comparators closer than this to the counter may be missed
+#define HPET_MIN_DELTA 64u
+// the 32-bit comparator is ahead of the counter as long as the difference
+// is positive as a signed number, longer delays are cut to this
+#define HPET_MAX_DELTA 0x7FFFFFFFu
+
+#define FEMTOSECONDS_PER_SECOND 1000000000000000ull
+
+typedef enum { HPET_TIMER_IDLE, HPET_TIMER_PERIODIC, HPET_TIMER_ONESHOT } HpetTimerMode;
+
+static volatile uint8_t *hpetBase = NULL;
+static uint64_t frequency = 0;
+static uint32_t numTimers = 0;
+static bool counter64 = false;
+
+// software extension of a 32-bit main counter
+static uint32_t lastLow = 0;
+static uint32_t highWord = 0;
+
+static HpetTimerMode timerMode = HPET_TIMER_IDLE;
+static bool legacyRouted = false;
+static TimerEventCallback timerCallback = NULL;
+
+static inline uint32_t hpet_read(uint32_t reg) {
+  return *(volatile uint32_t *)(hpetBase + reg);
+}
+
+static inline void hpet_write(uint32_t reg, uint32_t value) {
+  *(volatile uint32_t *)(hpetBase + reg) = value;
+}
+
+// the counter is only written while it is halted
+static void hpet_set_enabled(bool enabled) {
+  uint32_t config = hpet_read(HPET_REG_CONFIG);
+  if (enabled) {
+    config |= HPET_CFG_ENABLE;
+  } else {
+    config &= ~HPET_CFG_ENABLE;
+  }
+  hpet_write(HPET_REG_CONFIG, config);
+}
+
+// legacy replacement routes comparator 0 to IRQ0 instead of the PIT
+static void hpet_set_legacy_route(bool enabled) {
+  uint32_t config = hpet_read(HPET_REG_CONFIG);
+  if (enabled) {
+    config |= HPET_CFG_LEGACY_ROUTE;
+    irq_unmask(IRQ_BASE + 0);
+  } else {
+    config &= ~HPET_CFG_LEGACY_ROUTE;
+  }
+  hpet_write(HPET_REG_CONFIG, config);
+  legacyRouted = enabled;
+}
+
+static uint64_t hpet_clock_read(void) { return hpet_counter(); }
+
+static ClockSource hpetClockSource = {
+    .name = "hpet", .read = hpet_clock_read, .frequency = 0, .rating = 250};
+
+static EventSource hpetEventSource = {.name = "hpet",
+                                      .rating = 50,
+                                      .usesIrq0 = true,
+                                      .startPeriodic = hpet_timer_periodic,
+                                      .oneshotUs = hpet_timer_oneshot_us};
+
+bool hpet_init(void) {
+  if (hpetBase != NULL) {
+    return true;
+  }
+  const AcpiHpetTable *table = (const AcpiHpetTable *)acpi_find_table("HPET");
+  // only memory mapped HPETs below 4 GiB are reachable
+  if (table == NULL || table->baseAddress.addressSpaceId != 0 ||
+      (table->baseAddress.address >> 32) != 0) {
+    return false;
+  }
+  hpetBase = (volatile uint8_t *)(uintptr_t)table->baseAddress.address;
+
+  uint32_t capabilities = hpet_read(HPET_REG_CAPABILITIES);
+  uint32_t periodFs = hpet_read(HPET_REG_CAPABILITIES + 4);
+  if (periodFs == 0 || periodFs > 100000000u) {
+    // the specification caps the period at 100 ns
+    hpetBase = NULL;
+    return false;
+  }
+  frequency = FEMTOSECONDS_PER_SECOND / periodFs;
+  numTimers = HPET_CAP_NUM_TIMERS(capabilities);
+  counter64 = (capabilities & HPET_CAP_COUNT_64BIT) != 0;
+
+  // start the main counter from zero with all comparators disabled
+  hpet_set_enabled(false);
+  hpet_set_legacy_route(false);
+  for (uint32_t i = 0; i < numTimers; i++) {
+    uint32_t config = hpet_read(HPET_REG_TIMER_CONFIG(i));
+    hpet_write(HPET_REG_TIMER_CONFIG(i), config & ~HPET_TN_INT_ENABLE);
+  }
+  hpet_write(HPET_REG_COUNTER, 0);
+  hpet_write(HPET_REG_COUNTER + 4, 0);
+  hpet_set_enabled(true);
+
+  hpetClockSource.frequency = frequency;
+  clocksource_register(&hpetClockSource);
+  eventsource_register(&hpetEventSource);
+  return true;
+}
+
+bool hpet_available(void) { return hpetBase != NULL; }
+
+uint64_t hpet_frequency(void) { return frequency; }
+
+uint32_t hpet_timer_count(void) { return numTimers; }
+
+uint64_t hpet_counter(void) {
+  if (hpetBase == NULL) {
+    return 0;
+  }
+
+  if (counter64) {
+    // read high, low, high again so a carry between the halves is detected
+    uint32_t high, low, check;
+    do {
+      high = hpet_read(HPET_REG_COUNTER + 4);
+      low = hpet_read(HPET_REG_COUNTER);
+      check = hpet_read(HPET_REG_COUNTER + 4);
+    } while (high != check);
+    return ((uint64_t)high << 32) | low;
+  }
+
+  // 32-bit counter: count wrap-arounds, which requires a read at least once
+  // per wrap period (the system tick takes care of that)
+  uint32_t flags = irq_save();
+  uint32_t low = hpet_read(HPET_REG_COUNTER);
+  if (low < lastLow) {
+    highWord++;
+  }
+  lastLow = low;
+  uint64_t value = ((uint64_t)highWord << 32) | low;
+  irq_restore(flags);
+  return value;
+}
+
+bool hpet_timer_periodic(uint32_t hz, TimerEventCallback callback) {
+  if (hpetBase == NULL || hz == 0 || callback == NULL) {
+    return false;
+  }
+  uint32_t config = hpet_read(HPET_REG_TIMER_CONFIG(0));
+  if (!(config & HPET_TN_PERIODIC_CAP)) {
+    return false;
+  }
+  uint32_t delta = (uint32_t)(frequency / hz);
+  if (delta < HPET_MIN_DELTA) {
+    delta = HPET_MIN_DELTA;
+  }
+
+  timerCallback = callback;
+  timerMode = HPET_TIMER_PERIODIC;
+
+  // with SETVAL the first comparator write sets the next expiry and the
+  // second one the period; the counter is halted so both land in time
+  hpet_set_enabled(false);
+  uint32_t now = hpet_read(HPET_REG_COUNTER);
+  hpet_write(HPET_REG_TIMER_CONFIG(0), config | HPET_TN_INT_ENABLE |
+                                           HPET_TN_PERIODIC | HPET_TN_SETVAL |
+                                           HPET_TN_32BIT);
+  hpet_write(HPET_REG_TIMER_COMPARATOR(0), now + delta);
+  hpet_write(HPET_REG_TIMER_COMPARATOR(0), delta);
+  hpet_set_legacy_route(true);
+  hpet_set_enabled(true);
+  return true;
+}
+
+bool hpet_timer_oneshot_us(uint32_t us, TimerEventCallback callback) {
+  if (hpetBase == NULL || callback == NULL ||
+      timerMode == HPET_TIMER_PERIODIC) {
+    return false;
+  }
+  // the legacy route would disconnect a PIT driven tick from IRQ0
+  const EventSource *tick = eventsource_tick();
+  if (tick != NULL && tick->usesIrq0 && tick != &hpetEventSource) {
+    return false;
+  }
+  uint64_t ticks = (frequency * us) / 1000000u;
+  uint32_t delta = ticks > HPET_MAX_DELTA ? HPET_MAX_DELTA : (uint32_t)ticks;
+  if (delta < HPET_MIN_DELTA) {
+    delta = HPET_MIN_DELTA;
+  }
+
+  timerCallback = callback;
+  timerMode = HPET_TIMER_ONESHOT;
+
+  uint32_t config = hpet_read(HPET_REG_TIMER_CONFIG(0));
+  config &= ~HPET_TN_PERIODIC;
+  hpet_write(HPET_REG_TIMER_CONFIG(0),
+             config | HPET_TN_INT_ENABLE | HPET_TN_32BIT);
+  hpet_set_legacy_route(true);
+
+  // if the counter already passed the comparator the match would only come
+  // after a full wrap, so retry with a larger delta
+  for (;;) {
+    uint32_t target = hpet_read(HPET_REG_COUNTER) + delta;
+    hpet_write(HPET_REG_TIMER_COMPARATOR(0), target);
+    if ((int32_t)(target - hpet_read(HPET_REG_COUNTER)) > 0) {
+      break;
+    }
+    delta = delta > HPET_MAX_DELTA / 2 ? HPET_MAX_DELTA : delta * 2;
+  }
+  return true;
+}
+
+void hpet_timer_stop(void) {
+  if (hpetBase == NULL) {
+    return;
+  }
+  uint32_t config = hpet_read(HPET_REG_TIMER_CONFIG(0));
+  hpet_write(HPET_REG_TIMER_CONFIG(0),
+             config & ~(HPET_TN_INT_ENABLE | HPET_TN_PERIODIC));
+  hpet_set_legacy_route(false);
+  timerMode = HPET_TIMER_IDLE;
+  timerCallback = NULL;
+}
+
+bool hpet_owns_irq0(void) { return legacyRouted; }
+
+void hpet_irq(void) {
+  // edge triggered, but clearing the status bit keeps level mode working too
+  hpet_write(HPET_REG_INT_STATUS, 1);
+
+  TimerEventCallback callback = timerCallback;
+  if (timerMode == HPET_TIMER_ONESHOT) {
+    timerMode = HPET_TIMER_IDLE;
+    timerCallback = NULL;
+  }
+  if (callback != NULL) {
+    callback();
+  }
+}
@@ -0,0 +1,91 @@
+#ifndef HPET_H
+#define HPET_H
+
+/**
+ * @file hpet.h
+ * @brief High Precision Event Timer driver.
+ *
+ * The HPET is discovered through its ACPI table. Its main counter is exposed
+ * as a 64-bit monotonic clock source, and comparator 0 is used as an event
+ * source. Comparator interrupts are delivered through the legacy replacement
+ * route (IRQ0), which takes over the line of the PIT.
+ */
+
+#include "time.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Finds, enables and registers the HPET.
+ *
+ * @return true If an HPET was found and its main counter is running.
+ * @details Registers the HPET as a clock source and as an event source with
+ * the time module.
+ */
+bool hpet_init(void);
+
+/**
+ * @brief Checks whether an HPET has been initialized.
+ *
+ * @return true If hpet_init() succeeded.
+ */
+bool hpet_available(void);
+
+/**
+ * @brief Reads the 64-bit main counter.
+ *
+ * @return uint64_t The counter value (extended in software on 32-bit HPETs).
+ */
+uint64_t hpet_counter(void);
+
+/**
+ * @brief Returns the main counter frequency.
+ *
+ * @return uint64_t Counter ticks per second.
+ */
+uint64_t hpet_frequency(void);
+
+/**
+ * @brief Returns the number of comparators the HPET provides.
+ *
+ * @return uint32_t Number of timers.
+ */
+uint32_t hpet_timer_count(void);
+
+/**
+ * @brief Starts comparator 0 as a periodic timer.
+ *
+ * @param hz The interrupt frequency.
+ * @param callback Called on every period.
+ * @return true If comparator 0 is periodic capable and was started.
+ */
+bool hpet_timer_periodic(uint32_t hz, TimerEventCallback callback);
+
+/**
+ * @brief Arms comparator 0 to fire once after @p us microseconds.
+ *
+ * @param us The delay in microseconds. Delays beyond 2^31 - 1 ticks of the
+ * 32-bit comparator (about 150 s at 14.3 MHz) are cut to that.
+ * @param callback Called once on expiry.
+ * @return true If the timer was armed, false if it runs a periodic tick.
+ */
+bool hpet_timer_oneshot_us(uint32_t us, TimerEventCallback callback);
+
+/**
+ * @brief Stops comparator 0 and releases the IRQ0 line.
+ */
+void hpet_timer_stop(void);
+
+/**
+ * @brief Checks whether the HPET currently owns IRQ0.
+ *
+ * @return true If legacy replacement routing is active.
+ */
+bool hpet_owns_irq0(void);
+
+/**
+ * @brief HPET comparator 0 interrupt handler.
+ */
+void hpet_irq(void);
+
+#endif
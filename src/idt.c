@@ -1,5 +1,6 @@
 #include "idt.h"
-#include "io.h"
+#include "ioapic.h"
+#include "pic.h"
 #include "printOS.h"
 #include "str.h"
 #include "terminal.h"
@@ -11,122 +12,70 @@ IdtEntry idtEntries[256];
 // the descriptor of our idt
 IdtDescriptor idtDescriptor;
 
-// These are all the stubs generated in our interrupts_stubs.asm file
-extern void isr0();
-extern void isr1();
-extern void isr2();
-extern void isr3();
-extern void isr4();
-extern void isr5();
-extern void isr6();
-extern void isr7();
-extern void isr8();
-extern void isr9();
-extern void isr10();
-extern void isr11();
-extern void isr12();
-extern void isr13();
-extern void isr14();
-extern void isr15();
-extern void isr16();
-extern void isr17();
-extern void isr18();
-extern void isr19();
-extern void isr20();
-extern void isr21();
-extern void isr22();
-extern void isr23();
-extern void isr24();
-extern void isr25();
-extern void isr26();
-extern void isr27();
-extern void isr28();
-extern void isr29();
-extern void isr30();
-extern void isr31();
-extern void isr32(); // PIT timer interrupt
-extern void isr33(); // Keyboard interrupt
-
-// a list of all the cpu interrupts. interrupt numbers: 0-31
-void *isrStubTable[32] = {
-    isr0,  isr1,  isr2,  isr3,  isr4,  isr5,  isr6,  isr7,  isr8,  isr9,  isr10,
-    isr11, isr12, isr13, isr14, isr15, isr16, isr17, isr18, isr19, isr20, isr21,
-    isr22, isr23, isr24, isr25, isr26, isr27, isr28, isr29, isr30, isr31};
+// the addresses of the stubs for all 256 vectors, generated in our
+// interrupts_stubs.asm file
+extern void *isrStubTable[256];
+
+// the lean hardware interrupt stubs for vectors 32-255 (0 below)
+extern void *irqFastStubTable[256];
 
 // a function to return the interrupt with number i
 uint32_t getStubAddr(int i) { return (uint32_t)isrStubTable[i]; }
 
-// initialize the programmable interrupt controller
-void pic_init() {
-  // send bytes to PICs Command-Ports to start configuration
-  outb(0x20, 0x11);
-  outb(0xA0, 0x11);
-  ioWait();
-  // send bytes to PICs Data_ports to set the offset for our interrupt-Numbers
-  // so they dont overlap with our cpu interrupts (new interrupts are from 32
-  // onward) send bytes for offset to not overlap with cpu interrupts, to the
-  outb(0x21, 0x20);
-  outb(0xA1, 0x28);
-  ioWait();
-  // configure Cascading
-  outb(0x21, 0x04);
-  outb(0xA1, 0x02);
-  ioWait();
-  // set mode
-  outb(0x21, 0x01);
-  outb(0xA1, 0x01);
-  ioWait();
-
-  // mask all interrupts except 33 for keyboard and 32 for PIT timer
-  outb(0x21, 0xFC);
-  outb(0xA1, 0xFF);
-  ioWait();
+// points the IDT entry of a vector to a ring 0 interrupt gate for handler
+static void idtSetGate(int vector, uint32_t addr) {
+  idtEntries[vector].lowerBase = addr & 0xFFFF;
+  idtEntries[vector].higherBase = (addr >> 16) & 0xFFFF;
+  idtEntries[vector].kernelCodeSegment = 0x08;
+  idtEntries[vector].zero = 0;
+  idtEntries[vector].typeAttribute = 0x8E;
 }
 
 void idtInit() {
-  // setup our pic
+  // setup our pic, all lines stay masked until a handler is registered
   pic_init();
-
-  // for each cpu interrupt 0-31 map it to our stub, that then calls our
-  // isrHandler function
-  for (int i = 0; i < 32; i++) {
-    uint32_t addr = getStubAddr(i);
-    uint16_t lowerBase = addr & 0xFFFF;
-    uint16_t higherBase = (addr >> 16) & 0xFFFF;
-    idtEntries[i].lowerBase = lowerBase;
-    idtEntries[i].higherBase = higherBase;
-    idtEntries[i].kernelCodeSegment = 0x08;
-    idtEntries[i].zero = 0;
-    idtEntries[i].typeAttribute = 0x8E;
+  // route through the IOAPIC and Local APIC instead if the MADT has one
+  ioapic_init();
+
+  // map the exceptions to the full stubs, that then call our isrHandler
+  // function, and hardware interrupts to the lean stubs. Both dispatch to
+  // whatever was registered with irq_register()
+  for (int i = 0; i < 256; i++) {
+    idtSetGate(i, i < 32 ? getStubAddr(i) : (uint32_t)irqFastStubTable[i]);
   }
-  // map our isr32 (PIT timer) to vector 32
-  uint32_t addr32 = (uint32_t)isr32;
-  uint16_t lowerBase32 = addr32 & 0xFFFF;
-  uint16_t higherBase32 = (addr32 >> 16) & 0xFFFF;
-  idtEntries[32].lowerBase = lowerBase32;
-  idtEntries[32].higherBase = higherBase32;
-  idtEntries[32].kernelCodeSegment = 0x08;
-  idtEntries[32].zero = 0;
-  idtEntries[32].typeAttribute = 0x8E;
-  // map our isr33 keyboard interrupt to use the stub, that then calls our
-  // isrHandler function
-  uint32_t addr = (uint32_t)isr33;
-  uint16_t lowerBase = addr & 0xFFFF;
-  uint16_t higherBase = (addr >> 16) & 0xFFFF;
-  idtEntries[33].lowerBase = lowerBase;
-  idtEntries[33].higherBase = higherBase;
-  idtEntries[33].kernelCodeSegment = 0x08;
-  idtEntries[33].zero = 0;
-  idtEntries[33].typeAttribute = 0x8E;
 
   // generate the idtDescriptor
   idtDescriptor.base = (uint32_t)&idtEntries;
   idtDescriptor.limit = (sizeof(IdtEntry) * 256) - 1;
 
+  idtLoad();
+}
+
+void idtLoad() {
   // set idt descriptor to be used by cpu
   __asm__ volatile("lidt (%0)" : : "r"(&idtDescriptor) : "memory");
 }
 
+void idtSetUserGate(int vector, uint32_t addr) {
+  if (vector >= 32 && vector < 256) {
+    idtSetGate(vector, addr);
+    // present, DPL 3, 32-bit interrupt gate
+    idtEntries[vector].typeAttribute = 0xEE;
+  }
+}
+
+void idtUseFullEntry(int vector) {
+  if (vector >= 32 && vector < 256) {
+    idtSetGate(vector, getStubAddr(vector));
+  }
+}
+
+void idtUseFastEntry(int vector) {
+  if (vector >= 32 && vector < 256) {
+    idtSetGate(vector, (uint32_t)irqFastStubTable[vector]);
+  }
+}
+
 // Prints the currently loaded IDT information read from the CPU
 void printIdtInfo() {
   // Struct to load current IDT info into
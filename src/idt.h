@@ -40,6 +40,39 @@ typedef struct IdtDescriptorStruct {
  */
 void idtInit();
 
+/**
+ * @brief Loads the IDT built by idtInit() on the calling CPU.
+ *
+ * @details Application processors share the BSP's IDT.
+ */
+void idtLoad();
+
+/**
+ * @brief Points a vector at an entry stub that ring 3 may call with `int`.
+ *
+ * @param vector The interrupt vector, 32-255.
+ * @param addr Address of the stub.
+ * @details Other gates raise a general protection fault when a program
+ * uses `int` on them.
+ */
+void idtSetUserGate(int vector, uint32_t addr);
+
+/**
+ * @brief Routes a vector through the full entry stub.
+ *
+ * @param vector The interrupt vector, 32-255.
+ * @details The full stub saves all registers and hands a ::registers_t frame
+ * to the handlers, e.g. for system calls.
+ */
+void idtUseFullEntry(int vector);
+
+/**
+ * @brief Routes a vector through the lean hardware interrupt stub (default).
+ *
+ * @param vector The interrupt vector, 32-255.
+ */
+void idtUseFastEntry(int vector);
+
 /**
  * @brief Prints information about the IDT.
  *
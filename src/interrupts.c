@@ -1,100 +1,355 @@
-#include "keyboard.h"
-#include "io.h"
+#include "interrupts.h"
+#include "cpu.h"
+#include "idt.h"
+#include "ioapic.h"
+#include "lapic.h"
+#include "percpu.h"
+#include "pic.h"
 #include "printOS.h"
-#include "register.h"
-#include "shutdown.h"
+#include "sched.h"
+#include "softirq.h"
+#include "str.h"
 #include "terminal.h"
 #include "time.h"
+#include "user.h"
 #include <stddef.h>
 #include <stdint.h>
 
-// defines the command ports for programmable interrupts controllers (master,
-// slave) and the end of interrupt value
-#define PIC1_COMMAND_PORT 0x20
-#define PIC2_COMMAND_PORT 0xA0 // For Slave PIC EOI
-#define PIC_EOI 0x20
+// upper bound of handlers over all vectors, enough for every driver we have
+// plus a few shared lines
+#define IRQ_MAX_ACTIONS 64
 
-// Static variable to track extended key sequences (0xE0 prefix)
-// Two-byte sequence expected for extended keys
-static bool extended_key = false;
+/**
+ * @brief One registered handler, linked into the chain of its vector.
+ */
+typedef struct IrqAction {
+  IrqHandler handler;
+  void *ctx;
+  struct IrqAction *next;
+} IrqAction;
 
-// send whenever a interrupt was handled for the controller to know that the
-// next is wanted
-void pic_send_eoi(uint8_t irq) {
-  if (irq >= 8) {
-    outb(PIC2_COMMAND_PORT, PIC_EOI); // EOI to Slave Command Port
+/**
+ * @brief What the dispatcher calls for a vector.
+ *
+ * For a single handler this is the handler itself, for a shared vector it is
+ * irq_chain() with the first action as context.
+ */
+typedef struct {
+  IrqHandler handler;
+  void *ctx;
+} IrqVector;
+
+static IrqVector irqVectors[IRQ_VECTOR_COUNT];
+static IrqAction *irqChains[IRQ_VECTOR_COUNT];
+static IrqAction irqActionPool[IRQ_MAX_ACTIONS];
+static IrqStats irqStats[IRQ_VECTOR_COUNT];
+static const char *irqNames[IRQ_VECTOR_COUNT];
+
+// messages of the exceptions that halt the system, NULL ones are ignored
+static const char *const exceptionMessages[32] = {
+    [0] = "!! DIVIDE BY ZERO !! System Halted.",
+    [8] = "!!! DOUBLE FAULT !!! System Halted.",
+    [13] = "!! GENERAL PROTECTION FAULT !! System Halted.",
+    [14] = "!! PAGE FAULT (Not Handled) !! System Halted.",
+};
+
+// calls every handler of a shared vector
+static void irq_chain(registers_t *regs, void *ctx) {
+  for (IrqAction *action = ctx; action != NULL; action = action->next) {
+    action->handler(regs, action->ctx);
   }
-  outb(PIC1_COMMAND_PORT, PIC_EOI); // EOI to Master Command Port
 }
 
-void isrHandler(registers_t *regs) {
+// points the dispatch entry at the single handler or at the chain walker
+static void irq_update_vector(uint8_t vector) {
+  IrqAction *head = irqChains[vector];
+  if (head == NULL) {
+    irqVectors[vector].handler = NULL;
+    irqVectors[vector].ctx = NULL;
+  } else if (head->next == NULL) {
+    irqVectors[vector].handler = head->handler;
+    irqVectors[vector].ctx = head->ctx;
+  } else {
+    irqVectors[vector].handler = irq_chain;
+    irqVectors[vector].ctx = head;
+  }
+}
 
-  // Handle interrupt based on number
-  switch (regs->int_no) {
-  case 0: // Divide By Zero
-    screenWriteLine("!! DIVIDE BY ZERO !! System Halted.", 0);
-    __asm__ volatile("cli; hlt");
-    break;
+void irq_mask(uint8_t vector) {
+  if (!irq_is_isa_vector(vector)) {
+    return;
+  }
+  if (ioapic_active()) {
+    ioapic_mask_isa(vector - IRQ_BASE);
+  } else {
+    pic_mask(vector - IRQ_BASE);
+  }
+}
 
-  case 8: // Double Fault
-    screenWriteLine("!!! DOUBLE FAULT !!! System Halted.", 0);
-    __asm__ volatile("cli; hlt");
-    break;
+void irq_unmask(uint8_t vector) {
+  if (!irq_is_isa_vector(vector)) {
+    return;
+  }
+  if (ioapic_active()) {
+    ioapic_unmask_isa(vector - IRQ_BASE);
+  } else {
+    pic_unmask(vector - IRQ_BASE);
+  }
+}
 
-  case 13: // General Protection Fault
-    screenWriteLine("!! GENERAL PROTECTION FAULT !! System Halted.", 0);
-    // TODO: Print more debug info (err_code, EIP, CS etc. from regs)
-    __asm__ volatile("cli; hlt");
-    break;
+const char *irq_controller_name(void) {
+  return ioapic_active() ? "IOAPIC" : "8259 PIC";
+}
 
-  case 14: // Page Fault
-    screenWriteLine("!! PAGE FAULT (Not Handled) !! System Halted.", 0);
-    // TODO: Implement page fault handler
-    __asm__ volatile("cli; hlt");
-    break;
+bool irq_register(uint8_t vector, IrqHandler handler, void *ctx) {
+  if (handler == NULL) {
+    return false;
+  }
 
-  case 32: // PIT timer tick (IRQ0 after remap)
-      timer_irq();
+  uint32_t flags = irq_save();
+  IrqAction *action = NULL;
+  for (int i = 0; i < IRQ_MAX_ACTIONS; i++) {
+    if (irqActionPool[i].handler == NULL) {
+      action = &irqActionPool[i];
       break;
+    }
+  }
+  if (action == NULL) {
+    irq_restore(flags);
+    return false;
+  }
 
-  case 33: // Keyboard Interrupt (IRQ 1, after remap interrupt number 33)
-  {
-    uint8_t scancode = inb(0x60); // Read scan code of pressed key
+  action->handler = handler;
+  action->ctx = ctx;
+  action->next = NULL;
+  IrqAction **tail = &irqChains[vector];
+  while (*tail != NULL) {
+    tail = &(*tail)->next;
+  }
+  *tail = action;
+  irq_update_vector(vector);
 
-    // Check for extended key prefix (0xE0)
-    if (scancode == 0xE0) {
-      extended_key = true;
-      break; // Wait for the next byte
-    }
-    
-    // Handle key release codes (high bit set)
-    if (scancode & 0x80) {
-      extended_key = false; // Reset extended key flag on key release
-      break; // Ignore key release events
+  irq_unmask(vector);
+  irq_restore(flags);
+  return true;
+}
+
+void irq_unregister(uint8_t vector, IrqHandler handler, void *ctx) {
+  uint32_t flags = irq_save();
+  for (IrqAction **link = &irqChains[vector]; *link != NULL;
+       link = &(*link)->next) {
+    IrqAction *action = *link;
+    if (action->handler == handler && action->ctx == ctx) {
+      *link = action->next;
+      action->handler = NULL;
+      break;
     }
-    
-    // Handle extended keys
-    if (extended_key) {
-      switch (scancode) {
-        case 0x48: keyBufferPut(KEY_ARROW_UP); break;
-        case 0x50: keyBufferPut(KEY_ARROW_DOWN); break;
-        case 0x4B: keyBufferPut(KEY_ARROW_LEFT); break;
-        case 0x4D: keyBufferPut(KEY_ARROW_RIGHT); break;
-        default: break; // Ignore unhandled extended keys
-      }
-      extended_key = false;
+  }
+  irq_update_vector(vector);
+
+  if (irqChains[vector] == NULL) {
+    irq_mask(vector);
+  }
+  irq_restore(flags);
+}
+
+void irq_set_name(uint8_t vector, const char *name) { irqNames[vector] = name; }
+
+void irq_get_stats(uint8_t vector, IrqStats *out) {
+  // the 64-bit fields are updated from interrupt context
+  uint32_t flags = irq_save();
+  *out = irqStats[vector];
+  irq_restore(flags);
+}
+
+// docs see header file
+void irq_unhandled(uint8_t vector, registers_t *regs) {
+  if (vector < 32 && regs != NULL && (regs->cs & 3) != 0) {
+    user_fault(vector);
+  }
+  if (vector < 32 && exceptionMessages[vector] != NULL) {
+    screenWriteLine(exceptionMessages[vector], 0);
+    // TODO: Print more debug info (err_code, EIP, CS etc. from regs)
+    __asm__ volatile("cli; hlt");
+  }
+}
+
+// shared by both entry paths, regs is NULL on the fast path
+static inline __attribute__((always_inline)) void
+irq_dispatch(uint8_t vector, registers_t *regs) {
+  const IrqVector *entry = &irqVectors[vector];
+  if (vector >= IRQ_BASE) {
+    this_cpu_inc(irqs);
+    sched_irq_enter();
+  }
+  if (irqsoffTracing && vector >= IRQ_BASE) {
+    irqsoff_irq_enter(vector);
+  }
+  uint64_t start = rdtsc();
+  if (entry->handler != NULL) {
+    entry->handler(regs, entry->ctx);
+  } else {
+    irq_unhandled(vector, regs);
+  }
+  uint64_t cycles = rdtsc() - start;
+
+  IrqStats *stats = &irqStats[vector];
+  stats->count++;
+  stats->cycles += cycles;
+  if (cycles > stats->maxCycles) {
+    stats->maxCycles = cycles;
+  }
+
+  // ISA IRQs need their end of interrupt, whether a handler was there or not
+  if (irq_is_isa_vector(vector)) {
+    if (ioapic_active()) {
+      lapic_eoi();
     } else {
-      // Handle normal keys
-      keyBufferPut((KeyCode)scancode);
+      pic_send_eoi(vector - IRQ_BASE);
     }
-  } break;
+  }
 
-  default:
-    break;
+  // the deferred part of the work runs with interrupts enabled again, only
+  // on the way out of a hardware IRQ: an exception may have been taken in a
+  // section that runs with interrupts disabled
+  if (vector >= IRQ_BASE) {
+    softirq_run();
   }
 
-  // Check if the interrupt number is in the range of hardware IRQs (32-47)
-  if (regs->int_no >= 32 && regs->int_no < 48) {
-    pic_send_eoi(regs->int_no - 32); // Calculate IRQ number and send EOI
+  // iret enables interrupts again
+  if (irqsoffTracing && vector >= IRQ_BASE) {
+    irqsoff_irq_exit(vector);
+  }
+
+  // preemption: the interrupted thread resumes here when it runs again
+  if (vector >= IRQ_BASE) {
+    sched_irq_exit();
+  }
+}
+
+void isrHandler(registers_t *regs) { irq_dispatch(regs->int_no & 0xFF, regs); }
+
+void irqFastHandler(uint32_t vector) { irq_dispatch(vector & 0xFF, NULL); }
+
+static void irq_bench_handler(registers_t *regs, void *ctx) {
+  (void)regs;
+  (void)ctx;
+}
+
+static void irq_bench_raise_full(void) {
+  __asm__ volatile("int %0" : : "i"(IRQ_BENCH_FULL_VECTOR) : "memory");
+}
+
+static void irq_bench_raise_fast(void) {
+  __asm__ volatile("int %0" : : "i"(IRQ_BENCH_FAST_VECTOR) : "memory");
+}
+
+// times loops software interrupts, the call overhead is the same for both
+static void irq_bench_run(void (*raise)(void), uint32_t loops,
+                          IrqEntryBenchmark *result) {
+  result->min = UINT64_MAX;
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < loops; i++) {
+    uint64_t start = rdtsc();
+    raise();
+    uint64_t cycles = rdtsc() - start;
+    if (cycles < result->min) {
+      result->min = cycles;
+    }
+    total += cycles;
+  }
+  result->avg = total / loops;
+}
+
+// docs see header file
+void irq_entry_benchmark(uint32_t loops, IrqEntryBenchmark *full,
+                         IrqEntryBenchmark *fast) {
+  full->avg = full->min = 0;
+  fast->avg = fast->min = 0;
+  if (loops == 0) {
+    return;
+  }
+
+  irq_register(IRQ_BENCH_FULL_VECTOR, irq_bench_handler, NULL);
+  irq_register(IRQ_BENCH_FAST_VECTOR, irq_bench_handler, NULL);
+  irq_set_name(IRQ_BENCH_FULL_VECTOR, "bench-full");
+  irq_set_name(IRQ_BENCH_FAST_VECTOR, "bench-fast");
+  idtUseFullEntry(IRQ_BENCH_FULL_VECTOR);
+
+  irq_bench_run(irq_bench_raise_full, loops, full);
+  irq_bench_run(irq_bench_raise_fast, loops, fast);
+
+  idtUseFastEntry(IRQ_BENCH_FULL_VECTOR);
+  irq_unregister(IRQ_BENCH_FULL_VECTOR, irq_bench_handler, NULL);
+  irq_unregister(IRQ_BENCH_FAST_VECTOR, irq_bench_handler, NULL);
+}
+
+// appends name left aligned in a field of width characters
+static void append_name(char *line, const char *name, size_t width) {
+  appendString(line, name);
+  for (size_t len = strlenOS(name); len < width; len++) {
+    appendString(line, " ");
+  }
+}
+
+static void append_vector_name(char *line, uint8_t vector) {
+  char name[16] = "";
+  if (irqNames[vector] != NULL) {
+    appendString(name, irqNames[vector]);
+  } else if (vector < 32) {
+    appendString(name, "exception");
+  } else if (irq_is_isa_vector(vector)) {
+    appendString(name, "irq");
+    appendDecimal(name, vector - IRQ_BASE, 0);
+  } else {
+    appendString(name, "-");
+  }
+  append_name(line, name, 14);
+}
+
+// docs see header file
+void printIrqStatsToTerminal(void) {
+  static IrqStats before[IRQ_VECTOR_COUNT];
+  uint64_t tscHz = tsc_hz();
+
+  // sample every counter over one second for the rates
+  for (int v = 0; v < IRQ_VECTOR_COUNT; v++) {
+    irq_get_stats((uint8_t)v, &before[v]);
+  }
+  uint64_t startTsc = rdtsc();
+  timer_sleep_ms(1000);
+  uint64_t elapsed = rdtsc() - startTsc;
+  if (elapsed == 0) {
+    elapsed = 1;
+  }
+
+  terminalWriteLine("  vec name               count      /s   avg cyc   max cyc     cpu");
+  for (int v = 0; v < IRQ_VECTOR_COUNT; v++) {
+    IrqStats now;
+    irq_get_stats((uint8_t)v, &now);
+    if (now.count == 0) {
+      continue;
+    }
+    uint64_t deltaCount = now.count - before[v].count;
+    uint64_t deltaCycles = now.cycles - before[v].cycles;
+    // the sample window is only close to one second, scale by the TSC
+    uint64_t rate = tscHz != 0 ? deltaCount * tscHz / elapsed : deltaCount;
+    // cpu share in hundredths of a percent
+    uint64_t share = deltaCycles * 10000u / elapsed;
+
+    char line[128] = "";
+    appendDecimal(line, (uint64_t)v, 5);
+    appendString(line, " ");
+    append_vector_name(line, (uint8_t)v);
+    appendDecimal(line, now.count, 10);
+    appendDecimal(line, rate, 8);
+    appendDecimal(line, now.cycles / now.count, 10);
+    appendDecimal(line, now.maxCycles, 10);
+    appendDecimal(line, share / 100, 4);
+    appendString(line, ".");
+    appendString(line, share % 100 < 10 ? "0" : "");
+    appendDecimal(line, share % 100, 0);
+    appendString(line, "%");
+    terminalWriteLine(line);
   }
 }
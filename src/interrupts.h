@@ -4,15 +4,179 @@
 /**
  * @file interrupts.h
  * @brief Interrupt handling functions and definitions.
+ *
+ * Every vector has an entry in a handler table. Drivers attach to a vector
+ * with irq_register(), the common stub then dispatches with a single
+ * indirect call. Several handlers on one vector (shared IRQ lines) are
+ * chained and called in registration order.
  */
 
 #include "register.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @brief Number of interrupt vectors of the IDT. */
+#define IRQ_VECTOR_COUNT 256
+
+/** @brief Vector of ISA IRQ0, the ISA IRQs 0-15 follow consecutively. */
+#define IRQ_BASE 32
+
+/** @brief Number of ISA IRQ lines. */
+#define IRQ_ISA_COUNT 16
+
+/**
+ * @brief Checks whether a vector is one of the ISA IRQs.
+ *
+ * @param vector The interrupt vector.
+ * @return true If the vector is IRQ_BASE + 0-15.
+ */
+static inline bool irq_is_isa_vector(uint32_t vector) {
+  return vector >= IRQ_BASE && vector < IRQ_BASE + IRQ_ISA_COUNT;
+}
+
+/**
+ * @brief An interrupt handler.
+ *
+ * @param regs The CPU registers at the time of the interrupt. NULL for
+ * vectors that enter through the fast path (all vectors from IRQ_BASE on,
+ * unless idtUseFullEntry() was called for them).
+ * @param ctx The context pointer given to irq_register().
+ */
+typedef void (*IrqHandler)(registers_t *regs, void *ctx);
+
+/**
+ * @brief Attaches a handler to an interrupt vector.
+ *
+ * @param vector The interrupt vector 0-255.
+ * @param handler The function to call for every interrupt on the vector.
+ * @param ctx Passed to handler unchanged.
+ * @return true If the handler was registered.
+ * @details If the vector already has handlers the new one is chained behind
+ * them. ISA IRQ vectors are unmasked automatically at the IOAPIC (or the
+ * 8259 PIC as fallback), and their end of interrupt is sent after all
+ * handlers ran. Handlers for other vectors (e.g. Local APIC) acknowledge the
+ * interrupt themselves.
+ */
+bool irq_register(uint8_t vector, IrqHandler handler, void *ctx);
+
+/**
+ * @brief Detaches a handler registered with irq_register().
+ *
+ * @param vector The interrupt vector 0-255.
+ * @param handler The handler to remove.
+ * @param ctx The context it was registered with.
+ * @details An ISA IRQ line is masked again once its last handler is removed.
+ */
+void irq_unregister(uint8_t vector, IrqHandler handler, void *ctx);
+
+/**
+ * @brief What happens on a vector without handler.
+ * @param vector The interrupt vector 0-255.
+ * @param regs The CPU registers, NULL on the fast path.
+ * @details Fatal exceptions halt, the rest is ignored. Exceptions from
+ * ring 3 only end the program that caused them. Exception handlers call
+ * this for the cases they cannot resolve.
+ */
+void irq_unhandled(uint8_t vector, registers_t *regs);
+
+/**
+ * @brief Masks the ISA IRQ line of a vector at the interrupt controller.
+ *
+ * @param vector An ISA IRQ vector, other vectors are ignored.
+ */
+void irq_mask(uint8_t vector);
+
+/**
+ * @brief Unmasks the ISA IRQ line of a vector at the interrupt controller.
+ *
+ * @param vector An ISA IRQ vector, other vectors are ignored.
+ */
+void irq_unmask(uint8_t vector);
+
+/**
+ * @brief Returns the name of the interrupt controller in use.
+ *
+ * @return const char* "IOAPIC" or "8259 PIC".
+ */
+const char *irq_controller_name(void);
+
+/**
+ * @brief Per-vector interrupt statistics, updated by isrHandler().
+ */
+typedef struct {
+  uint64_t count;     /**< Number of interrupts on the vector. */
+  uint64_t cycles;    /**< TSC cycles spent in its handlers in total. */
+  uint64_t maxCycles; /**< Longest single run of its handlers. */
+} IrqStats;
+
+/**
+ * @brief Gives a vector a name for irqstat.
+ *
+ * @param vector The interrupt vector 0-255.
+ * @param name A string that stays valid, e.g. "keyboard".
+ */
+void irq_set_name(uint8_t vector, const char *name);
+
+/**
+ * @brief Takes a consistent copy of the statistics of one vector.
+ *
+ * @param vector The interrupt vector 0-255.
+ * @param out Receives the statistics.
+ */
+void irq_get_stats(uint8_t vector, IrqStats *out);
+
+/**
+ * @brief Prints the per-vector interrupt statistics to the terminal.
+ *
+ * @details Samples all counters for one second to show per-second rates and
+ * the share of CPU time spent in each vector, then lists every vector that
+ * fired at least once since boot.
+ */
+void printIrqStatsToTerminal(void);
+
+/** @brief Vector the entry benchmark raises through the full path. */
+#define IRQ_BENCH_FULL_VECTOR 0xF0
+
+/** @brief Vector the entry benchmark raises through the fast path. */
+#define IRQ_BENCH_FAST_VECTOR 0xF1
+
+/**
+ * @brief Result of one entry path measurement, in TSC cycles.
+ */
+typedef struct {
+  uint64_t min; /**< Fastest round trip. */
+  uint64_t avg; /**< Average round trip. */
+} IrqEntryBenchmark;
+
+/**
+ * @brief Measures the round trip cost of both interrupt entry paths.
+ *
+ * @param loops Number of software interrupts per path.
+ * @param full Receives the cycles through isr_common_stub (pusha, segment
+ * reloads, register frame).
+ * @param fast Receives the cycles through the lean IRQ entry.
+ * @details Both vectors get an empty handler, so the difference is the cost
+ * of the entry and exit code alone.
+ */
+void irq_entry_benchmark(uint32_t loops, IrqEntryBenchmark *full,
+                         IrqEntryBenchmark *fast);
 
 /**
  * @brief Handles an interrupt service routine (ISR).
  *
  * @param regs The CPU registers at the time of the interrupt.
+ * @details Called by the full assembly stubs, which are used for the CPU
+ * exceptions and for vectors switched with idtUseFullEntry().
  */
 void isrHandler(registers_t *regs);
 
+/**
+ * @brief Handles a hardware interrupt that came in through the fast path.
+ *
+ * @param vector The interrupt vector.
+ * @details Called by the lean IRQ stubs, which only save the caller-clobbered
+ * registers and skip the segment reloads when interrupting kernel code.
+ */
+void irqFastHandler(uint32_t vector);
+
 #endif
@@ -1,76 +1,143 @@
-; interrupts.asm - Interrupt Service Routine (ISR) stubs for exceptions 0-31
+; interrupts.asm - Interrupt Service Routine (ISR) stubs for all 256 vectors,
+; plus lean entry stubs for hardware interrupts
 
-; Declare the C handler function as external so NASM knows it exists elsewhere.
+; Declare the C handler functions as external so NASM knows they exist elsewhere.
 extern isrHandler
-
-; --- Macros for creating ISR stubs ---
-
-; Macro for ISRs that DON'T push an error code onto the stack
-; %1: Interrupt number
-%macro ISR_NO_ERR_STUB 1
-  global isr%1         ; Make the label globally visible for the linker
-  isr%1:
+extern irqFastHandler
+extern syscall_sysenter_entry
+extern syscall_sysenter_stepping
+
+%define EFLAGS_TF 0x100
+
+; Kernel code keeps the per-CPU segment (percpu.h) in GS, an entry from
+; ring 3 finds it through the task register: each CPU's TSS selector lies
+; this far above its per-CPU selector (GDT_TSS_FIRST - GDT_PERCPU_FIRST
+; entries, see gdt.h)
+%define TSS_TO_PERCPU (16 * 8)
+
+; --- Generate one stub for every vector 0-255 ---
+; Only exceptions 8, 10-14, 17, 21, 29 and 30 get an error code from the CPU.
+; Everything else (including all hardware IRQs) pushes a dummy one, so the
+; stack frame always looks the same to isr_common_stub.
+
+section .text
+%assign vector 0
+%rep 256
+  global isr %+ vector ; Make the label globally visible for the linker
+  isr %+ vector:
     cli                ; Disable interrupts first
+  %if vector == 1
+    ; sysenter keeps the program's TF, the single step traps before the
+    ; sysenter stub switched stacks and ESP is still in the TSS, with no
+    ; room for the full stub. Resume without TF in the stub's variant that
+    ; remembers it, only the trap frame was pushed
+    cmp dword [esp], syscall_sysenter_entry
+    jne .debug_trap
+    mov dword [esp], syscall_sysenter_stepping
+    and dword [esp + 8], ~EFLAGS_TF
+    iret
+.debug_trap:
+  %endif
+  %if !(vector == 8 || (vector >= 10 && vector <= 14) || vector == 17 || vector == 21 || vector == 29 || vector == 30)
     push byte 0        ; Push a dummy error code (0) to make the stack frame consistent
-    push byte %1       ; Push the interrupt number
-    jmp isr_common_stub ; Jump to the common handler code
-%endmacro
-
-; Macro for ISRs that DO push an error code onto the stack (CPU does this)
-; %1: Interrupt number
-%macro ISR_ERR_STUB 1
-  global isr%1         ; Make the label globally visible
-  isr%1:
-    cli                ; Disable interrupts first
-    ; Error code is already pushed by the CPU
-    push byte %1       ; Push the interrupt number
+  %endif
+    push dword vector  ; Push the interrupt number (dword: vectors >= 128 would sign-extend as byte)
     jmp isr_common_stub ; Jump to the common handler code
-%endmacro
-
-; --- Generate the specific ISR stubs using the macros ---
-; Exceptions 0-31
-
-ISR_NO_ERR_STUB 0   ; 0: Divide By Zero Exception
-ISR_NO_ERR_STUB 1   ; 1: Debug Exception
-ISR_NO_ERR_STUB 2   ; 2: Non Maskable Interrupt Exception
-ISR_NO_ERR_STUB 3   ; 3: Breakpoint Exception
-ISR_NO_ERR_STUB 4   ; 4: Into Detected Overflow Exception
-ISR_NO_ERR_STUB 5   ; 5: Out of Bounds Exception
-ISR_NO_ERR_STUB 6   ; 6: Invalid Opcode Exception
-ISR_NO_ERR_STUB 7   ; 7: No Coprocessor Exception
-
-ISR_ERR_STUB    8   ; 8: Double Fault Exception (pushes an error code)
-
-ISR_NO_ERR_STUB 9   ; 9: Coprocessor Segment Overrun Exception
-
-ISR_ERR_STUB    10  ; 10: Bad TSS Exception (pushes an error code)
-ISR_ERR_STUB    11  ; 11: Segment Not Present Exception (pushes an error code)
-ISR_ERR_STUB    12  ; 12: Stack Fault Exception (pushes an error code)
-ISR_ERR_STUB    13  ; 13: General Protection Fault Exception (pushes an error code)
-ISR_ERR_STUB    14  ; 14: Page Fault Exception (pushes an error code)
-
-ISR_NO_ERR_STUB 15  ; 15: Reserved Exception
-
-ISR_NO_ERR_STUB 16  ; 16: Floating Point Exception (Math Fault)
-
-ISR_ERR_STUB    17  ; 17: Alignment Check Exception (pushes an error code)
-
-ISR_NO_ERR_STUB 18  ; 18: Machine Check Exception
-ISR_NO_ERR_STUB 19  ; 19: SIMD Floating Point Exception
-ISR_NO_ERR_STUB 20  ; 20: Virtualization Exception
-ISR_ERR_STUB    21  ; 21: Control Protection Exception (pushes an error code)
-ISR_NO_ERR_STUB 22  ; 22: Reserved
-ISR_NO_ERR_STUB 23  ; 23: Reserved
-ISR_NO_ERR_STUB 24  ; 24: Reserved
-ISR_NO_ERR_STUB 25  ; 25: Reserved
-ISR_NO_ERR_STUB 26  ; 26: Reserved
-ISR_NO_ERR_STUB 27  ; 27: Reserved
-ISR_NO_ERR_STUB 28  ; 28: Reserved
-ISR_ERR_STUB    29  ; 29: Reserved (Hypervisor Injection / AMD SVM)
-ISR_ERR_STUB    30  ; 30: Reserved (VMM Communication / AMD SVM Security)
-ISR_NO_ERR_STUB 31  ; 31: Reserved (Security / AMD SEV)
-ISR_NO_ERR_STUB 32  ; 32: PIT Timer
-ISR_NO_ERR_STUB 33  ; Keyboard Interrupt (IRQ 1 -> INT 33)
+  %assign vector vector + 1
+%endrep
+
+; --- Table of all stub addresses, indexed by vector, used by idt.c ---
+section .rodata
+align 4
+global isrStubTable
+isrStubTable:
+%assign vector 0
+%rep 256
+    dd isr %+ vector
+  %assign vector vector + 1
+%endrep
+
+; --- Fast entry stubs for hardware interrupts (vectors 32-255) ---
+; There is no error code to even out and the handlers do not look at the
+; interrupted registers, so only EAX (then used for the vector), ECX and EDX
+; are saved. The C code preserves the callee-saved registers itself.
+
+section .text
+%assign vector 32
+%rep 224
+  global irq %+ vector
+  irq %+ vector:
+    push eax           ; The gate already cleared IF, no cli needed
+    mov eax, vector
+    jmp irq_fast_common
+  %assign vector vector + 1
+%endrep
+
+; --- Table of the fast stubs, indexed by vector, 0 for the exceptions ---
+section .rodata
+align 4
+global irqFastStubTable
+irqFastStubTable:
+    times 32 dd 0
+%assign vector 32
+%rep 224
+    dd irq %+ vector
+  %assign vector vector + 1
+%endrep
+
+section .text
+align 16
+irq_fast_common:
+    ; 1. Save the rest of the caller-clobbered registers
+    push ecx
+    push edx
+
+    ; 2. Interrupted kernel code already runs on the kernel data segments,
+    ;    only an interrupt from ring 3 needs the reloads
+    mov ecx, ds
+    cmp cx, 0x10
+    jne .reload_segments
+
+    ; 3. Call the C handler with the vector as its only argument
+    push eax
+    call irqFastHandler
+    add esp, 4
+
+    ; 4. Restore and return
+    pop edx
+    pop ecx
+    pop eax
+    iret
+
+.reload_segments:
+    push ds
+    push es
+    push fs
+    push gs
+    cld                ; ring 3 may have left the direction flag set
+    mov cx, 0x10
+    mov ds, cx
+    mov es, cx
+    mov fs, cx
+    test byte [esp + 32], 3 ; CS of the interrupted code
+    jz .gs_loaded
+    str cx
+    sub cx, TSS_TO_PERCPU
+    mov gs, cx
+.gs_loaded:
+
+    push eax
+    call irqFastHandler
+    add esp, 4
+
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    pop edx
+    pop ecx
+    pop eax
+    iret
 
 ; --- The common stub called by all ISRs ---
 ; This part does the bulk of the work to save state and call the C handler
@@ -84,13 +151,19 @@ isr_common_stub:
     mov ax, ds         ; Get current data segment selector
     push eax           ; Push it onto the stack (use 32-bit push for alignment)
 
-    ; 3. Load kernel data segments into DS, ES, FS, GS
-    ; Assuming your kernel data segment selector is 0x10 from your GDT
+    ; 3. Load kernel data segments into DS and ES, and FS and the per-CPU
+    ;    GS when coming from ring 3. Kernel code already has them
+    cld                ; ring 3 may have left the direction flag set
     mov ax, 0x10
     mov ds, ax
     mov es, ax
+    test byte [esp + 48], 3 ; CS of the interrupted code
+    jz .kernel_entry
     mov fs, ax
+    str ax
+    sub ax, TSS_TO_PERCPU
     mov gs, ax
+.kernel_entry:
 
     ; 4. Prepare argument and call the C handler
     mov eax, esp       ; Get current stack pointer (points to saved registers/segments)
@@ -100,10 +173,13 @@ isr_common_stub:
 
     ; 5. Restore data segment registers
     pop eax            ; Pop the original data segment selector we saved into EAX
-    mov ds, ax         ; Restore DS, ES, FS, GS
+    mov ds, ax         ; Restore DS and ES, FS and GS too for ring 3
     mov es, ax
+    test byte [esp + 44], 3
+    jz .kernel_return
     mov fs, ax
     mov gs, ax
+.kernel_return:
 
     ; 6. Restore general purpose registers
     popa               ; Pops EDI, ESI, EBP, ESP, EBX, EDX, ECX, EAX
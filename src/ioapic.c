@@ -0,0 +1,160 @@
+#include "ioapic.h"
+#include "acpi.h"
+#include "cpu.h"
+#include "interrupts.h"
+#include "lapic.h"
+#include <stddef.h>
+
+// indirect register access: select with IOREGSEL, then read/write IOWIN
+#define IOAPIC_IOREGSEL 0x00
+#define IOAPIC_IOWIN 0x10
+
+#define IOAPIC_REG_VERSION 0x01
+#define IOAPIC_REG_REDIRECTION 0x10 // two 32-bit registers per entry
+
+// low dword of a redirection entry
+#define REDIR_ACTIVE_LOW (1u << 13)
+#define REDIR_LEVEL (1u << 15)
+#define REDIR_MASKED (1u << 16)
+
+/**
+ * @brief One IOAPIC in use.
+ */
+typedef struct {
+  volatile uint32_t *base;
+  uint32_t gsiBase;
+  uint32_t entries;
+} Ioapic;
+
+static Ioapic ioapics[ACPI_MAX_IOAPICS];
+static uint32_t numIoapics = 0;
+static bool active = false;
+static const AcpiMadtInfo *madt = NULL;
+
+static uint32_t ioapic_read(const Ioapic *ioapic, uint32_t reg) {
+  ioapic->base[IOAPIC_IOREGSEL / 4] = reg;
+  return ioapic->base[IOAPIC_IOWIN / 4];
+}
+
+static void ioapic_write(const Ioapic *ioapic, uint32_t reg, uint32_t value) {
+  ioapic->base[IOAPIC_IOREGSEL / 4] = reg;
+  ioapic->base[IOAPIC_IOWIN / 4] = value;
+}
+
+// finds the IOAPIC handling gsi and the pin on it
+static Ioapic *ioapic_for_gsi(uint32_t gsi, uint32_t *pin) {
+  for (uint32_t i = 0; i < numIoapics; i++) {
+    if (gsi >= ioapics[i].gsiBase &&
+        gsi < ioapics[i].gsiBase + ioapics[i].entries) {
+      *pin = gsi - ioapics[i].gsiBase;
+      return &ioapics[i];
+    }
+  }
+  return NULL;
+}
+
+static void ioapic_set_masked(uint32_t gsi, bool masked) {
+  uint32_t pin;
+  Ioapic *ioapic = ioapic_for_gsi(gsi, &pin);
+  if (ioapic == NULL) {
+    return;
+  }
+  uint32_t flags = irq_save();
+  uint32_t low = ioapic_read(ioapic, IOAPIC_REG_REDIRECTION + pin * 2);
+  low = masked ? low | REDIR_MASKED : low & ~REDIR_MASKED;
+  ioapic_write(ioapic, IOAPIC_REG_REDIRECTION + pin * 2, low);
+  irq_restore(flags);
+}
+
+// an identity mapped ISA IRQ loses its GSI to an IRQ overridden onto it,
+// e.g. IRQ0 usually lands on GSI 2, where the unused cascade IRQ2 would be
+static bool isa_gsi_taken(uint8_t irq) {
+  for (uint8_t other = 0; other < ACPI_ISA_IRQS; other++) {
+    if (other != irq && madt->isaGsi[other] != other &&
+        madt->isaGsi[other] == madt->isaGsi[irq]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool isa_gsi_lost(uint8_t irq) {
+  return madt->isaGsi[irq] == irq && isa_gsi_taken(irq);
+}
+
+bool ioapic_init(void) {
+  if (active) {
+    return true;
+  }
+  madt = acpi_madt();
+  if (madt == NULL || madt->ioapicCount == 0 || !lapic_init()) {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < madt->ioapicCount; i++) {
+    Ioapic *ioapic = &ioapics[numIoapics++];
+    ioapic->base = (volatile uint32_t *)(uintptr_t)madt->ioapics[i].address;
+    ioapic->gsiBase = madt->ioapics[i].gsiBase;
+    ioapic->entries =
+        ((ioapic_read(ioapic, IOAPIC_REG_VERSION) >> 16) & 0xFF) + 1;
+    for (uint32_t pin = 0; pin < ioapic->entries; pin++) {
+      ioapic_write(ioapic, IOAPIC_REG_REDIRECTION + pin * 2, REDIR_MASKED);
+      ioapic_write(ioapic, IOAPIC_REG_REDIRECTION + pin * 2 + 1, 0);
+    }
+  }
+
+  // the ISA IRQs keep their PIC vectors, so drivers do not notice the switch
+  for (uint8_t irq = 0; irq < ACPI_ISA_IRQS; irq++) {
+    if (isa_gsi_lost(irq)) {
+      continue;
+    }
+    ioapic_route(madt->isaGsi[irq], (uint8_t)(IRQ_BASE + irq),
+                 madt->isaFlags[irq], true);
+  }
+  active = true;
+  return true;
+}
+
+bool ioapic_active(void) { return active; }
+
+bool ioapic_route(uint32_t gsi, uint8_t vector, uint16_t flags, bool masked) {
+  uint32_t pin;
+  Ioapic *ioapic = ioapic_for_gsi(gsi, &pin);
+  if (ioapic == NULL) {
+    return false;
+  }
+
+  // fixed delivery, physical destination
+  uint32_t low = vector;
+  if ((flags & ACPI_MADT_POLARITY_MASK) == ACPI_MADT_POLARITY_LOW) {
+    low |= REDIR_ACTIVE_LOW;
+  }
+  if ((flags & ACPI_MADT_TRIGGER_MASK) == ACPI_MADT_TRIGGER_LEVEL) {
+    low |= REDIR_LEVEL;
+  }
+  if (masked) {
+    low |= REDIR_MASKED;
+  }
+
+  uint32_t irqFlags = irq_save();
+  // mask while changing, the entry must never be half written and live
+  ioapic_write(ioapic, IOAPIC_REG_REDIRECTION + pin * 2, REDIR_MASKED);
+  ioapic_write(ioapic, IOAPIC_REG_REDIRECTION + pin * 2 + 1, lapic_id() << 24);
+  ioapic_write(ioapic, IOAPIC_REG_REDIRECTION + pin * 2, low);
+  irq_restore(irqFlags);
+  return true;
+}
+
+void ioapic_mask_isa(uint8_t irq) {
+  if (active && irq < ACPI_ISA_IRQS && !isa_gsi_lost(irq)) {
+    ioapic_set_masked(madt->isaGsi[irq], true);
+  }
+}
+
+void ioapic_unmask_isa(uint8_t irq) {
+  if (active && irq < ACPI_ISA_IRQS && !isa_gsi_lost(irq)) {
+    ioapic_set_masked(madt->isaGsi[irq], false);
+  }
+}
+
+uint32_t ioapic_count(void) { return active ? numIoapics : 0; }
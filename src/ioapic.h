@@ -0,0 +1,68 @@
+#ifndef IOAPIC_H
+#define IOAPIC_H
+
+/**
+ * @file ioapic.h
+ * @brief IOAPIC driver, routing device interrupts to the Local APIC.
+ *
+ * When the MADT describes an IOAPIC, the 8259 PICs are left fully masked and
+ * every ISA IRQ is routed through the IOAPIC redirection table to the same
+ * vector the PIC would have used (IRQ_BASE + irq). The end of interrupt then
+ * is a single Local APIC register write instead of one or two port writes.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Takes over interrupt routing from the 8259 PICs.
+ *
+ * @return true If an IOAPIC was found and the Local APIC could be enabled.
+ * @return false Interrupts keep going through the 8259 PICs.
+ * @details Must run after pic_init(). All redirection entries start masked,
+ * ISA IRQs are prepared with the polarity and trigger mode from the MADT
+ * interrupt source overrides.
+ */
+bool ioapic_init(void);
+
+/**
+ * @brief Checks whether ioapic_init() took over interrupt routing.
+ *
+ * @return true If interrupts are delivered by the IOAPIC.
+ */
+bool ioapic_active(void);
+
+/**
+ * @brief Programs the redirection entry of a global system interrupt.
+ *
+ * @param gsi The global system interrupt.
+ * @param vector The vector to deliver on.
+ * @param flags MPS INTI flags (polarity and trigger mode), 0 for ISA default.
+ * @param masked Whether the entry starts out masked.
+ * @return true If an IOAPIC handles the GSI.
+ * @details Interrupts are delivered to the Local APIC of the boot CPU.
+ */
+bool ioapic_route(uint32_t gsi, uint8_t vector, uint16_t flags, bool masked);
+
+/**
+ * @brief Masks the IOAPIC input an ISA IRQ is wired to.
+ *
+ * @param irq The ISA IRQ 0-15.
+ */
+void ioapic_mask_isa(uint8_t irq);
+
+/**
+ * @brief Unmasks the IOAPIC input an ISA IRQ is wired to.
+ *
+ * @param irq The ISA IRQ 0-15.
+ */
+void ioapic_unmask_isa(uint8_t irq);
+
+/**
+ * @brief Returns the number of IOAPICs in use.
+ *
+ * @return uint32_t The IOAPIC count, 0 while the PICs are used.
+ */
+uint32_t ioapic_count(void);
+
+#endif
@@ -0,0 +1,253 @@
+#include "ipc.h"
+#include "sched.h"
+#include <stddef.h>
+
+// a message waiting in an endpoint's queue
+typedef struct {
+  uint32_t pid;
+  uint32_t words[IPC_MESSAGE_WORDS];
+} IpcMessage;
+
+// a thread blocked in a synchronous send, lives on its kernel stack
+typedef struct IpcSender {
+  AddressSpace *space;
+  uint32_t pid;
+  uint32_t words[IPC_MESSAGE_WORDS];
+  uint32_t pages; // address | count, 0 for none
+  bool done;      // a receiver took the message
+  uint32_t result;
+  struct IpcSender *next;
+} IpcSender;
+
+typedef struct {
+  const UserProcess *owner;
+  IpcSender *senders; // oldest first
+  IpcSender *lastSender;
+  IpcMessage queue[IPC_QUEUE_LENGTH];
+  uint32_t queueHead;
+  uint32_t queueCount;
+  WaitQueue receivers; // threads in ipc_receive()
+  WaitQueue delivered; // senders waiting for done
+  uint32_t users;      // threads in a call, they may still look at it
+  bool closed;
+  bool used;
+} IpcEndpoint;
+
+static IpcEndpoint endpoints[IPC_MAX_ENDPOINTS];
+static IpcStats stats;
+
+// an open endpoint, call with interrupts disabled
+static IpcEndpoint *endpoint_get(uint32_t id) {
+  if (id >= IPC_MAX_ENDPOINTS || !endpoints[id].used ||
+      endpoints[id].closed) {
+    return NULL;
+  }
+  return &endpoints[id];
+}
+
+// the last thread leaving a closed endpoint frees the slot
+static void endpoint_leave(IpcEndpoint *endpoint) {
+  endpoint->users--;
+  if (endpoint->closed && endpoint->users == 0) {
+    endpoint->used = false;
+  }
+}
+
+static void endpoint_close(IpcEndpoint *endpoint) {
+  endpoint->closed = true;
+  endpoint->queueCount = 0;
+  waitqueue_wake_all(&endpoint->receivers);
+  waitqueue_wake_all(&endpoint->delivered);
+  if (endpoint->users == 0) {
+    endpoint->used = false;
+  }
+}
+
+// removes a sender that gave up, if it is still queued
+static void sender_unlink(IpcEndpoint *endpoint, IpcSender *sender) {
+  IpcSender *prev = NULL;
+  for (IpcSender *s = endpoint->senders; s != NULL; prev = s, s = s->next) {
+    if (s == sender) {
+      if (prev == NULL) {
+        endpoint->senders = s->next;
+      } else {
+        prev->next = s->next;
+      }
+      if (endpoint->lastSender == s) {
+        endpoint->lastSender = prev;
+      }
+      return;
+    }
+  }
+}
+
+uint32_t ipc_endpoint_create(UserProcess *owner) {
+  uint32_t id = SYSCALL_ERROR;
+  uint32_t flags = irq_save();
+  for (uint32_t i = 0; i < IPC_MAX_ENDPOINTS; i++) {
+    if (!endpoints[i].used) {
+      IpcEndpoint *endpoint = &endpoints[i];
+      endpoint->owner = owner;
+      endpoint->senders = NULL;
+      endpoint->lastSender = NULL;
+      endpoint->queueHead = 0;
+      endpoint->queueCount = 0;
+      waitqueue_init(&endpoint->receivers);
+      waitqueue_init(&endpoint->delivered);
+      endpoint->users = 0;
+      endpoint->closed = false;
+      endpoint->used = true;
+      id = i;
+      break;
+    }
+  }
+  irq_restore(flags);
+  return id;
+}
+
+bool ipc_endpoint_close(uint32_t id, const UserProcess *owner) {
+  uint32_t flags = irq_save();
+  IpcEndpoint *endpoint = endpoint_get(id);
+  bool closed = endpoint != NULL && endpoint->owner == owner;
+  if (closed) {
+    endpoint_close(endpoint);
+  }
+  irq_restore(flags);
+  return closed;
+}
+
+void ipc_process_exit(const UserProcess *proc) {
+  uint32_t flags = irq_save();
+  for (uint32_t i = 0; i < IPC_MAX_ENDPOINTS; i++) {
+    if (endpoints[i].used && !endpoints[i].closed &&
+        endpoints[i].owner == proc) {
+      endpoint_close(&endpoints[i]);
+    }
+  }
+  irq_restore(flags);
+}
+
+uint32_t ipc_send(const SyscallFrame *frame, bool async) {
+  Thread *self = thread_current();
+  uint32_t address = frame->ebp & ~IPC_PAGES_MASK;
+  uint32_t pages = frame->ebp & IPC_PAGES_MASK;
+  if (pages > 0 &&
+      (async || pages > IPC_MAX_PAGES ||
+       !as_check_user(self->space, address, pages * PAGE_SIZE, false))) {
+    return SYSCALL_ERROR;
+  }
+
+  uint32_t flags = irq_save();
+  IpcEndpoint *endpoint = endpoint_get(frame->ebx);
+  if (endpoint == NULL) {
+    irq_restore(flags);
+    return SYSCALL_ERROR;
+  }
+  if (async) {
+    uint32_t result = SYSCALL_ERROR;
+    if (endpoint->queueCount < IPC_QUEUE_LENGTH) {
+      IpcMessage *message =
+          &endpoint->queue[(endpoint->queueHead + endpoint->queueCount) %
+                           IPC_QUEUE_LENGTH];
+      message->pid = self->id;
+      message->words[0] = frame->esi;
+      message->words[1] = frame->edi;
+      endpoint->queueCount++;
+      waitqueue_wake_one(&endpoint->receivers);
+      result = 0;
+    }
+    irq_restore(flags);
+    return result;
+  }
+
+  // the receiver fills in the result and moves the pages while this thread
+  // is blocked, its address space cannot change meanwhile
+  IpcSender sender = {self->space, self->id, {frame->esi, frame->edi},
+                      frame->ebp, false, SYSCALL_ERROR, NULL};
+  if (endpoint->lastSender == NULL) {
+    endpoint->senders = &sender;
+  } else {
+    endpoint->lastSender->next = &sender;
+  }
+  endpoint->lastSender = &sender;
+  endpoint->users++;
+  waitqueue_wake_one(&endpoint->receivers);
+  while (!sender.done && !endpoint->closed && !thread_should_stop()) {
+    waitqueue_wait(&endpoint->delivered);
+  }
+  if (!sender.done) {
+    sender_unlink(endpoint, &sender);
+  }
+  endpoint_leave(endpoint);
+  irq_restore(flags);
+  return sender.result;
+}
+
+// hands a waiting sender's message to the receiver's frame
+static uint32_t deliver(IpcSender *sender, SyscallFrame *frame) {
+  uint32_t window = frame->ebp;
+  frame->esi = sender->words[0];
+  frame->edi = sender->words[1];
+  frame->ebp = 0;
+  sender->result = 0;
+  uint32_t pages = sender->pages & IPC_PAGES_MASK;
+  if (pages > 0) {
+    if (pages <= (window & IPC_PAGES_MASK) &&
+        as_move(sender->space, sender->pages & ~IPC_PAGES_MASK,
+                thread_current()->space, window & ~IPC_PAGES_MASK, pages)) {
+      frame->ebp = (window & ~IPC_PAGES_MASK) | pages;
+      stats.pagesMoved += pages;
+    } else {
+      // the sender keeps its pages and learns about it
+      sender->result = SYSCALL_ERROR;
+    }
+  }
+  return sender->pid;
+}
+
+uint32_t ipc_receive(SyscallFrame *frame) {
+  uint32_t flags = irq_save();
+  IpcEndpoint *endpoint = endpoint_get(frame->ebx);
+  // only the owner takes messages, and with them pages
+  if (endpoint == NULL || endpoint->owner != thread_current()->process) {
+    irq_restore(flags);
+    return SYSCALL_ERROR;
+  }
+  endpoint->users++;
+  while (!endpoint->closed && endpoint->queueCount == 0 &&
+         endpoint->senders == NULL && !thread_should_stop()) {
+    waitqueue_wait(&endpoint->receivers);
+  }
+
+  uint32_t result = SYSCALL_ERROR;
+  if (endpoint->closed || thread_should_stop()) {
+    // nothing taken
+  } else if (endpoint->queueCount > 0) {
+    IpcMessage *message = &endpoint->queue[endpoint->queueHead];
+    endpoint->queueHead = (endpoint->queueHead + 1) % IPC_QUEUE_LENGTH;
+    endpoint->queueCount--;
+    frame->esi = message->words[0];
+    frame->edi = message->words[1];
+    frame->ebp = 0;
+    result = message->pid;
+  } else {
+    // interrupts stay off until the sender is done, so it cannot give up
+    // while its pages move
+    IpcSender *sender = endpoint->senders;
+    endpoint->senders = sender->next;
+    if (endpoint->senders == NULL) {
+      endpoint->lastSender = NULL;
+    }
+    result = deliver(sender, frame);
+    sender->done = true;
+    waitqueue_wake_all(&endpoint->delivered);
+  }
+  if (result != SYSCALL_ERROR) {
+    stats.messages++;
+  }
+  endpoint_leave(endpoint);
+  irq_restore(flags);
+  return result;
+}
+
+void ipc_stats(IpcStats *out) { *out = stats; }
@@ -0,0 +1,114 @@
+#ifndef IPC_H
+#define IPC_H
+
+/**
+ * @file ipc.h
+ * @brief Message passing between processes through endpoints.
+ *
+ * A message is IPC_MESSAGE_WORDS words in registers (ESI and EDI), the
+ * kernel never touches the sender's memory for them. A synchronous send
+ * waits until a receiver took the message and may move pages along: the
+ * sender names them in EBP as the page aligned address or'ed with the
+ * number of pages, the receiver names a window of unmapped pages the same
+ * way. The page table entries move from one address space to the other,
+ * the sender loses the pages and nothing is copied, whatever the size.
+ * Asynchronous sends return at once, their messages wait in the
+ * endpoint's queue (IPC_QUEUE_LENGTH), they carry words only.
+ *
+ * | call               | EBX      | ESI, EDI  | EBP                   | EAX        |
+ * |--------------------|----------|-----------|-----------------------|------------|
+ * | SYS_IPC_SEND       | endpoint | words     | pages to move         | 0          |
+ * | SYS_IPC_SEND_ASYNC | endpoint | words     | 0                     | 0          |
+ * | SYS_IPC_RECEIVE    | endpoint | words out | window, pages out     | sender pid |
+ *
+ * Every call returns SYSCALL_ERROR on failure. An endpoint belongs to the
+ * process that created it, only that process receives from it, any process
+ * may send to it. It is closed when its owner ends, which makes calls
+ * waiting on it fail. Endpoint ids are small numbers that are
+ * reused after a close. Like all threads, processes run on the BSP, the
+ * endpoints are protected by disabling interrupts as in sync.h.
+ */
+
+#include "syscall.h"
+#include "user.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @brief Most endpoints open at the same time. */
+#define IPC_MAX_ENDPOINTS 16
+
+/** @brief Words of a message, passed in ESI and EDI. */
+#define IPC_MESSAGE_WORDS 2
+
+/** @brief Asynchronous messages an endpoint holds until they are received. */
+#define IPC_QUEUE_LENGTH 16
+
+/** @brief Bits of a page descriptor (EBP) that hold the page count. */
+#define IPC_PAGES_MASK 0xFFFu
+
+/** @brief Most pages one message moves. */
+#define IPC_MAX_PAGES 1024
+
+/**
+ * @brief Transfer totals since boot.
+ */
+typedef struct {
+  uint32_t messages;   /**< Messages received. */
+  uint32_t pagesMoved; /**< Pages that changed address space. */
+} IpcStats;
+
+/**
+ * @brief Opens an endpoint.
+ *
+ * @param owner The process it belongs to.
+ * @return uint32_t The endpoint id, SYSCALL_ERROR if all are in use.
+ */
+uint32_t ipc_endpoint_create(UserProcess *owner);
+
+/**
+ * @brief Closes an endpoint, calls waiting on it fail.
+ *
+ * @param id The endpoint.
+ * @param owner The process closing it, only its owner may.
+ * @return true If it was closed.
+ */
+bool ipc_endpoint_close(uint32_t id, const UserProcess *owner);
+
+/**
+ * @brief Closes all endpoints of a process.
+ *
+ * @param proc The process, it ended or was never started.
+ */
+void ipc_process_exit(const UserProcess *proc);
+
+/**
+ * @brief Sends the message of a system call frame.
+ *
+ * @param frame EBX endpoint, ESI and EDI words, EBP pages (synchronous
+ * only).
+ * @param async Queue the message instead of waiting for the receiver.
+ * @return uint32_t 0, or SYSCALL_ERROR if the endpoint is closed, the
+ * queue is full, the pages are not the sender's or do not fit into the
+ * receiver's window (the receiver then gets the words only).
+ */
+uint32_t ipc_send(const SyscallFrame *frame, bool async);
+
+/**
+ * @brief Waits for a message and stores it in a system call frame.
+ *
+ * @param frame EBX endpoint, EBP window for pages. Receives the words in
+ * ESI and EDI and in EBP the pages mapped into the window, 0 for none.
+ * @return uint32_t The sender's pid, SYSCALL_ERROR if the endpoint is
+ * closed or not the calling process' own.
+ * @details Queued asynchronous messages come before waiting senders.
+ */
+uint32_t ipc_receive(SyscallFrame *frame);
+
+/**
+ * @brief Returns the transfer totals.
+ *
+ * @param out Receives the counters.
+ */
+void ipc_stats(IpcStats *out);
+
+#endif
@@ -0,0 +1,167 @@
+#include "ipcbench.h"
+#include "cpu.h"
+#include "ipc.h"
+#include "kmem.h"
+#include "paging.h"
+#include "str.h"
+#include "terminal.h"
+#include "time.h"
+#include "user.h"
+#include <stddef.h>
+
+// where the pinging side owns the pages it sends, the same as in
+// userprogs.asm
+#define IPCBENCH_BUFFER 0x60000000u
+// page tables, stacks and the like besides the buffer
+#define IPCBENCH_SPARE_FRAMES 64
+// 4 KiB copies averaged for the memcpy column
+#define IPCBENCH_COPY_SAMPLES 256
+// arguments of the program, see userprogs.asm
+#define IPCBENCH_ARGS 6
+#define ROLE_PING 0
+#define ROLE_PONG 1
+
+// in userprogs.asm, linked for the user range
+extern uint8_t user_ipc_bench[];
+
+// message sizes in pages after the two register only runs
+static const uint32_t pageCounts[] = {1, 16, 256, IPC_MAX_PAGES};
+
+static void release_both(UserProcess *ping, UserProcess *pong) {
+  if (ping != NULL) {
+    user_process_release(ping);
+  }
+  if (pong != NULL) {
+    user_process_release(pong);
+  }
+}
+
+// one ping-pong, the average cycles per round trip or 0 if it failed
+static uint32_t run_pingpong(uint32_t roundTrips, uint32_t pages,
+                             bool async) {
+  UserProcess *ping = user_process_create();
+  UserProcess *pong = user_process_create();
+  if (ping == NULL || pong == NULL) {
+    release_both(ping, pong);
+    return 0;
+  }
+  // each side owns the endpoint it receives from, so when one of them ends
+  // the other's calls fail instead of waiting forever
+  uint32_t toPong = ipc_endpoint_create(pong);
+  uint32_t toPing = ipc_endpoint_create(ping);
+  uint32_t pingArgs[IPCBENCH_ARGS] = {roundTrips, toPong, toPing,
+                                      pages,      async,  ROLE_PING};
+  uint32_t pongArgs[IPCBENCH_ARGS] = {roundTrips, toPing, toPong,
+                                      pages,      async,  ROLE_PONG};
+  if (toPong == SYSCALL_ERROR || toPing == SYSCALL_ERROR ||
+      !user_process_map_builtin(ping) || !user_process_map_builtin(pong) ||
+      (pages > 0 &&
+       !as_map_zeroed(ping->space, IPCBENCH_BUFFER, pages, PTE_WRITABLE)) ||
+      !user_process_start(ping, "ipc-ping", (uint32_t)user_ipc_bench,
+                          pingArgs, IPCBENCH_ARGS)) {
+    release_both(ping, pong);
+    return 0;
+  }
+  if (!user_process_start(pong, "ipc-pong", (uint32_t)user_ipc_bench,
+                          pongArgs, IPCBENCH_ARGS)) {
+    // closes the endpoint ping sends to, which ends it
+    user_process_release(pong);
+    user_process_wait(ping);
+    return 0;
+  }
+  int32_t cycles = user_process_wait(ping);
+  user_process_wait(pong);
+  return cycles > 0 ? (uint32_t)cycles : 0;
+}
+
+// cycles memcpy needs for one page that is in the cache, 0 without memory
+static uint32_t page_copy_cycles(void) {
+  uint32_t source = frame_alloc();
+  uint32_t target = frame_alloc();
+  uint32_t cycles = 0;
+  if (source != 0 && target != 0) {
+    memsetOS((void *)source, 0x5A, PAGE_SIZE);
+    memcpyOS((void *)target, (const void *)source, PAGE_SIZE);
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < IPCBENCH_COPY_SAMPLES; i++) {
+      memcpyOS((void *)target, (const void *)source, PAGE_SIZE);
+    }
+    cycles = (uint32_t)((rdtsc() - start) / IPCBENCH_COPY_SAMPLES);
+  }
+  if (source != 0) {
+    frame_free(source);
+  }
+  if (target != 0) {
+    frame_free(target);
+  }
+  return cycles;
+}
+
+static void print_run(const char *name, uint32_t cycles, uint32_t pages,
+                      uint32_t copyCycles) {
+  char line[128] = "";
+  appendString(line, name);
+  for (size_t len = strlenOS(name); len < 18; len++) {
+    appendString(line, " ");
+  }
+  if (cycles == 0) {
+    appendString(line, "    failed");
+    terminalWriteLine(line);
+    return;
+  }
+  uint64_t cyclesPerUs = tsc_hz() / 1000000u;
+  if (cyclesPerUs == 0) {
+    cyclesPerUs = 1;
+  }
+  appendDecimal(line, cycles, 10);
+  appendDecimal(line, (uint64_t)cycles * 1000u / cyclesPerUs, 10);
+  if (pages > 0) {
+    // the pages travel there and back in every round trip
+    uint64_t bytes = 2ull * pages * PAGE_SIZE;
+    appendDecimal(line, bytes * cyclesPerUs / cycles, 10);
+    appendDecimal(line, 2ull * pages * copyCycles, 13);
+  }
+  terminalWriteLine(line);
+}
+
+void runIpcBenchmark(uint32_t roundTrips) {
+  if (!user_available()) {
+    terminalWriteLine("User mode needs paging with 4 MiB pages (PSE)");
+    return;
+  }
+
+  char line[128] = "Ping-pong between two processes, ";
+  appendDecimal(line, roundTrips, 0);
+  appendString(line, " round trips each, TSC cycles.");
+  terminalWriteLine(line);
+  terminalWriteLine("Pages move both ways by remapping, COPY is what memcpy needs for them.");
+  terminalWriteLine("MESSAGE            CYCLES/RT     NS/RT      MB/S  COPY CYCLES");
+  IpcStats before;
+  ipc_stats(&before);
+  print_run("registers, sync", run_pingpong(roundTrips, 0, false), 0, 0);
+  print_run("registers, async", run_pingpong(roundTrips, 0, true), 0, 0);
+
+  uint32_t copyCycles = page_copy_cycles();
+  for (size_t i = 0; i < sizeof(pageCounts) / sizeof(pageCounts[0]); i++) {
+    uint32_t pages = pageCounts[i];
+    char name[32] = "";
+    appendDecimal(name, pages, 0);
+    appendString(name, pages == 1 ? " page" : " pages");
+    if (pages + IPCBENCH_SPARE_FRAMES > frame_free_count()) {
+      appendString(name, ": not enough free memory");
+      terminalWriteLine(name);
+      break;
+    }
+    print_run(name, run_pingpong(roundTrips, pages, false), pages,
+              copyCycles);
+  }
+
+  IpcStats after;
+  ipc_stats(&after);
+  line[0] = '\0';
+  appendDecimal(line, after.messages - before.messages, 0);
+  appendString(line, " messages, ");
+  appendDecimal(line, after.pagesMoved - before.pagesMoved, 0);
+  appendString(line, " pages moved, no bytes copied");
+  terminalWriteLine(line);
+}
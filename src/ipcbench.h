@@ -0,0 +1,28 @@
+#ifndef IPCBENCH_H
+#define IPCBENCH_H
+
+/**
+ * @file ipcbench.h
+ * @brief Message passing latency and bandwidth between two processes.
+ *
+ * Two instances of a built-in program (userprogs.asm) play ping-pong over
+ * a pair of endpoints (ipc.h), each receiving on the one it owns. Messages
+ * of registers only give the latency of a round trip, synchronous and
+ * asynchronous. Messages carrying pages move a buffer to the other process
+ * and back, which gives the bandwidth of page transfer. The cost of
+ * copying the same bytes with memcpy is shown next to it.
+ */
+
+#include <stdint.h>
+
+/** @brief Round trips per message size when the command gives no count. */
+#define IPCBENCH_DEFAULT_ROUND_TRIPS 10000
+
+/**
+ * @brief Runs the ping-pongs and prints the results.
+ *
+ * @param roundTrips Round trips per message size, at least 1.
+ */
+void runIpcBenchmark(uint32_t roundTrips);
+
+#endif
@@ -0,0 +1,139 @@
+#include "irqsoff.h"
+#include "cpu.h"
+#include "str.h"
+#include "terminal.h"
+#include "time.h"
+#include <stddef.h>
+
+volatile bool irqsoffTracing = true;
+
+// the section that is open right now
+static bool sectionOpen = false;
+static uint64_t openTsc = 0;
+static const char *openFunc = NULL;
+static uint32_t openLine = 0;
+
+// longest sections, sorted longest first
+static IrqsoffSection top[IRQSOFF_TOP];
+static uint32_t topCount = 0;
+static uint64_t sectionCount = 0;
+
+// the tracer must not trace itself, so it uses the bare instructions
+static inline uint32_t raw_irq_save(void) {
+  uint32_t flags;
+  __asm__ volatile("pushf\n\tpop %0\n\tcli" : "=r"(flags) : : "memory");
+  return flags;
+}
+
+static inline void raw_irq_restore(uint32_t flags) {
+  __asm__ volatile("push %0\n\tpopf" : : "r"(flags) : "memory", "cc");
+}
+
+static void section_open(const char *func, uint32_t line) {
+  if (sectionOpen) {
+    return;
+  }
+  sectionOpen = true;
+  openFunc = func;
+  openLine = line;
+  openTsc = rdtsc();
+}
+
+static void section_close(const char *func, uint32_t line) {
+  if (!sectionOpen) {
+    return;
+  }
+  uint64_t cycles = rdtsc() - openTsc;
+  sectionOpen = false;
+  sectionCount++;
+
+  if (topCount == IRQSOFF_TOP && cycles <= top[IRQSOFF_TOP - 1].cycles) {
+    return;
+  }
+  // insertion into the sorted list, dropping the shortest when full
+  uint32_t i = topCount < IRQSOFF_TOP ? topCount++ : IRQSOFF_TOP - 1;
+  while (i > 0 && top[i - 1].cycles < cycles) {
+    top[i] = top[i - 1];
+    i--;
+  }
+  top[i].cycles = cycles;
+  top[i].offFunc = openFunc;
+  top[i].offLine = openLine;
+  top[i].onFunc = func;
+  top[i].onLine = line;
+}
+
+void irqsoff_set_tracing(bool enabled) {
+  uint32_t flags = raw_irq_save();
+  sectionOpen = false;
+  irqsoffTracing = enabled;
+  raw_irq_restore(flags);
+}
+
+void irqsoff_reset(void) {
+  uint32_t flags = raw_irq_save();
+  topCount = 0;
+  sectionCount = 0;
+  raw_irq_restore(flags);
+}
+
+void irqsoff_disabled(const char *func, uint32_t line) {
+  section_open(func, line);
+}
+
+void irqsoff_enabled(const char *func, uint32_t line) {
+  section_close(func, line);
+}
+
+void irqsoff_irq_enter(uint8_t vector) { section_open("irq", vector); }
+
+void irqsoff_irq_exit(uint8_t vector) { section_close("irq", vector); }
+
+uint32_t irqsoff_top(IrqsoffSection out[IRQSOFF_TOP]) {
+  uint32_t flags = raw_irq_save();
+  uint32_t count = topCount;
+  for (uint32_t i = 0; i < count; i++) {
+    out[i] = top[i];
+  }
+  raw_irq_restore(flags);
+  return count;
+}
+
+// "func:line", or "irq:vector" for interrupt entry and exit
+static void append_site(char *line, const char *func, uint32_t number) {
+  appendString(line, func != NULL ? func : "?");
+  appendString(line, ":");
+  appendDecimal(line, number, 0);
+}
+
+// docs see header file
+void printIrqsoffToTerminal(void) {
+  IrqsoffSection sections[IRQSOFF_TOP];
+  uint32_t count = irqsoff_top(sections);
+  uint64_t cyclesPerUs = tsc_hz() / 1000000u;
+
+  uint32_t flags = raw_irq_save();
+  uint64_t traced = sectionCount;
+  raw_irq_restore(flags);
+
+  char line[160] = "Interrupts-off sections traced: ";
+  appendDecimal(line, traced, 0);
+  appendString(line, irqsoffTracing ? " (tracing)" : " (stopped)");
+  terminalWriteLine(line);
+  if (count == 0) {
+    return;
+  }
+
+  terminalWriteLine("      cycles      us  disabled at -> enabled at");
+  for (uint32_t i = 0; i < count; i++) {
+    line[0] = '\0';
+    appendDecimal(line, sections[i].cycles, 12);
+    appendDecimal(line, cyclesPerUs != 0 ? sections[i].cycles / cyclesPerUs : 0,
+                  8);
+    appendString(line, "  ");
+    append_site(line, sections[i].offFunc, sections[i].offLine);
+    appendString(line, " -> ");
+    append_site(line, sections[i].onFunc, sections[i].onLine);
+    terminalWriteLine(line);
+  }
+}
@@ -0,0 +1,96 @@
+#ifndef IRQSOFF_H
+#define IRQSOFF_H
+
+/**
+ * @file irqsoff.h
+ * @brief Tracer for sections that run with interrupts disabled.
+ *
+ * Every interrupt flag transition made through the helpers in cpu.h, and the
+ * entry and exit of every hardware interrupt, is timestamped with the TSC. The
+ * longest sections are kept together with the code locations that disabled
+ * and re-enabled interrupts. The handlers themselves run with interrupts
+ * disabled, so they are measured from dispatch until interrupts are enabled
+ * again (on iret or in softirq_run()).
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @brief Number of longest sections that are kept. */
+#define IRQSOFF_TOP 8
+
+/**
+ * @brief One interrupts-disabled section.
+ */
+typedef struct {
+  uint64_t cycles;     /**< Length of the section in TSC cycles. */
+  const char *offFunc; /**< Function that disabled interrupts. */
+  uint32_t offLine;    /**< Line in offFunc, or the vector for "irq". */
+  const char *onFunc;  /**< Function that enabled them again. */
+  uint32_t onLine;     /**< Line in onFunc, or the vector for "irq". */
+} IrqsoffSection;
+
+/**
+ * @brief True while the tracer records, checked inline by cpu.h.
+ */
+extern volatile bool irqsoffTracing;
+
+/**
+ * @brief Starts or stops recording.
+ *
+ * @param enabled Whether to record transitions.
+ */
+void irqsoff_set_tracing(bool enabled);
+
+/**
+ * @brief Forgets all recorded sections.
+ */
+void irqsoff_reset(void);
+
+/**
+ * @brief Records that interrupts were just disabled.
+ *
+ * @param func The calling function.
+ * @param line The calling line.
+ * @details Called by the cpu.h helpers with interrupts already disabled.
+ * A nested call while a section is open is ignored.
+ */
+void irqsoff_disabled(const char *func, uint32_t line);
+
+/**
+ * @brief Records that interrupts are about to be enabled.
+ *
+ * @param func The calling function.
+ * @param line The calling line.
+ * @details Called by the cpu.h helpers while interrupts are still disabled.
+ */
+void irqsoff_enabled(const char *func, uint32_t line);
+
+/**
+ * @brief Records the entry into a hardware interrupt handler.
+ *
+ * @param vector The interrupt vector.
+ */
+void irqsoff_irq_enter(uint8_t vector);
+
+/**
+ * @brief Records the return from a hardware interrupt handler.
+ *
+ * @param vector The interrupt vector.
+ */
+void irqsoff_irq_exit(uint8_t vector);
+
+/**
+ * @brief Copies the longest recorded sections, longest first.
+ *
+ * @param out Receives up to IRQSOFF_TOP sections.
+ * @return uint32_t The number of sections written to out.
+ */
+uint32_t irqsoff_top(IrqsoffSection out[IRQSOFF_TOP]);
+
+/**
+ * @brief Prints the longest interrupts-disabled sections to the terminal.
+ */
+void printIrqsoffToTerminal(void);
+
+#endif
@@ -0,0 +1,265 @@
+#include "jobs.h"
+#include "cpu.h"
+#include "events.h"
+#include "modeManager.h"
+#include "sched.h"
+#include "sync.h"
+#include "terminal.h"
+#include <stddef.h>
+
+typedef enum {
+  JOB_FREE,
+  JOB_RUNNING,
+  JOB_DONE, // the handler returned, output may still be buffered
+} JobState;
+
+typedef struct {
+  volatile JobState state;
+  uint32_t sequence; // start order, for jobs_latest()
+  bool killed;
+  bool foreground; // fg waits for it, no "Done" line
+  Thread *thread;
+  JobHandler handler;
+  char command[JOB_COMMAND_LENGTH];
+  char args[NUM_SUBSTRINGS][LEN_SUBSTRINGS];
+  // ring of output lines, written by the job, read by the main loop
+  char lines[JOB_OUTPUT_LINES][JOB_LINE_LENGTH];
+  uint32_t head;
+  uint32_t count;
+  uint32_t dropped;
+  WaitQueue events; // woken on new output and when the handler returns
+} Job;
+
+static Job jobs[JOB_MAX];
+static uint32_t nextSequence = 1;
+
+static uint32_t job_id(const Job *job) { return (uint32_t)(job - jobs) + 1; }
+
+static Job *job_get(uint32_t id) {
+  if (id == 0 || id > JOB_MAX || jobs[id - 1].state == JOB_FREE) {
+    return NULL;
+  }
+  return &jobs[id - 1];
+}
+
+// the job the running thread belongs to, if any
+static Job *job_current(void) {
+  Thread *self = thread_current();
+  if (self == NULL) {
+    return NULL;
+  }
+  for (uint32_t i = 0; i < JOB_MAX; i++) {
+    if (jobs[i].state == JOB_RUNNING && jobs[i].thread == self) {
+      return &jobs[i];
+    }
+  }
+  return NULL;
+}
+
+static void job_main(void *arg) {
+  Job *job = arg;
+  char buffer[256];
+  job->handler(job->args, buffer);
+  // whoever sees JOB_DONE frees the slot and a new job may reuse it, so this
+  // is the thread's last touch of the job: no other thread runs before it
+  // is done with the wait queue
+  uint32_t flags = irq_save();
+  job->state = JOB_DONE;
+  waitqueue_wake_all(&job->events);
+  event_post(EVENT_WORK);
+  irq_restore(flags);
+}
+
+uint32_t jobs_start(JobHandler handler, char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS]) {
+  if (!sched_active()) {
+    return 0;
+  }
+  Job *job = NULL;
+  for (uint32_t i = 0; i < JOB_MAX; i++) {
+    if (jobs[i].state == JOB_FREE) {
+      job = &jobs[i];
+      break;
+    }
+  }
+  if (job == NULL) {
+    return 0;
+  }
+
+  job->command[0] = '\0';
+  for (int i = 0; i < NUM_SUBSTRINGS; i++) {
+    size_t j = 0;
+    for (; cmd[i][j] != '\0'; j++) {
+      job->args[i][j] = cmd[i][j];
+    }
+    job->args[i][j] = '\0';
+    if (cmd[i][0] != '\0' &&
+        strlenOS(job->command) + j + 1 < JOB_COMMAND_LENGTH) {
+      if (i > 0) {
+        appendString(job->command, " ");
+      }
+      appendString(job->command, cmd[i]);
+    }
+  }
+  job->handler = handler;
+  job->killed = false;
+  job->foreground = false;
+  job->head = 0;
+  job->count = 0;
+  job->dropped = 0;
+  waitqueue_init(&job->events);
+  job->sequence = nextSequence++;
+  job->state = JOB_RUNNING;
+
+  // job_current() finds the job by its thread, which must not run before
+  // the pointer is set
+  preempt_disable();
+  job->thread = thread_create(job->args[0], job_main, job);
+  preempt_enable();
+  if (job->thread == NULL) {
+    job->state = JOB_FREE;
+    return 0;
+  }
+  return job_id(job);
+}
+
+bool jobs_capture_line(const char *line) {
+  Job *job = job_current();
+  if (job == NULL) {
+    return false;
+  }
+  uint32_t flags = irq_save();
+  if (job->count == JOB_OUTPUT_LINES) {
+    // full, the oldest line goes
+    job->head = (job->head + 1) % JOB_OUTPUT_LINES;
+    job->count--;
+    job->dropped++;
+  }
+  char *slot = job->lines[(job->head + job->count) % JOB_OUTPUT_LINES];
+  size_t i = 0;
+  for (; line[i] != '\0' && i < JOB_LINE_LENGTH - 1; i++) {
+    slot[i] = line[i];
+  }
+  slot[i] = '\0';
+  job->count++;
+  waitqueue_wake_all(&job->events);
+  event_post(EVENT_WORK);
+  irq_restore(flags);
+  return true;
+}
+
+// moves the buffered lines of one job into the terminal ring
+static void job_flush(Job *job) {
+  char prefix[16] = "[";
+  appendDecimal(prefix, job_id(job), 0);
+  appendString(prefix, "] ");
+
+  while (1) {
+    char line[JOB_LINE_LENGTH + 16];
+    uint32_t flags = irq_save();
+    if (job->dropped != 0) {
+      concat(prefix, "... ", line);
+      appendDecimal(line, job->dropped, 0);
+      appendString(line, " lines dropped");
+      job->dropped = 0;
+    } else if (job->count != 0) {
+      concat(prefix, "", line);
+      appendString(line, job->lines[job->head]);
+      job->head = (job->head + 1) % JOB_OUTPUT_LINES;
+      job->count--;
+    } else {
+      irq_restore(flags);
+      return;
+    }
+    irq_restore(flags);
+    terminalWriteLine(line);
+  }
+}
+
+// prints the state of a job, used by jobs and for finished jobs
+static void job_print(const Job *job) {
+  char line[128] = "[";
+  appendDecimal(line, job_id(job), 0);
+  appendString(line, "] ");
+  if (job->state == JOB_DONE) {
+    appendString(line, job->killed ? "Killed    " : "Done      ");
+  } else {
+    appendString(line, job->killed ? "Stopping  " : "Running   ");
+  }
+  appendString(line, job->command);
+  terminalWriteLine(line);
+}
+
+void jobs_poll(void) {
+  // only the main loop merges, and only into a visible terminal
+  if (job_current() != NULL || getCurrentMode() != TERMINAL_MODE) {
+    return;
+  }
+  for (uint32_t i = 0; i < JOB_MAX; i++) {
+    Job *job = &jobs[i];
+    if (job->state == JOB_FREE || job->foreground) {
+      continue;
+    }
+    JobState state = job->state;
+    job_flush(job);
+    if (state == JOB_DONE) {
+      job_print(job);
+      job->state = JOB_FREE;
+    }
+  }
+}
+
+uint32_t jobs_latest(void) {
+  Job *latest = NULL;
+  for (uint32_t i = 0; i < JOB_MAX; i++) {
+    if (jobs[i].state != JOB_FREE &&
+        (latest == NULL || jobs[i].sequence > latest->sequence)) {
+      latest = &jobs[i];
+    }
+  }
+  return latest != NULL ? job_id(latest) : 0;
+}
+
+bool jobs_foreground(uint32_t id) {
+  Job *job = job_get(id);
+  // a job waiting for itself would never finish
+  if (job == NULL || job == job_current() || job->foreground) {
+    return false;
+  }
+  job->foreground = true;
+  terminalWriteLine(job->command);
+  while (job->state == JOB_RUNNING) {
+    job_flush(job);
+    if (!wait_event(&job->events, job->count != 0 || job->dropped != 0 ||
+                                      job->state != JOB_RUNNING)) {
+      // fg itself runs as a job that got killed, leave the job running
+      job->foreground = false;
+      return true;
+    }
+  }
+  job_flush(job);
+  job->state = JOB_FREE;
+  return true;
+}
+
+bool jobs_kill(uint32_t id) {
+  Job *job = job_get(id);
+  if (job == NULL || job->state != JOB_RUNNING) {
+    return false;
+  }
+  job->killed = true;
+  thread_kill(job->thread);
+  return true;
+}
+
+void printJobsToTerminal(void) {
+  bool any = false;
+  for (uint32_t i = 0; i < JOB_MAX; i++) {
+    if (jobs[i].state != JOB_FREE) {
+      job_print(&jobs[i]);
+      any = true;
+    }
+  }
+  if (!any) {
+    terminalWriteLine("No jobs");
+  }
+}
@@ -0,0 +1,89 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+/**
+ * @file jobs.h
+ * @brief Background jobs for terminal commands (`cmd &`).
+ *
+ * A background job runs a command handler in its own kernel thread. Lines
+ * it writes through terminalWriteLine() do not go to the terminal directly
+ * but into a small per-job buffer. The main loop merges the buffers into the
+ * terminal ring with a "[id]" prefix (jobs_poll()), so the prompt stays
+ * usable and the output of several jobs never interleaves mid-line.
+ */
+
+#include "str.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @brief Most jobs that can run at the same time. */
+#define JOB_MAX 8
+
+/** @brief Buffered output lines per job, older lines are dropped first. */
+#define JOB_OUTPUT_LINES 32
+
+/** @brief Longest buffered output line, longer lines are cut. */
+#define JOB_LINE_LENGTH 128
+
+/** @brief Longest command line shown by jobs. */
+#define JOB_COMMAND_LENGTH 64
+
+/**
+ * @brief A command handler, same signature as the ones in commandHandler.c.
+ */
+typedef void (*JobHandler)(char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS], char *buf);
+
+/**
+ * @brief Starts a command as a background job.
+ *
+ * @param handler The command's handler.
+ * @param cmd The split command line, copied into the job.
+ * @return uint32_t The job id (1 based), 0 if no job slot or thread was free.
+ */
+uint32_t jobs_start(JobHandler handler, char cmd[NUM_SUBSTRINGS][LEN_SUBSTRINGS]);
+
+/**
+ * @brief Buffers a terminal line if the running thread is a job.
+ *
+ * @param line The line written through terminalWriteLine().
+ * @return true If the line was taken by a job, false if it is for the terminal.
+ */
+bool jobs_capture_line(const char *line);
+
+/**
+ * @brief Merges buffered job output into the terminal and reaps finished jobs.
+ *
+ * @details Called from the main loop. Output is held back while a visual
+ * mode owns the screen.
+ */
+void jobs_poll(void);
+
+/**
+ * @brief Returns the most recently started job that is still listed.
+ *
+ * @return uint32_t The job id, 0 if there is none.
+ */
+uint32_t jobs_latest(void);
+
+/**
+ * @brief Waits for a job, showing its output as it comes.
+ *
+ * @param id The job id.
+ * @return true If the job existed.
+ */
+bool jobs_foreground(uint32_t id);
+
+/**
+ * @brief Asks a job to stop, see thread_kill().
+ *
+ * @param id The job id.
+ * @return true If the job existed and was still running.
+ */
+bool jobs_kill(uint32_t id);
+
+/**
+ * @brief Prints all jobs with their state and command line.
+ */
+void printJobsToTerminal(void);
+
+#endif
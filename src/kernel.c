@@ -7,20 +7,52 @@
  * and handles basic terminal input/output.
  */
 
+#include "acpi.h"
 #include "commandHandler.h"
+#include "cpu.h"
+#include "cpufeatures.h"
+#include "events.h"
+#include "fpu.h"
+#include "gcov.h"
 #include "gdt.h"
+#include "jobs.h"
 #include "idt.h"
 #include "keyboard.h"
+#include "kmem.h"
 #include "multiboot.h"
 #include "printOS.h" 
 #include "terminal.h"
 #include "time.h"
 #include "str.h"
 #include "modeManager.h"
+#include "modules.h"
+#include "percpu.h"
+#include "paging.h"
+#include "pgotrain.h"
+#include "rtc.h"
+#include "sched.h"
+#include "serial.h"
+#include "smp.h"
 #include "snake.h"
+#include "softirq.h"
+#include "taskpool.h"
+#include "user.h"
 #include <stddef.h>
 #include <stdint.h>
 
+// set when the boot loader asked for the PGO training workload
+static bool pgoTraining = false;
+
+// waits until enter is pressed, a training run has nobody to press it
+static void waitForEnter(void) {
+  if (pgoTraining) {
+    return;
+  }
+  // halts between keys, the timer is not running yet
+  while (keyBufferWait() != KEY_ENTER) {
+  }
+}
+
 /**
  * @brief Kernel main entry point.
  *
@@ -28,14 +60,31 @@
  */
 void kernel_main(multiboot_info_t *mbi) {
 
+  // register the profile counters of a -fprofile-arcs build, the dump goes
+  // out through COM1
+  gcov_init();
+  serial_init();
+  pgoTraining = pgo_training_requested(mbi);
+
   // Setup the Global Descriptor Table
   gdtInit();
+  percpu_init(0); // GS addresses the BSP's per-CPU block from here on
 
   // Setup Interrupt Descriptor Table
   idtInit();
 
+  keyboardInit();
+
+  cpu_features_init();
+  fpu_init(); // x87/SSE on, FPU state is switched lazily through #NM
+  kmem_init(); // pick memcpy/memset/... variants for this CPU
+  acpi_init();       // copy the ACPI tables while all of RAM is reachable
+  paging_init(mbi);  // identity map the kernel, programs get their own pages
+  user_init();       // TSS and system call gates for ring 3
+  modules_init(mbi); // programs the bootloader loaded, see exec
+
   // Tell the os we will handle interrupts ourselfs
-  __asm__ volatile("sti");
+  irq_enable();
 
   // Initialize terminal or console interface
   screenInit();
@@ -47,27 +96,13 @@ void kernel_main(multiboot_info_t *mbi) {
   screenWriteLine("Welcome to miniOS!", 0);
   screenWriteLine("Press enter to continue...", 2);
 
-  while (1) {
-    if (!keyBufferIsEmpty()) {
-      KeyCode key = keyBufferGet();
-      if (key == KEY_ENTER) {
-        break;
-      }
-    }
-  }
+  waitForEnter();
 
   // print out information about Multiboot
   printMultibootInfo(mbi); // Pass the pointer received from _start
 
   // wait for enter to be pressed
-  while (1) {
-    if (!keyBufferIsEmpty()) {
-      KeyCode key = keyBufferGet();
-      if (key == KEY_ENTER) {
-        break;
-      }
-    }
-  }
+  waitForEnter();
   screenClear(); // Clear screen after Multiboot info
   // Print the GdtInformation to confirm everything is runngin
 
@@ -75,57 +110,56 @@ void kernel_main(multiboot_info_t *mbi) {
   checkMemoryMapForStack(mbi); // Pass the pointer received from _start
 
   // wait for enter to be pressed
-  while (1) {
-    if (!keyBufferIsEmpty()) {
-      KeyCode key = keyBufferGet();
-      if (key == KEY_ENTER) {
-        break;
-      }
-    }
-  }
+  waitForEnter();
   screenClear(); // Clear screen after Multiboot info
   // Print the GdtInformation to confirm everything is runngin
 
   printGdtInfo();
   // wait for enter to be pressed
-  while (1) {
-    if (!keyBufferIsEmpty()) {
-      KeyCode key = keyBufferGet();
-      if (key == KEY_ENTER) {
-        break;
-      }
-    }
-  }
+  waitForEnter();
   screenClear();
 
   printIdtInfo();
   // wait for enter to be pressed
-  while (1) {
-    if (!keyBufferIsEmpty()) {
-      KeyCode key = keyBufferGet();
-      if (key == KEY_ENTER) {
-        break;
-      }
-    }
-  }
+  waitForEnter();
   screenClear();
 
   initCommands();
-  pit_init(1000); // Initialize PIT with 1000 Hz
+  timer_init(1000); // 1000 Hz tick, Local APIC timer preferred over the PIT
+  sched_init();      // this code becomes the "main" thread, the tick preempts
+  smp_init();        // start the application processors into their idle loops
+  taskpool_init();   // let the idle APs steal tasks
+  rtc_init();        // read the CMOS clock once, wall time follows clock_ns()
   modeManagerInit(); // Initialize mode manager
   terminalInit();
 
-  // infinite loop for os to run
+  if (pgoTraining) {
+    pgo_run_training();
+  }
+
+  // infinite loop for os to run, sleeps whenever no event is queued
   while (1) {
-    // Handle mode transitions
-    handleModeTransitions();
-    
-    if (!keyBufferIsEmpty()) {
-      KeyCode key = keyBufferGet();
-      processModeInput(key);
+    switch (event_wait()) {
+    case EVENT_KEY:
+      while (!keyBufferIsEmpty()) {
+        processModeInput(keyBufferGet());
+      }
+      break;
+    case EVENT_TIMER:
+      // Update visual mode logic if in visual mode
+      updateVisualMode();
+      break;
+    case EVENT_MODE:
+      handleModeTransitions();
+      break;
+    case EVENT_WORK:
+      // deferred interrupt work left over when the last interrupt returned
+      softirq_run();
+      // output of background jobs and their "Done" lines
+      jobs_poll();
+      break;
+    default:
+      break;
     }
-    
-    // Update visual mode logic if in visual mode
-    updateVisualMode();
   }
 }
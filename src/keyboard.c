@@ -1,11 +1,24 @@
 #include "keyboard.h"
+#include "events.h"
+#include "interrupts.h"
+#include "io.h"
 #include "printOS.h"
+#include "softirq.h"
+#include "spinlock.h"
+#include "sync.h"
+
+// data port of the PS/2 controller
+#define KEYBOARD_DATA_PORT 0x60
 
 #define KEY_BUFFER_SIZE 32
 // ringbuffer for keycodes that were just pressed
 volatile KeyCode keyBuffer[KEY_BUFFER_SIZE];
 volatile int8_t keyBufferReadIndex;
 volatile int8_t keyBufferWriteIndex;
+// the softirq fills the buffer, the shell and background jobs drain it
+static Spinlock keyBufferLock = SPINLOCK_INIT("keyBuffer");
+// threads sleeping in keyBufferWait()
+static WaitQueue keyWaiters = WAITQUEUE_INIT;
 
 void keyBufferInit() {
   keyBufferReadIndex = 0;
@@ -15,17 +28,113 @@ void keyBufferInit() {
 bool keyBufferIsEmpty() { return keyBufferReadIndex == keyBufferWriteIndex; }
 
 void keyBufferPut(KeyCode keycode) {
+  uint32_t flags = spin_lock_irqsave(&keyBufferLock);
   keyBuffer[keyBufferWriteIndex] = keycode;
   keyBufferWriteIndex = (keyBufferWriteIndex + 1) % KEY_BUFFER_SIZE;
+  spin_unlock_irqrestore(&keyBufferLock, flags);
+  waitqueue_wake_all(&keyWaiters);
+  event_post(EVENT_KEY);
+}
+
+// raw scan codes from the IRQ, decoded later in the keyboard softirq
+#define SCANCODE_BUFFER_SIZE 64
+// scan codes decoded per softirq pass, so typing cannot starve other work
+#define KEYBOARD_SOFTIRQ_BUDGET 16
+
+static volatile uint8_t scancodeBuffer[SCANCODE_BUFFER_SIZE];
+static volatile uint8_t scancodeReadIndex = 0;
+static volatile uint8_t scancodeWriteIndex = 0;
+
+// Static variable to track extended key sequences (0xE0 prefix)
+// Two-byte sequence expected for extended keys
+static bool extended_key = false;
+
+// turns one scan code into a key buffer entry
+static void keyboardDecode(uint8_t scancode) {
+  // Check for extended key prefix (0xE0)
+  if (scancode == 0xE0) {
+    extended_key = true;
+    return; // Wait for the next byte
+  }
+
+  // Handle key release codes (high bit set)
+  if (scancode & 0x80) {
+    extended_key = false; // Reset extended key flag on key release
+    return;               // Ignore key release events
+  }
+
+  // Handle extended keys
+  if (extended_key) {
+    switch (scancode) {
+    case 0x48: keyBufferPut(KEY_ARROW_UP); break;
+    case 0x50: keyBufferPut(KEY_ARROW_DOWN); break;
+    case 0x4B: keyBufferPut(KEY_ARROW_LEFT); break;
+    case 0x4D: keyBufferPut(KEY_ARROW_RIGHT); break;
+    default: break; // Ignore unhandled extended keys
+    }
+    extended_key = false;
+  } else {
+    // Handle normal keys
+    keyBufferPut((KeyCode)scancode);
+  }
+}
+
+// IRQ1: only read the scan code (which acknowledges the controller) and
+// leave the decoding to the softirq
+static void keyboardIrq(registers_t *regs, void *ctx) {
+  (void)regs;
+  (void)ctx;
+  uint8_t scancode = inb(KEYBOARD_DATA_PORT);
+  uint8_t next = (scancodeWriteIndex + 1) % SCANCODE_BUFFER_SIZE;
+  if (next != scancodeReadIndex) { // drop the scan code if the buffer is full
+    scancodeBuffer[scancodeWriteIndex] = scancode;
+    scancodeWriteIndex = next;
+  }
+  softirq_raise(SOFTIRQ_KEYBOARD);
+}
+
+// SOFTIRQ_KEYBOARD: decode buffered scan codes with interrupts enabled
+static void keyboardSoftirq(void) {
+  for (int i = 0; i < KEYBOARD_SOFTIRQ_BUDGET; i++) {
+    if (scancodeReadIndex == scancodeWriteIndex) {
+      return;
+    }
+    uint8_t scancode = scancodeBuffer[scancodeReadIndex];
+    scancodeReadIndex = (scancodeReadIndex + 1) % SCANCODE_BUFFER_SIZE;
+    keyboardDecode(scancode);
+  }
+  // budget used up, continue in the next pass
+  if (scancodeReadIndex != scancodeWriteIndex) {
+    softirq_raise(SOFTIRQ_KEYBOARD);
+  }
+}
+
+void keyboardInit(void) {
+  keyBufferInit();
+  extended_key = false;
+  scancodeReadIndex = 0;
+  scancodeWriteIndex = 0;
+  softirq_register(SOFTIRQ_KEYBOARD, keyboardSoftirq);
+  irq_register(KEYBOARD_VECTOR, keyboardIrq, NULL);
+  irq_set_name(KEYBOARD_VECTOR, "keyboard");
 }
 
 KeyCode keyBufferGet() {
-  if (keyBufferIsEmpty()) {
+  uint32_t flags = spin_lock_irqsave(&keyBufferLock);
+  KeyCode key = KEY_NONE;
+  if (!keyBufferIsEmpty()) {
+    key = keyBuffer[keyBufferReadIndex];
+    keyBufferReadIndex = (keyBufferReadIndex + 1) % KEY_BUFFER_SIZE;
+  }
+  spin_unlock_irqrestore(&keyBufferLock, flags);
+  return key;
+}
+
+KeyCode keyBufferWait(void) {
+  if (!wait_event(&keyWaiters, !keyBufferIsEmpty())) {
     return KEY_NONE;
   }
-  uint8_t temp = keyBufferReadIndex;
-  keyBufferReadIndex = (keyBufferReadIndex + 1) % KEY_BUFFER_SIZE;
-  return keyBuffer[temp];
+  return keyBufferGet();
 }
 
 char getCharFromKey(KeyCode key) {
@@ -11,6 +11,7 @@
  * to map a key to a printable character.
  */
 
+#include "interrupts.h"
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -74,6 +75,17 @@ typedef enum {
   KEY_ARROW_RIGHT = 0xE04D,
 } KeyCode;
 
+/** @brief Interrupt vector of the PS/2 keyboard (IRQ1). */
+#define KEYBOARD_VECTOR (IRQ_BASE + 1)
+
+/**
+ * @brief Initializes the keyboard driver.
+ * @details Resets the key buffer and registers the IRQ1 handler. The handler
+ * only buffers the raw scan code, decoding into the key buffer happens in
+ * the SOFTIRQ_KEYBOARD softirq.
+ */
+void keyboardInit(void);
+
 /**
  * @brief Initializes the key buffer.
  * @details This function sets up the key buffer to store keyboard input.
@@ -94,6 +106,14 @@ void keyBufferPut(KeyCode keycode);
  */
 KeyCode keyBufferGet();
 
+/**
+ * @brief Sleeps until a key is in the key buffer, then retrieves it.
+ * @return KeyCode The key code, KEY_NONE if thread_kill() ended the wait
+ * or another reader took the key first.
+ * @details The calling thread blocks (see sync.h) instead of polling.
+ */
+KeyCode keyBufferWait(void);
+
 /**
  * @brief Checks if the key buffer is empty.
  * @return true If the key buffer is empty.
@@ -0,0 +1,333 @@
+#include "kmem.h"
+#include "cpufeatures.h"
+#include "fpu.h"
+#include <stdbool.h>
+
+// below this many bytes saving the FPU state costs more than SIMD saves
+#define KMEM_SIMD_THRESHOLD 1024
+
+// bytes moved per iteration of the SSE2 loops
+#define SSE2_BLOCK 64
+
+// word-at-a-time helpers: a word has a zero byte iff
+// (w - 0x01010101) & ~w & 0x80808080 is not zero
+#define ONES 0x01010101u
+#define HIGHS 0x80808080u
+
+/*
+ * Plain variants, they work on every CPU and are the boot defaults.
+ */
+
+static void *memcpy_movsd(void *dest, const void *src, size_t n) {
+  void *d = dest;
+  size_t dwords = n / 4;
+  size_t rest = n % 4;
+  __asm__ volatile("rep movsl"
+                   : "+D"(d), "+S"(src), "+c"(dwords)
+                   :
+                   : "memory");
+  __asm__ volatile("rep movsb"
+                   : "+D"(d), "+S"(src), "+c"(rest)
+                   :
+                   : "memory");
+  return dest;
+}
+
+static void *memset_stosd(void *dest, int value, size_t n) {
+  void *d = dest;
+  uint32_t pattern = (uint8_t)value * ONES;
+  size_t dwords = n / 4;
+  size_t rest = n % 4;
+  __asm__ volatile("rep stosl"
+                   : "+D"(d), "+c"(dwords)
+                   : "a"(pattern)
+                   : "memory");
+  __asm__ volatile("rep stosb"
+                   : "+D"(d), "+c"(rest)
+                   : "a"(pattern)
+                   : "memory");
+  return dest;
+}
+
+static void fill16_stosw(uint16_t *dest, uint16_t value, size_t count) {
+  __asm__ volatile("rep stosw"
+                   : "+D"(dest), "+c"(count)
+                   : "a"(value)
+                   : "memory");
+}
+
+static size_t strlen_bytes(const char *str) {
+  size_t len = 0;
+  while (str[len]) {
+    len++;
+  }
+  return len;
+}
+
+static uint8_t checksum8_bytes(const void *data, size_t length) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  uint8_t sum = 0;
+  for (size_t i = 0; i < length; i++) {
+    sum += bytes[i];
+  }
+  return sum;
+}
+
+/*
+ * Variants for CPUs with enhanced rep movsb/stosb (ERMS): the microcode
+ * moves whole cache lines, so the byte string instructions beat any
+ * hand-written loop at every size.
+ */
+
+static void *memcpy_movsb(void *dest, const void *src, size_t n) {
+  void *d = dest;
+  __asm__ volatile("rep movsb" : "+D"(d), "+S"(src), "+c"(n) : : "memory");
+  return dest;
+}
+
+static void *memset_stosb(void *dest, int value, size_t n) {
+  void *d = dest;
+  __asm__ volatile("rep stosb"
+                   : "+D"(d), "+c"(n)
+                   : "a"(value)
+                   : "memory");
+  return dest;
+}
+
+/*
+ * Word-at-a-time variants, they only need 32-bit registers. Aligned word
+ * reads never cross a page boundary, so reading past the terminator of a
+ * string is safe.
+ */
+
+static size_t strlen_words(const char *str) {
+  const char *p = str;
+  while ((uintptr_t)p % 4 != 0) {
+    if (*p == '\0') {
+      return (size_t)(p - str);
+    }
+    p++;
+  }
+  const uint32_t *w = (const uint32_t *)p;
+  while (((*w - ONES) & ~*w & HIGHS) == 0) {
+    w++;
+  }
+  p = (const char *)w;
+  while (*p != '\0') {
+    p++;
+  }
+  return (size_t)(p - str);
+}
+
+static uint8_t checksum8_words(const void *data, size_t length) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  uint32_t sum = 0;
+  while (length > 0 && (uintptr_t)bytes % 4 != 0) {
+    sum += *bytes++;
+    length--;
+  }
+  const uint32_t *words = (const uint32_t *)bytes;
+  size_t count = length / 4;
+  while (count > 0) {
+    // two 16-bit lanes per accumulator overflow after 257 words
+    size_t chunk = count < 256 ? count : 256;
+    uint32_t even = 0, odd = 0;
+    for (size_t i = 0; i < chunk; i++) {
+      even += words[i] & 0x00FF00FFu;
+      odd += (words[i] >> 8) & 0x00FF00FFu;
+    }
+    sum += (even & 0xFFFF) + (even >> 16) + (odd & 0xFFFF) + (odd >> 16);
+    words += chunk;
+    count -= chunk;
+  }
+  bytes = (const uint8_t *)words;
+  for (size_t i = 0; i < length % 4; i++) {
+    sum += bytes[i];
+  }
+  return (uint8_t)sum;
+}
+
+/*
+ * SSE2 variants. The loops live in their own functions with the sse2
+ * target, so the compiler never uses XMM registers outside of the
+ * kernel_fpu_begin()/kernel_fpu_end() section.
+ */
+
+// blocks must be at least 1, the callers only get here above the threshold
+__attribute__((target("sse2"))) static void
+copy_blocks_sse2(uint8_t *dest, const uint8_t *src, size_t blocks) {
+  __asm__ volatile("1:\n\t"
+                   "movdqu (%1), %%xmm0\n\t"
+                   "movdqu 16(%1), %%xmm1\n\t"
+                   "movdqu 32(%1), %%xmm2\n\t"
+                   "movdqu 48(%1), %%xmm3\n\t"
+                   "movdqu %%xmm0, (%0)\n\t"
+                   "movdqu %%xmm1, 16(%0)\n\t"
+                   "movdqu %%xmm2, 32(%0)\n\t"
+                   "movdqu %%xmm3, 48(%0)\n\t"
+                   "add $64, %0\n\t"
+                   "add $64, %1\n\t"
+                   "dec %2\n\t"
+                   "jnz 1b"
+                   : "+r"(dest), "+r"(src), "+r"(blocks)
+                   :
+                   : "memory", "cc", "xmm0", "xmm1", "xmm2", "xmm3");
+}
+
+// pattern holds 16 bytes that are repeated over the destination
+__attribute__((target("sse2"))) static void
+fill_blocks_sse2(uint8_t *dest, const uint32_t pattern[4], size_t blocks) {
+  __asm__ volatile("movdqu (%2), %%xmm0\n"
+                   "1:\n\t"
+                   "movdqu %%xmm0, (%0)\n\t"
+                   "movdqu %%xmm0, 16(%0)\n\t"
+                   "movdqu %%xmm0, 32(%0)\n\t"
+                   "movdqu %%xmm0, 48(%0)\n\t"
+                   "add $64, %0\n\t"
+                   "dec %1\n\t"
+                   "jnz 1b"
+                   : "+r"(dest), "+r"(blocks)
+                   : "r"(pattern)
+                   : "memory", "cc", "xmm0");
+}
+
+// psadbw against zero adds up eight bytes into each 64-bit half
+__attribute__((target("sse2"))) static uint32_t
+sum_blocks_sse2(const uint8_t *src, size_t blocks) {
+  uint32_t low, high;
+  __asm__ volatile("pxor %%xmm7, %%xmm7\n\t"
+                   "pxor %%xmm4, %%xmm4\n"
+                   "1:\n\t"
+                   "movdqu (%2), %%xmm0\n\t"
+                   "movdqu 16(%2), %%xmm1\n\t"
+                   "movdqu 32(%2), %%xmm2\n\t"
+                   "movdqu 48(%2), %%xmm3\n\t"
+                   "psadbw %%xmm7, %%xmm0\n\t"
+                   "psadbw %%xmm7, %%xmm1\n\t"
+                   "psadbw %%xmm7, %%xmm2\n\t"
+                   "psadbw %%xmm7, %%xmm3\n\t"
+                   "paddq %%xmm0, %%xmm4\n\t"
+                   "paddq %%xmm1, %%xmm4\n\t"
+                   "paddq %%xmm2, %%xmm4\n\t"
+                   "paddq %%xmm3, %%xmm4\n\t"
+                   "add $64, %2\n\t"
+                   "dec %3\n\t"
+                   "jnz 1b\n\t"
+                   "movd %%xmm4, %0\n\t"
+                   "psrldq $8, %%xmm4\n\t"
+                   "movd %%xmm4, %1"
+                   : "=&r"(low), "=&r"(high), "+r"(src), "+r"(blocks)
+                   :
+                   : "memory", "cc", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4",
+                     "xmm7");
+  return low + high;
+}
+
+static void *memcpy_sse2(void *dest, const void *src, size_t n) {
+  if (n < KMEM_SIMD_THRESHOLD) {
+    return memcpy_movsd(dest, src, n);
+  }
+  size_t blocks = n / SSE2_BLOCK;
+  size_t done = blocks * SSE2_BLOCK;
+  kernel_fpu_begin();
+  copy_blocks_sse2((uint8_t *)dest, (const uint8_t *)src, blocks);
+  kernel_fpu_end();
+  memcpy_movsd((uint8_t *)dest + done, (const uint8_t *)src + done, n - done);
+  return dest;
+}
+
+static void *memset_sse2(void *dest, int value, size_t n) {
+  if (n < KMEM_SIMD_THRESHOLD) {
+    return memset_stosd(dest, value, n);
+  }
+  uint32_t word = (uint8_t)value * ONES;
+  uint32_t pattern[4] = {word, word, word, word};
+  size_t blocks = n / SSE2_BLOCK;
+  size_t done = blocks * SSE2_BLOCK;
+  kernel_fpu_begin();
+  fill_blocks_sse2((uint8_t *)dest, pattern, blocks);
+  kernel_fpu_end();
+  memset_stosd((uint8_t *)dest + done, value, n - done);
+  return dest;
+}
+
+static void fill16_sse2(uint16_t *dest, uint16_t value, size_t count) {
+  if (count * 2 < KMEM_SIMD_THRESHOLD) {
+    fill16_stosw(dest, value, count);
+    return;
+  }
+  uint32_t word = value | (uint32_t)value << 16;
+  uint32_t pattern[4] = {word, word, word, word};
+  size_t blocks = count * 2 / SSE2_BLOCK;
+  size_t done = blocks * SSE2_BLOCK / 2;
+  kernel_fpu_begin();
+  fill_blocks_sse2((uint8_t *)dest, pattern, blocks);
+  kernel_fpu_end();
+  fill16_stosw(dest + done, value, count - done);
+}
+
+static uint8_t checksum8_sse2(const void *data, size_t length) {
+  if (length < KMEM_SIMD_THRESHOLD) {
+    return checksum8_words(data, length);
+  }
+  size_t blocks = length / SSE2_BLOCK;
+  size_t done = blocks * SSE2_BLOCK;
+  kernel_fpu_begin();
+  uint32_t sum = sum_blocks_sse2((const uint8_t *)data, blocks);
+  kernel_fpu_end();
+  return (uint8_t)(sum + checksum8_words((const uint8_t *)data + done,
+                                         length - done));
+}
+
+KmemOps kmemOps = {
+    .memcpy = memcpy_movsd,
+    .memset = memset_stosd,
+    .fill16 = fill16_stosw,
+    .strlen = strlen_bytes,
+    .checksum8 = checksum8_bytes,
+};
+
+static const char *implNames[KMEM_ROUTINE_COUNT] = {
+    [KMEM_MEMCPY] = "rep movsd",  [KMEM_MEMSET] = "rep stosd",
+    [KMEM_FILL16] = "rep stosw",  [KMEM_STRLEN] = "bytes",
+    [KMEM_CHECKSUM8] = "bytes",
+};
+
+void kmem_init(void) {
+  const CpuFeatures *cpu = cpu_features();
+  // SSE registers are only usable once fpu_init() enabled fxsave/xsave
+  bool sse2 = cpu->sse2 && fpu_save_method() >= FPU_SAVE_FXSAVE;
+
+  if (cpu->erms) {
+    kmemOps.memcpy = memcpy_movsb;
+    kmemOps.memset = memset_stosb;
+    implNames[KMEM_MEMCPY] = "rep movsb (erms)";
+    implNames[KMEM_MEMSET] = "rep stosb (erms)";
+  } else if (sse2) {
+    kmemOps.memcpy = memcpy_sse2;
+    kmemOps.memset = memset_sse2;
+    implNames[KMEM_MEMCPY] = "sse2";
+    implNames[KMEM_MEMSET] = "sse2";
+  }
+
+  if (sse2) {
+    kmemOps.fill16 = fill16_sse2;
+    kmemOps.checksum8 = checksum8_sse2;
+    implNames[KMEM_FILL16] = "sse2";
+    implNames[KMEM_CHECKSUM8] = "sse2";
+  } else {
+    kmemOps.checksum8 = checksum8_words;
+    implNames[KMEM_CHECKSUM8] = "words";
+  }
+
+  // strings are short, an FPU save per call would never pay off
+  kmemOps.strlen = strlen_words;
+  implNames[KMEM_STRLEN] = "words";
+}
+
+const char *kmem_impl_name(KmemRoutine routine) {
+  if (routine >= KMEM_ROUTINE_COUNT) {
+    return "?";
+  }
+  return implNames[routine];
+}
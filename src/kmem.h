@@ -0,0 +1,112 @@
+#ifndef KMEM_H
+#define KMEM_H
+
+/**
+ * @file kmem.h
+ * @brief Memory, string and checksum routines selected per CPU at boot.
+ *
+ * Every routine is called through ::kmemOps. The table starts out with
+ * plain implementations that work on any x86 CPU, so the routines can be
+ * used before kmem_init(). kmem_init() then picks the best variant for the
+ * CPU found by cpu_features_init() (rep movsb/stosb with ERMS, SSE2 for
+ * large blocks, ...), so one kernel binary makes use of whatever the CPU
+ * model offers.
+ *
+ * SIMD variants bracket their work with kernel_fpu_begin()/kernel_fpu_end()
+ * and only take that path above a size threshold, below it the FPU state
+ * save costs more than the wider loads and stores save.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief The dispatched routines, used to query the selected variant.
+ */
+typedef enum {
+  KMEM_MEMCPY,    /**< memcpyOS() */
+  KMEM_MEMSET,    /**< memsetOS() */
+  KMEM_FILL16,    /**< fill16OS() */
+  KMEM_STRLEN,    /**< strlenOS() */
+  KMEM_CHECKSUM8, /**< checksum8OS() */
+  KMEM_ROUTINE_COUNT,
+} KmemRoutine;
+
+/**
+ * @brief The dispatch table, one function pointer per routine.
+ */
+typedef struct {
+  void *(*memcpy)(void *dest, const void *src, size_t n);
+  void *(*memset)(void *dest, int value, size_t n);
+  void (*fill16)(uint16_t *dest, uint16_t value, size_t count);
+  size_t (*strlen)(const char *str);
+  uint8_t (*checksum8)(const void *data, size_t length);
+} KmemOps;
+
+/** @brief The selected implementations, written once by kmem_init(). */
+extern KmemOps kmemOps;
+
+/**
+ * @brief Selects the best implementation of every routine for this CPU.
+ *
+ * @details Must run after cpu_features_init() and fpu_init(). Interrupt
+ * handlers may already be using the routines, every pointer is replaced
+ * with a single aligned store.
+ */
+void kmem_init(void);
+
+/**
+ * @brief Returns the name of the variant selected for a routine.
+ *
+ * @param routine The routine.
+ * @return const char* e.g. "rep movsb", "sse2".
+ */
+const char *kmem_impl_name(KmemRoutine routine);
+
+/**
+ * @brief Copies n bytes, the areas must not overlap.
+ *
+ * @param dest The destination.
+ * @param src The source.
+ * @param n The number of bytes.
+ * @return void* dest.
+ */
+static inline void *memcpyOS(void *dest, const void *src, size_t n) {
+  return kmemOps.memcpy(dest, src, n);
+}
+
+/**
+ * @brief Sets n bytes to a value.
+ *
+ * @param dest The destination.
+ * @param value The byte value (only the low 8 bits are used).
+ * @param n The number of bytes.
+ * @return void* dest.
+ */
+static inline void *memsetOS(void *dest, int value, size_t n) {
+  return kmemOps.memset(dest, value, n);
+}
+
+/**
+ * @brief Sets count 16-bit cells to a value, e.g. to fill VGA text memory.
+ *
+ * @param dest The first cell.
+ * @param value The cell value.
+ * @param count The number of cells.
+ */
+static inline void fill16OS(uint16_t *dest, uint16_t value, size_t count) {
+  kmemOps.fill16(dest, value, count);
+}
+
+/**
+ * @brief Sums up bytes modulo 256, as used by ACPI and SMBIOS checksums.
+ *
+ * @param data The data.
+ * @param length The number of bytes.
+ * @return uint8_t The sum of all bytes, 0 for a valid ACPI table.
+ */
+static inline uint8_t checksum8OS(const void *data, size_t length) {
+  return kmemOps.checksum8(data, length);
+}
+
+#endif
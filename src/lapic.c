@@ -0,0 +1,293 @@
+#include "lapic.h"
+#include "cpu.h"
+#include "interrupts.h"
+#include "time.h"
+#include <stddef.h>
+
+// Local APIC register offsets (relative to the MMIO base)
+#define LAPIC_REG_ID 0x020
+#define LAPIC_REG_TPR 0x080
+#define LAPIC_REG_EOI 0x0B0
+#define LAPIC_REG_SVR 0x0F0
+#define LAPIC_REG_ICR_LOW 0x300
+#define LAPIC_REG_ICR_HIGH 0x310
+#define LAPIC_REG_LVT_TIMER 0x320
+#define LAPIC_REG_TIMER_INITIAL 0x380
+#define LAPIC_REG_TIMER_CURRENT 0x390
+#define LAPIC_REG_TIMER_DIVIDE 0x3E0
+
+// bits in the APIC base MSR and the spurious vector register
+#define APIC_BASE_ENABLE (1u << 11)
+#define APIC_BASE_ADDR_MASK 0xFFFFF000u
+#define SVR_APIC_ENABLE (1u << 8)
+
+// LVT timer register bits
+#define LVT_MASKED (1u << 16)
+#define LVT_TIMER_ONESHOT (0u << 17)
+#define LVT_TIMER_PERIODIC (1u << 17)
+#define LVT_TIMER_TSC_DEADLINE (2u << 17)
+
+// interrupt command register bits
+#define ICR_DELIVERY_INIT (5u << 8)
+#define ICR_DELIVERY_STARTUP (6u << 8)
+#define ICR_SEND_PENDING (1u << 12)
+#define ICR_LEVEL_ASSERT (1u << 14)
+#define ICR_DESTINATION_SHIFT 24
+
+// divide configuration value 0x3 selects divide by 16
+#define TIMER_DIVIDE_BY_16 0x3
+
+// CPUID.1 feature bits we depend on
+#define CPUID1_EDX_APIC (1u << 9)
+#define CPUID1_ECX_TSC_DEADLINE (1u << 24)
+
+// calibration window against the PIT
+#define CALIBRATION_US 10000u
+
+static volatile uint32_t *lapicBase = NULL;
+static bool vectorsRegistered = false;
+static bool tscDeadline = false;
+static uint32_t timerHz = 0;
+static LapicTimerMode timerMode = LAPIC_TIMER_OFF;
+
+// periodic tick state (TSC-deadline emulation keeps the next deadline here)
+static LapicTimerCallback tickCallback = NULL;
+static uint64_t tickPeriodTsc = 0;
+static uint64_t nextTickTsc = 0;
+
+// pending one-shot timer
+static LapicTimerCallback oneshotCallback = NULL;
+static uint64_t oneshotTsc = 0;
+
+static inline uint32_t lapic_read(uint32_t reg) {
+  return lapicBase[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+  lapicBase[reg / 4] = value;
+}
+
+// timer vector: run the timer logic, then acknowledge at the Local APIC
+static void lapic_timer_interrupt(registers_t *regs, void *ctx) {
+  (void)regs;
+  (void)ctx;
+  lapic_timer_irq();
+  lapic_eoi();
+}
+
+// spurious interrupts must not be acknowledged
+static void lapic_spurious_interrupt(registers_t *regs, void *ctx) {
+  (void)regs;
+  (void)ctx;
+}
+
+bool lapic_init(void) {
+  uint32_t eax, ebx, ecx, edx;
+  cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+  if (!(edx & CPUID1_EDX_APIC)) {
+    return false;
+  }
+  tscDeadline = (ecx & CPUID1_ECX_TSC_DEADLINE) != 0 && tsc_hz() != 0;
+
+  // make sure the APIC is globally enabled and find its MMIO window
+  uint64_t base = rdmsr(MSR_IA32_APIC_BASE);
+  wrmsr(MSR_IA32_APIC_BASE, base | APIC_BASE_ENABLE);
+  lapicBase = (volatile uint32_t *)(uintptr_t)(base & APIC_BASE_ADDR_MASK);
+
+  // accept all priorities and software-enable the APIC
+  lapic_write(LAPIC_REG_TPR, 0);
+  lapic_write(LAPIC_REG_SVR, SVR_APIC_ENABLE | LAPIC_SPURIOUS_VECTOR);
+
+  lapic_write(LAPIC_REG_LVT_TIMER, LVT_MASKED);
+
+  if (!vectorsRegistered) {
+    irq_register(LAPIC_TIMER_VECTOR, lapic_timer_interrupt, NULL);
+    irq_register(LAPIC_SPURIOUS_VECTOR, lapic_spurious_interrupt, NULL);
+    irq_set_name(LAPIC_TIMER_VECTOR, "lapic-timer");
+    irq_set_name(LAPIC_SPURIOUS_VECTOR, "lapic-spurious");
+    vectorsRegistered = true;
+  }
+  return true;
+}
+
+bool lapic_available(void) { return lapicBase != NULL; }
+
+uint32_t lapic_id(void) {
+  if (lapicBase == NULL) {
+    return 0;
+  }
+  return lapic_read(LAPIC_REG_ID) >> 24;
+}
+
+void lapic_eoi(void) { lapic_write(LAPIC_REG_EOI, 0); }
+
+// writing the low half sends the IPI, so the destination goes first
+static void lapic_send_ipi(uint32_t apicId, uint32_t command) {
+  lapic_write(LAPIC_REG_ICR_HIGH, apicId << ICR_DESTINATION_SHIFT);
+  lapic_write(LAPIC_REG_ICR_LOW, command);
+  while (lapic_read(LAPIC_REG_ICR_LOW) & ICR_SEND_PENDING) {
+    cpu_relax();
+  }
+}
+
+void lapic_send_init(uint32_t apicId) {
+  lapic_send_ipi(apicId, ICR_DELIVERY_INIT | ICR_LEVEL_ASSERT);
+}
+
+void lapic_send_startup(uint32_t apicId, uint8_t page) {
+  lapic_send_ipi(apicId, ICR_DELIVERY_STARTUP | ICR_LEVEL_ASSERT | page);
+}
+
+bool lapic_timer_calibrate(void) {
+  if (lapicBase == NULL) {
+    return false;
+  }
+  // let the counter run down from its maximum while the PIT measures a
+  // fixed window, the interrupt stays masked during the measurement
+  lapic_write(LAPIC_REG_TIMER_DIVIDE, TIMER_DIVIDE_BY_16);
+  lapic_write(LAPIC_REG_LVT_TIMER, LVT_MASKED | LVT_TIMER_ONESHOT);
+  lapic_write(LAPIC_REG_TIMER_INITIAL, 0xFFFFFFFF);
+  pit_delay_us(CALIBRATION_US);
+  uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_REG_TIMER_CURRENT);
+  lapic_write(LAPIC_REG_TIMER_INITIAL, 0);
+
+  timerHz = elapsed * (1000000u / CALIBRATION_US);
+  return timerHz != 0;
+}
+
+uint32_t lapic_timer_frequency(void) { return timerHz; }
+
+bool lapic_timer_has_tsc_deadline(void) { return tscDeadline; }
+
+LapicTimerMode lapic_timer_mode(void) { return timerMode; }
+
+// Programs the deadline MSR with the earliest pending expiry
+static void lapic_arm_deadline(void) {
+  uint64_t deadline = 0;
+  if (tickCallback != NULL) {
+    deadline = nextTickTsc;
+  }
+  if (oneshotCallback != NULL && (deadline == 0 || oneshotTsc < deadline)) {
+    deadline = oneshotTsc;
+  }
+  // a deadline of 0 disarms the timer
+  wrmsr(MSR_IA32_TSC_DEADLINE, deadline);
+}
+
+static void lapic_enter_deadline_mode(void) {
+  if (timerMode != LAPIC_TIMER_TSC_DEADLINE) {
+    lapic_write(LAPIC_REG_LVT_TIMER,
+                LVT_TIMER_TSC_DEADLINE | LAPIC_TIMER_VECTOR);
+    // the LVT write must be ordered before the first deadline write
+    __asm__ volatile("mfence" ::: "memory");
+    timerMode = LAPIC_TIMER_TSC_DEADLINE;
+  }
+}
+
+void lapic_timer_start_periodic(uint32_t hz, LapicTimerCallback callback) {
+  if (lapicBase == NULL || timerHz == 0 || hz == 0) {
+    return;
+  }
+  tickCallback = callback;
+
+  if (tscDeadline) {
+    tickPeriodTsc = tsc_hz() / hz;
+    nextTickTsc = rdtsc() + tickPeriodTsc;
+    lapic_enter_deadline_mode();
+    lapic_arm_deadline();
+    return;
+  }
+
+  uint32_t count = (timerHz + hz / 2) / hz;
+  if (count == 0) {
+    count = 1;
+  }
+  lapic_write(LAPIC_REG_TIMER_DIVIDE, TIMER_DIVIDE_BY_16);
+  lapic_write(LAPIC_REG_LVT_TIMER, LVT_TIMER_PERIODIC | LAPIC_TIMER_VECTOR);
+  lapic_write(LAPIC_REG_TIMER_INITIAL, count);
+  timerMode = LAPIC_TIMER_PERIODIC;
+}
+
+bool lapic_timer_oneshot_us(uint32_t us, LapicTimerCallback callback) {
+  if (lapicBase == NULL || timerHz == 0 || callback == NULL) {
+    return false;
+  }
+
+  if (tscDeadline) {
+    oneshotTsc = rdtsc() + (tsc_hz() * us) / 1000000u;
+    oneshotCallback = callback;
+    lapic_enter_deadline_mode();
+    lapic_arm_deadline();
+    return true;
+  }
+
+  if (timerMode == LAPIC_TIMER_PERIODIC) {
+    return false;
+  }
+  uint64_t count = ((uint64_t)timerHz * us) / 1000000u;
+  if (count == 0) {
+    count = 1;
+  }
+  if (count > 0xFFFFFFFFu) {
+    count = 0xFFFFFFFFu;
+  }
+  oneshotCallback = callback;
+  lapic_write(LAPIC_REG_TIMER_DIVIDE, TIMER_DIVIDE_BY_16);
+  lapic_write(LAPIC_REG_LVT_TIMER, LVT_TIMER_ONESHOT | LAPIC_TIMER_VECTOR);
+  lapic_write(LAPIC_REG_TIMER_INITIAL, (uint32_t)count);
+  timerMode = LAPIC_TIMER_ONESHOT;
+  return true;
+}
+
+void lapic_timer_stop(void) {
+  if (lapicBase == NULL) {
+    return;
+  }
+  tickCallback = NULL;
+  oneshotCallback = NULL;
+  if (timerMode == LAPIC_TIMER_TSC_DEADLINE) {
+    wrmsr(MSR_IA32_TSC_DEADLINE, 0);
+  }
+  lapic_write(LAPIC_REG_TIMER_INITIAL, 0);
+  lapic_write(LAPIC_REG_LVT_TIMER, LVT_MASKED);
+  timerMode = LAPIC_TIMER_OFF;
+}
+
+void lapic_timer_irq(void) {
+  if (timerMode == LAPIC_TIMER_PERIODIC) {
+    if (tickCallback != NULL) {
+      tickCallback();
+    }
+    return;
+  }
+
+  if (timerMode == LAPIC_TIMER_ONESHOT) {
+    LapicTimerCallback callback = oneshotCallback;
+    oneshotCallback = NULL;
+    timerMode = LAPIC_TIMER_OFF;
+    if (callback != NULL) {
+      callback();
+    }
+    return;
+  }
+
+  if (timerMode != LAPIC_TIMER_TSC_DEADLINE) {
+    return;
+  }
+
+  uint64_t now = rdtsc();
+  // replay every tick whose deadline has passed, so a long interrupts-off
+  // section does not make the tick count drift
+  if (tickCallback != NULL) {
+    while (nextTickTsc <= now) {
+      nextTickTsc += tickPeriodTsc;
+      tickCallback();
+    }
+  }
+  if (oneshotCallback != NULL && oneshotTsc <= now) {
+    LapicTimerCallback callback = oneshotCallback;
+    oneshotCallback = NULL;
+    callback();
+  }
+  lapic_arm_deadline();
+}
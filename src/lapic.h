@@ -0,0 +1,143 @@
+#ifndef LAPIC_H
+#define LAPIC_H
+
+/**
+ * @file lapic.h
+ * @brief Local APIC driver and Local APIC timer.
+ *
+ * The Local APIC timer is programmed through per-CPU MMIO registers (or a
+ * single MSR write in TSC-deadline mode) instead of the slow port I/O needed
+ * to reprogram the 8253 PIT. The timer is calibrated against the PIT once at
+ * boot and can then run in periodic, one-shot or TSC-deadline mode.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Interrupt vectors used by the Local APIC
+#define LAPIC_TIMER_VECTOR 48
+#define LAPIC_SPURIOUS_VECTOR 0xFF
+
+/**
+ * @brief The hardware mode the Local APIC timer is running in.
+ */
+typedef enum {
+  LAPIC_TIMER_OFF,          /**< Timer is stopped (masked). */
+  LAPIC_TIMER_PERIODIC,     /**< Counter reloads automatically. */
+  LAPIC_TIMER_ONESHOT,      /**< Counter fires once and stops. */
+  LAPIC_TIMER_TSC_DEADLINE, /**< Fires when the TSC reaches a deadline. */
+} LapicTimerMode;
+
+/**
+ * @brief Callback type invoked from the Local APIC timer interrupt.
+ */
+typedef void (*LapicTimerCallback)(void);
+
+/**
+ * @brief Detects and enables the Local APIC of the calling CPU.
+ *
+ * @return true If a Local APIC was found and enabled.
+ * @return false If CPUID does not report an APIC.
+ * @details Also registers the handlers for ::LAPIC_TIMER_VECTOR and
+ * ::LAPIC_SPURIOUS_VECTOR with irq_register().
+ */
+bool lapic_init(void);
+
+/**
+ * @brief Checks whether the Local APIC has been enabled.
+ *
+ * @return true If lapic_init() succeeded.
+ */
+bool lapic_available(void);
+
+/**
+ * @brief Returns the APIC ID of the calling CPU.
+ *
+ * @return uint32_t The Local APIC ID.
+ */
+uint32_t lapic_id(void);
+
+/**
+ * @brief Signals end of interrupt to the Local APIC.
+ */
+void lapic_eoi(void);
+
+/**
+ * @brief Sends an INIT IPI, which resets the target CPU into wait-for-SIPI.
+ *
+ * @param apicId Local APIC ID of the target CPU.
+ */
+void lapic_send_init(uint32_t apicId);
+
+/**
+ * @brief Sends a startup IPI (SIPI).
+ *
+ * @param apicId Local APIC ID of the target CPU.
+ * @param page The target starts in real mode at physical page * 4096.
+ */
+void lapic_send_startup(uint32_t apicId, uint8_t page);
+
+/**
+ * @brief Calibrates the Local APIC timer against the PIT.
+ *
+ * @return true If the timer frequency could be determined.
+ */
+bool lapic_timer_calibrate(void);
+
+/**
+ * @brief Returns the calibrated Local APIC timer frequency.
+ *
+ * @return uint32_t Timer counts per second (after the divider), 0 if uncalibrated.
+ */
+uint32_t lapic_timer_frequency(void);
+
+/**
+ * @brief Checks whether CPUID advertises TSC-deadline mode.
+ *
+ * @return true If TSC-deadline mode can be used.
+ */
+bool lapic_timer_has_tsc_deadline(void);
+
+/**
+ * @brief Starts a periodic timer calling @p callback @p hz times per second.
+ *
+ * @param hz The tick frequency.
+ * @param callback Function called on every tick.
+ * @details Uses TSC-deadline mode when available and re-arms the deadline on
+ * every tick, otherwise the hardware periodic mode. Ticks that were missed
+ * because interrupts were disabled are replayed so that time does not drift.
+ */
+void lapic_timer_start_periodic(uint32_t hz, LapicTimerCallback callback);
+
+/**
+ * @brief Arms a one-shot timer that fires after @p us microseconds.
+ *
+ * @param us The delay in microseconds.
+ * @param callback Function called once when the timer expires.
+ * @return true If the timer was armed.
+ * @return false If the timer is uncalibrated or a hardware periodic tick is
+ * running (one-shot and periodic mode are exclusive without TSC-deadline).
+ */
+bool lapic_timer_oneshot_us(uint32_t us, LapicTimerCallback callback);
+
+/**
+ * @brief Stops the Local APIC timer.
+ */
+void lapic_timer_stop(void);
+
+/**
+ * @brief Returns the mode the timer hardware is currently programmed in.
+ *
+ * @return LapicTimerMode The current mode.
+ */
+LapicTimerMode lapic_timer_mode(void);
+
+/**
+ * @brief Local APIC timer interrupt handler.
+ *
+ * @details Called from the handler lapic_init() registers on
+ * ::LAPIC_TIMER_VECTOR, which also sends the EOI.
+ */
+void lapic_timer_irq(void);
+
+#endif
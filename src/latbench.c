@@ -0,0 +1,207 @@
+#include "latbench.h"
+#include "cpu.h"
+#include "printOS.h"
+#include "sched.h"
+#include "str.h"
+#include "sync.h"
+#include "terminal.h"
+#include "time.h"
+
+// histogram buckets: [0] < 1us, [i] < 2^i us, the last one catches the rest
+#define LATBENCH_BUCKETS 12
+
+/**
+ * @brief Accumulated latencies of one run, in TSC cycles.
+ */
+typedef struct {
+  uint64_t min;
+  uint64_t max;
+  uint64_t sum;
+  uint32_t count;
+  uint32_t histogram[LATBENCH_BUCKETS];
+} LatencyStats;
+
+static volatile bool fired = false;
+static volatile uint64_t firedTsc = 0;
+static WaitQueue timerWaiters = WAITQUEUE_INIT;
+static uint32_t loadCounter = 0;
+
+static void latbench_timer_fired(void) {
+  firedTsc = rdtsc();
+  fired = true;
+  waitqueue_wake_all(&timerWaiters);
+}
+
+// rewrites the whole screen, to put cache and bus pressure on every tick
+static void latbench_load_tick(void) {
+  loadCounter++;
+  char c = (char)('!' + loadCounter % 94);
+  uint8_t color = (uint8_t)(VGA_COLOR_LIGHT_GREY | (loadCounter % 8) << 4);
+  for (size_t y = 0; y < VGA_HEIGHT; y++) {
+    for (size_t x = 0; x < VGA_WIDTH; x++) {
+      screenPutchar(c, color, x, y);
+    }
+  }
+}
+
+static uint64_t cycles_to_ns(uint64_t cycles) {
+  return cycles * 1000u / (tsc_hz() / 1000000u);
+}
+
+static void stats_add(LatencyStats *stats, uint64_t cycles) {
+  if (stats->count == 0 || cycles < stats->min) {
+    stats->min = cycles;
+  }
+  if (cycles > stats->max) {
+    stats->max = cycles;
+  }
+  stats->sum += cycles;
+  stats->count++;
+
+  uint64_t us = cycles_to_ns(cycles) / 1000u;
+  uint32_t bucket = 0;
+  while (bucket < LATBENCH_BUCKETS - 1 && us >= (1ull << bucket)) {
+    bucket++;
+  }
+  stats->histogram[bucket]++;
+}
+
+// late wakeups count, early ones are clamped to zero
+static uint64_t lateness(uint64_t actual, uint64_t expected) {
+  return actual > expected ? actual - expected : 0;
+}
+
+// blocks until the one-shot callback ran, other threads get the CPU
+// meanwhile and the wakeup goes through the scheduler like any other
+static bool wait_for_timer(void) {
+  return wait_event(&timerWaiters, fired);
+}
+
+static bool run_timer_mode(uint32_t intervalUs, uint32_t loops,
+                           LatencyStats *irq, LatencyStats *wake) {
+  uint64_t intervalCycles = tsc_hz() / 1000000u * intervalUs;
+  for (uint32_t i = 0; i < loops && !thread_should_stop(); i++) {
+    fired = false;
+    uint64_t expected = rdtsc() + intervalCycles;
+    if (!timer_oneshot_us(intervalUs, latbench_timer_fired)) {
+      return false;
+    }
+    if (!wait_for_timer()) {
+      break; // killed, the timer fires into an empty queue
+    }
+    uint64_t woke = rdtsc();
+    stats_add(irq, lateness(firedTsc, expected));
+    stats_add(wake, lateness(woke, expected));
+  }
+  return true;
+}
+
+static void run_sleep_mode(uint32_t intervalUs, uint32_t loops,
+                           LatencyStats *wake) {
+  uint32_t ms = (intervalUs + 999) / 1000;
+  if (ms == 0) {
+    ms = 1;
+  }
+  uint64_t intervalCycles = tsc_hz() / 1000u * ms;
+  // start every sleep right after a tick, like a periodic task would
+  timer_sleep_ms(1);
+  for (uint32_t i = 0; i < loops && !thread_should_stop(); i++) {
+    uint64_t start = rdtsc();
+    timer_sleep_ms(ms);
+    stats_add(wake, lateness(rdtsc(), start + intervalCycles));
+  }
+}
+
+static void print_stats(const char *label, const LatencyStats *stats) {
+  char line[128] = "";
+  appendString(line, label);
+  appendString(line, " min ");
+  appendDecimal(line, cycles_to_ns(stats->min), 0);
+  appendString(line, " ns, avg ");
+  appendDecimal(line, cycles_to_ns(stats->sum / stats->count), 0);
+  appendString(line, " ns, max ");
+  appendDecimal(line, cycles_to_ns(stats->max), 0);
+  appendString(line, " ns");
+  terminalWriteLine(line);
+}
+
+static void print_histogram(const LatencyStats *stats) {
+  // the 80 column terminal fits three buckets per line
+  char line[128] = "";
+  for (uint32_t i = 0; i < LATBENCH_BUCKETS; i++) {
+    if (i == LATBENCH_BUCKETS - 1) {
+      appendString(line, "   >=");
+      appendDecimal(line, 1u << (i - 1), 4);
+    } else {
+      appendString(line, "    <");
+      appendDecimal(line, 1u << i, 4);
+    }
+    appendString(line, " us:");
+    appendDecimal(line, stats->histogram[i], 8);
+    if (i % 3 == 2 || i == LATBENCH_BUCKETS - 1) {
+      terminalWriteLine(line);
+      line[0] = '\0';
+    }
+  }
+}
+
+// docs see header file
+void runLatencyBenchmark(LatbenchMode mode, uint32_t intervalUs,
+                         uint32_t loops, bool load) {
+  if (tsc_hz() == 0) {
+    terminalWriteLine("latbench: TSC not calibrated");
+    return;
+  }
+  if (loops == 0 || intervalUs == 0) {
+    terminalWriteLine("latbench: interval and loops must be positive");
+    return;
+  }
+
+  LatencyStats irq = {0};
+  LatencyStats wake = {0};
+  bool timerOk = true;
+
+  if (load) {
+    loadCounter = 0;
+    timer_set_tick_hook(latbench_load_tick);
+  }
+  if (mode == LATBENCH_TIMER) {
+    timerOk = run_timer_mode(intervalUs, loops, &irq, &wake);
+  } else {
+    run_sleep_mode(intervalUs, loops, &wake);
+  }
+  if (load) {
+    timer_set_tick_hook(NULL);
+    initShowTerminal();
+  }
+
+  char line[128] = "";
+  if (!timerOk && wake.count == 0) {
+    terminalWriteLine("latbench: no event source supports one-shot timers,");
+    terminalWriteLine("falling back to sleep mode");
+    mode = LATBENCH_SLEEP;
+    run_sleep_mode(intervalUs, loops, &wake);
+  }
+
+  // killed as a background job before the first sample
+  if (wake.count == 0) {
+    terminalWriteLine("latbench: stopped");
+    return;
+  }
+
+  appendString(line, mode == LATBENCH_TIMER ? "one-shot timer" : "sleep");
+  appendString(line, " on ");
+  appendString(line, timer_source_name());
+  appendString(line, ", interval ");
+  appendDecimal(line, intervalUs, 0);
+  appendString(line, " us, ");
+  appendDecimal(line, wake.count, 0);
+  appendString(line, load ? " loops, screen load" : " loops, idle");
+  terminalWriteLine(line);
+
+  if (mode == LATBENCH_TIMER) {
+    print_stats("IRQ   ", &irq);
+  }
+  print_stats("Wakeup", &wake);
+  print_histogram(&wake);
+}
@@ -0,0 +1,38 @@
+#ifndef LATBENCH_H
+#define LATBENCH_H
+
+/**
+ * @file latbench.h
+ * @brief cyclictest-style timer wakeup latency benchmark.
+ *
+ * A timer (or a sleep) is armed repeatedly for a target interval and the
+ * actual wakeup is timestamped with the TSC. The difference between the
+ * expected and the actual wakeup is the latency, reported as min/avg/max
+ * and as a histogram.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief What the benchmark waits on.
+ */
+typedef enum {
+  LATBENCH_TIMER, /**< One-shot timer interrupt waking a wait queue. */
+  LATBENCH_SLEEP, /**< timer_sleep_ms(), i.e. the tick driven hlt loop. */
+} LatbenchMode;
+
+/**
+ * @brief Runs the latency benchmark and prints the results to the terminal.
+ *
+ * @param mode Whether to arm one-shot timers or to sleep.
+ * @param intervalUs The target interval in microseconds (rounded up to whole
+ * milliseconds in ::LATBENCH_SLEEP mode).
+ * @param loops The number of wakeups to measure.
+ * @param load If true, the screen is flooded from every timer tick while the
+ * benchmark runs.
+ */
+void runLatencyBenchmark(LatbenchMode mode, uint32_t intervalUs,
+                         uint32_t loops, bool load);
+
+#endif
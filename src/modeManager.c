@@ -1,4 +1,5 @@
 #include "modeManager.h"
+#include "events.h"
 #include "terminal.h"
 #include "keyboard.h"
 
@@ -22,6 +23,7 @@ OperatingMode getCurrentMode(void) {
 
 void setCurrentMode(OperatingMode mode) {
     currentMode = mode;
+    event_post(EVENT_MODE); // the main loop runs handleModeTransitions()
 }
 
 void setVisualModeHandlers(VisualModeInputHandler inputHandler, VisualModeUpdateHandler updateHandler) {
@@ -37,6 +39,8 @@ void handleModeTransitions(void) {
         }
         previousMode = currentMode; // Update previous mode
     }
+    // visual modes animate, they get an EVENT_TIMER per tick
+    events_want_ticks(currentMode == VISUAL_MODE);
 }
 
 void processModeInput(KeyCode key) {
@@ -47,7 +51,7 @@ void processModeInput(KeyCode key) {
         // Handle visual mode input using the current handler
         if (currentInputHandler != NULL) {
             if (currentInputHandler(key)) {
-                currentMode = TERMINAL_MODE; // Return to terminal mode
+                setCurrentMode(TERMINAL_MODE); // Return to terminal mode
             }
         }
     }
@@ -0,0 +1,188 @@
+#include "modules.h"
+#include "cpu.h"
+#include "elf.h"
+#include "str.h"
+#include "terminal.h"
+#include "time.h"
+#include <stddef.h>
+
+// multiboot flag bit of the module fields
+#define MBI_FLAG_MODULES (1u << 3)
+
+static BootModule modules[MODULES_MAX];
+static uint32_t moduleCount = 0;
+
+// the last path component of the first word of a module command line
+static void module_name(const char *cmdline, char *name) {
+  const char *start = cmdline;
+  const char *end = cmdline;
+  for (; *end != '\0' && *end != ' '; end++) {
+    if (*end == '/') {
+      start = end + 1;
+    }
+  }
+  size_t length = 0;
+  for (; start < end && length < MODULE_NAME_LENGTH - 1; start++) {
+    name[length++] = *start;
+  }
+  name[length] = '\0';
+}
+
+void modules_init(const multiboot_info_t *mbi) {
+  if (mbi == NULL || (mbi->flags & MBI_FLAG_MODULES) == 0) {
+    return;
+  }
+  const multiboot_module_t *loaded =
+      (const multiboot_module_t *)mbi->mods_addr;
+  moduleCount = 0;
+  for (uint32_t i = 0; i < mbi->mods_count && moduleCount < MODULES_MAX; i++) {
+    // only the identity mapped RAM below the user range is reachable
+    if (loaded[i].mod_end <= loaded[i].mod_start ||
+        loaded[i].mod_end > USER_BASE) {
+      continue;
+    }
+    BootModule *module = &modules[moduleCount];
+    module->start = (const uint8_t *)loaded[i].mod_start;
+    module->size = loaded[i].mod_end - loaded[i].mod_start;
+    module->cmdline =
+        loaded[i].string != 0 ? (const char *)loaded[i].string : "";
+    module_name(module->cmdline, module->name);
+    if (module->name[0] == '\0') {
+      appendString(module->name, "module");
+      appendDecimal(module->name, moduleCount, 0);
+    }
+    moduleCount++;
+  }
+}
+
+uint32_t modules_count(void) { return moduleCount; }
+
+const BootModule *modules_find(const char *name) {
+  for (uint32_t i = 0; i < moduleCount; i++) {
+    if (strcmpOS(modules[i].name, (char *)name) == 0) {
+      return &modules[i];
+    }
+  }
+  uint32_t index;
+  if (decimalStringToUint32(name, &index) && index < moduleCount) {
+    return &modules[index];
+  }
+  return NULL;
+}
+
+// whether the module starts like an ELF file, the loader checks the rest
+static bool module_is_elf(const BootModule *module) {
+  return module->size >= sizeof(ElfHeader) && module->start[0] == 0x7F &&
+         module->start[1] == 'E' && module->start[2] == 'L' &&
+         module->start[3] == 'F';
+}
+
+void printModulesToTerminal(void) {
+  char line[128] = "";
+  appendDecimal(line, moduleCount, 0);
+  appendString(line, " boot modules");
+  terminalWriteLine(line);
+  if (moduleCount == 0) {
+    terminalWriteLine("Pass programs with make run MODULES=\"prog.elf,other.elf\"");
+    return;
+  }
+  terminalWriteLine("  # NAME                                  BYTES  ADDRESS     TYPE");
+  for (uint32_t i = 0; i < moduleCount; i++) {
+    const BootModule *module = &modules[i];
+    char hex[12];
+    line[0] = '\0';
+    appendDecimal(line, i, 3);
+    appendString(line, " ");
+    appendString(line, module->name);
+    for (size_t len = strlenOS(module->name); len < 32; len++) {
+      appendString(line, " ");
+    }
+    appendDecimal(line, module->size, 11);
+    appendString(line, "  ");
+    intToHex((uint32_t)module->start, hex);
+    appendString(line, hex);
+    appendString(line, "  ");
+    appendString(line, module_is_elf(module) ? "ELF" : "data");
+    terminalWriteLine(line);
+  }
+}
+
+void runModuleProgram(const BootModule *module, const uint32_t *args,
+                      uint32_t argCount) {
+  if (!user_available()) {
+    terminalWriteLine("User mode needs paging with 4 MiB pages (PSE)");
+    return;
+  }
+  if (argCount > MODULE_MAX_ARGS) {
+    terminalWriteLine("exec: too many numbers");
+    return;
+  }
+  UserProcess *proc = user_process_create();
+  if (proc == NULL) {
+    terminalWriteLine("exec: no process slot or memory left");
+    return;
+  }
+
+  ElfImage loaded;
+  uint64_t start = rdtsc();
+  ElfStatus status = elf_load(proc, module->start, module->size, &loaded);
+  uint64_t loadCycles = rdtsc() - start;
+  char line[128] = "";
+  if (status != ELF_OK) {
+    appendString(line, "exec: ");
+    appendString(line, module->name);
+    appendString(line, ": ");
+    appendString(line, elf_status_string(status));
+    terminalWriteLine(line);
+    user_process_release(proc);
+    return;
+  }
+
+  appendString(line, "loaded in ");
+  appendDecimal(line, loadCycles, 0);
+  appendString(line, " cycles: ");
+  appendDecimal(line, loaded.sharedPages, 0);
+  appendString(line, " pages shared with the module, ");
+  appendDecimal(line, loaded.copiedPages, 0);
+  appendString(line, " copied, ");
+  appendDecimal(line, loaded.zeroedPages, 0);
+  appendString(line, " zeroed");
+  terminalWriteLine(line);
+
+  // like argc, the program finds out how many numbers it got
+  uint32_t stack[USER_MAX_ARGS] = {argCount};
+  for (uint32_t i = 0; i < argCount; i++) {
+    stack[i + 1] = args[i];
+  }
+  if (!user_process_start(proc, module->name, loaded.entry, stack,
+                          argCount + 1)) {
+    terminalWriteLine("exec: no thread left");
+    user_process_release(proc);
+    return;
+  }
+  start = rdtsc();
+  int32_t code = user_process_wait(proc);
+  uint64_t runCycles = rdtsc() - start;
+  uint64_t cyclesPerUs = tsc_hz() / 1000000u;
+  if (cyclesPerUs == 0) {
+    cyclesPerUs = 1;
+  }
+
+  line[0] = '\0';
+  appendString(line, module->name);
+  if (USER_EXIT_IS_FAULT(code)) {
+    appendString(line, " stopped by exception ");
+    appendDecimal(line, USER_EXIT_VECTOR(code), 0);
+  } else if (code == USER_EXIT_KILLED) {
+    appendString(line, " was killed");
+  } else {
+    char digits[16];
+    intToDecimalString(code, digits);
+    appendString(line, " exited with ");
+    appendString(line, digits);
+  }
+  appendString(line, " after ");
+  appendDecimal(line, runCycles / cyclesPerUs, 0);
+  appendString(line, " us");
+  terminalWriteLine(line);
+}
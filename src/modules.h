@@ -0,0 +1,81 @@
+#ifndef MODULES_H
+#define MODULES_H
+
+/**
+ * @file modules.h
+ * @brief Boot modules and running them as user programs.
+ *
+ * The bootloader can load files next to the kernel, e.g. with QEMU's
+ * `-initrd "prog.elf,other.elf"` (`make run MODULES=...`). Modules are page
+ * aligned and paging.c never hands out their frames, so an ELF executable
+ * among them is mapped into processes straight from where it was loaded
+ * (elf.h). That way benchmark programs can be swapped without rebuilding
+ * the kernel.
+ */
+
+#include "multiboot.h"
+#include "user.h"
+#include <stdint.h>
+
+/** @brief Most boot modules remembered. */
+#define MODULES_MAX 16
+
+/** @brief Most numbers runModuleProgram() passes, one slot is the count. */
+#define MODULE_MAX_ARGS (USER_MAX_ARGS - 1)
+
+/** @brief Longest module name kept, including the terminator. */
+#define MODULE_NAME_LENGTH 32
+
+/**
+ * @brief A file loaded by the bootloader.
+ */
+typedef struct {
+  const uint8_t *start;          /**< First byte, identity mapped. */
+  uint32_t size;                 /**< Size in bytes. */
+  char name[MODULE_NAME_LENGTH]; /**< File name without the path. */
+  const char *cmdline;           /**< What the bootloader was told, or "". */
+} BootModule;
+
+/**
+ * @brief Remembers the modules the bootloader loaded.
+ *
+ * @param mbi The multiboot information.
+ * @details Modules the identity map does not reach are skipped.
+ */
+void modules_init(const multiboot_info_t *mbi);
+
+/**
+ * @brief Returns the number of modules.
+ *
+ * @return uint32_t Modules remembered by modules_init().
+ */
+uint32_t modules_count(void);
+
+/**
+ * @brief Finds a module by name or by index.
+ *
+ * @param name A file name as shown by the `exec` list or a decimal index.
+ * @return const BootModule* The module, NULL if there is none.
+ */
+const BootModule *modules_find(const char *name);
+
+/**
+ * @brief Lists the modules with their size and whether they are ELF
+ * executables, to the terminal.
+ */
+void printModulesToTerminal(void);
+
+/**
+ * @brief Loads a module as a process, runs it to its end and reports.
+ *
+ * @param module The module, an ELF executable.
+ * @param args Numbers for the program.
+ * @param argCount Up to MODULE_MAX_ARGS. The program finds the count at
+ * [ESP] and the numbers above it.
+ * @details Prints the load time, the pages shared with the module and
+ * copied, and the exit code.
+ */
+void runModuleProgram(const BootModule *module, const uint32_t *args,
+                      uint32_t argCount);
+
+#endif
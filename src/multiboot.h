@@ -49,6 +49,19 @@ typedef struct memory_map_entry {
   uint32_t type;      /**< Type of region (1 = Available RAM, others) */
 } __attribute__((packed)) memory_map_entry_t;
 
+/**
+ * @brief Boot module entry, mods_count of them start at mods_addr.
+ *
+ * Modules are files the bootloader loaded next to the kernel, page aligned
+ * because boot.asm asks for it.
+ */
+typedef struct multiboot_module {
+  uint32_t mod_start; /**< Physical address of the first byte */
+  uint32_t mod_end;   /**< Physical address past the last byte */
+  uint32_t string;    /**< Physical address of the module's command line */
+  uint32_t reserved;  /**< Always 0 */
+} __attribute__((packed)) multiboot_module_t;
+
 /** * @brief Converts an integer to a hexadecimal string.
  *
  * @param value The integer value to convert.
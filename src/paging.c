@@ -0,0 +1,547 @@
+#include "paging.h"
+#include "cpu.h"
+#include "cpufeatures.h"
+#include "kmem.h"
+#include "percpu.h"
+#include "spinlock.h"
+#include <stddef.h>
+
+// RAM above this is not identity mapped, its frames are never handed out
+#define PAGING_RAM_LIMIT 0x40000000u
+#define PAGING_FRAMES (PAGING_RAM_LIMIT / PAGE_SIZE)
+#define BITMAP_WORDS (PAGING_FRAMES / 32)
+
+#define PDE_INDEX(address) ((address) >> 22)
+#define PTE_INDEX(address) (((address) >> 12) & 0x3FF)
+#define PTE_FRAME(entry) ((entry) & ~(PAGE_SIZE - 1))
+
+// multiboot flag bits of the fields read here
+#define MBI_FLAG_MEMORY (1u << 0)
+#define MBI_FLAG_MODULES (1u << 3)
+#define MBI_FLAG_MMAP (1u << 6)
+
+// end of the kernel image, from linker.ld
+extern uint8_t kernel_end[];
+
+static uint32_t kernelDirectory[1024] __attribute__((aligned(4096)));
+static AddressSpace spaces[PAGING_MAX_SPACES];
+static bool enabled = false;
+static uint32_t globalFlag = 0;
+
+// one bit per frame below PAGING_RAM_LIMIT, set while the frame is free,
+// the frames in the CPUs' caches are free with a clear bit
+static uint32_t freeBitmap[BITMAP_WORDS];
+static uint32_t freeFrames = 0; // in the bitmap
+static uint32_t totalFrames = 0;
+// word where the last frame was found, the search starts there
+static uint32_t searchHint = 0;
+// mappings of each frame plus the kernel's own use, an address space can
+// map a frame several times, so the count is not bounded by the spaces
+static uint16_t frameRefs[PAGING_FRAMES];
+static Spinlock frameLock = SPINLOCK_INIT("frames");
+static CowStats cowStats;
+
+// hands out the whole frames of [start, end) that lie above floor
+static void frames_add_range(uint64_t start, uint64_t end, uint32_t floor) {
+  if (start < floor) {
+    start = floor;
+  }
+  if (end > PAGING_RAM_LIMIT) {
+    end = PAGING_RAM_LIMIT;
+  }
+  start = (start + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+  for (uint32_t frame = (uint32_t)start; frame + PAGE_SIZE <= end;
+       frame += PAGE_SIZE) {
+    uint32_t index = frame / PAGE_SIZE;
+    uint32_t bit = 1u << (index % 32);
+    if ((freeBitmap[index / 32] & bit) == 0) {
+      freeBitmap[index / 32] |= bit;
+      freeFrames++;
+      totalFrames++;
+    }
+  }
+}
+
+static uint32_t max_address(uint32_t a, uint32_t b) { return a > b ? a : b; }
+
+// first address above the kernel, the boot modules and what describes them
+static uint32_t boot_data_end(const multiboot_info_t *mbi) {
+  uint32_t end = (uint32_t)kernel_end;
+  end = max_address(end, (uint32_t)mbi + sizeof(*mbi));
+  if (mbi->flags & MBI_FLAG_MMAP) {
+    end = max_address(end, mbi->mmap_addr + mbi->mmap_length);
+  }
+  if (mbi->flags & MBI_FLAG_MODULES) {
+    const multiboot_module_t *modules =
+        (const multiboot_module_t *)mbi->mods_addr;
+    end = max_address(end, mbi->mods_addr +
+                               mbi->mods_count * sizeof(multiboot_module_t));
+    for (uint32_t i = 0; i < mbi->mods_count; i++) {
+      end = max_address(end, modules[i].mod_end);
+      if (modules[i].string != 0) {
+        const char *string = (const char *)modules[i].string;
+        size_t length = 0;
+        while (string[length] != '\0') {
+          length++;
+        }
+        end = max_address(end, modules[i].string + length + 1);
+      }
+    }
+  }
+  return end;
+}
+
+void paging_init(const multiboot_info_t *mbi) {
+  const CpuFeatures *features = cpu_features();
+  if (enabled || !features->pse || mbi == NULL) {
+    return;
+  }
+
+  uint32_t floor = boot_data_end(mbi);
+  if (mbi->flags & MBI_FLAG_MMAP) {
+    uint32_t address = mbi->mmap_addr;
+    while (address < mbi->mmap_addr + mbi->mmap_length) {
+      const memory_map_entry_t *entry = (const memory_map_entry_t *)address;
+      if (entry->size == 0) {
+        break;
+      }
+      if (entry->type == MEMORY_REGION_AVAILABLE) {
+        frames_add_range(entry->base_addr, entry->base_addr + entry->length,
+                         floor);
+      }
+      address += entry->size + sizeof(entry->size);
+    }
+  } else if (mbi->flags & MBI_FLAG_MEMORY) {
+    frames_add_range(0x100000, 0x100000 + (uint64_t)mbi->mem_upper * 1024,
+                     floor);
+  }
+
+  // 4 MiB kernel pages, the top GiB holds the device registers (Local
+  // APIC, IOAPIC) and is not cached, the user range stays empty
+  globalFlag = features->pge ? PTE_GLOBAL : 0;
+  for (uint32_t i = 0; i < 1024; i++) {
+    uint32_t address = i << 22;
+    if (address >= USER_BASE && address < USER_END) {
+      kernelDirectory[i] = 0;
+      continue;
+    }
+    uint32_t entry =
+        address | PTE_PRESENT | PTE_WRITABLE | PTE_LARGE | globalFlag;
+    if (address >= USER_END) {
+      entry |= PTE_PCD | PTE_PWT;
+    }
+    kernelDirectory[i] = entry;
+  }
+
+  enabled = true;
+  paging_cpu_init();
+}
+
+void paging_cpu_init(void) {
+  if (!enabled) {
+    return;
+  }
+  write_cr4(read_cr4() | CR4_PSE);
+  write_cr3((uint32_t)kernelDirectory);
+  // WP: read-only user pages stay read-only for the kernel as well
+  write_cr0(read_cr0() | CR0_PG | CR0_WP);
+  if (globalFlag != 0) {
+    write_cr4(read_cr4() | CR4_PGE);
+  }
+}
+
+bool paging_enabled(void) { return enabled; }
+
+// takes a frame out of the bitmap, call with frameLock held
+static uint32_t bitmap_take(void) {
+  for (uint32_t n = 0; n < BITMAP_WORDS && freeFrames > 0; n++) {
+    uint32_t word = (searchHint + n) % BITMAP_WORDS;
+    if (freeBitmap[word] != 0) {
+      uint32_t bit = (uint32_t)__builtin_ctz(freeBitmap[word]);
+      freeBitmap[word] &= ~(1u << bit);
+      freeFrames--;
+      searchHint = word;
+      return (word * 32 + bit) * PAGE_SIZE;
+    }
+  }
+  return 0;
+}
+
+uint32_t frame_alloc(void) {
+  uint32_t flags = irq_save();
+  PerCpu *cpu = this_cpu_ptr();
+  if (cpu->frameCacheCount == 0) {
+    // one trip to the bitmap for half a cache, the other half stays room
+    // for frames this CPU frees
+    spin_lock(&frameLock);
+    while (cpu->frameCacheCount < PERCPU_FRAME_CACHE / 2) {
+      uint32_t frame = bitmap_take();
+      if (frame == 0) {
+        break;
+      }
+      cpu->frameCache[cpu->frameCacheCount++] = frame;
+    }
+    spin_unlock(&frameLock);
+  }
+  uint32_t frame = 0;
+  if (cpu->frameCacheCount > 0) {
+    frame = cpu->frameCache[--cpu->frameCacheCount];
+    frameRefs[frame / PAGE_SIZE] = 1;
+  }
+  irq_restore(flags);
+  return frame;
+}
+
+void frame_free(uint32_t frame) {
+  if (frame == 0 || frame >= PAGING_RAM_LIMIT) {
+    return;
+  }
+  uint32_t index = frame / PAGE_SIZE;
+  uint32_t flags = spin_lock_irqsave(&frameLock);
+  if (frameRefs[index] > 1) {
+    frameRefs[index]--;
+  } else if (frameRefs[index] == 1) {
+    // the last reference, a count of 0 means it is free already
+    frameRefs[index] = 0;
+    PerCpu *cpu = this_cpu_ptr();
+    if (cpu->frameCacheCount < PERCPU_FRAME_CACHE) {
+      cpu->frameCache[cpu->frameCacheCount++] = frame;
+    } else {
+      freeBitmap[index / 32] |= 1u << (index % 32);
+      freeFrames++;
+    }
+  }
+  spin_unlock_irqrestore(&frameLock, flags);
+}
+
+bool frame_ref(uint32_t frame) {
+  if (frame >= PAGING_RAM_LIMIT) {
+    return false;
+  }
+  uint32_t flags = spin_lock_irqsave(&frameLock);
+  bool added = frameRefs[frame / PAGE_SIZE] < PAGING_MAX_REFS;
+  if (added) {
+    frameRefs[frame / PAGE_SIZE]++;
+  }
+  spin_unlock_irqrestore(&frameLock, flags);
+  return added;
+}
+
+uint32_t frame_ref_count(uint32_t frame) {
+  return frame < PAGING_RAM_LIMIT ? frameRefs[frame / PAGE_SIZE] : 0;
+}
+
+uint32_t frame_free_count(void) {
+  uint32_t count = freeFrames;
+  for (uint32_t i = 0; i < SMP_MAX_CPUS; i++) {
+    count += percpu_area(i)->frameCacheCount;
+  }
+  return count;
+}
+
+uint32_t frame_total_count(void) { return totalFrames; }
+
+AddressSpace *as_create(void) {
+  if (!enabled) {
+    return NULL;
+  }
+  AddressSpace *space = NULL;
+  uint32_t flags = irq_save();
+  for (uint32_t i = 0; i < PAGING_MAX_SPACES; i++) {
+    if (!spaces[i].used) {
+      space = &spaces[i];
+      space->used = true;
+      break;
+    }
+  }
+  irq_restore(flags);
+  if (space == NULL) {
+    return NULL;
+  }
+
+  uint32_t directory = frame_alloc();
+  if (directory == 0) {
+    space->used = false;
+    return NULL;
+  }
+  // the kernel entries are shared, the user entries of the copy are empty
+  memcpyOS((void *)directory, kernelDirectory, PAGE_SIZE);
+  space->directory = (uint32_t *)directory;
+  space->pages = 0;
+  return space;
+}
+
+void as_destroy(AddressSpace *space) {
+  if (space == NULL) {
+    return;
+  }
+  for (uint32_t i = PDE_INDEX(USER_BASE); i < PDE_INDEX(USER_END); i++) {
+    uint32_t pde = space->directory[i];
+    if ((pde & PTE_PRESENT) == 0) {
+      continue;
+    }
+    uint32_t *table = (uint32_t *)PTE_FRAME(pde);
+    for (uint32_t j = 0; j < 1024; j++) {
+      if ((table[j] & PTE_PRESENT) != 0 && (table[j] & PTE_BORROWED) == 0) {
+        frame_free(PTE_FRAME(table[j]));
+      }
+    }
+    frame_free((uint32_t)table);
+  }
+  frame_free((uint32_t)space->directory);
+  space->directory = NULL;
+  space->pages = 0;
+  space->used = false;
+}
+
+// the page table covering a user address, allocated on demand
+static uint32_t *page_table(AddressSpace *space, uint32_t virt) {
+  uint32_t *pde = &space->directory[PDE_INDEX(virt)];
+  if ((*pde & PTE_PRESENT) == 0) {
+    uint32_t table = frame_alloc();
+    if (table == 0) {
+      return NULL;
+    }
+    memsetOS((void *)table, 0, PAGE_SIZE);
+    // the page table entries decide about write access
+    *pde = table | PTE_PRESENT | PTE_WRITABLE | PTE_USER;
+  }
+  return (uint32_t *)PTE_FRAME(*pde);
+}
+
+bool as_map(AddressSpace *space, uint32_t virt, uint32_t frame,
+            uint32_t flags) {
+  if (virt < USER_BASE || virt >= USER_END || (virt & (PAGE_SIZE - 1)) != 0) {
+    return false;
+  }
+  uint32_t *table = page_table(space, virt);
+  if (table == NULL) {
+    return false;
+  }
+  uint32_t *entry = &table[PTE_INDEX(virt)];
+  uint32_t old = *entry;
+  bool replaced = (old & PTE_PRESENT) != 0;
+  if (!replaced) {
+    space->pages++;
+  }
+  *entry = PTE_FRAME(frame) | (flags & (PTE_WRITABLE | PTE_BORROWED)) |
+           PTE_PRESENT | PTE_USER;
+  if (replaced && read_cr3() == (uint32_t)space->directory) {
+    invlpg(virt);
+  }
+  // the old frame loses this mapping's reference, unless only the flags
+  // changed or it was never the address space's to free
+  if (replaced && PTE_FRAME(old) != PTE_FRAME(frame) &&
+      (old & PTE_BORROWED) == 0) {
+    frame_free(PTE_FRAME(old));
+  }
+  return true;
+}
+
+bool as_map_zeroed(AddressSpace *space, uint32_t virt, uint32_t pages,
+                   uint32_t flags) {
+  for (uint32_t i = 0; i < pages; i++) {
+    uint32_t frame = frame_alloc();
+    if (frame == 0) {
+      return false;
+    }
+    memsetOS((void *)frame, 0, PAGE_SIZE);
+    if (!as_map(space, virt + i * PAGE_SIZE, frame, flags & ~PTE_BORROWED)) {
+      frame_free(frame);
+      return false;
+    }
+  }
+  return true;
+}
+
+// the copy of one page for as_fork(), shared unless eager
+static bool fork_page(uint32_t *parentEntry, uint32_t *childEntry, bool eager) {
+  uint32_t entry = *parentEntry;
+  uint32_t frame = PTE_FRAME(entry);
+  if ((entry & PTE_BORROWED) != 0) {
+    *childEntry = entry;
+  } else if (eager) {
+    uint32_t copy = frame_alloc();
+    if (copy == 0) {
+      return false;
+    }
+    memcpyOS((void *)copy, (const void *)frame, PAGE_SIZE);
+    // the copy is the child's alone, a shared page becomes writable again
+    uint32_t flags = entry & (PAGE_SIZE - 1);
+    if ((flags & PTE_COW) != 0) {
+      flags = (flags & ~PTE_COW) | PTE_WRITABLE;
+    }
+    *childEntry = copy | flags;
+  } else {
+    if (!frame_ref(frame)) {
+      return false;
+    }
+    if ((entry & PTE_WRITABLE) != 0) {
+      entry = (entry & ~PTE_WRITABLE) | PTE_COW;
+      *parentEntry = entry;
+    }
+    *childEntry = entry;
+  }
+  return true;
+}
+
+AddressSpace *as_fork(AddressSpace *parent, bool eager) {
+  AddressSpace *child = as_create();
+  if (child == NULL) {
+    return NULL;
+  }
+  bool complete = true;
+  for (uint32_t i = PDE_INDEX(USER_BASE); i < PDE_INDEX(USER_END) && complete;
+       i++) {
+    uint32_t pde = parent->directory[i];
+    if ((pde & PTE_PRESENT) == 0) {
+      continue;
+    }
+    uint32_t *from = (uint32_t *)PTE_FRAME(pde);
+    uint32_t *to = page_table(child, i << 22);
+    if (to == NULL) {
+      complete = false;
+      break;
+    }
+    for (uint32_t j = 0; j < 1024; j++) {
+      if ((from[j] & PTE_PRESENT) == 0) {
+        continue;
+      }
+      if (!fork_page(&from[j], &to[j], eager)) {
+        complete = false;
+        break;
+      }
+      child->pages++;
+    }
+  }
+  // the parent's TLB may still let it write to what is shared now, the
+  // kernel's global pages stay
+  if (!eager && read_cr3() == (uint32_t)parent->directory) {
+    write_cr3(read_cr3());
+  }
+  if (!complete) {
+    as_destroy(child);
+    return NULL;
+  }
+  return child;
+}
+
+// the page table entry of a user address, NULL without a page table
+static uint32_t *page_entry(AddressSpace *space, uint32_t virt) {
+  uint32_t pde = space->directory[PDE_INDEX(virt)];
+  if ((pde & PTE_PRESENT) == 0) {
+    return NULL;
+  }
+  return &((uint32_t *)PTE_FRAME(pde))[PTE_INDEX(virt)];
+}
+
+bool as_cow_fault(AddressSpace *space, uint32_t virt) {
+  if (virt < USER_BASE || virt >= USER_END) {
+    return false;
+  }
+  uint32_t *entry = page_entry(space, virt);
+  if (entry == NULL || (*entry & (PTE_PRESENT | PTE_COW)) !=
+                           (PTE_PRESENT | PTE_COW)) {
+    return false;
+  }
+  uint32_t frame = PTE_FRAME(*entry);
+  if (frame_ref_count(frame) > 1) {
+    uint32_t copy = frame_alloc();
+    if (copy == 0) {
+      return false;
+    }
+    memcpyOS((void *)copy, (const void *)frame, PAGE_SIZE);
+    frame_free(frame);
+    frame = copy;
+    cowStats.copies++;
+  } else {
+    // the others already wrote to their copies or are gone
+    cowStats.reuses++;
+  }
+  *entry = frame | (*entry & (PAGE_SIZE - 1) & ~PTE_COW) | PTE_WRITABLE;
+  invlpg(virt & ~(PAGE_SIZE - 1));
+  return true;
+}
+
+void as_cow_stats(CowStats *out) { *out = cowStats; }
+
+bool as_move(AddressSpace *from, uint32_t fromVirt, AddressSpace *to,
+             uint32_t toVirt, uint32_t pages) {
+  if (fromVirt < USER_BASE || fromVirt >= USER_END || toVirt < USER_BASE ||
+      toVirt >= USER_END || ((fromVirt | toVirt) & (PAGE_SIZE - 1)) != 0 ||
+      pages > (USER_END - fromVirt) / PAGE_SIZE ||
+      pages > (USER_END - toVirt) / PAGE_SIZE) {
+    return false;
+  }
+  // everything is checked first so the pages move all or none, this also
+  // refuses overlapping ranges
+  for (uint32_t i = 0; i < pages; i++) {
+    uint32_t *source = page_entry(from, fromVirt + i * PAGE_SIZE);
+    uint32_t *table = page_table(to, toVirt + i * PAGE_SIZE);
+    if (source == NULL || (*source & PTE_PRESENT) == 0 || table == NULL ||
+        (table[PTE_INDEX(toVirt + i * PAGE_SIZE)] & PTE_PRESENT) != 0) {
+      return false;
+    }
+  }
+  // the frames keep their reference counts, copy-on-write and borrowed
+  // pages stay so
+  for (uint32_t i = 0; i < pages; i++) {
+    uint32_t *source = page_entry(from, fromVirt + i * PAGE_SIZE);
+    *page_entry(to, toVirt + i * PAGE_SIZE) = *source;
+    *source = 0;
+  }
+  from->pages -= pages;
+  to->pages += pages;
+  // the target entries were not present, so no TLB holds them
+  if (pages > 0 && read_cr3() == (uint32_t)from->directory) {
+    write_cr3(read_cr3());
+  }
+  return true;
+}
+
+uint32_t as_lookup(const AddressSpace *space, uint32_t virt) {
+  if (virt < USER_BASE || virt >= USER_END) {
+    return 0;
+  }
+  uint32_t pde = space->directory[PDE_INDEX(virt)];
+  if ((pde & PTE_PRESENT) == 0) {
+    return 0;
+  }
+  return ((const uint32_t *)PTE_FRAME(pde))[PTE_INDEX(virt)];
+}
+
+bool as_check_user(const AddressSpace *space, uint32_t addr, uint32_t length,
+                   bool write) {
+  if (space == NULL) {
+    return false;
+  }
+  if (length == 0) {
+    return true;
+  }
+  if (addr < USER_BASE || addr >= USER_END || length > USER_END - addr) {
+    return false;
+  }
+  for (uint32_t page = addr & ~(PAGE_SIZE - 1); page < addr + length;
+       page += PAGE_SIZE) {
+    uint32_t entry = as_lookup(space, page);
+    if ((entry & (PTE_PRESENT | PTE_USER)) != (PTE_PRESENT | PTE_USER)) {
+      return false;
+    }
+    // a kernel write to a copy-on-write page faults and gets its copy
+    if (write && (entry & (PTE_WRITABLE | PTE_COW)) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void as_switch(const AddressSpace *space) {
+  if (!enabled) {
+    return;
+  }
+  uint32_t directory = space != NULL ? (uint32_t)space->directory
+                                     : (uint32_t)kernelDirectory;
+  if (read_cr3() != directory) {
+    write_cr3(directory);
+  }
+}
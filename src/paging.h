@@ -0,0 +1,279 @@
+#ifndef PAGING_H
+#define PAGING_H
+
+/**
+ * @file paging.h
+ * @brief Physical page frames and the address spaces of user programs.
+ *
+ * The kernel sees physical memory identity mapped: [0, 1 GiB) for RAM and
+ * [3 GiB, 4 GiB) for memory mapped devices, with 4 MiB pages that are
+ * global, so they survive address space switches. Only ring 0 can touch
+ * them. RAM between 1 GiB and 3 GiB is not used and not reachable once
+ * paging is on, so anything the kernel needs from there is read before
+ * paging_init(): acpi_init() copies the ACPI tables, which firmware tends to
+ * put at the top of RAM. Every address space shares these directory entries
+ * and has its own 4 KiB page tables for the user range [USER_BASE,
+ * USER_END) in between.
+ *
+ * Page frames come from RAM above the kernel image and the boot modules,
+ * below 1 GiB so the kernel can reach them through the identity map. A
+ * bitmap tracks the free ones, and a reference count per frame how many
+ * address spaces map it. Each CPU keeps up to PERCPU_FRAME_CACHE free
+ * frames in its ::PerCpu block: frame_alloc() takes them without the lock
+ * and refills half the cache at a time, frame_free() puts frames back
+ * there until it is full.
+ *
+ * as_fork() shares all pages of an address space with the copy. Writable
+ * pages turn read-only with PTE_COW in both, the first write faults and
+ * as_cow_fault() gives the writer a copy of its own, or just the write
+ * access back if nobody else maps the frame any more. A fork thus costs
+ * page table entries, not page contents.
+ *
+ * as_move() hands pages from one address space to another the same way,
+ * for passing large messages between processes (ipc.h).
+ *
+ * Kernel threads do not own an address space, they keep running on
+ * whatever directory is loaded (every one maps the kernel), so switching
+ * between kernel and user threads only costs a CR3 write when the next
+ * user thread lives in another address space.
+ */
+
+#include "multiboot.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @brief Size of a page and a page frame in bytes. */
+#define PAGE_SIZE 4096u
+
+/** @brief Lowest user address. */
+#define USER_BASE 0x40000000u
+
+/** @brief First address above the user range. */
+#define USER_END 0xC0000000u
+
+/** @brief Most address spaces that can exist at the same time. */
+#define PAGING_MAX_SPACES 16
+
+/** @brief Most mappings of one page frame. An address space may map a
+ * frame many times (as_move()), forks that would exceed this fail. */
+#define PAGING_MAX_REFS 0xFFFFu
+
+// page directory and page table entry bits
+#define PTE_PRESENT 0x001u  /**< Mapped. */
+#define PTE_WRITABLE 0x002u /**< Writable, else read-only. */
+#define PTE_USER 0x004u     /**< Reachable from ring 3. */
+#define PTE_PWT 0x008u      /**< Write-through. */
+#define PTE_PCD 0x010u      /**< Cache disabled. */
+#define PTE_LARGE 0x080u    /**< Directory entry maps 4 MiB directly. */
+#define PTE_GLOBAL 0x100u   /**< Kept in the TLB across CR3 writes. */
+/** @brief The frame is not owned by the address space (kernel image, boot
+ * module), as_destroy() does not free it. */
+#define PTE_BORROWED 0x200u
+/** @brief Shared after as_fork(), writable once as_cow_fault() copied it. */
+#define PTE_COW 0x400u
+
+/**
+ * @brief The user half of a page table tree.
+ */
+typedef struct AddressSpace {
+  uint32_t *directory; /**< Page directory, a frame (physical = virtual). */
+  uint32_t pages;      /**< User pages mapped. */
+  bool used;           /**< Slot taken. */
+} AddressSpace;
+
+/**
+ * @brief Builds the kernel mappings and turns paging on for the BSP.
+ *
+ * @param mbi Memory map and boot modules, their frames are not handed out.
+ * @details Needs cpu_features_init(). Without 4 MiB pages (PSE) paging
+ * stays off and paging_enabled() reports false.
+ */
+void paging_init(const multiboot_info_t *mbi);
+
+/**
+ * @brief Turns paging on for an application processor.
+ *
+ * @details Loads the kernel directory, called by the APs when they come up.
+ */
+void paging_cpu_init(void);
+
+/**
+ * @brief Returns whether paging is on.
+ *
+ * @return true If paging_init() enabled paging.
+ */
+bool paging_enabled(void);
+
+/**
+ * @brief Takes a free page frame.
+ *
+ * @return uint32_t The physical address of the frame, 0 if none is left.
+ * @details The frame's content is undefined, its reference count is 1.
+ */
+uint32_t frame_alloc(void);
+
+/**
+ * @brief Drops a reference to a page frame, the last one frees it.
+ *
+ * @param frame The address frame_alloc() returned.
+ */
+void frame_free(uint32_t frame);
+
+/**
+ * @brief Adds a reference to a page frame.
+ *
+ * @param frame A frame from frame_alloc() that is still referenced.
+ * @return true If added, false if the frame has PAGING_MAX_REFS already.
+ */
+bool frame_ref(uint32_t frame);
+
+/**
+ * @brief Returns the reference count of a page frame.
+ *
+ * @param frame The frame.
+ * @return uint32_t The references, 0 if it is free or not managed.
+ */
+uint32_t frame_ref_count(uint32_t frame);
+
+/**
+ * @brief Returns the number of free page frames.
+ *
+ * @return uint32_t Free frames.
+ */
+uint32_t frame_free_count(void);
+
+/**
+ * @brief Returns the number of page frames managed.
+ *
+ * @return uint32_t Free and used frames.
+ */
+uint32_t frame_total_count(void);
+
+/**
+ * @brief Creates an address space with nothing mapped in the user range.
+ *
+ * @return AddressSpace* The address space, NULL without paging or memory.
+ */
+AddressSpace *as_create(void);
+
+/**
+ * @brief Creates a copy of an address space.
+ *
+ * @param parent The address space to copy.
+ * @param eager Copy every page right away instead of sharing them
+ * copy-on-write, only for comparing both.
+ * @return AddressSpace* The copy, NULL without memory or if a frame would
+ * exceed PAGING_MAX_REFS.
+ * @details Borrowed pages stay borrowed in the copy. Flushes the TLB if
+ * parent is loaded, it is the caller's address space.
+ */
+AddressSpace *as_fork(AddressSpace *parent, bool eager);
+
+/**
+ * @brief Frees an address space with all frames it owns.
+ *
+ * @param space The address space, must not be loaded on any CPU.
+ */
+void as_destroy(AddressSpace *space);
+
+/**
+ * @brief Maps a page frame into the user range.
+ *
+ * @param space The address space.
+ * @param virt Page aligned user address.
+ * @param frame Physical address of the frame.
+ * @param flags PTE_WRITABLE and PTE_BORROWED, PTE_PRESENT and PTE_USER are
+ * implied.
+ * @return true If mapped, false outside the user range or without memory
+ * for a page table.
+ * @details Replaces an existing mapping. Its frame loses a reference unless
+ * it is the same frame or was borrowed.
+ */
+bool as_map(AddressSpace *space, uint32_t virt, uint32_t frame,
+            uint32_t flags);
+
+/**
+ * @brief Maps fresh zeroed frames over a user range.
+ *
+ * @param space The address space.
+ * @param virt Page aligned user address.
+ * @param pages Number of pages.
+ * @param flags As for as_map().
+ * @return true If all pages were mapped.
+ */
+bool as_map_zeroed(AddressSpace *space, uint32_t virt, uint32_t pages,
+                   uint32_t flags);
+
+/**
+ * @brief Returns the page table entry of a user address.
+ *
+ * @param space The address space.
+ * @param virt Any user address.
+ * @return uint32_t The entry, 0 if nothing is mapped there.
+ */
+uint32_t as_lookup(const AddressSpace *space, uint32_t virt);
+
+/**
+ * @brief Resolves a write to a copy-on-write page.
+ *
+ * @param space The address space, loaded on this CPU.
+ * @param virt The address written to.
+ * @return true If the page is writable now, false if it is not a
+ * copy-on-write page or no frame is left for the copy.
+ */
+bool as_cow_fault(AddressSpace *space, uint32_t virt);
+
+/**
+ * @brief Moves pages from one address space to another without copying.
+ *
+ * @param from The address space that loses the pages.
+ * @param fromVirt Page aligned user address of the first page.
+ * @param to The address space that gets them, may be from.
+ * @param toVirt Page aligned user address, the range must be unmapped.
+ * @param pages Number of pages, all must be mapped in from.
+ * @return true If moved, false if nothing was (range, mapping or memory
+ * for a page table).
+ * @details Only page table entries change, the frames keep their
+ * reference counts and flags. Flushes the TLB if from is loaded.
+ */
+bool as_move(AddressSpace *from, uint32_t fromVirt, AddressSpace *to,
+             uint32_t toVirt, uint32_t pages);
+
+/**
+ * @brief Copy-on-write faults since boot.
+ */
+typedef struct {
+  uint32_t copies; /**< Faults that copied the page. */
+  uint32_t reuses; /**< Faults on the last reference, no copy needed. */
+} CowStats;
+
+/**
+ * @brief Returns the copy-on-write statistics.
+ *
+ * @param out Receives the counters.
+ */
+void as_cow_stats(CowStats *out);
+
+/**
+ * @brief Checks that a user buffer is mapped for ring 3.
+ *
+ * @param space The address space.
+ * @param addr Start of the buffer.
+ * @param length Size in bytes.
+ * @param write Whether the buffer is written to.
+ * @return true If the kernel may access the buffer on the program's behalf.
+ * @details System calls check every pointer they get with this first, a
+ * page fault in ring 0 is fatal unless it hits a copy-on-write page.
+ */
+bool as_check_user(const AddressSpace *space, uint32_t addr, uint32_t length,
+                   bool write);
+
+/**
+ * @brief Loads an address space on the calling CPU.
+ *
+ * @param space The address space, NULL for the kernel directory.
+ * @details Does nothing if it is loaded already.
+ */
+void as_switch(const AddressSpace *space);
+
+#endif
@@ -0,0 +1,178 @@
+#include "parbench.h"
+#include "cpu.h"
+#include "kmem.h"
+#include "percpu.h"
+#include "smp.h"
+#include "str.h"
+#include "taskpool.h"
+#include "terminal.h"
+#include "time.h"
+#include <stddef.h>
+
+#define PARBENCH_BUFFER_SIZE (2u * 1024u * 1024u)
+#define PARBENCH_FILL_VALUE 0x5a
+
+// the rendered image, one iteration count per pixel
+#define PARBENCH_WIDTH 320
+#define PARBENCH_HEIGHT 200
+#define PARBENCH_MAX_ITERATIONS 255
+
+// Mandelbrot in 8.24 fixed point, a kernel_fpu_begin() per pixel would
+// cost more than the floating point saves
+#define FIX_SHIFT 24
+#define FIX_ONE (1 << FIX_SHIFT)
+
+static uint8_t buffer[PARBENCH_BUFFER_SIZE] __attribute__((aligned(4096)));
+static uint8_t image[PARBENCH_HEIGHT][PARBENCH_WIDTH];
+
+static int32_t fix_mul(int32_t a, int32_t b) {
+  return (int32_t)(((int64_t)a * b) >> FIX_SHIFT);
+}
+
+// renders the rows [start, end) of the view x in [-2.5, 1], y in [-1, 1]
+static void render_rows(uint32_t start, uint32_t end, void *arg) {
+  (void)arg;
+  const int32_t stepX = 7 * (FIX_ONE / 2) / PARBENCH_WIDTH;
+  const int32_t stepY = 2 * FIX_ONE / PARBENCH_HEIGHT;
+  for (uint32_t row = start; row < end; row++) {
+    int32_t ci = -FIX_ONE + (int32_t)row * stepY;
+    for (uint32_t column = 0; column < PARBENCH_WIDTH; column++) {
+      int32_t cr = -5 * (FIX_ONE / 2) + (int32_t)column * stepX;
+      int32_t zr = 0;
+      int32_t zi = 0;
+      uint32_t n = 0;
+      while (n < PARBENCH_MAX_ITERATIONS) {
+        int32_t zr2 = fix_mul(zr, zr);
+        int32_t zi2 = fix_mul(zi, zi);
+        if (zr2 + zi2 > 4 * FIX_ONE) {
+          break;
+        }
+        zi = 2 * fix_mul(zr, zi) + ci;
+        zr = zr2 - zi2 + cr;
+        n++;
+      }
+      image[row][column] = (uint8_t)n;
+    }
+  }
+}
+
+static void serial_fill(void) {
+  uint8_t *dest = buffer;
+  size_t count = PARBENCH_BUFFER_SIZE;
+  __asm__ volatile("rep stosb"
+                   : "+D"(dest), "+c"(count)
+                   : "a"(PARBENCH_FILL_VALUE)
+                   : "memory");
+}
+
+static uint8_t serial_checksum(const uint8_t *data, size_t length) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i < length; i++) {
+    sum += data[i];
+  }
+  return (uint8_t)sum;
+}
+
+static bool buffer_filled(void) {
+  for (size_t i = 0; i < PARBENCH_BUFFER_SIZE; i++) {
+    if (buffer[i] != PARBENCH_FILL_VALUE) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void print_result(const char *name, uint64_t serialCycles,
+                         uint64_t parallelCycles, bool match) {
+  uint64_t cyclesPerUs = tsc_hz() / 1000000u;
+  if (cyclesPerUs == 0) {
+    cyclesPerUs = 1;
+  }
+  if (parallelCycles == 0) {
+    parallelCycles = 1;
+  }
+  uint64_t speedup = serialCycles * 100u / parallelCycles;
+
+  char line[128] = "";
+  appendString(line, name);
+  for (size_t len = strlenOS(name); len < 10; len++) {
+    appendString(line, " ");
+  }
+  appendDecimal(line, serialCycles / cyclesPerUs, 10);
+  appendDecimal(line, parallelCycles / cyclesPerUs, 13);
+  appendDecimal(line, speedup / 100u, 7);
+  appendString(line, ".");
+  appendDecimal(line, speedup % 100u / 10u, 0);
+  appendDecimal(line, speedup % 10u, 0);
+  appendString(line, "x  ");
+  appendString(line, match ? "ok" : "MISMATCH");
+  terminalWriteLine(line);
+}
+
+void runParallelBenchmark(void) {
+  char line[128] = "";
+  appendDecimal(line, taskpool_workers(), 0);
+  appendString(line, " workers, 2 MiB fill and checksum, ");
+  appendDecimal(line, PARBENCH_WIDTH, 0);
+  appendString(line, "x");
+  appendDecimal(line, PARBENCH_HEIGHT, 0);
+  appendString(line, " Mandelbrot");
+  terminalWriteLine(line);
+
+  uint32_t tasksBefore[SMP_MAX_CPUS];
+  uint32_t stolenBefore[SMP_MAX_CPUS];
+  for (uint32_t i = 0; i < smp_cpu_count(); i++) {
+    tasksBefore[i] = percpu_area(i)->tasksRun;
+    stolenBefore[i] = percpu_area(i)->tasksStolen;
+  }
+
+  terminalWriteLine("WORKLOAD   SERIAL us  PARALLEL us  SPEEDUP");
+
+  // fill: the buffer is zeroed in between, so both runs write every byte
+  parallel_memset(buffer, 0, PARBENCH_BUFFER_SIZE);
+  uint64_t start = rdtsc();
+  serial_fill();
+  uint64_t serialCycles = rdtsc() - start;
+  bool match = buffer_filled();
+  parallel_memset(buffer, 0, PARBENCH_BUFFER_SIZE);
+  start = rdtsc();
+  parallel_memset(buffer, PARBENCH_FILL_VALUE, PARBENCH_BUFFER_SIZE);
+  uint64_t parallelCycles = rdtsc() - start;
+  print_result("fill", serialCycles, parallelCycles, match && buffer_filled());
+
+  // checksum: give the bytes some variety first
+  for (size_t i = 0; i < PARBENCH_BUFFER_SIZE; i++) {
+    buffer[i] = (uint8_t)(i * 7u + (i >> 12));
+  }
+  start = rdtsc();
+  uint8_t serialSum = serial_checksum(buffer, PARBENCH_BUFFER_SIZE);
+  serialCycles = rdtsc() - start;
+  start = rdtsc();
+  uint8_t parallelSum = parallel_checksum8(buffer, PARBENCH_BUFFER_SIZE);
+  parallelCycles = rdtsc() - start;
+  print_result("checksum", serialCycles, parallelCycles,
+               serialSum == parallelSum);
+
+  // render: one row per task is plenty, rows differ a lot in cost
+  start = rdtsc();
+  render_rows(0, PARBENCH_HEIGHT, NULL);
+  serialCycles = rdtsc() - start;
+  serialSum = serial_checksum(&image[0][0], sizeof(image));
+  memsetOS(image, 0, sizeof(image));
+  start = rdtsc();
+  parallel_for(0, PARBENCH_HEIGHT, 1, render_rows, NULL);
+  parallelCycles = rdtsc() - start;
+  parallelSum = serial_checksum(&image[0][0], sizeof(image));
+  print_result("render", serialCycles, parallelCycles,
+               serialSum == parallelSum);
+
+  terminalWriteLine(" CPU     TASKS    STOLEN");
+  for (uint32_t i = 0; i < smp_cpu_count(); i++) {
+    const PerCpu *area = percpu_area(i);
+    line[0] = '\0';
+    appendDecimal(line, i, 4);
+    appendDecimal(line, area->tasksRun - tasksBefore[i], 10);
+    appendDecimal(line, area->tasksStolen - stolenBefore[i], 10);
+    terminalWriteLine(line);
+  }
+}
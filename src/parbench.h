@@ -0,0 +1,20 @@
+#ifndef PARBENCH_H
+#define PARBENCH_H
+
+/**
+ * @file parbench.h
+ * @brief Speedup of the task pool on fill, checksum and render workloads.
+ *
+ * Every workload runs once on the calling CPU alone and once through the
+ * task pool (see taskpool.h), both timed with the TSC. The results of both
+ * runs are compared, so a broken split shows up as a mismatch rather than
+ * as a suspiciously good speedup.
+ */
+
+/**
+ * @brief Runs all workloads and prints times, speedups and how many tasks
+ * every CPU ran and stole.
+ */
+void runParallelBenchmark(void);
+
+#endif
@@ -0,0 +1,40 @@
+#include "percpu.h"
+#include "cpu.h"
+#include "gdt.h"
+
+_Static_assert(SMP_MAX_CPUS <= GDT_PERCPU_COUNT,
+               "the GDT needs a per-CPU segment for every CPU");
+
+static PerCpu areas[SMP_MAX_CPUS];
+
+void percpu_init(uint32_t index) {
+  PerCpu *cpu = &areas[index];
+  cpu->self = cpu;
+  cpu->index = index;
+  cpu->onlineTsc = rdtsc();
+  uint16_t selector =
+      gdtSetPerCpuSegment(index, (uint32_t)cpu, sizeof(PerCpu) - 1);
+  __asm__ volatile("mov %0, %%gs" : : "r"(selector) : "memory");
+}
+
+PerCpu *percpu_area(uint32_t index) {
+  return index < SMP_MAX_CPUS ? &areas[index] : NULL;
+}
+
+uint32_t percpu_busy_permille(uint32_t index) {
+  const PerCpu *cpu = percpu_area(index);
+  if (cpu == NULL || cpu->onlineTsc == 0) {
+    return 0;
+  }
+  uint64_t now = rdtsc();
+  uint64_t elapsed = now - cpu->onlineTsc;
+  uint64_t idle = cpu->idleCycles;
+  // a halt still in progress is not booked yet
+  if (cpu->halted && now > cpu->haltTsc) {
+    idle += now - cpu->haltTsc;
+  }
+  if (elapsed == 0 || idle >= elapsed) {
+    return 0;
+  }
+  return (uint32_t)((elapsed - idle) * 1000u / elapsed);
+}
@@ -0,0 +1,153 @@
+#ifndef PERCPU_H
+#define PERCPU_H
+
+/**
+ * @file percpu.h
+ * @brief Per-CPU data areas addressed through the GS segment.
+ *
+ * Every CPU owns one ::PerCpu block. gdt.c reserves a data segment per CPU
+ * whose base is that block, and the CPU keeps the selector loaded in GS. So
+ * `%gs:offset` always addresses the running CPU's copy of a field, without
+ * looking up the CPU number and without locks: nobody else writes it.
+ *
+ * this_cpu_read(), this_cpu_write() and this_cpu_add() compile to a single
+ * `%gs:`-relative instruction, which also makes them safe against
+ * interrupts on the same CPU. They take fields of at most 4 bytes, larger
+ * ones go through this_cpu_ptr().
+ */
+
+#include "fpu.h"
+#include "smp.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct Thread;
+
+/** @brief Free page frames a CPU keeps at hand, see frame_alloc(). */
+#define PERCPU_FRAME_CACHE 16
+
+/**
+ * @brief The data one CPU keeps for itself.
+ */
+typedef struct PerCpu {
+  struct PerCpu *self;     /**< Linear address of this block. */
+  uint32_t index;          /**< CPU index, 0 is the BSP (see smp.h). */
+  uint32_t apicId;         /**< Local APIC ID. */
+  struct Thread *current;  /**< Thread running on this CPU. */
+  struct Thread *idle;     /**< Runs when the run queue is empty. */
+  struct Thread *runHead;  /**< Run queue, next thread to run. */
+  struct Thread *runTail;  /**< Run queue, last thread. */
+  bool needResched;        /**< Switch threads at the next chance. */
+  uint32_t preemptCount;   /**< preempt_disable() depth. */
+  uint32_t irqDepth;       /**< Nesting of hardware interrupts. */
+  uint32_t irqs;           /**< Hardware interrupts handled. */
+  uint32_t contextSwitches; /**< Thread switches. */
+  uint32_t tasksRun;       /**< Task pool tasks run here. */
+  uint32_t tasksStolen;    /**< Of those, taken from another CPU. */
+  uint64_t switchTsc;      /**< TSC when current got the CPU. */
+  bool halted;             /**< In sched_idle_halt(), since haltTsc. */
+  uint64_t haltTsc;        /**< TSC when the CPU went idle. */
+  uint64_t idleCycles;     /**< TSC cycles spent idle, halted or waiting. */
+  uint64_t onlineTsc;      /**< TSC when percpu_init() ran. */
+  uint32_t *tssEsp0;       /**< ESP0 of this CPU's TSS, see gdtLoadTss(). */
+  FpuContext *fpuCurrent;  /**< Context running here, see fpu_switch(). */
+  FpuContext *fpuOwner;    /**< Context whose state is in the registers. */
+  uint32_t kernelFpuDepth; /**< kernel_fpu_begin() nesting. */
+  uint32_t kernelFpuFlags; /**< Interrupt state of the outermost begin. */
+  uint32_t frameCache[PERCPU_FRAME_CACHE]; /**< Free frames, see paging.h. */
+  uint32_t frameCacheCount; /**< Frames in frameCache. */
+} __attribute__((aligned(64))) PerCpu;
+
+/**
+ * @brief Sets up the calling CPU's block and loads its GS selector.
+ *
+ * @param index The CPU index, below SMP_MAX_CPUS.
+ * @details Must run before anything uses this_cpu_*(). The BSP calls it
+ * right after gdtInit(), APs right after gdtLoad(), which resets GS.
+ */
+void percpu_init(uint32_t index);
+
+/**
+ * @brief Returns the block of any CPU, for statistics.
+ *
+ * @param index The CPU index.
+ * @return PerCpu* The block, NULL if the index is out of range.
+ */
+PerCpu *percpu_area(uint32_t index);
+
+/**
+ * @brief Returns how busy a CPU was since it came online.
+ *
+ * @param index The CPU index.
+ * @return uint32_t The share of non-idle time in tenths of a percent.
+ * @details Another CPU's 64-bit counters may be read torn, which only ever
+ * skews one sample.
+ */
+uint32_t percpu_busy_permille(uint32_t index);
+
+/** @brief Type of a PerCpu field. */
+#define percpu_type(field) __typeof__(((PerCpu *)0)->field)
+
+/**
+ * @brief Reads a field of the running CPU's block.
+ *
+ * @param field The field name.
+ */
+#define this_cpu_read(field)                                                   \
+  ({                                                                           \
+    percpu_type(field) percpuValue;                                            \
+    _Static_assert(sizeof(percpuValue) <= 4, "use this_cpu_ptr()");            \
+    __asm__ volatile("mov %%gs:%c1, %0"                                        \
+                     : "=q"(percpuValue)                                       \
+                     : "i"(offsetof(PerCpu, field))                            \
+                     : "memory");                                              \
+    percpuValue;                                                               \
+  })
+
+/**
+ * @brief Writes a field of the running CPU's block.
+ *
+ * @param field The field name.
+ * @param value The new value.
+ */
+#define this_cpu_write(field, value)                                           \
+  do {                                                                         \
+    percpu_type(field) percpuValue = (value);                                  \
+    _Static_assert(sizeof(percpuValue) <= 4, "use this_cpu_ptr()");            \
+    __asm__ volatile("mov %0, %%gs:%c1"                                        \
+                     :                                                         \
+                     : "q"(percpuValue), "i"(offsetof(PerCpu, field))          \
+                     : "memory");                                              \
+  } while (0)
+
+/**
+ * @brief Adds to a 32-bit field of the running CPU's block.
+ *
+ * @param field The field name.
+ * @param value The value to add, may be negative.
+ */
+#define this_cpu_add(field, value)                                             \
+  do {                                                                         \
+    _Static_assert(sizeof(percpu_type(field)) == 4, "32-bit fields only");     \
+    __asm__ volatile("addl %0, %%gs:%c1"                                       \
+                     :                                                         \
+                     : "ri"((uint32_t)(value)), "i"(offsetof(PerCpu, field))   \
+                     : "memory", "cc");                                        \
+  } while (0)
+
+/** @brief Increments a 32-bit field of the running CPU's block. */
+#define this_cpu_inc(field) this_cpu_add(field, 1)
+
+/** @brief Decrements a 32-bit field of the running CPU's block. */
+#define this_cpu_dec(field) this_cpu_add(field, -1)
+
+/**
+ * @brief Returns the running CPU's block as a normal pointer.
+ *
+ * @details For fields wider than 4 bytes and multi-field updates, which
+ * then need interrupts disabled like any other shared data.
+ */
+#define this_cpu_ptr() this_cpu_read(self)
+
+#endif
@@ -0,0 +1,78 @@
+#include "pgotrain.h"
+#include "gcov.h"
+#include "shutdown.h"
+#include "terminal.h"
+
+// multiboot info flag: the cmdline field is valid
+#define MULTIBOOT_FLAG_CMDLINE (1u << 2)
+
+// how often the command list is repeated, so short paths still add up
+#define TRAINING_ROUNDS 3
+
+// Commands that wait for keyboard input (snake) or play sound are left out,
+// the training run has neither a keyboard nor speakers.
+static const char *trainingCommands[] = {
+    "help",
+    "help sysinfo",
+    "sysinfo",
+    "uptime",
+    "date",
+    "memory",
+    "gdt",
+    "idt",
+    "clocks",
+    "cpuinfo",
+    "irqstat",
+    "irqbench 2000",
+    "latbench 500 200",
+    "latbench load 1000 100",
+    "latbench sleep 2000 20",
+    "irqsoff",
+    "nosuchcommand",
+};
+
+static bool contains(const char *str, const char *word) {
+  for (; *str != '\0'; str++) {
+    const char *s = str;
+    const char *w = word;
+    while (*w != '\0' && *s == *w) {
+      s++;
+      w++;
+    }
+    if (*w == '\0') {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool pgo_training_requested(const multiboot_info_t *mbi) {
+  if (mbi == NULL || !(mbi->flags & MULTIBOOT_FLAG_CMDLINE) ||
+      mbi->cmdline == 0) {
+    return false;
+  }
+  return contains((const char *)(uintptr_t)mbi->cmdline, "pgo-train");
+}
+
+void pgo_run_training(void) {
+  if (gcov_object_count() == 0) {
+    terminalWriteLine("pgo training: not an instrumented build, no profile");
+  }
+  // the boot path runs once, the profile is about the commands
+  gcov_reset();
+  for (int round = 0; round < TRAINING_ROUNDS; round++) {
+    for (size_t i = 0;
+         i < sizeof(trainingCommands) / sizeof(trainingCommands[0]); i++) {
+      terminalRunCommand(trainingCommands[i]);
+    }
+    // scroll through the history, that redraws the whole terminal each time
+    for (int i = 0; i < 32; i++) {
+      keyPressedForTerminal(KEY_ARROW_UP);
+    }
+    for (int i = 0; i < 32; i++) {
+      keyPressedForTerminal(KEY_ARROW_DOWN);
+    }
+  }
+  terminalWriteLine("pgo training done");
+  systemShutdown();
+}
@@ -0,0 +1,36 @@
+#ifndef PGOTRAIN_H
+#define PGOTRAIN_H
+
+/**
+ * @file pgotrain.h
+ * @brief Scripted training workload for profile-guided builds.
+ *
+ * `make pgo-gen` boots the instrumented kernel with "pgo-train" on the
+ * multiboot command line. The kernel then skips the boot prompts, runs a
+ * fixed list of terminal commands that exercise the hot paths (terminal
+ * redraw, string formatting, interrupt handling, timers) and shuts down,
+ * which dumps the profile counters over the serial port.
+ */
+
+#include "multiboot.h"
+#include <stdbool.h>
+
+/**
+ * @brief Checks the multiboot command line for "pgo-train".
+ *
+ * @param mbi The multiboot information passed by the boot loader.
+ * @return true If the training workload should run instead of the
+ * interactive boot.
+ */
+bool pgo_training_requested(const multiboot_info_t *mbi);
+
+/**
+ * @brief Runs the training commands and shuts the system down.
+ *
+ * @details Must be called once the terminal and the timer are up. Zeroes
+ * the counters first, so the profile leaves the boot path out. Does not
+ * return.
+ */
+void pgo_run_training(void);
+
+#endif
@@ -0,0 +1,61 @@
+#include "pic.h"
+#include "io.h"
+
+// command and data (mask) ports of the master and slave PIC
+#define PIC1_COMMAND_PORT 0x20
+#define PIC1_DATA_PORT 0x21
+#define PIC2_COMMAND_PORT 0xA0
+#define PIC2_DATA_PORT 0xA1
+
+#define PIC_ICW1_INIT 0x11 // edge triggered, cascaded, ICW4 follows
+#define PIC_ICW4_8086 0x01
+#define PIC_EOI 0x20
+#define PIC_CASCADE_IRQ 2
+
+// initialize the programmable interrupt controller
+void pic_init(void) {
+  // send bytes to PICs Command-Ports to start configuration
+  outb(PIC1_COMMAND_PORT, PIC_ICW1_INIT);
+  outb(PIC2_COMMAND_PORT, PIC_ICW1_INIT);
+  ioWait();
+  // set the offset for our interrupt numbers so they dont overlap with the
+  // cpu exceptions (master from 32, slave from 40 onward)
+  outb(PIC1_DATA_PORT, PIC_IRQ_BASE);
+  outb(PIC2_DATA_PORT, PIC_IRQ_BASE + 8);
+  ioWait();
+  // configure Cascading: slave on IRQ2 of the master
+  outb(PIC1_DATA_PORT, 1 << PIC_CASCADE_IRQ);
+  outb(PIC2_DATA_PORT, PIC_CASCADE_IRQ);
+  ioWait();
+  // set mode
+  outb(PIC1_DATA_PORT, PIC_ICW4_8086);
+  outb(PIC2_DATA_PORT, PIC_ICW4_8086);
+  ioWait();
+
+  // mask everything, lines are unmasked when a handler is registered
+  outb(PIC1_DATA_PORT, 0xFF);
+  outb(PIC2_DATA_PORT, 0xFF);
+  ioWait();
+}
+
+void pic_mask(uint8_t irq) {
+  uint16_t port = irq < 8 ? PIC1_DATA_PORT : PIC2_DATA_PORT;
+  outb(port, inb(port) | (uint8_t)(1 << (irq & 7)));
+}
+
+void pic_unmask(uint8_t irq) {
+  if (irq >= 8) {
+    pic_unmask(PIC_CASCADE_IRQ);
+  }
+  uint16_t port = irq < 8 ? PIC1_DATA_PORT : PIC2_DATA_PORT;
+  outb(port, inb(port) & (uint8_t)~(1 << (irq & 7)));
+}
+
+// send whenever a interrupt was handled for the controller to know that the
+// next is wanted
+void pic_send_eoi(uint8_t irq) {
+  if (irq >= 8) {
+    outb(PIC2_COMMAND_PORT, PIC_EOI); // EOI to Slave Command Port
+  }
+  outb(PIC1_COMMAND_PORT, PIC_EOI); // EOI to Master Command Port
+}
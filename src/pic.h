@@ -0,0 +1,50 @@
+#ifndef PIC_H
+#define PIC_H
+
+/**
+ * @file pic.h
+ * @brief Driver for the two cascaded 8259 programmable interrupt controllers.
+ *
+ * The PICs are remapped so IRQ 0-15 arrive on vectors 32-47, right after the
+ * CPU exceptions. All lines start out masked, a line is unmasked when a
+ * handler for its vector is registered with irq_register(). When an IOAPIC
+ * takes over (see ioapic.h) the PICs stay fully masked.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @brief First vector the PICs deliver on (IRQ0). */
+#define PIC_IRQ_BASE 32
+
+/** @brief Number of IRQ lines of both PICs together. */
+#define PIC_IRQ_COUNT 16
+
+/**
+ * @brief Remaps both PICs to PIC_IRQ_BASE and masks every line.
+ */
+void pic_init(void);
+
+/**
+ * @brief Masks (disables) one IRQ line.
+ *
+ * @param irq The IRQ line 0-15.
+ */
+void pic_mask(uint8_t irq);
+
+/**
+ * @brief Unmasks (enables) one IRQ line.
+ *
+ * @param irq The IRQ line 0-15.
+ * @details Lines of the slave PIC also unmask the cascade line IRQ2.
+ */
+void pic_unmask(uint8_t irq);
+
+/**
+ * @brief Sends the end of interrupt for an IRQ line.
+ *
+ * @param irq The IRQ line 0-15 that was handled.
+ */
+void pic_send_eoi(uint8_t irq);
+
+#endif
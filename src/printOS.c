@@ -1,5 +1,6 @@
 #include "printOS.h"
 #include "io.h"
+#include "kmem.h"
 #include "str.h"
 #include <stdbool.h>
 #include <stddef.h>
@@ -77,10 +78,6 @@ void screenClear() {
   uint8_t terminal_color = vgaEntryColor(VGA_COLOR_GREEN, VGA_COLOR_BLACK);
 
   // write a space to all the available places in the buffer
-  for (size_t y = 0; y < VGA_HEIGHT; y++) {
-    for (size_t x = 0; x < VGA_WIDTH; x++) {
-      const size_t index = y * VGA_WIDTH + x;
-      screenBuffer[index] = vgaEntry(' ', terminal_color);
-    }
-  }
+  fill16OS(screenBuffer, vgaEntry(' ', terminal_color),
+           VGA_WIDTH * VGA_HEIGHT);
 };
@@ -0,0 +1,228 @@
+#include "rtc.h"
+#include "acpi.h"
+#include "cpu.h"
+#include "io.h"
+#include "str.h"
+#include "time.h"
+
+// CMOS index/data ports, bit 7 of the index keeps NMIs disabled while we read
+#define CMOS_INDEX_PORT 0x70
+#define CMOS_DATA_PORT 0x71
+#define CMOS_NMI_DISABLE 0x80
+
+// CMOS clock registers
+#define RTC_SECONDS 0x00
+#define RTC_MINUTES 0x02
+#define RTC_HOURS 0x04
+#define RTC_DAY 0x07
+#define RTC_MONTH 0x08
+#define RTC_YEAR 0x09
+#define RTC_STATUS_A 0x0A
+#define RTC_STATUS_B 0x0B
+
+#define RTC_A_UPDATE_IN_PROGRESS 0x80
+#define RTC_B_24_HOUR 0x02
+#define RTC_B_BINARY 0x04
+#define RTC_HOUR_PM 0x80
+
+// offset of the century register index in the ACPI FADT
+#define FADT_CENTURY_OFFSET 108
+
+#define NS_PER_SECOND 1000000000ull
+#define SECONDS_PER_DAY 86400u
+
+/**
+ * @brief Raw register values of one CMOS clock read.
+ */
+typedef struct {
+  uint8_t second, minute, hour, day, month, year, century;
+} CmosTime;
+
+// wall-clock anchor: Unix time of the CMOS read and clock_ns() at that moment
+static uint64_t bootUnixSeconds = 0;
+static uint64_t anchorNs = 0;
+static bool valid = false;
+
+static uint8_t cmos_read(uint8_t reg) {
+  outb(CMOS_INDEX_PORT, CMOS_NMI_DISABLE | reg);
+  return inb(CMOS_DATA_PORT);
+}
+
+static bool cmos_update_in_progress(void) {
+  return (cmos_read(RTC_STATUS_A) & RTC_A_UPDATE_IN_PROGRESS) != 0;
+}
+
+static void cmos_read_time(CmosTime *t, uint8_t centuryReg) {
+  while (cmos_update_in_progress()) {
+  }
+  t->second = cmos_read(RTC_SECONDS);
+  t->minute = cmos_read(RTC_MINUTES);
+  t->hour = cmos_read(RTC_HOURS);
+  t->day = cmos_read(RTC_DAY);
+  t->month = cmos_read(RTC_MONTH);
+  t->year = cmos_read(RTC_YEAR);
+  t->century = centuryReg != 0 ? cmos_read(centuryReg) : 0;
+}
+
+static bool cmos_time_equal(const CmosTime *a, const CmosTime *b) {
+  return a->second == b->second && a->minute == b->minute &&
+         a->hour == b->hour && a->day == b->day && a->month == b->month &&
+         a->year == b->year && a->century == b->century;
+}
+
+static uint8_t bcd_to_binary(uint8_t value) {
+  return (uint8_t)((value & 0x0F) + (value >> 4) * 10);
+}
+
+// days since 1970-01-01 for a proleptic Gregorian date
+static int64_t days_from_civil(int64_t y, uint32_t m, uint32_t d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  uint32_t yoe = (uint32_t)(y - era * 400);
+  uint32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int64_t)doe - 719468;
+}
+
+// inverse of days_from_civil
+static void civil_from_days(int64_t z, uint16_t *year, uint8_t *month,
+                            uint8_t *day) {
+  z += 719468;
+  int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+  uint32_t doe = (uint32_t)(z - era * 146097);
+  uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  int64_t y = (int64_t)yoe + era * 400;
+  uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  uint32_t mp = (5 * doy + 2) / 153;
+  uint32_t d = doy - (153 * mp + 2) / 5 + 1;
+  uint32_t m = mp < 10 ? mp + 3 : mp - 9;
+  *year = (uint16_t)(y + (m <= 2));
+  *month = (uint8_t)m;
+  *day = (uint8_t)d;
+}
+
+bool rtc_init(void) {
+  // the FADT tells us which CMOS register holds the century, if any
+  uint8_t centuryReg = 0;
+  const AcpiSdtHeader *fadt = acpi_find_table("FACP");
+  if (fadt != NULL && fadt->length > FADT_CENTURY_OFFSET) {
+    centuryReg = ((const uint8_t *)fadt)[FADT_CENTURY_OFFSET];
+  }
+
+  // read until two consecutive reads agree, so an update that started
+  // between the UIP check and the reads cannot give a torn value
+  uint32_t flags = irq_save();
+  CmosTime now, check;
+  cmos_read_time(&now, centuryReg);
+  do {
+    check = now;
+    cmos_read_time(&now, centuryReg);
+  } while (!cmos_time_equal(&now, &check));
+  uint8_t statusB = cmos_read(RTC_STATUS_B);
+  uint64_t readNs = clock_ns();
+  irq_restore(flags);
+
+  bool pm = (now.hour & RTC_HOUR_PM) != 0;
+  now.hour &= (uint8_t)~RTC_HOUR_PM;
+  if (!(statusB & RTC_B_BINARY)) {
+    now.second = bcd_to_binary(now.second);
+    now.minute = bcd_to_binary(now.minute);
+    now.hour = bcd_to_binary(now.hour);
+    now.day = bcd_to_binary(now.day);
+    now.month = bcd_to_binary(now.month);
+    now.year = bcd_to_binary(now.year);
+    now.century = bcd_to_binary(now.century);
+  }
+  if (!(statusB & RTC_B_24_HOUR)) {
+    // 12 hour mode: 12 AM is midnight, 12 PM is noon
+    now.hour = (uint8_t)(now.hour % 12 + (pm ? 12 : 0));
+  }
+
+  uint32_t year = now.century != 0 ? now.century * 100u + now.year
+                                   : 2000u + now.year;
+  if (now.month < 1 || now.month > 12 || now.day < 1 || now.day > 31 ||
+      now.hour > 23 || now.minute > 59 || now.second > 59) {
+    valid = false;
+    return false;
+  }
+
+  int64_t days = days_from_civil(year, now.month, now.day);
+  bootUnixSeconds = (uint64_t)days * SECONDS_PER_DAY + now.hour * 3600u +
+                    now.minute * 60u + now.second;
+  anchorNs = readNs;
+  valid = true;
+  return true;
+}
+
+uint64_t rtc_now_ns(void) {
+  if (!valid) {
+    return 0;
+  }
+  return bootUnixSeconds * NS_PER_SECOND + (clock_ns() - anchorNs);
+}
+
+uint64_t rtc_now_unix(void) { return rtc_now_ns() / NS_PER_SECOND; }
+
+void rtc_now(RtcDateTime *out) {
+  uint64_t ns = rtc_now_ns();
+  uint64_t seconds = ns / NS_PER_SECOND;
+  uint64_t days = seconds / SECONDS_PER_DAY;
+  uint32_t secondOfDay = (uint32_t)(seconds % SECONDS_PER_DAY);
+
+  civil_from_days((int64_t)days, &out->year, &out->month, &out->day);
+  out->hour = (uint8_t)(secondOfDay / 3600);
+  out->minute = (uint8_t)((secondOfDay / 60) % 60);
+  out->second = (uint8_t)(secondOfDay % 60);
+  // 1970-01-01 was a Thursday
+  out->weekday = (uint8_t)((days + 4) % 7);
+  out->millisecond = (uint16_t)((ns % NS_PER_SECOND) / 1000000u);
+}
+
+// writes value as a zero padded decimal with the given number of digits
+static char *put_digits(char *dest, uint32_t value, int digits) {
+  for (int i = digits - 1; i >= 0; i--) {
+    dest[i] = (char)('0' + value % 10);
+    value /= 10;
+  }
+  return dest + digits;
+}
+
+// "YYYY-MM-DD HH:MM:SS"
+static char *put_date_time(char *p, const RtcDateTime *t) {
+  p = put_digits(p, t->year, 4);
+  *p++ = '-';
+  p = put_digits(p, t->month, 2);
+  *p++ = '-';
+  p = put_digits(p, t->day, 2);
+  *p++ = ' ';
+  p = put_digits(p, t->hour, 2);
+  *p++ = ':';
+  p = put_digits(p, t->minute, 2);
+  *p++ = ':';
+  p = put_digits(p, t->second, 2);
+  return p;
+}
+
+void rtc_format_timestamp(char *buffer) {
+  RtcDateTime t;
+  rtc_now(&t);
+  char *p = put_date_time(buffer, &t);
+  *p++ = '.';
+  p = put_digits(p, t.millisecond, 3);
+  *p = '\0';
+}
+
+void rtc_format_date(char *buffer) {
+  static const char *weekdays[] = {"Sun", "Mon", "Tue", "Wed",
+                                   "Thu", "Fri", "Sat"};
+  if (!valid) {
+    concat("unknown (RTC not read)", "", buffer);
+    return;
+  }
+  RtcDateTime t;
+  rtc_now(&t);
+  concat(weekdays[t.weekday], " ", buffer);
+  char *p = put_date_time(buffer + strlenOS(buffer), &t);
+  *p = '\0';
+  concat(buffer, " UTC", buffer);
+}
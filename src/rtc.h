@@ -0,0 +1,75 @@
+#ifndef RTC_H
+#define RTC_H
+
+/**
+ * @file rtc.h
+ * @brief Wall-clock time from the CMOS real time clock.
+ *
+ * The CMOS clock is read exactly once at boot. Afterwards the date and time
+ * are derived from the monotonic clock (clock_ns(), normally the TSC), so
+ * timestamps never need the slow CMOS port I/O.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief A broken down calendar date and time (UTC).
+ */
+typedef struct {
+  uint16_t year;        /**< Full year, e.g. 2026. */
+  uint8_t month;        /**< Month 1-12. */
+  uint8_t day;          /**< Day of the month 1-31. */
+  uint8_t hour;         /**< Hour 0-23. */
+  uint8_t minute;       /**< Minute 0-59. */
+  uint8_t second;       /**< Second 0-59. */
+  uint8_t weekday;      /**< Day of the week, 0 = Sunday. */
+  uint16_t millisecond; /**< Millisecond 0-999. */
+} RtcDateTime;
+
+/**
+ * @brief Reads the CMOS clock and anchors wall-clock time to clock_ns().
+ *
+ * @return true If a plausible date was read.
+ * @details Must be called after timer_init() so the monotonic clock runs.
+ * Handles BCD/binary encoding, 12/24 hour mode and the update-in-progress
+ * window of the RTC.
+ */
+bool rtc_init(void);
+
+/**
+ * @brief Returns the current time as Unix time in nanoseconds.
+ *
+ * @return uint64_t Nanoseconds since 1970-01-01 00:00:00 UTC, 0 if unknown.
+ */
+uint64_t rtc_now_ns(void);
+
+/**
+ * @brief Returns the current time as Unix time in seconds.
+ *
+ * @return uint64_t Seconds since 1970-01-01 00:00:00 UTC, 0 if unknown.
+ */
+uint64_t rtc_now_unix(void);
+
+/**
+ * @brief Returns the current date and time.
+ *
+ * @param out Receives the broken down time.
+ */
+void rtc_now(RtcDateTime *out);
+
+/**
+ * @brief Formats the current time as a log timestamp.
+ *
+ * @param buffer Receives "YYYY-MM-DD HH:MM:SS.mmm", at least 24 bytes.
+ */
+void rtc_format_timestamp(char *buffer);
+
+/**
+ * @brief Formats the current time in a human readable form.
+ *
+ * @param buffer Receives e.g. "Mon 2026-10-19 12:34:56 UTC", at least 32 bytes.
+ */
+void rtc_format_date(char *buffer);
+
+#endif
@@ -0,0 +1,443 @@
+#include "sched.h"
+#include "cpu.h"
+#include "paging.h"
+#include "percpu.h"
+#include "str.h"
+#include "terminal.h"
+#include "time.h"
+
+// in switch.asm
+extern void context_switch(uint32_t *oldEsp, uint32_t newEsp);
+
+static Thread threads[THREAD_MAX];
+static uint8_t stacks[THREAD_MAX][THREAD_STACK_SIZE] __attribute__((aligned(16)));
+static uint8_t fpuAreas[THREAD_MAX][FPU_STATE_SIZE]
+    __attribute__((aligned(FPU_STATE_ALIGN)));
+static FpuContext fpuContexts[THREAD_MAX];
+
+// the running thread, the idle thread, the run queue and the preemption
+// state live in the per-CPU block (percpu.h)
+static uint32_t nextId = 0;
+static uint32_t sleepers = 0;
+
+static const char *stateNames[] = {"unused", "ready",   "running",
+                                   "sleep",  "blocked", "exited"};
+
+static void runqueue_push(Thread *thread) {
+  PerCpu *cpu = this_cpu_ptr();
+  thread->next = NULL;
+  if (cpu->runTail != NULL) {
+    cpu->runTail->next = thread;
+  } else {
+    cpu->runHead = thread;
+  }
+  cpu->runTail = thread;
+}
+
+static Thread *runqueue_pop(void) {
+  PerCpu *cpu = this_cpu_ptr();
+  Thread *thread = cpu->runHead;
+  if (thread != NULL) {
+    cpu->runHead = thread->next;
+    if (cpu->runHead == NULL) {
+      cpu->runTail = NULL;
+    }
+    thread->next = NULL;
+  }
+  return thread;
+}
+
+static bool runqueue_empty(void) { return this_cpu_read(runHead) == NULL; }
+
+// picks the next thread and switches to it, interrupts must be disabled
+static void schedule(void) {
+  PerCpu *cpu = this_cpu_ptr();
+  Thread *prev = cpu->current;
+  Thread *idle = cpu->idle;
+  cpu->needResched = false;
+
+  if (prev->state == THREAD_RUNNING) {
+    if (runqueue_empty()) {
+      // nobody else wants the CPU, keep going with a fresh slice
+      prev->sliceLeft = SCHED_SLICE_TICKS;
+      return;
+    }
+    // the idle thread never waits in the run queue
+    if (prev != idle) {
+      prev->state = THREAD_READY;
+      runqueue_push(prev);
+    }
+  }
+
+  Thread *next = runqueue_pop();
+  if (next == NULL) {
+    next = idle;
+  }
+  next->state = THREAD_RUNNING;
+  next->sliceLeft = SCHED_SLICE_TICKS;
+  if (next == prev) {
+    return;
+  }
+
+  uint64_t now = rdtsc();
+  prev->cpuCycles += now - cpu->switchTsc;
+  cpu->switchTsc = now;
+  cpu->contextSwitches++;
+  next->switchesIn++;
+  cpu->current = next;
+  fpu_switch(next->fpu);
+  if (next->space != NULL) {
+    // ring 3 enters the kernel at the top of the thread's own stack, kernel
+    // threads keep whatever directory is loaded
+    *cpu->tssEsp0 = (uint32_t)(next->stack + THREAD_STACK_SIZE);
+    as_switch(next->space);
+  }
+  context_switch(&prev->esp, next->esp);
+  // prev runs again from here, once something switched back to it
+}
+
+// first code of every new thread, entered from schedule() by context_switch
+static void thread_start(void) {
+  irq_enable();
+  Thread *self = this_cpu_read(current);
+  self->entry(self->arg);
+  thread_exit();
+}
+
+static void thread_setup(Thread *thread, uint32_t slot, const char *name,
+                         ThreadEntry entry, void *arg) {
+  thread->id = nextId++;
+  size_t i = 0;
+  for (; name[i] != '\0' && i < THREAD_NAME_LENGTH; i++) {
+    thread->name[i] = name[i];
+  }
+  thread->name[i] = '\0';
+  thread->entry = entry;
+  thread->arg = arg;
+  thread->wakeTick = 0;
+  thread->sliceLeft = SCHED_SLICE_TICKS;
+  thread->cpuCycles = 0;
+  thread->switchesIn = 0;
+  thread->preemptions = 0;
+  thread->killPending = false;
+  thread->next = NULL;
+  thread->waitQueue = NULL;
+  thread->waitNext = NULL;
+  thread->space = NULL;
+  thread->process = NULL;
+
+  fpu_context_init(&fpuContexts[slot], fpuAreas[slot]);
+  thread->fpu = &fpuContexts[slot];
+
+  // make the stack look like the thread was switched out right before
+  // calling thread_start: the registers context_switch pops, the return
+  // address into thread_start and a dummy return address for thread_start
+  // itself, which keeps the stack 16 byte aligned at its entry
+  thread->stack = stacks[slot];
+  uint32_t *sp = (uint32_t *)(stacks[slot] + THREAD_STACK_SIZE);
+  *--sp = 0;                       // return address of thread_start
+  *--sp = (uint32_t)thread_start;  // where context_switch returns to
+  *--sp = 0;                       // ebp
+  *--sp = 0;                       // ebx
+  *--sp = 0;                       // esi
+  *--sp = 0;                       // edi
+  thread->esp = (uint32_t)sp;
+}
+
+static void idle_loop(void *arg) {
+  (void)arg;
+  while (1) {
+    irq_disable();
+    if (!runqueue_empty()) {
+      schedule();
+      irq_enable();
+    } else {
+      // sti;hlt, a wakeup that raced with the check still ends the hlt
+      sched_idle_halt();
+      irq_enable();
+    }
+  }
+}
+
+// books the idle period that an interrupt or the halting code itself ended
+static void idle_end(void) {
+  PerCpu *cpu = this_cpu_ptr();
+  if (cpu->halted) {
+    cpu->halted = false;
+    cpu->idleCycles += rdtsc() - cpu->haltTsc;
+  }
+}
+
+void sched_idle_halt(void) {
+  PerCpu *cpu = this_cpu_ptr();
+  cpu->haltTsc = rdtsc();
+  cpu->halted = true;
+  irq_enable_and_halt();
+  irq_disable();
+  idle_end();
+}
+
+void sched_init(void) {
+  if (this_cpu_read(current) != NULL) {
+    return;
+  }
+  // slot 0 describes the code that is already running on the boot stack
+  Thread *main = &threads[0];
+  main->id = nextId++;
+  concat("main", "", main->name);
+  main->state = THREAD_RUNNING;
+  main->sliceLeft = SCHED_SLICE_TICKS;
+  main->fpu = fpu_current();
+  if (main->fpu == NULL) {
+    fpu_context_init(&fpuContexts[0], fpuAreas[0]);
+    main->fpu = &fpuContexts[0];
+  }
+
+  Thread *idle = &threads[1];
+  thread_setup(idle, 1, "idle", idle_loop, NULL);
+  idle->state = THREAD_READY; // runs only when the run queue is empty
+  this_cpu_write(idle, idle);
+
+  uint32_t flags = irq_save();
+  this_cpu_ptr()->switchTsc = rdtsc();
+  this_cpu_write(current, main);
+  irq_restore(flags);
+}
+
+bool sched_active(void) { return this_cpu_read(current) != NULL; }
+
+// a thread became runnable, the idle thread gives way at the next chance
+static void request_resched_if_idle(void) {
+  if (this_cpu_read(current) == this_cpu_read(idle)) {
+    this_cpu_write(needResched, true);
+  }
+}
+
+Thread *thread_create(const char *name, ThreadEntry entry, void *arg) {
+  Thread *current = this_cpu_read(current);
+  if (current == NULL || entry == NULL) {
+    return NULL;
+  }
+  uint32_t flags = irq_save();
+  Thread *thread = NULL;
+  uint32_t slot = 0;
+  for (; slot < THREAD_MAX; slot++) {
+    // an exited thread's stack is free once it is no longer running on it
+    ThreadState state = threads[slot].state;
+    if ((state == THREAD_UNUSED || state == THREAD_EXITED) &&
+        &threads[slot] != current) {
+      thread = &threads[slot];
+      break;
+    }
+  }
+  if (thread != NULL) {
+    thread_setup(thread, slot, name, entry, arg);
+    thread->state = THREAD_READY;
+    runqueue_push(thread);
+    request_resched_if_idle();
+  }
+  irq_restore(flags);
+  return thread;
+}
+
+Thread *thread_current(void) { return this_cpu_read(current); }
+
+void thread_yield(void) {
+  if (this_cpu_read(current) == NULL) {
+    return;
+  }
+  uint32_t flags = irq_save();
+  schedule();
+  irq_restore(flags);
+}
+
+void thread_sleep_ms(uint64_t ms) {
+  Thread *current = this_cpu_read(current);
+  if (current == NULL || current == this_cpu_read(idle) ||
+      current->killPending) {
+    return;
+  }
+  uint64_t ticks = timer_ms_to_ticks(ms);
+  if (ticks == 0) {
+    thread_yield();
+    return;
+  }
+  uint32_t flags = irq_save();
+  current->wakeTick = timer_ticks() + ticks;
+  current->state = THREAD_SLEEPING;
+  sleepers++;
+  schedule();
+  irq_restore(flags);
+}
+
+void thread_exit(void) {
+  irq_disable();
+  Thread *current = this_cpu_read(current);
+  current->state = THREAD_EXITED;
+  fpu_context_release(current->fpu);
+  schedule();
+  // never reached, nothing switches back to an exited thread
+  while (1) {
+    irq_enable_and_halt();
+  }
+}
+
+void thread_block(void) {
+  this_cpu_read(current)->state = THREAD_BLOCKED;
+  schedule();
+}
+
+void thread_wake(Thread *thread) {
+  uint32_t flags = irq_save();
+  if (thread->state == THREAD_SLEEPING) {
+    sleepers--;
+  }
+  if (thread->state == THREAD_SLEEPING || thread->state == THREAD_BLOCKED) {
+    thread->state = THREAD_READY;
+    runqueue_push(thread);
+    request_resched_if_idle();
+  }
+  irq_restore(flags);
+}
+
+void thread_kill(Thread *thread) {
+  thread->killPending = true;
+  // a sleeper or waiter notices on its way out of thread_sleep_ms() or
+  // when re-checking its wait condition
+  thread_wake(thread);
+}
+
+bool thread_should_stop(void) {
+  Thread *current = this_cpu_read(current);
+  return current != NULL && current->killPending;
+}
+
+Thread *thread_find(uint32_t id) {
+  for (uint32_t i = 0; i < THREAD_MAX; i++) {
+    ThreadState state = threads[i].state;
+    if (threads[i].id == id && state != THREAD_UNUSED &&
+        state != THREAD_EXITED) {
+      return &threads[i];
+    }
+  }
+  return NULL;
+}
+
+void preempt_disable(void) { this_cpu_inc(preemptCount); }
+
+void preempt_enable(void) {
+  this_cpu_dec(preemptCount);
+  if (this_cpu_read(preemptCount) == 0 && this_cpu_read(needResched) &&
+      this_cpu_read(irqDepth) == 0 && this_cpu_read(current) != NULL) {
+    uint32_t flags = irq_save();
+    schedule();
+    irq_restore(flags);
+  }
+}
+
+void sched_tick(void) {
+  Thread *current = this_cpu_read(current);
+  if (current == NULL) {
+    return;
+  }
+
+  if (sleepers > 0) {
+    uint64_t now = timer_ticks();
+    for (uint32_t i = 0; i < THREAD_MAX; i++) {
+      Thread *thread = &threads[i];
+      if (thread->state == THREAD_SLEEPING && thread->wakeTick <= now) {
+        thread->state = THREAD_READY;
+        sleepers--;
+        runqueue_push(thread);
+      }
+    }
+  }
+
+  if (current == this_cpu_read(idle)) {
+    if (!runqueue_empty()) {
+      this_cpu_write(needResched, true);
+    }
+    return;
+  }
+  if (current->sliceLeft > 0) {
+    current->sliceLeft--;
+  }
+  if (current->sliceLeft == 0 && !runqueue_empty()) {
+    current->preemptions++;
+    this_cpu_write(needResched, true);
+  }
+}
+
+void sched_irq_enter(void) {
+  this_cpu_inc(irqDepth);
+  if (this_cpu_read(halted)) {
+    idle_end();
+  }
+}
+
+void sched_irq_exit(void) {
+  this_cpu_dec(irqDepth);
+  // only the outermost interrupt switches, nested ones return to it first
+  if (this_cpu_read(irqDepth) == 0 && this_cpu_read(needResched) &&
+      this_cpu_read(preemptCount) == 0 && this_cpu_read(current) != NULL) {
+    schedule();
+  }
+}
+
+// appends str left aligned in a field of width characters
+static void append_padded(char *line, const char *str, size_t width) {
+  appendString(line, str);
+  for (size_t len = strlenOS(str); len < width; len++) {
+    appendString(line, " ");
+  }
+}
+
+void printThreadsToTerminal(void) {
+  if (this_cpu_read(current) == NULL) {
+    terminalWriteLine("Scheduler not running");
+    return;
+  }
+
+  // copy under cli, printing may itself be preempted
+  Thread snapshot[THREAD_MAX];
+  uint32_t flags = irq_save();
+  uint64_t now = rdtsc();
+  uint32_t runningId = this_cpu_read(current)->id;
+  uint64_t runningCycles = now - this_cpu_ptr()->switchTsc;
+  for (uint32_t i = 0; i < THREAD_MAX; i++) {
+    snapshot[i] = threads[i];
+  }
+  irq_restore(flags);
+
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < THREAD_MAX; i++) {
+    if (snapshot[i].state == THREAD_UNUSED) {
+      continue;
+    }
+    if (snapshot[i].state == THREAD_RUNNING && snapshot[i].id == runningId) {
+      snapshot[i].cpuCycles += runningCycles;
+    }
+    total += snapshot[i].cpuCycles;
+  }
+  uint64_t cyclesPerMs = tsc_hz() / 1000u;
+
+  terminalWriteLine("  ID NAME            STATE       CPU ms  CPU%  "
+                    "SWITCHES  PREEMPTED");
+  for (uint32_t i = 0; i < THREAD_MAX; i++) {
+    const Thread *thread = &snapshot[i];
+    if (thread->state == THREAD_UNUSED) {
+      continue;
+    }
+    char line[128] = "";
+    appendDecimal(line, thread->id, 4);
+    appendString(line, " ");
+    append_padded(line, thread->name, 16);
+    append_padded(line, stateNames[thread->state], 8);
+    appendDecimal(line, cyclesPerMs != 0 ? thread->cpuCycles / cyclesPerMs : 0,
+                  10);
+    appendDecimal(line, total != 0 ? thread->cpuCycles * 100u / total : 0, 6);
+    appendDecimal(line, thread->switchesIn, 10);
+    appendDecimal(line, thread->preemptions, 11);
+    terminalWriteLine(line);
+  }
+}
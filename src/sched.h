@@ -0,0 +1,222 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+/**
+ * @file sched.h
+ * @brief Preemptive kernel threads with a round-robin scheduler.
+ *
+ * Every thread has a control block (::Thread), its own kernel stack and its
+ * own FPU context. Runnable threads wait in one FIFO run queue. The timer
+ * tick (timer_irq()) charges the running thread's time slice and wakes
+ * sleepers. When the slice is used up, the switch happens on the way out
+ * of the interrupt, so a thread that never yields is still preempted.
+ *
+ * The thread that called sched_init() becomes the "main" thread. An idle
+ * thread halts the CPU whenever nothing else is runnable.
+ */
+
+#include "fpu.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief Most threads that can exist at the same time, idle included. */
+#define THREAD_MAX 16
+
+/** @brief Size of each thread's kernel stack in bytes. */
+#define THREAD_STACK_SIZE 16384
+
+/** @brief Ticks a thread may run before another runnable thread gets the CPU. */
+#define SCHED_SLICE_TICKS 10
+
+/** @brief Longest thread name, without the terminator. */
+#define THREAD_NAME_LENGTH 15
+
+/**
+ * @brief Lifecycle of a thread.
+ */
+typedef enum {
+  THREAD_UNUSED,   /**< Free slot. */
+  THREAD_READY,    /**< In the run queue. */
+  THREAD_RUNNING,  /**< On the CPU. */
+  THREAD_SLEEPING, /**< Waiting for a tick, see thread_sleep_ms(). */
+  THREAD_BLOCKED,  /**< Waiting for someone to call thread_wake(). */
+  THREAD_EXITED,   /**< Finished, the slot is reused by thread_create(). */
+} ThreadState;
+
+struct WaitQueue;
+struct AddressSpace;
+struct UserProcess;
+
+/**
+ * @brief The entry function of a thread.
+ */
+typedef void (*ThreadEntry)(void *arg);
+
+/**
+ * @brief Thread control block.
+ */
+typedef struct Thread {
+  uint32_t esp; /**< Saved stack pointer while switched out. */
+  uint32_t id;  /**< Unique id, never reused. */
+  char name[THREAD_NAME_LENGTH + 1]; /**< Shown by ps. */
+  ThreadState state; /**< Current lifecycle state. */
+  ThreadEntry entry; /**< Entry function. */
+  void *arg;         /**< Argument of the entry function. */
+  uint8_t *stack;    /**< Lowest address of the kernel stack. */
+  FpuContext *fpu;   /**< FPU/SSE state, switched lazily. */
+  uint64_t wakeTick; /**< Tick to wake up at while sleeping. */
+  uint32_t sliceLeft;     /**< Ticks left in the current time slice. */
+  uint64_t cpuCycles;     /**< TSC cycles spent on the CPU. */
+  uint64_t switchesIn;    /**< How often the thread was switched to. */
+  uint64_t preemptions;   /**< How often its slice ran out. */
+  bool killPending;       /**< Set by thread_kill(), see thread_should_stop(). */
+  struct Thread *next;    /**< Run queue link. */
+  struct WaitQueue *waitQueue; /**< Queue the thread waits in (sync.h). */
+  struct Thread *waitNext;     /**< Wait queue link. */
+  struct AddressSpace *space;  /**< Pages of a user thread, else NULL. */
+  struct UserProcess *process; /**< The process it runs (user.h), or NULL. */
+} Thread;
+
+/**
+ * @brief Turns the caller into the "main" thread and starts scheduling.
+ *
+ * @details Must run after fpu_init() and timer_init(). Creates the idle
+ * thread, from then on the tick preempts.
+ */
+void sched_init(void);
+
+/**
+ * @brief Returns whether sched_init() ran.
+ *
+ * @return true Once threads are being scheduled.
+ */
+bool sched_active(void);
+
+/**
+ * @brief Creates a thread and puts it into the run queue.
+ *
+ * @param name Name shown by ps, truncated to THREAD_NAME_LENGTH.
+ * @param entry The entry function, returning from it exits the thread.
+ * @param arg Passed to entry.
+ * @return Thread* The new thread, NULL if all THREAD_MAX slots are taken.
+ */
+Thread *thread_create(const char *name, ThreadEntry entry, void *arg);
+
+/**
+ * @brief Returns the running thread.
+ *
+ * @return Thread* The running thread, NULL before sched_init().
+ */
+Thread *thread_current(void);
+
+/**
+ * @brief Gives the CPU to the next runnable thread, if any.
+ */
+void thread_yield(void);
+
+/**
+ * @brief Puts the running thread to sleep for at least ms milliseconds.
+ *
+ * @param ms The time to sleep, rounded up to whole ticks.
+ */
+void thread_sleep_ms(uint64_t ms);
+
+/**
+ * @brief Ends the running thread.
+ *
+ * @details Does not return. The main and the idle thread must not exit.
+ */
+void thread_exit(void) __attribute__((noreturn));
+
+/**
+ * @brief Blocks the running thread until thread_wake() is called for it.
+ *
+ * @details Must be called with interrupts disabled, the caller re-checks
+ * its wait condition after it returns (wakeups can be spurious). Returns
+ * with interrupts still disabled.
+ */
+void thread_block(void);
+
+/**
+ * @brief Makes a blocked or sleeping thread runnable again.
+ *
+ * @param thread The thread, other states are left alone.
+ * @details Safe to call from interrupt handlers.
+ */
+void thread_wake(Thread *thread);
+
+/**
+ * @brief Asks a thread to stop.
+ *
+ * @param thread The thread.
+ * @details Threads are never torn down from the outside, they might hold
+ * hardware in some state. Instead the request wakes the thread from a
+ * sleep, makes further sleeps return at once and is polled by long running
+ * loops through thread_should_stop().
+ */
+void thread_kill(Thread *thread);
+
+/**
+ * @brief Returns whether the running thread was asked to stop.
+ *
+ * @return true If thread_kill() was called for the running thread.
+ */
+bool thread_should_stop(void);
+
+/**
+ * @brief Returns a thread by id.
+ *
+ * @param id The thread id.
+ * @return Thread* The thread, NULL if no live thread has that id.
+ */
+Thread *thread_find(uint32_t id);
+
+/**
+ * @brief Disables preemption of the running thread (nests).
+ *
+ * @details Interrupts still arrive, but the scheduler does not switch away
+ * on their way out until preempt_enable().
+ */
+void preempt_disable(void);
+
+/**
+ * @brief Undoes one preempt_disable(), switching if a switch was deferred.
+ */
+void preempt_enable(void);
+
+/**
+ * @brief Halts until the next interrupt and books the time as idle.
+ *
+ * @details Call with interrupts disabled, returns with them disabled. The
+ * idle period ends when the waking interrupt enters (sched_irq_enter()),
+ * so its handler counts as busy time.
+ */
+void sched_idle_halt(void);
+
+/**
+ * @brief Charges the running thread one tick and wakes due sleepers.
+ *
+ * @details Called by timer_irq() with interrupts disabled.
+ */
+void sched_tick(void);
+
+/**
+ * @brief Marks the start of a hardware interrupt, for nesting detection.
+ */
+void sched_irq_enter(void);
+
+/**
+ * @brief Switches threads if the tick asked for it.
+ *
+ * @details Called on the way out of every hardware interrupt. Does nothing
+ * in nested interrupts or with preemption disabled.
+ */
+void sched_irq_exit(void);
+
+/**
+ * @brief Prints all threads with state and CPU time to the terminal.
+ */
+void printThreadsToTerminal(void);
+
+#endif
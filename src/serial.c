@@ -0,0 +1,64 @@
+#include "serial.h"
+#include "io.h"
+#include <stdint.h>
+
+#define COM1_PORT 0x3F8
+
+// UART registers, relative to the base port
+#define UART_DATA 0          // THR/RBR, divisor low with DLAB
+#define UART_INTERRUPT 1     // IER, divisor high with DLAB
+#define UART_FIFO 2          // FCR
+#define UART_LINE_CONTROL 3  // LCR
+#define UART_MODEM_CONTROL 4 // MCR
+#define UART_LINE_STATUS 5   // LSR
+
+#define LCR_8N1 0x03
+#define LCR_DLAB 0x80
+#define FCR_ENABLE_CLEAR_14 0xC7 // enable, clear both, 14 byte threshold
+#define MCR_DTR_RTS_OUT2 0x0B
+#define MCR_LOOPBACK 0x10
+#define LSR_THR_EMPTY 0x20
+
+// 115200 / divisor = baud rate
+#define BAUD_DIVISOR 1
+
+static bool present = false;
+
+bool serial_init(void) {
+  outb(COM1_PORT + UART_INTERRUPT, 0x00);
+  outb(COM1_PORT + UART_LINE_CONTROL, LCR_DLAB);
+  outb(COM1_PORT + UART_DATA, BAUD_DIVISOR & 0xFF);
+  outb(COM1_PORT + UART_INTERRUPT, BAUD_DIVISOR >> 8);
+  outb(COM1_PORT + UART_LINE_CONTROL, LCR_8N1);
+  outb(COM1_PORT + UART_FIFO, FCR_ENABLE_CLEAR_14);
+
+  // a byte sent in loopback mode has to come back, otherwise no UART is there
+  outb(COM1_PORT + UART_MODEM_CONTROL, MCR_LOOPBACK | MCR_DTR_RTS_OUT2);
+  outb(COM1_PORT + UART_DATA, 0xAE);
+  present = inb(COM1_PORT + UART_DATA) == 0xAE;
+
+  outb(COM1_PORT + UART_MODEM_CONTROL, MCR_DTR_RTS_OUT2);
+  return present;
+}
+
+static void serial_put_raw(char c) {
+  while (!(inb(COM1_PORT + UART_LINE_STATUS) & LSR_THR_EMPTY)) {
+  }
+  outb(COM1_PORT + UART_DATA, (uint8_t)c);
+}
+
+void serial_putc(char c) {
+  if (!present) {
+    return;
+  }
+  if (c == '\n') {
+    serial_put_raw('\r');
+  }
+  serial_put_raw(c);
+}
+
+void serial_write(const char *str) {
+  while (*str != '\0') {
+    serial_putc(*str++);
+  }
+}
@@ -0,0 +1,37 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+/**
+ * @file serial.h
+ * @brief Polled output on the first serial port (COM1).
+ *
+ * Used to get data out of the machine without a screen, e.g. the profile
+ * counters of a training run (QEMU: -serial file:...). Output is polled, so
+ * it works with interrupts disabled and during shutdown.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Programs COM1 for 115200 baud, 8N1, FIFOs on, interrupts off.
+ *
+ * @return true If a UART answered the loopback test.
+ */
+bool serial_init(void);
+
+/**
+ * @brief Writes one character, waiting until the transmitter has room.
+ *
+ * @param c The character, '\n' is sent as "\r\n".
+ */
+void serial_putc(char c);
+
+/**
+ * @brief Writes a string.
+ *
+ * @param str The null terminated string.
+ */
+void serial_write(const char *str);
+
+#endif
@@ -1,4 +1,5 @@
 #include "shutdown.h"
+#include "gcov.h"
 #include "io.h"
 #include "printOS.h"
 #include <stdint.h>
@@ -9,6 +10,9 @@
 void systemShutdown() {
   screenWriteLine("Attempting QEMU Shutdown via 0x501...", 0);
 
+  // profile counters of a -fprofile-arcs kernel leave through the serial port
+  gcov_dump();
+
   // send 0 to QEMU_DEBUG_EXIT_PORT to signal that we want to shut down
   outb(QEMU_DEBUG_EXIT_PORT, 0);
   // If this worked, QEMU will exit. If it didn't, the code below might run.
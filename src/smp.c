@@ -0,0 +1,235 @@
+#include "smp.h"
+#include "cpu.h"
+#include "cpufeatures.h"
+#include "fpu.h"
+#include "gdt.h"
+#include "idt.h"
+#include "kmem.h"
+#include "lapic.h"
+#include "paging.h"
+#include "percpu.h"
+#include "str.h"
+#include "terminal.h"
+#include "time.h"
+#include <stddef.h>
+
+// delays of the INIT-SIPI-SIPI sequence from the MP specification
+#define SMP_INIT_DELAY_US 10000
+#define SMP_SIPI_DELAY_US 200
+// how long an AP gets to report back, and how often the BSP looks
+#define SMP_BOOT_TIMEOUT_US 100000
+#define SMP_BOOT_POLL_US 100
+
+// in trampoline.asm
+extern uint8_t ap_trampoline_start[];
+extern uint8_t ap_trampoline_end[];
+extern uint8_t ap_trampoline_stack[];
+extern uint8_t ap_trampoline_entry[];
+
+static SmpCpu cpus[SMP_MAX_CPUS];
+static uint8_t stacks[SMP_MAX_CPUS][SMP_STACK_SIZE] __attribute__((aligned(16)));
+static uint32_t cpuCount = 0;
+static bool useMwait = false;
+static bool (*volatile idleWork)(void) = NULL;
+
+// the AP being started, APs come up one at a time
+static volatile uint32_t bootingCpu = 0;
+
+static const char *stateNames[] = {"offline", "booting", "online", "failed"};
+
+// the parameter block inside the copy of the trampoline
+static uint32_t *trampoline_field(uint8_t *field) {
+  return (uint32_t *)(SMP_TRAMPOLINE_BASE + (field - ap_trampoline_start));
+}
+
+// waits for work in the mailbox, the line is only watched when MWAIT exists
+static void __attribute__((noreturn)) ap_idle(SmpCpu *cpu) {
+  while (1) {
+    SmpFunction function = cpu->function;
+    if (function != NULL) {
+      function(cpu->arg);
+      cpu->calls++;
+      // emptying the mailbox is what smp_wait() looks for
+      cpu->function = NULL;
+      continue;
+    }
+    bool (*work)(void) = idleWork;
+    if (work != NULL && work()) {
+      continue;
+    }
+    // no interrupts here, so the idle time is booked directly
+    uint64_t idleStart = rdtsc();
+    if (useMwait) {
+      // announce the nap before the last look for work, smp_kick_idle()
+      // does it the other way round, so one of both notices the other
+      cpu->sleeping = true;
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+      cpu_monitor(&cpu->function);
+      if (cpu->function == NULL && (work == NULL || !work())) {
+        cpu_mwait();
+      }
+      cpu->sleeping = false;
+    } else {
+      cpu_relax();
+    }
+    this_cpu_ptr()->idleCycles += rdtsc() - idleStart;
+  }
+}
+
+// C entry of the APs, called by the trampoline on the AP's own stack
+static void __attribute__((noreturn)) ap_main(void) {
+  SmpCpu *cpu = &cpus[bootingCpu];
+  gdtLoad();
+  paging_cpu_init();
+  percpu_init(cpu->index);
+  idtLoad();
+  fpu_cpu_init();
+  lapic_init();
+  this_cpu_write(apicId, lapic_id());
+  cpu->state = SMP_CPU_ONLINE;
+  ap_idle(cpu);
+}
+
+// INIT-SIPI-SIPI, then waits for the AP to report back
+static void start_ap(SmpCpu *cpu) {
+  *trampoline_field(ap_trampoline_stack) =
+      (uint32_t)(stacks[cpu->index] + SMP_STACK_SIZE);
+  *trampoline_field(ap_trampoline_entry) = (uint32_t)ap_main;
+  bootingCpu = cpu->index;
+  cpu->state = SMP_CPU_BOOTING;
+
+  uint64_t start = rdtsc();
+  uint8_t page = SMP_TRAMPOLINE_BASE >> 12;
+  lapic_send_init(cpu->apicId);
+  pit_delay_us(SMP_INIT_DELAY_US);
+  lapic_send_startup(cpu->apicId, page);
+  pit_delay_us(SMP_SIPI_DELAY_US);
+  // the second SIPI is only for CPUs that missed the first one
+  if (cpu->state != SMP_CPU_ONLINE) {
+    lapic_send_startup(cpu->apicId, page);
+  }
+
+  for (uint32_t waited = 0;
+       cpu->state != SMP_CPU_ONLINE && waited < SMP_BOOT_TIMEOUT_US;
+       waited += SMP_BOOT_POLL_US) {
+    pit_delay_us(SMP_BOOT_POLL_US);
+  }
+  if (cpu->state == SMP_CPU_ONLINE) {
+    cpu->bootCycles = rdtsc() - start;
+  } else {
+    cpu->state = SMP_CPU_FAILED;
+  }
+}
+
+void smp_init(void) {
+  if (cpuCount != 0) {
+    return;
+  }
+  cpus[0].index = 0;
+  cpus[0].apicId = lapic_id();
+  cpus[0].state = SMP_CPU_ONLINE;
+  this_cpu_write(apicId, cpus[0].apicId);
+  cpuCount = 1;
+
+  const AcpiMadtInfo *madt = acpi_madt();
+  if (madt == NULL || !lapic_available()) {
+    return;
+  }
+  useMwait = cpu_features()->monitor;
+  memcpyOS((void *)SMP_TRAMPOLINE_BASE, ap_trampoline_start,
+           (size_t)(ap_trampoline_end - ap_trampoline_start));
+
+  for (uint32_t i = 0; i < madt->cpuCount && cpuCount < SMP_MAX_CPUS; i++) {
+    if (madt->cpuApicIds[i] == cpus[0].apicId) {
+      continue;
+    }
+    SmpCpu *cpu = &cpus[cpuCount];
+    cpu->index = cpuCount;
+    cpu->apicId = madt->cpuApicIds[i];
+    cpuCount++;
+    start_ap(cpu);
+  }
+}
+
+uint32_t smp_cpu_count(void) { return cpuCount; }
+
+uint32_t smp_online_count(void) {
+  uint32_t online = 0;
+  for (uint32_t i = 0; i < cpuCount; i++) {
+    if (cpus[i].state == SMP_CPU_ONLINE) {
+      online++;
+    }
+  }
+  return online;
+}
+
+const SmpCpu *smp_cpu(uint32_t index) {
+  return index < cpuCount ? &cpus[index] : NULL;
+}
+
+bool smp_call(uint32_t index, SmpFunction function, void *arg) {
+  if (index == 0 || index >= cpuCount || cpus[index].state != SMP_CPU_ONLINE ||
+      cpus[index].function != NULL) {
+    return false;
+  }
+  // x86 keeps stores in order, the AP sees arg before function
+  cpus[index].arg = arg;
+  cpus[index].function = function;
+  return true;
+}
+
+void smp_wait(uint32_t index) {
+  if (index >= cpuCount) {
+    return;
+  }
+  while (cpus[index].function != NULL) {
+    cpu_relax();
+  }
+}
+
+void smp_set_idle_work(bool (*work)(void)) { idleWork = work; }
+
+void smp_kick_idle(void) {
+  if (!useMwait) {
+    return;
+  }
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  for (uint32_t i = 1; i < cpuCount; i++) {
+    if (cpus[i].sleeping) {
+      // any write to the monitored line ends the mwait
+      cpus[i].kicks++;
+    }
+  }
+}
+
+void printSmpToTerminal(void) {
+  char line[128] = "";
+  appendDecimal(line, smp_online_count(), 0);
+  appendString(line, " of ");
+  appendDecimal(line, cpuCount, 0);
+  appendString(line, " CPUs online, APs idle with ");
+  appendString(line, useMwait ? "monitor/mwait" : "pause");
+  terminalWriteLine(line);
+
+  uint64_t cyclesPerUs = tsc_hz() / 1000000u;
+  terminalWriteLine(" CPU  APIC  STATE     BOOT us     CALLS      IRQS  SWITCHES");
+  for (uint32_t i = 0; i < cpuCount; i++) {
+    const SmpCpu *cpu = &cpus[i];
+    line[0] = '\0';
+    appendDecimal(line, cpu->index, 4);
+    appendDecimal(line, cpu->apicId, 6);
+    appendString(line, "  ");
+    appendString(line, i == 0 ? "bsp     " : stateNames[cpu->state]);
+    for (size_t len = i == 0 ? 8 : strlenOS(stateNames[cpu->state]); len < 8;
+         len++) {
+      appendString(line, " ");
+    }
+    appendDecimal(line, cyclesPerUs != 0 ? cpu->bootCycles / cyclesPerUs : 0,
+                  10);
+    appendDecimal(line, cpu->calls, 10);
+    const PerCpu *area = percpu_area(i);
+    appendDecimal(line, area->irqs, 10);
+    appendDecimal(line, area->contextSwitches, 10);
+    terminalWriteLine(line);
+  }
+}
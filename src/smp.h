@@ -0,0 +1,128 @@
+#ifndef SMP_H
+#define SMP_H
+
+/**
+ * @file smp.h
+ * @brief Bring-up of the application processors (APs).
+ *
+ * The BSP starts every CPU the ACPI MADT lists with INIT-SIPI-SIPI. An AP
+ * begins in real mode in the trampoline (trampoline.asm), switches to
+ * protected mode, loads the kernel's GDT, page tables and IDT, enables its
+ * FPU and Local APIC and then waits in its own idle loop for work posted
+ * with smp_call(). APs run with interrupts disabled, everything interrupt
+ * driven (scheduler, timers, softirqs, tracing) stays on the BSP.
+ */
+
+#include "acpi.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @brief Most CPUs brought up, the BSP included. */
+#define SMP_MAX_CPUS ACPI_MAX_CPUS
+
+/** @brief Physical address the trampoline is copied to, page aligned, below 1 MiB. */
+#define SMP_TRAMPOLINE_BASE 0x7000
+
+/** @brief Size of each AP's stack in bytes. */
+#define SMP_STACK_SIZE 8192
+
+/**
+ * @brief Function run on another CPU, see smp_call().
+ */
+typedef void (*SmpFunction)(void *arg);
+
+/**
+ * @brief Bring-up state of a CPU.
+ */
+typedef enum {
+  SMP_CPU_OFFLINE, /**< Not started. */
+  SMP_CPU_BOOTING, /**< INIT-SIPI-SIPI sent, not reported back yet. */
+  SMP_CPU_ONLINE,  /**< Running its idle loop. */
+  SMP_CPU_FAILED,  /**< Did not come up in time. */
+} SmpCpuState;
+
+/**
+ * @brief One CPU, index 0 is the BSP.
+ *
+ * @details Cache line sized, so an AP monitoring its mailbox is not woken
+ * by writes to its neighbours.
+ */
+typedef struct {
+  uint32_t index;              /**< Position in the CPU list. */
+  uint32_t apicId;             /**< Local APIC ID. */
+  volatile SmpCpuState state;  /**< Bring-up state. */
+  volatile SmpFunction function; /**< Mailbox: work to run, NULL when idle. */
+  void *volatile arg;          /**< Mailbox: argument of function. */
+  volatile uint64_t calls;     /**< Mailbox functions run so far. */
+  uint64_t bootCycles;         /**< TSC cycles from INIT until online. */
+  volatile bool sleeping;      /**< In mwait, see smp_kick_idle(). */
+  volatile uint32_t kicks;     /**< Written to wake the CPU from mwait. */
+} __attribute__((aligned(64))) SmpCpu;
+
+/**
+ * @brief Starts all application processors.
+ *
+ * @details Needs acpi_init() (through idtInit()), timer_init() and
+ * fpu_init(). Without a MADT or Local APIC only the BSP is listed.
+ */
+void smp_init(void);
+
+/**
+ * @brief Returns the number of listed CPUs, online or not.
+ *
+ * @return uint32_t The CPU count, at least 1.
+ */
+uint32_t smp_cpu_count(void);
+
+/**
+ * @brief Returns the number of CPUs running, the BSP included.
+ *
+ * @return uint32_t The online CPU count.
+ */
+uint32_t smp_online_count(void);
+
+/**
+ * @brief Returns a CPU by index.
+ *
+ * @param index 0 for the BSP, up to smp_cpu_count() - 1.
+ * @return const SmpCpu* The CPU, NULL if the index is out of range.
+ */
+const SmpCpu *smp_cpu(uint32_t index);
+
+/**
+ * @brief Posts a function to an AP's mailbox.
+ *
+ * @param index The AP, must be online and not the BSP.
+ * @param function Runs on the AP with interrupts disabled.
+ * @param arg Passed to function.
+ * @return true If posted, false if the AP is offline or still busy.
+ */
+bool smp_call(uint32_t index, SmpFunction function, void *arg);
+
+/**
+ * @brief Waits until an AP finished the function posted with smp_call().
+ *
+ * @param index The AP.
+ */
+void smp_wait(uint32_t index);
+
+/**
+ * @brief Sets work the APs look for whenever their mailbox is empty.
+ *
+ * @param work Returns true if it found and did something, NULL for none.
+ */
+void smp_set_idle_work(bool (*work)(void));
+
+/**
+ * @brief Wakes the APs that wait in mwait, so they look for idle work.
+ *
+ * @details Cheap when nobody sleeps. Without MWAIT the APs poll anyway.
+ */
+void smp_kick_idle(void);
+
+/**
+ * @brief Prints all CPUs with APIC ID, state and boot time to the terminal.
+ */
+void printSmpToTerminal(void);
+
+#endif
@@ -0,0 +1,94 @@
+#include "softirq.h"
+#include "cpu.h"
+#include "events.h"
+#include "sched.h"
+#include <stddef.h>
+
+static void work_softirq(void);
+
+static SoftirqHandler handlers[SOFTIRQ_COUNT] = {[SOFTIRQ_WORK] = work_softirq};
+static volatile uint32_t pendingBits = 0;
+static volatile bool running = false;
+
+// FIFO of work items
+static WorkItem *workHead = NULL;
+static WorkItem *workTail = NULL;
+
+void softirq_register(SoftirqType type, SoftirqHandler handler) {
+  handlers[type] = handler;
+}
+
+void softirq_raise(SoftirqType type) {
+  uint32_t flags = irq_save();
+  pendingBits |= 1u << type;
+  irq_restore(flags);
+}
+
+bool softirq_pending(void) { return pendingBits != 0; }
+
+void softirq_run(void) {
+  uint32_t flags = irq_save();
+  if (running || pendingBits == 0) {
+    irq_restore(flags);
+    return;
+  }
+  running = true;
+  // the handlers run with interrupts on but must not be switched away from
+  preempt_disable();
+
+  for (int pass = 0; pass < SOFTIRQ_MAX_PASSES && pendingBits != 0; pass++) {
+    uint32_t bits = pendingBits;
+    pendingBits = 0;
+    irq_enable();
+    for (uint32_t type = 0; type < SOFTIRQ_COUNT; type++) {
+      if ((bits & (1u << type)) && handlers[type] != NULL) {
+        handlers[type]();
+      }
+    }
+    irq_disable();
+  }
+
+  running = false;
+  // out of passes, the main loop picks up the rest
+  if (pendingBits != 0) {
+    event_post(EVENT_WORK);
+  }
+  irq_restore(flags);
+  preempt_enable();
+}
+
+// SOFTIRQ_WORK: runs the items queued when the softirq started, items queued
+// meanwhile wait for the next pass
+static void work_softirq(void) {
+  uint32_t flags = irq_save();
+  WorkItem *work = workHead;
+  workHead = NULL;
+  workTail = NULL;
+  irq_restore(flags);
+
+  while (work != NULL) {
+    WorkItem *next = work->next;
+    work->queued = false;
+    work->function(work->arg);
+    work = next;
+  }
+}
+
+bool work_queue(WorkItem *work) {
+  uint32_t flags = irq_save();
+  if (work->queued) {
+    irq_restore(flags);
+    return false;
+  }
+  work->queued = true;
+  work->next = NULL;
+  if (workTail != NULL) {
+    workTail->next = work;
+  } else {
+    workHead = work;
+  }
+  workTail = work;
+  pendingBits |= 1u << SOFTIRQ_WORK;
+  irq_restore(flags);
+  return true;
+}
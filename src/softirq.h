@@ -0,0 +1,94 @@
+#ifndef SOFTIRQ_H
+#define SOFTIRQ_H
+
+/**
+ * @file softirq.h
+ * @brief Deferred interrupt work (softirqs and work items).
+ *
+ * Interrupt handlers only do the minimum with interrupts disabled: they
+ * acknowledge the device, store what it delivered and raise a softirq. The
+ * pending softirqs then run with interrupts enabled, right after the end of
+ * interrupt on the way out of a hardware IRQ, or from the idle loop. CPU
+ * exceptions never run them, they may hit code that keeps interrupts off.
+ *
+ * Each softirq type has its own pending bit, so a busy source cannot hide
+ * the others. Types run in ascending order, each at most once per pass, and
+ * softirq_run() gives up after SOFTIRQ_MAX_PASSES passes, leaving the rest
+ * to the idle loop or the next interrupt.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief The softirq types, lower values run first.
+ */
+typedef enum {
+  SOFTIRQ_KEYBOARD, /**< Scan code decoding, raised by IRQ1. */
+  SOFTIRQ_WORK,     /**< The work item queue, see work_queue(). */
+  SOFTIRQ_COUNT     /**< Number of softirq types. */
+} SoftirqType;
+
+/** @brief Passes over the pending bits per softirq_run() call. */
+#define SOFTIRQ_MAX_PASSES 8
+
+/**
+ * @brief A softirq handler, runs with interrupts enabled.
+ */
+typedef void (*SoftirqHandler)(void);
+
+/**
+ * @brief A unit of deferred work for the SOFTIRQ_WORK queue.
+ *
+ * @details Owned by the caller, it must stay valid until it ran. A work item
+ * that is still queued is not queued a second time.
+ */
+typedef struct WorkItem {
+  void (*function)(void *arg); /**< The function to run. */
+  void *arg;                   /**< Passed to function. */
+  struct WorkItem *next;       /**< Queue link, managed by the softirq code. */
+  volatile bool queued;        /**< True while waiting in the queue. */
+} WorkItem;
+
+/**
+ * @brief Installs the handler of a softirq type.
+ *
+ * @param type The softirq type.
+ * @param handler The function to run when the type is pending.
+ */
+void softirq_register(SoftirqType type, SoftirqHandler handler);
+
+/**
+ * @brief Marks a softirq type as pending.
+ *
+ * @param type The softirq type.
+ * @details Safe to call from interrupt handlers and from softirqs, a handler
+ * may raise its own type again to continue in the next pass.
+ */
+void softirq_raise(SoftirqType type);
+
+/**
+ * @brief Checks whether any softirq is pending.
+ *
+ * @return true If softirq_run() has work to do.
+ */
+bool softirq_pending(void);
+
+/**
+ * @brief Runs the pending softirqs with interrupts enabled.
+ *
+ * @details Called by isrHandler() after the end of interrupt and by idle
+ * loops. Does nothing if softirqs are already running further up the stack.
+ * The interrupt flag is the same on return as on entry.
+ */
+void softirq_run(void);
+
+/**
+ * @brief Queues a work item to run from the SOFTIRQ_WORK softirq.
+ *
+ * @param work The work item, function and arg must be set.
+ * @return true If it was queued, false if it was already pending.
+ */
+bool work_queue(WorkItem *work);
+
+#endif
@@ -0,0 +1,278 @@
+#include "spinlock.h"
+#include "str.h"
+#include "terminal.h"
+#include "time.h"
+#include <stddef.h>
+
+// most locks the lockstat command sorts and prints
+#define LOCKSTAT_SHOWN 16
+
+static volatile bool statsEnabled = true;
+static LockStat *volatile lockList = NULL;
+
+// links a lock into the list the first time it is taken, lock-free because
+// the first acquisition can happen on any CPU and in any context
+static void lockstat_register(LockStat *stat) {
+  if (__atomic_exchange_n(&stat->registered, true, __ATOMIC_ACQ_REL)) {
+    return;
+  }
+  LockStat *head = __atomic_load_n(&lockList, __ATOMIC_RELAXED);
+  do {
+    stat->next = head;
+  } while (!__atomic_compare_exchange_n(&lockList, &head, stat, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static inline void lockstat_acquired(LockStat *stat) {
+  if (!stat->registered) {
+    lockstat_register(stat);
+  }
+  __atomic_add_fetch(&stat->acquisitions, 1, __ATOMIC_RELAXED);
+}
+
+// 0 when the statistics are off, so the wait is not timed
+static inline uint64_t lockstat_wait_start(void) {
+  return statsEnabled ? rdtsc() : 0;
+}
+
+static void lockstat_contended(LockStat *stat, uint64_t start) {
+  if (start == 0) {
+    return;
+  }
+  uint64_t cycles = rdtsc() - start;
+  __atomic_add_fetch(&stat->contended, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&stat->spinCycles, cycles, __ATOMIC_RELAXED);
+  uint64_t max = stat->maxSpinCycles;
+  while (cycles > max &&
+         !__atomic_compare_exchange_n(&stat->maxSpinCycles, &max, cycles, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+static void lockstat_init(LockStat *stat, const char *name, const char *kind) {
+  stat->name = name;
+  stat->kind = kind;
+  stat->acquisitions = 0;
+  stat->contended = 0;
+  stat->spinCycles = 0;
+  stat->maxSpinCycles = 0;
+  stat->registered = false;
+  stat->next = NULL;
+}
+
+// --- spinlock ---
+
+void spin_lock_init(Spinlock *lock, const char *name) {
+  lock->locked = 0;
+  lockstat_init(&lock->stat, name, "spin");
+}
+
+void spin_lock(Spinlock *lock) {
+  preempt_disable();
+  if (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE) != 0) {
+    uint64_t start = lockstat_wait_start();
+    do {
+      // spin on a plain read, the cache line stays shared until it is freed
+      while (lock->locked != 0) {
+        cpu_relax();
+      }
+    } while (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE) != 0);
+    lockstat_contended(&lock->stat, start);
+  }
+  lockstat_acquired(&lock->stat);
+}
+
+bool spin_trylock(Spinlock *lock) {
+  preempt_disable();
+  if (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE) != 0) {
+    preempt_enable();
+    return false;
+  }
+  lockstat_acquired(&lock->stat);
+  return true;
+}
+
+void spin_release(Spinlock *lock) {
+  __atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+void spin_unlock(Spinlock *lock) {
+  spin_release(lock);
+  preempt_enable();
+}
+
+// --- ticket lock ---
+
+void ticket_lock_init(TicketLock *lock, const char *name) {
+  lock->next = 0;
+  lock->owner = 0;
+  lockstat_init(&lock->stat, name, "ticket");
+}
+
+void ticket_lock(TicketLock *lock) {
+  preempt_disable();
+  uint16_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+  if (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+    uint64_t start = lockstat_wait_start();
+    while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+      cpu_relax();
+    }
+    lockstat_contended(&lock->stat, start);
+  }
+  lockstat_acquired(&lock->stat);
+}
+
+void ticket_release(TicketLock *lock) {
+  // only the holder writes owner, no atomic add needed
+  __atomic_store_n(&lock->owner, (uint16_t)(lock->owner + 1), __ATOMIC_RELEASE);
+}
+
+void ticket_unlock(TicketLock *lock) {
+  ticket_release(lock);
+  preempt_enable();
+}
+
+// --- reader-writer lock ---
+
+void rwlock_init(RwLock *lock, const char *name) {
+  lock->state = 0;
+  lockstat_init(&lock->stat, name, "rw");
+}
+
+static bool read_try(RwLock *lock) {
+  uint32_t state = __atomic_load_n(&lock->state, __ATOMIC_RELAXED);
+  return (state & RWLOCK_WRITER) == 0 &&
+         __atomic_compare_exchange_n(&lock->state, &state, state + 1, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+void read_lock(RwLock *lock) {
+  preempt_disable();
+  if (!read_try(lock)) {
+    uint64_t start = lockstat_wait_start();
+    while (!read_try(lock)) {
+      cpu_relax();
+    }
+    lockstat_contended(&lock->stat, start);
+  }
+  lockstat_acquired(&lock->stat);
+}
+
+void read_release(RwLock *lock) {
+  __atomic_sub_fetch(&lock->state, 1, __ATOMIC_RELEASE);
+}
+
+void read_unlock(RwLock *lock) {
+  read_release(lock);
+  preempt_enable();
+}
+
+// claims the writer bit, which keeps new readers out while the old drain
+static bool write_claim(RwLock *lock) {
+  uint32_t state = __atomic_load_n(&lock->state, __ATOMIC_RELAXED);
+  return (state & RWLOCK_WRITER) == 0 &&
+         __atomic_compare_exchange_n(&lock->state, &state,
+                                     state | RWLOCK_WRITER, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+void write_lock(RwLock *lock) {
+  preempt_disable();
+  bool claimed = write_claim(lock);
+  if (!claimed ||
+      __atomic_load_n(&lock->state, __ATOMIC_ACQUIRE) != RWLOCK_WRITER) {
+    uint64_t start = lockstat_wait_start();
+    while (!claimed) {
+      cpu_relax();
+      claimed = write_claim(lock);
+    }
+    // only the readers from before the claim are left
+    while (__atomic_load_n(&lock->state, __ATOMIC_ACQUIRE) != RWLOCK_WRITER) {
+      cpu_relax();
+    }
+    lockstat_contended(&lock->stat, start);
+  }
+  lockstat_acquired(&lock->stat);
+}
+
+void write_release(RwLock *lock) {
+  __atomic_store_n(&lock->state, 0, __ATOMIC_RELEASE);
+}
+
+void write_unlock(RwLock *lock) {
+  write_release(lock);
+  preempt_enable();
+}
+
+// --- statistics ---
+
+void lockstat_set_enabled(bool enabled) { statsEnabled = enabled; }
+
+void lockstat_reset(void) {
+  for (LockStat *stat = lockList; stat != NULL; stat = stat->next) {
+    stat->acquisitions = 0;
+    stat->contended = 0;
+    stat->spinCycles = 0;
+    stat->maxSpinCycles = 0;
+  }
+}
+
+// name padded or cut to width columns
+static void append_padded(char *line, const char *text, size_t width) {
+  size_t len = 0;
+  char cell[2] = "";
+  for (; text[len] != '\0' && len < width; len++) {
+    cell[0] = text[len];
+    appendString(line, cell);
+  }
+  for (; len < width; len++) {
+    appendString(line, " ");
+  }
+}
+
+// docs see header file
+void printLockstatToTerminal(void) {
+  LockStat *shown[LOCKSTAT_SHOWN];
+  uint32_t count = 0;
+  uint32_t total = 0;
+
+  // insertion sort by spin cycles, then by contended acquisitions
+  for (LockStat *stat = lockList; stat != NULL; stat = stat->next) {
+    total++;
+    if (count == LOCKSTAT_SHOWN &&
+        stat->spinCycles <= shown[LOCKSTAT_SHOWN - 1]->spinCycles) {
+      continue;
+    }
+    uint32_t i = count < LOCKSTAT_SHOWN ? count++ : LOCKSTAT_SHOWN - 1;
+    while (i > 0 && (shown[i - 1]->spinCycles < stat->spinCycles ||
+                     (shown[i - 1]->spinCycles == stat->spinCycles &&
+                      shown[i - 1]->contended < stat->contended))) {
+      shown[i] = shown[i - 1];
+      i--;
+    }
+    shown[i] = stat;
+  }
+
+  char line[128] = "";
+  appendDecimal(line, total, 0);
+  appendString(line, " locks, contention statistics ");
+  appendString(line, statsEnabled ? "on" : "off");
+  terminalWriteLine(line);
+  terminalWriteLine("NAME            KIND      ACQUIRED  CONTENDED   SPIN us    MAX us");
+
+  uint64_t cyclesPerUs = tsc_hz() / 1000000u;
+  if (cyclesPerUs == 0) {
+    cyclesPerUs = 1;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    const LockStat *stat = shown[i];
+    line[0] = '\0';
+    append_padded(line, stat->name != NULL ? stat->name : "?", 16);
+    append_padded(line, stat->kind, 6);
+    appendDecimal(line, stat->acquisitions, 12);
+    appendDecimal(line, stat->contended, 11);
+    appendDecimal(line, stat->spinCycles / cyclesPerUs, 10);
+    appendDecimal(line, stat->maxSpinCycles / cyclesPerUs, 10);
+    terminalWriteLine(line);
+  }
+}
@@ -0,0 +1,341 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+/**
+ * @file spinlock.h
+ * @brief Spinlocks, ticket locks, reader-writer locks and lock statistics.
+ *
+ * All locks disable preemption while held, so a thread never spins on a
+ * lock owned by a thread of the same CPU that got switched out. The
+ * `_irqsave` variants also disable interrupts, they are needed whenever an
+ * interrupt handler or softirq takes the same lock. Like irq_save() they
+ * are macros, so the irqsoff tracer reports the caller.
+ *
+ * Every lock carries a ::LockStat. It counts acquisitions and, only when
+ * the first attempt fails, contended acquisitions and the TSC cycles spent
+ * spinning, so the uncontended path only pays for one counter increment. A
+ * lock shows up in the `lockstat` list the first time it is taken and is
+ * never removed again, so locks have to be static or live just as long.
+ *
+ * ::SeqCount is for data with a single writer that readers may not block,
+ * e.g. the 64-bit tick counter written from the timer interrupt.
+ */
+
+#include "cpu.h"
+#include "sched.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Usage statistics of one lock.
+ */
+typedef struct LockStat {
+  const char *name;               /**< Shown by `lockstat`. */
+  const char *kind;               /**< "spin", "ticket" or "rw". */
+  volatile uint32_t acquisitions; /**< Times the lock was taken. */
+  volatile uint32_t contended;    /**< Of those, not on the first attempt. */
+  volatile uint64_t spinCycles;   /**< TSC cycles spent waiting. */
+  volatile uint64_t maxSpinCycles; /**< Longest single wait. */
+  volatile bool registered;       /**< Linked into the lockstat list. */
+  struct LockStat *next;          /**< Next registered lock. */
+} LockStat;
+
+/** @brief Initializer of a ::LockStat. */
+#define LOCKSTAT_INIT(lockName, lockKind)                                      \
+  { (lockName), (lockKind), 0, 0, 0, 0, false, NULL }
+
+/**
+ * @brief Test-and-test-and-set spinlock.
+ */
+typedef struct {
+  volatile uint32_t locked; /**< 1 while held. */
+  LockStat stat;            /**< Usage statistics. */
+} Spinlock;
+
+/** @brief Initializer of an unlocked ::Spinlock. */
+#define SPINLOCK_INIT(lockName) {0, LOCKSTAT_INIT((lockName), "spin")}
+
+/**
+ * @brief FIFO spinlock, waiters get the lock in the order they arrived.
+ */
+typedef struct {
+  volatile uint16_t next;  /**< Ticket handed to the next arriving CPU. */
+  volatile uint16_t owner; /**< Ticket that holds the lock. */
+  LockStat stat;           /**< Usage statistics. */
+} TicketLock;
+
+/** @brief Initializer of an unlocked ::TicketLock. */
+#define TICKETLOCK_INIT(lockName) {0, 0, LOCKSTAT_INIT((lockName), "ticket")}
+
+/**
+ * @brief Reader-writer spinlock, a waiting writer keeps new readers out.
+ */
+typedef struct {
+  volatile uint32_t state; /**< Reader count, RWLOCK_WRITER when claimed. */
+  LockStat stat;           /**< Usage statistics. */
+} RwLock;
+
+/** @brief Bit of RwLock::state held by a writer. */
+#define RWLOCK_WRITER 0x80000000u
+
+/** @brief Initializer of an unlocked ::RwLock. */
+#define RWLOCK_INIT(lockName) {0, LOCKSTAT_INIT((lockName), "rw")}
+
+/**
+ * @brief Sequence counter, odd while the writer is updating.
+ */
+typedef struct {
+  volatile uint32_t sequence; /**< Incremented before and after a write. */
+} SeqCount;
+
+/** @brief Initializer of a ::SeqCount. */
+#define SEQCOUNT_INIT {0}
+
+/**
+ * @brief Prepares a spinlock at run time.
+ *
+ * @param lock The lock.
+ * @param name Shown by `lockstat`, must stay valid.
+ */
+void spin_lock_init(Spinlock *lock, const char *name);
+
+/**
+ * @brief Takes a spinlock, spinning while another CPU holds it.
+ *
+ * @param lock The lock.
+ */
+void spin_lock(Spinlock *lock);
+
+/**
+ * @brief Takes a spinlock if it is free.
+ *
+ * @param lock The lock.
+ * @return true If taken, false if it is held.
+ */
+bool spin_trylock(Spinlock *lock);
+
+/**
+ * @brief Releases a spinlock.
+ *
+ * @param lock The lock.
+ */
+void spin_unlock(Spinlock *lock);
+
+/**
+ * @brief Prepares a ticket lock at run time.
+ *
+ * @param lock The lock.
+ * @param name Shown by `lockstat`, must stay valid.
+ */
+void ticket_lock_init(TicketLock *lock, const char *name);
+
+/**
+ * @brief Draws a ticket and spins until it is served.
+ *
+ * @param lock The lock.
+ */
+void ticket_lock(TicketLock *lock);
+
+/**
+ * @brief Serves the next ticket.
+ *
+ * @param lock The lock.
+ */
+void ticket_unlock(TicketLock *lock);
+
+/**
+ * @brief Prepares a reader-writer lock at run time.
+ *
+ * @param lock The lock.
+ * @param name Shown by `lockstat`, must stay valid.
+ */
+void rwlock_init(RwLock *lock, const char *name);
+
+/**
+ * @brief Takes a reader-writer lock shared, with other readers.
+ *
+ * @param lock The lock.
+ */
+void read_lock(RwLock *lock);
+
+/**
+ * @brief Drops a shared hold.
+ *
+ * @param lock The lock.
+ */
+void read_unlock(RwLock *lock);
+
+/**
+ * @brief Takes a reader-writer lock exclusively.
+ *
+ * @param lock The lock.
+ */
+void write_lock(RwLock *lock);
+
+/**
+ * @brief Drops an exclusive hold.
+ *
+ * @param lock The lock.
+ */
+void write_unlock(RwLock *lock);
+
+/**
+ * @brief Releases a spinlock but leaves preemption disabled.
+ *
+ * @param lock The lock.
+ * @details For the `_irqrestore` macros, which only allow preemption again
+ * once interrupts are back on. Everyone else uses spin_unlock().
+ */
+void spin_release(Spinlock *lock);
+
+/** @brief ticket_unlock() without preempt_enable(), see spin_release(). */
+void ticket_release(TicketLock *lock);
+
+/** @brief read_unlock() without preempt_enable(), see spin_release(). */
+void read_release(RwLock *lock);
+
+/** @brief write_unlock() without preempt_enable(), see spin_release(). */
+void write_release(RwLock *lock);
+
+/**
+ * @brief Disables interrupts, then takes a spinlock.
+ *
+ * @param lock The lock.
+ * @return uint32_t The EFLAGS to pass to spin_unlock_irqrestore().
+ */
+#define spin_lock_irqsave(lock)                                                \
+  ({                                                                           \
+    uint32_t lockFlags = irq_save();                                           \
+    spin_lock(lock);                                                           \
+    lockFlags;                                                                 \
+  })
+
+/**
+ * @brief Releases a spinlock, restores the interrupt flag, then allows
+ * preemption again.
+ *
+ * @param lock The lock.
+ * @param flags The value returned by spin_lock_irqsave().
+ */
+#define spin_unlock_irqrestore(lock, flags)                                    \
+  do {                                                                         \
+    spin_release(lock);                                                        \
+    irq_restore(flags);                                                        \
+    preempt_enable();                                                          \
+  } while (0)
+
+/** @brief ticket_lock() with interrupts disabled, see spin_lock_irqsave(). */
+#define ticket_lock_irqsave(lock)                                              \
+  ({                                                                           \
+    uint32_t lockFlags = irq_save();                                           \
+    ticket_lock(lock);                                                         \
+    lockFlags;                                                                 \
+  })
+
+/** @brief ticket_unlock() for ticket_lock_irqsave(). */
+#define ticket_unlock_irqrestore(lock, flags)                                  \
+  do {                                                                         \
+    ticket_release(lock);                                                      \
+    irq_restore(flags);                                                        \
+    preempt_enable();                                                          \
+  } while (0)
+
+/** @brief read_lock() with interrupts disabled, see spin_lock_irqsave(). */
+#define read_lock_irqsave(lock)                                                \
+  ({                                                                           \
+    uint32_t lockFlags = irq_save();                                           \
+    read_lock(lock);                                                           \
+    lockFlags;                                                                 \
+  })
+
+/** @brief read_unlock() for read_lock_irqsave(). */
+#define read_unlock_irqrestore(lock, flags)                                    \
+  do {                                                                         \
+    read_release(lock);                                                        \
+    irq_restore(flags);                                                        \
+    preempt_enable();                                                          \
+  } while (0)
+
+/** @brief write_lock() with interrupts disabled, see spin_lock_irqsave(). */
+#define write_lock_irqsave(lock)                                               \
+  ({                                                                           \
+    uint32_t lockFlags = irq_save();                                           \
+    write_lock(lock);                                                          \
+    lockFlags;                                                                 \
+  })
+
+/** @brief write_unlock() for write_lock_irqsave(). */
+#define write_unlock_irqrestore(lock, flags)                                   \
+  do {                                                                         \
+    write_release(lock);                                                       \
+    irq_restore(flags);                                                        \
+    preempt_enable();                                                          \
+  } while (0)
+
+/**
+ * @brief Marks the start of an update, the writer must be the only one.
+ *
+ * @param seq The counter.
+ */
+static inline void seqcount_write_begin(SeqCount *seq) {
+  seq->sequence++;
+  // x86 keeps stores in order, the compiler has to as well
+  __asm__ volatile("" ::: "memory");
+}
+
+/**
+ * @brief Marks the end of an update.
+ *
+ * @param seq The counter.
+ */
+static inline void seqcount_write_end(SeqCount *seq) {
+  __asm__ volatile("" ::: "memory");
+  seq->sequence++;
+}
+
+/**
+ * @brief Starts a read, waiting out an update in progress on another CPU.
+ *
+ * @param seq The counter.
+ * @return uint32_t The value to pass to seqcount_read_retry().
+ */
+static inline uint32_t seqcount_read_begin(const SeqCount *seq) {
+  uint32_t sequence;
+  while ((sequence = seq->sequence) & 1u) {
+    cpu_relax();
+  }
+  __asm__ volatile("" ::: "memory");
+  return sequence;
+}
+
+/**
+ * @brief Tells whether the data read since seqcount_read_begin() may be torn.
+ *
+ * @param seq The counter.
+ * @param sequence The value seqcount_read_begin() returned.
+ * @return true If an update happened meanwhile and the read has to repeat.
+ */
+static inline bool seqcount_read_retry(const SeqCount *seq, uint32_t sequence) {
+  __asm__ volatile("" ::: "memory");
+  return seq->sequence != sequence;
+}
+
+/**
+ * @brief Turns the contention statistics on or off.
+ *
+ * @param enabled Whether to count and time contended acquisitions.
+ * @details Acquisitions are always counted.
+ */
+void lockstat_set_enabled(bool enabled);
+
+/**
+ * @brief Zeroes the statistics of all registered locks.
+ */
+void lockstat_reset(void);
+
+/**
+ * @brief Prints all registered locks, most contended first, to the terminal.
+ */
+void printLockstatToTerminal(void);
+
+#endif
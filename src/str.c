@@ -1,13 +1,9 @@
 #include "str.h"
+#include "kmem.h"
 #include <stdbool.h>
 
-size_t strlenOS(const char *str) {
-  // count characters until \0 is found
-  size_t len = 0;
-  while (str[len])
-    len++;
-  return len;
-}
+// the implementation is picked per CPU, see kmem.h
+size_t strlenOS(const char *str) { return kmemOps.strlen(str); }
 
 void intToHex(uint32_t num, char *buffer) {
   buffer[0] = '0';
@@ -306,4 +302,44 @@ void intToDecimalString(int num, char* buffer) {
         start++;
         end--;
     }
-}
\ No newline at end of file
+}
+
+// parses an unsigned decimal number, rejecting empty strings, non-digits and
+// values that do not fit into 32 bits
+bool decimalStringToUint32(const char *str, uint32_t *out) {
+  if (str == NULL || out == NULL || *str == '\0') {
+    return false;
+  }
+  uint64_t value = 0;
+  for (const char *p = str; *p != '\0'; p++) {
+    if (*p < '0' || *p > '9') {
+      return false;
+    }
+    value = value * 10 + (uint64_t)(*p - '0');
+    if (value > 0xFFFFFFFFu) {
+      return false;
+    }
+  }
+  *out = (uint32_t)value;
+  return true;
+}
+
+// appends str to the end of buffer, the caller guarantees enough space
+char *appendString(char *buffer, const char *str) {
+  char *end = buffer + strlenOS(buffer);
+  while (*str != '\0') {
+    *end++ = *str++;
+  }
+  *end = '\0';
+  return buffer;
+}
+
+// appends value in decimal, right aligned to width characters
+char *appendDecimal(char *buffer, uint64_t value, size_t width) {
+  char digits[32];
+  uint64ToDecimalString(value, digits);
+  for (size_t len = strlenOS(digits); len < width; len++) {
+    appendString(buffer, " ");
+  }
+  return appendString(buffer, digits);
+}
@@ -6,6 +6,7 @@
  * @brief String manipulation functions for miniOS.
  */
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -107,4 +108,34 @@ void uint16ToDecimalString(uint16_t num, char *buffer);
  */
 void intToDecimalString(int num, char *buffer);
 
+/**
+ * @brief Appends a C string to the end of another one.
+ *
+ * @param buffer The string to append to, must have room for the result.
+ * @param str The string to append.
+ * @return char* The buffer.
+ * @details Unlike concat() this is not limited to LEN_SUBSTRINGS, which makes
+ * it suitable for building table rows of full terminal width.
+ */
+char *appendString(char *buffer, const char *str);
+
+/**
+ * @brief Appends a decimal number to the end of a C string.
+ *
+ * @param buffer The string to append to, must have room for the result.
+ * @param value The number to append.
+ * @param width Minimum field width, the number is right aligned (0 for none).
+ * @return char* The buffer.
+ */
+char *appendDecimal(char *buffer, uint64_t value, size_t width);
+
+/**
+ * @brief Parses a decimal string into a 32-bit unsigned integer.
+ *
+ * @param str The string to parse (digits only).
+ * @param out Receives the parsed value.
+ * @return true If the whole string was a valid number that fits into 32 bits.
+ */
+bool decimalStringToUint32(const char *str, uint32_t *out);
+
 #endif
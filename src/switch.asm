@@ -0,0 +1,33 @@
+; switch.asm - kernel thread context switch
+
+; void context_switch(uint32_t *oldEsp, uint32_t newEsp)
+;
+; Saves the callee-saved registers of the running thread on its own stack,
+; stores its stack pointer in *oldEsp and continues on the stack newEsp,
+; popping the registers the other thread saved when it was switched out.
+; EAX, ECX and EDX are caller-saved in the C calling convention, the caller
+; already expects them to be clobbered. EFLAGS (and with it the interrupt
+; flag) is not switched: both sides run with interrupts disabled and restore
+; their own flags after the call returns.
+;
+; A new thread's stack is prepared by thread_create() to look like a thread
+; that was switched out just before entering thread_start.
+
+section .text
+global context_switch
+context_switch:
+    mov eax, [esp + 4]  ; oldEsp
+    mov edx, [esp + 8]  ; newEsp
+
+    push ebp
+    push ebx
+    push esi
+    push edi
+    mov [eax], esp      ; the old thread continues from here
+
+    mov esp, edx
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret                 ; into the new thread, after its context_switch call
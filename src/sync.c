@@ -0,0 +1,208 @@
+#include "sync.h"
+#include "cpu.h"
+#include <stddef.h>
+
+// complete_all() marks the completion done for good
+#define COMPLETION_ALL UINT32_MAX
+
+// --- wait queues ---
+
+void waitqueue_init(WaitQueue *queue) {
+  queue->head = NULL;
+  queue->tail = NULL;
+}
+
+// takes a thread out of the queue, wherever it is
+static void waitqueue_remove(WaitQueue *queue, Thread *thread) {
+  Thread *prev = NULL;
+  for (Thread *t = queue->head; t != NULL; prev = t, t = t->waitNext) {
+    if (t != thread) {
+      continue;
+    }
+    if (prev != NULL) {
+      prev->waitNext = t->waitNext;
+    } else {
+      queue->head = t->waitNext;
+    }
+    if (queue->tail == t) {
+      queue->tail = prev;
+    }
+    break;
+  }
+  thread->waitNext = NULL;
+  thread->waitQueue = NULL;
+}
+
+void waitqueue_wait(WaitQueue *queue) {
+  Thread *self = thread_current();
+  if (self == NULL) {
+    // nothing to switch to yet, the waker is an interrupt handler
+    sched_idle_halt();
+    return;
+  }
+  self->waitQueue = queue;
+  self->waitNext = NULL;
+  if (queue->tail != NULL) {
+    queue->tail->waitNext = self;
+  } else {
+    queue->head = self;
+  }
+  queue->tail = self;
+
+  thread_block();
+
+  // thread_kill() wakes without going through the queue
+  if (self->waitQueue == queue) {
+    waitqueue_remove(queue, self);
+  }
+}
+
+bool waitqueue_wake_one(WaitQueue *queue) {
+  uint32_t flags = irq_save();
+  Thread *thread = queue->head;
+  if (thread != NULL) {
+    waitqueue_remove(queue, thread);
+    thread_wake(thread);
+  }
+  irq_restore(flags);
+  return thread != NULL;
+}
+
+uint32_t waitqueue_wake_all(WaitQueue *queue) {
+  uint32_t woken = 0;
+  while (waitqueue_wake_one(queue)) {
+    woken++;
+  }
+  return woken;
+}
+
+// --- mutexes ---
+
+void mutex_init(Mutex *mutex) {
+  mutex->locked = false;
+  mutex->owner = NULL;
+  waitqueue_init(&mutex->waiters);
+  mutex->contended = 0;
+}
+
+bool mutex_lock(Mutex *mutex) {
+  Thread *self = thread_current();
+  uint32_t flags = irq_save();
+  if (mutex->locked && self != NULL && mutex->owner == self) {
+    irq_restore(flags);
+    return false;
+  }
+  if (mutex->locked) {
+    mutex->contended++;
+    while (mutex->locked) {
+      waitqueue_wait(&mutex->waiters);
+    }
+  }
+  mutex->locked = true;
+  mutex->owner = self;
+  irq_restore(flags);
+  return true;
+}
+
+bool mutex_trylock(Mutex *mutex) {
+  uint32_t flags = irq_save();
+  bool taken = !mutex->locked;
+  if (taken) {
+    mutex->locked = true;
+    mutex->owner = thread_current();
+  }
+  irq_restore(flags);
+  return taken;
+}
+
+bool mutex_unlock(Mutex *mutex) {
+  uint32_t flags = irq_save();
+  if (!mutex->locked || mutex->owner != thread_current()) {
+    irq_restore(flags);
+    return false;
+  }
+  mutex->locked = false;
+  mutex->owner = NULL;
+  waitqueue_wake_one(&mutex->waiters);
+  irq_restore(flags);
+  return true;
+}
+
+Thread *mutex_owner(const Mutex *mutex) { return mutex->owner; }
+
+// --- semaphores ---
+
+void semaphore_init(Semaphore *sem, uint32_t count) {
+  sem->count = count;
+  waitqueue_init(&sem->waiters);
+}
+
+bool semaphore_down(Semaphore *sem) {
+  uint32_t flags = irq_save();
+  while (sem->count == 0 && !thread_should_stop()) {
+    waitqueue_wait(&sem->waiters);
+  }
+  bool taken = sem->count != 0;
+  if (taken) {
+    sem->count--;
+  }
+  irq_restore(flags);
+  return taken;
+}
+
+bool semaphore_trydown(Semaphore *sem) {
+  uint32_t flags = irq_save();
+  bool taken = sem->count != 0;
+  if (taken) {
+    sem->count--;
+  }
+  irq_restore(flags);
+  return taken;
+}
+
+void semaphore_up(Semaphore *sem) {
+  uint32_t flags = irq_save();
+  sem->count++;
+  waitqueue_wake_one(&sem->waiters);
+  irq_restore(flags);
+}
+
+// --- completions ---
+
+void completion_init(Completion *completion) {
+  completion->done = 0;
+  waitqueue_init(&completion->waiters);
+}
+
+void complete(Completion *completion) {
+  uint32_t flags = irq_save();
+  if (completion->done != COMPLETION_ALL) {
+    completion->done++;
+  }
+  waitqueue_wake_one(&completion->waiters);
+  irq_restore(flags);
+}
+
+void complete_all(Completion *completion) {
+  uint32_t flags = irq_save();
+  completion->done = COMPLETION_ALL;
+  waitqueue_wake_all(&completion->waiters);
+  irq_restore(flags);
+}
+
+bool wait_for_completion(Completion *completion) {
+  uint32_t flags = irq_save();
+  while (completion->done == 0 && !thread_should_stop()) {
+    waitqueue_wait(&completion->waiters);
+  }
+  bool happened = completion->done != 0;
+  if (happened && completion->done != COMPLETION_ALL) {
+    completion->done--;
+  }
+  irq_restore(flags);
+  return happened;
+}
+
+bool completion_done(const Completion *completion) {
+  return completion->done != 0;
+}
@@ -0,0 +1,236 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+/**
+ * @file sync.h
+ * @brief Sleeping synchronization: wait queues, mutexes, semaphores and
+ * completions.
+ *
+ * A thread that has to wait is put into a ::WaitQueue and blocked with
+ * thread_block(), the CPU goes to other threads or the idle thread until
+ * someone wakes the queue. Wakers may be interrupt handlers and softirqs,
+ * the queues are protected by disabling interrupts, like the scheduler's
+ * own state. Threads only run on the BSP, so that is all it takes.
+ *
+ * Before sched_init() there is nothing to switch to, waiting then halts
+ * until the next interrupt instead (sched_idle_halt()).
+ *
+ * Spinlocks (spinlock.h) must not be held while waiting.
+ */
+
+#include "cpu.h"
+#include "sched.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief FIFO of blocked threads.
+ */
+typedef struct WaitQueue {
+  Thread *head; /**< Woken first. */
+  Thread *tail; /**< Woken last. */
+} WaitQueue;
+
+/** @brief Initializer of an empty ::WaitQueue. */
+#define WAITQUEUE_INIT {NULL, NULL}
+
+/**
+ * @brief Sleeping lock with an owner, only the owner may unlock it.
+ */
+typedef struct {
+  volatile bool locked;    /**< Held by someone. */
+  Thread *volatile owner;  /**< The holder, NULL before sched_init(). */
+  WaitQueue waiters;       /**< Threads waiting for the lock. */
+  uint32_t contended;      /**< mutex_lock() calls that had to wait. */
+} Mutex;
+
+/** @brief Initializer of an unlocked ::Mutex. */
+#define MUTEX_INIT {false, NULL, WAITQUEUE_INIT, 0}
+
+/**
+ * @brief Counting semaphore.
+ */
+typedef struct {
+  volatile uint32_t count; /**< Units available. */
+  WaitQueue waiters;       /**< Threads waiting for a unit. */
+} Semaphore;
+
+/** @brief Initializer of a ::Semaphore holding count units. */
+#define SEMAPHORE_INIT(count) {(count), WAITQUEUE_INIT}
+
+/**
+ * @brief One-shot event, e.g. "the job finished" or "the I/O is done".
+ */
+typedef struct {
+  volatile uint32_t done; /**< complete() calls not consumed yet. */
+  WaitQueue waiters;      /**< Threads in wait_for_completion(). */
+} Completion;
+
+/** @brief Initializer of a ::Completion that has not happened. */
+#define COMPLETION_INIT {0, WAITQUEUE_INIT}
+
+/**
+ * @brief Prepares an empty wait queue.
+ *
+ * @param queue The queue.
+ */
+void waitqueue_init(WaitQueue *queue);
+
+/**
+ * @brief Blocks the running thread in the queue until it is woken.
+ *
+ * @param queue The queue.
+ * @details Must be called with interrupts disabled, after checking the wait
+ * condition under the same cli, so a wakeup cannot slip in between. Returns
+ * with interrupts disabled, the caller checks its condition again. Use
+ * wait_event() unless that does not fit.
+ */
+void waitqueue_wait(WaitQueue *queue);
+
+/**
+ * @brief Wakes the thread that waited longest.
+ *
+ * @param queue The queue.
+ * @return true If a thread was woken.
+ */
+bool waitqueue_wake_one(WaitQueue *queue);
+
+/**
+ * @brief Wakes every thread in the queue.
+ *
+ * @param queue The queue.
+ * @return uint32_t The number of threads woken.
+ */
+uint32_t waitqueue_wake_all(WaitQueue *queue);
+
+/**
+ * @brief Sleeps in a queue until a condition holds or the thread is killed.
+ *
+ * @param queue The queue the condition's writer wakes.
+ * @param condition Evaluated with interrupts disabled, possibly many times.
+ * @return true If the condition holds, false if thread_kill() ended the wait.
+ */
+#define wait_event(queue, condition)                                           \
+  ({                                                                           \
+    uint32_t waitFlags = irq_save();                                           \
+    while (!(condition) && !thread_should_stop()) {                            \
+      waitqueue_wait(queue);                                                   \
+    }                                                                          \
+    bool waitMet = (condition);                                                \
+    irq_restore(waitFlags);                                                    \
+    waitMet;                                                                   \
+  })
+
+/**
+ * @brief Prepares an unlocked mutex.
+ *
+ * @param mutex The mutex.
+ */
+void mutex_init(Mutex *mutex);
+
+/**
+ * @brief Takes a mutex, sleeping while another thread holds it.
+ *
+ * @param mutex The mutex.
+ * @return true If taken, false if the caller already holds it (which would
+ * deadlock).
+ * @details Not ended by thread_kill(), the caller always gets the lock.
+ */
+bool mutex_lock(Mutex *mutex);
+
+/**
+ * @brief Takes a mutex if it is free.
+ *
+ * @param mutex The mutex.
+ * @return true If taken.
+ */
+bool mutex_trylock(Mutex *mutex);
+
+/**
+ * @brief Releases a mutex and hands it to the next waiter.
+ *
+ * @param mutex The mutex.
+ * @return true If released, false if the caller is not the owner.
+ */
+bool mutex_unlock(Mutex *mutex);
+
+/**
+ * @brief Returns the thread holding a mutex.
+ *
+ * @param mutex The mutex.
+ * @return Thread* The owner, NULL if free (or held before sched_init()).
+ */
+Thread *mutex_owner(const Mutex *mutex);
+
+/**
+ * @brief Prepares a semaphore.
+ *
+ * @param sem The semaphore.
+ * @param count The units initially available.
+ */
+void semaphore_init(Semaphore *sem, uint32_t count);
+
+/**
+ * @brief Takes a unit, sleeping until one is available.
+ *
+ * @param sem The semaphore.
+ * @return true If taken, false if thread_kill() ended the wait.
+ */
+bool semaphore_down(Semaphore *sem);
+
+/**
+ * @brief Takes a unit if one is available.
+ *
+ * @param sem The semaphore.
+ * @return true If taken.
+ */
+bool semaphore_trydown(Semaphore *sem);
+
+/**
+ * @brief Returns a unit and wakes a waiter.
+ *
+ * @param sem The semaphore.
+ * @details Safe to call from interrupt handlers.
+ */
+void semaphore_up(Semaphore *sem);
+
+/**
+ * @brief Prepares a completion that has not happened.
+ *
+ * @param completion The completion.
+ */
+void completion_init(Completion *completion);
+
+/**
+ * @brief Signals the event to one waiter, or to the next one to wait.
+ *
+ * @param completion The completion.
+ * @details Safe to call from interrupt handlers.
+ */
+void complete(Completion *completion);
+
+/**
+ * @brief Signals the event to all current and future waiters.
+ *
+ * @param completion The completion.
+ * @details Stays done until completion_init() is called again.
+ */
+void complete_all(Completion *completion);
+
+/**
+ * @brief Sleeps until the event was signalled.
+ *
+ * @param completion The completion.
+ * @return true If it happened, false if thread_kill() ended the wait.
+ */
+bool wait_for_completion(Completion *completion);
+
+/**
+ * @brief Returns whether the event was signalled, without waiting.
+ *
+ * @param completion The completion.
+ * @return true If a wait_for_completion() would return at once.
+ */
+bool completion_done(const Completion *completion);
+
+#endif
@@ -0,0 +1,145 @@
+#include "sysbench.h"
+#include "cpu.h"
+#include "str.h"
+#include "syscall.h"
+#include "terminal.h"
+#include "time.h"
+#include "user.h"
+#include <stddef.h>
+
+// in userprogs.asm, linked for the user range
+extern uint8_t user_syscall_bench[];
+extern uint8_t user_isolation_probe[];
+
+#define SYSBENCH_PROBES 5
+
+static const char *const probeNames[SYSBENCH_PROBES] = {
+    "read kernel memory", "write kernel memory", "disable interrupts",
+    "read an I/O port", "pass a kernel pointer"};
+
+// runs a built-in program to its end
+static bool run_builtin(const char *name, uint8_t *entry,
+                        const uint32_t *args, uint32_t argCount,
+                        int32_t *exitCode) {
+  UserProcess *proc = user_process_create();
+  if (proc == NULL) {
+    return false;
+  }
+  if (!user_process_map_builtin(proc) ||
+      !user_process_start(proc, name, (uint32_t)entry, args, argCount)) {
+    user_process_release(proc);
+    return false;
+  }
+  *exitCode = user_process_wait(proc);
+  return true;
+}
+
+static void print_gate(const char *name, uint64_t cycles) {
+  uint64_t cyclesPerUs = tsc_hz() / 1000000u;
+  if (cyclesPerUs == 0) {
+    cyclesPerUs = 1;
+  }
+  char line[128] = "";
+  appendString(line, name);
+  for (size_t len = strlenOS(name); len < 12; len++) {
+    appendString(line, " ");
+  }
+  appendDecimal(line, cycles, 8);
+  appendDecimal(line, cycles * 1000u / cyclesPerUs, 10);
+  terminalWriteLine(line);
+}
+
+// times the round trips of one gate in ring 3, 0 if the program failed
+static uint32_t time_gate(uint32_t loops, uint32_t gate) {
+  uint32_t args[2] = {loops, gate};
+  int32_t cycles = 0;
+  if (!run_builtin("sysbench", user_syscall_bench, args, 2, &cycles) ||
+      cycles < 0) {
+    return 0;
+  }
+  return (uint32_t)cycles;
+}
+
+static void print_probe(uint32_t probe) {
+  char line[128] = "  ";
+  appendString(line, probeNames[probe]);
+  for (size_t len = strlenOS(probeNames[probe]); len < 24; len++) {
+    appendString(line, " ");
+  }
+  int32_t code = 0;
+  if (!run_builtin("probe", user_isolation_probe, &probe, 1, &code)) {
+    appendString(line, "could not start");
+  } else if (USER_EXIT_IS_FAULT(code)) {
+    uint8_t vector = USER_EXIT_VECTOR(code);
+    if (vector == 13) {
+      appendString(line, "general protection fault");
+    } else if (vector == 14) {
+      appendString(line, "page fault");
+    } else {
+      appendString(line, "exception ");
+      appendDecimal(line, vector, 0);
+    }
+    appendString(line, ", stopped");
+  } else if (code == 1) {
+    appendString(line, "refused");
+  } else {
+    appendString(line, "WENT THROUGH");
+  }
+  terminalWriteLine(line);
+}
+
+void runSyscallBenchmark(uint32_t loops) {
+  if (!user_available()) {
+    terminalWriteLine("User mode needs paging with 4 MiB pages (PSE)");
+    return;
+  }
+  if (loops == 0) {
+    loops = 1;
+  }
+
+  char line[128] = "";
+  appendDecimal(line, loops, 0);
+  appendString(line, " round trips of getpid per gate");
+  terminalWriteLine(line);
+  terminalWriteLine("GATE          CYCLES   NS/CALL");
+
+  // the call itself, without leaving the kernel
+  SyscallFrame frame = {0};
+  uint64_t start = rdtsc();
+  for (uint32_t i = 0; i < loops; i++) {
+    frame.eax = SYS_GETPID;
+    syscall_call(&frame);
+  }
+  print_gate("kernel call", (rdtsc() - start) / loops);
+
+  uint32_t int80 = time_gate(loops, 0);
+  if (int80 == 0) {
+    terminalWriteLine("int 0x80    failed");
+  } else {
+    print_gate("int 0x80", int80);
+  }
+  if (!syscall_sysenter_available()) {
+    terminalWriteLine("sysenter    not supported by this CPU");
+  } else {
+    uint32_t sysenter = time_gate(loops, 1);
+    if (sysenter == 0) {
+      terminalWriteLine("sysenter    failed");
+    } else {
+      print_gate("sysenter", sysenter);
+      if (int80 > sysenter) {
+        line[0] = '\0';
+        appendString(line, "sysenter saves ");
+        appendDecimal(line, int80 - sysenter, 0);
+        appendString(line, " cycles (");
+        appendDecimal(line, (uint64_t)(int80 - sysenter) * 100u / int80, 0);
+        appendString(line, "%) per call");
+        terminalWriteLine(line);
+      }
+    }
+  }
+
+  terminalWriteLine("Isolation, every attempt must be stopped:");
+  for (uint32_t probe = 0; probe < SYSBENCH_PROBES; probe++) {
+    print_probe(probe);
+  }
+}
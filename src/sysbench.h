@@ -0,0 +1,28 @@
+#ifndef SYSBENCH_H
+#define SYSBENCH_H
+
+/**
+ * @file sysbench.h
+ * @brief Cost of a system call through `int 0x80` and through `sysenter`.
+ *
+ * A built-in program (userprogs.asm) runs in ring 3 and times round trips
+ * of the cheapest call (getpid) with the TSC, once per gate. The same call
+ * made directly from the kernel gives the share of the work itself, the
+ * rest is the price of crossing into ring 0 and back. Afterwards a second
+ * program tries things a process must not do, each attempt has to end it
+ * (or be refused) without harming the kernel.
+ */
+
+#include <stdint.h>
+
+/** @brief Round trips per gate when the command gives no count. */
+#define SYSBENCH_DEFAULT_LOOPS 100000
+
+/**
+ * @brief Runs both gates and the isolation checks and prints the results.
+ *
+ * @param loops Round trips per gate, at least 1.
+ */
+void runSyscallBenchmark(uint32_t loops);
+
+#endif
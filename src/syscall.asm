@@ -0,0 +1,173 @@
+; syscall.asm - entry stubs of the system calls and the way into ring 3
+
+; Both gates build the same SyscallFrame (syscall.h) on the kernel stack:
+; int 0x80 pushes the interrupt frame itself, the sysenter stub pushes an
+; equivalent one by hand. The kernel then runs on its data segments with GS
+; on the per-CPU block, the user segments come back right before the
+; return to ring 3.
+
+extern syscall_dispatch
+
+; selectors, see gdt.h
+%define GDT_KERNEL_DATA 0x10
+%define GDT_USER_CODE 0x1B
+%define GDT_USER_DATA 0x23
+; distance of a CPU's TSS selector from its per-CPU selector, see gdt.h
+%define TSS_TO_PERCPU (16 * 8)
+%define EFLAGS_TF 0x100
+%define EFLAGS_IF 0x200
+%define EFLAGS_NT 0x4000
+; bit 1 is always set, everything else clear: no TF, NT or AC
+%define EFLAGS_FIXED 0x2
+
+; saves the registers, enters the kernel segments and calls the dispatcher
+; with interrupts enabled, returns with interrupts disabled on the user
+; segments
+%macro SYSCALL_BODY 0
+    push eax
+    push ebp
+    push edi
+    push esi
+    push edx
+    push ecx
+    push ebx
+    cld                     ; the C code expects the direction flag clear
+    mov ax, GDT_KERNEL_DATA
+    mov ds, ax
+    mov es, ax
+    str ax
+    sub ax, TSS_TO_PERCPU
+    mov gs, ax
+    mov eax, esp
+    sti
+    push eax                ; SyscallFrame *
+    call syscall_dispatch
+    add esp, 4
+    cli
+    mov ax, GDT_USER_DATA   ; flat like the kernel's, the stack stays reachable
+    mov ds, ax
+    mov es, ax
+    mov gs, ax
+%endmacro
+
+section .text
+
+; int 0x80, a DPL 3 interrupt gate: the CPU switched to ESP0 of the TSS and
+; pushed SS, ESP, EFLAGS, CS and EIP
+global syscall_int80_entry
+align 16
+syscall_int80_entry:
+    SYSCALL_BODY
+.return:
+    pop ebx
+    pop ecx
+    pop edx
+    pop esi
+    pop edi
+    pop ebp
+    pop eax
+    iret
+
+; sysenter: CS, SS and EIP come from the MSRs, ESP from SYSENTER_ESP, which
+; points at ESP0 in the TSS. Interrupts are off, the program's stack
+; pointer is in ECX and its return address in EDX. The other flags are
+; still the program's
+global syscall_sysenter_entry
+align 16
+syscall_sysenter_entry:
+    mov esp, [esp]          ; the thread's kernel stack
+    push dword GDT_USER_DATA ; the frame int 0x80 would have pushed
+    push ecx
+    pushfd
+    or dword [esp], EFLAGS_IF ; sysenter cleared IF, the program had it set
+.frame:
+    push dword GDT_USER_CODE
+    push edx
+    push dword EFLAGS_FIXED ; no TF, NT or AC of the program in ring 0
+    popfd
+    SYSCALL_BODY
+    ; sysexit cannot set TF atomically, a program being single-stepped
+    ; returns like from int 0x80
+    test dword [esp + 36], EFLAGS_TF
+    jnz syscall_int80_entry.return
+    pop ebx
+    add esp, 8              ; ECX and EDX, sysexit takes both
+    pop esi
+    pop edi
+    pop ebp
+    pop eax
+    ; sysexit continues at EDX with ESP = ECX, taken from the frame so a
+    ; call that changed them is honoured like with iret
+    mov edx, [esp]
+    mov ecx, [esp + 12]
+    and dword [esp + 8], ~(EFLAGS_IF | EFLAGS_NT)
+    push dword [esp + 8]
+    popfd                   ; the program's flags, interrupts still off
+    sti                     ; takes effect after sysexit, nothing in between
+    sysexit
+
+; A TF the program set survives sysenter and traps before its first
+; instruction. The #DB stub (interrupts_stubs.asm) clears TF and continues
+; here instead, which puts TF back into the saved flags
+global syscall_sysenter_stepping
+syscall_sysenter_stepping:
+    mov esp, [esp]
+    push dword GDT_USER_DATA
+    push ecx
+    pushfd
+    or dword [esp], EFLAGS_IF | EFLAGS_TF
+    jmp syscall_sysenter_entry.frame
+
+; void user_enter(uint32_t eip, uint32_t esp)
+;
+; Leaves the kernel for the first instruction of a program: an interrupt
+; frame for ring 3 with interrupts enabled, no kernel values left in the
+; registers. The kernel stack is given up, the next entry from ring 3
+; starts again at ESP0.
+global user_enter
+user_enter:
+    cli
+    mov ecx, [esp + 4]
+    mov edx, [esp + 8]
+    mov ax, GDT_USER_DATA
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    push dword GDT_USER_DATA ; ss
+    push edx                 ; esp
+    push dword EFLAGS_IF | 2 ; eflags, bit 1 is always set
+    push dword GDT_USER_CODE ; cs
+    push ecx                 ; eip
+    xor eax, eax
+    xor ebx, ebx
+    xor ecx, ecx
+    xor edx, edx
+    xor esi, esi
+    xor edi, edi
+    xor ebp, ebp
+    iret
+
+; void user_resume(const SyscallFrame *frame)
+;
+; Returns to ring 3 with the registers of a SyscallFrame, like the int 0x80
+; stub does after a call. A forked child starts like this, from the copy of
+; its parent's frame. The frame must stay in place (it is in the process
+; slot), it serves as the stack for the last instructions.
+global user_resume
+user_resume:
+    cli
+    mov esp, [esp + 4]
+    mov ax, GDT_USER_DATA
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    pop ebx
+    pop ecx
+    pop edx
+    pop esi
+    pop edi
+    pop ebp
+    pop eax
+    iret
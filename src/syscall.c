@@ -0,0 +1,118 @@
+#include "syscall.h"
+#include "cpu.h"
+#include "cpufeatures.h"
+#include "gdt.h"
+#include "idt.h"
+#include "ipc.h"
+#include "kmem.h"
+#include "paging.h"
+#include "sched.h"
+#include "terminal.h"
+#include "user.h"
+
+// in syscall.asm
+extern void syscall_int80_entry(void);
+extern void syscall_sysenter_entry(void);
+
+static bool sysenterAvailable = false;
+
+static uint32_t sys_exit(SyscallFrame *frame) {
+  user_exit((int32_t)frame->ebx);
+}
+
+static uint32_t sys_write(SyscallFrame *frame) {
+  uint32_t length = frame->esi;
+  if (length > SYSCALL_WRITE_MAX ||
+      !as_check_user(thread_current()->space, frame->ebx, length, false)) {
+    return SYSCALL_ERROR;
+  }
+  char line[SYSCALL_WRITE_MAX + 1];
+  memcpyOS(line, (const void *)frame->ebx, length);
+  line[length] = '\0';
+  terminalWriteLine(line);
+  return length;
+}
+
+static uint32_t sys_getpid(SyscallFrame *frame) {
+  (void)frame;
+  return thread_current()->id;
+}
+
+static uint32_t sys_yield(SyscallFrame *frame) {
+  (void)frame;
+  thread_yield();
+  return 0;
+}
+
+static uint32_t sys_sleep(SyscallFrame *frame) {
+  thread_sleep_ms(frame->ebx);
+  return 0;
+}
+
+static uint32_t sys_fork(SyscallFrame *frame) {
+  return user_fork(frame, frame->ebx != 0);
+}
+
+static uint32_t sys_wait(SyscallFrame *frame) {
+  return user_wait_child(frame->ebx);
+}
+
+static uint32_t sys_ipc_create(SyscallFrame *frame) {
+  (void)frame;
+  return ipc_endpoint_create(thread_current()->process);
+}
+
+static uint32_t sys_ipc_close(SyscallFrame *frame) {
+  return ipc_endpoint_close(frame->ebx, thread_current()->process)
+             ? 0
+             : SYSCALL_ERROR;
+}
+
+static uint32_t sys_ipc_send(SyscallFrame *frame) {
+  return ipc_send(frame, false);
+}
+
+static uint32_t sys_ipc_send_async(SyscallFrame *frame) {
+  return ipc_send(frame, true);
+}
+
+static uint32_t sys_ipc_receive(SyscallFrame *frame) {
+  return ipc_receive(frame);
+}
+
+static const SyscallFunction syscallTable[SYSCALL_COUNT] = {
+    [SYS_EXIT] = sys_exit,     [SYS_WRITE] = sys_write,
+    [SYS_GETPID] = sys_getpid, [SYS_YIELD] = sys_yield,
+    [SYS_SLEEP] = sys_sleep,   [SYS_FORK] = sys_fork,
+    [SYS_WAIT] = sys_wait,     [SYS_IPC_CREATE] = sys_ipc_create,
+    [SYS_IPC_CLOSE] = sys_ipc_close,
+    [SYS_IPC_SEND] = sys_ipc_send,
+    [SYS_IPC_SEND_ASYNC] = sys_ipc_send_async,
+    [SYS_IPC_RECEIVE] = sys_ipc_receive,
+};
+
+void syscall_init(uint32_t *kernelStackSlot) {
+  idtSetUserGate(SYSCALL_VECTOR, (uint32_t)syscall_int80_entry);
+  if (cpu_features()->sep) {
+    // SYSENTER_CS also gives SS (+8) and, for sysexit, the user code and
+    // stack segments (+16, +24), see gdt.h
+    wrmsr(MSR_IA32_SYSENTER_CS, GDT_KERNEL_CODE);
+    wrmsr(MSR_IA32_SYSENTER_ESP, (uint32_t)kernelStackSlot);
+    wrmsr(MSR_IA32_SYSENTER_EIP, (uint32_t)syscall_sysenter_entry);
+    sysenterAvailable = true;
+  }
+}
+
+bool syscall_sysenter_available(void) { return sysenterAvailable; }
+
+uint32_t syscall_call(SyscallFrame *frame) {
+  uint32_t number = frame->eax;
+  return number < SYSCALL_COUNT ? syscallTable[number](frame) : SYSCALL_ERROR;
+}
+
+void syscall_dispatch(SyscallFrame *frame) {
+  frame->eax = syscall_call(frame);
+  if (thread_should_stop()) {
+    user_exit(USER_EXIT_KILLED);
+  }
+}
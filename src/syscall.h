@@ -0,0 +1,112 @@
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+/**
+ * @file syscall.h
+ * @brief The system call interface of user programs.
+ *
+ * A program puts the call number into EAX and up to three arguments into
+ * EBX, ESI and EDI, the result comes back in EAX. The IPC calls (ipc.h)
+ * also take EBP and return a message in ESI, EDI and EBP. Two gates lead
+ * in:
+ *
+ * - `int 0x80` works on every CPU and preserves all registers but EAX.
+ * - `sysenter` skips the IDT lookup, the descriptor checks and the
+ *   interrupt frame, it is several times cheaper. The program passes its
+ *   stack pointer in ECX and the address to return to in EDX, both are
+ *   lost. Only if syscall_sysenter_available().
+ *
+ * Both entry stubs (syscall.asm) save the same ::SyscallFrame on the
+ * kernel stack and call syscall_dispatch(), which indexes the call table.
+ * System calls run with interrupts enabled and may sleep.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @brief Interrupt vector of the `int` gate. */
+#define SYSCALL_VECTOR 0x80
+
+/** @brief Result of a failed or unknown call. */
+#define SYSCALL_ERROR ((uint32_t)-1)
+
+/** @brief Longest line SYS_WRITE prints. */
+#define SYSCALL_WRITE_MAX 127
+
+/**
+ * @brief Call numbers.
+ */
+typedef enum {
+  SYS_EXIT,           /**< Ends the process, EBX = exit code. Does not
+                           return. */
+  SYS_WRITE,          /**< Prints a line, EBX = text, ESI = length. */
+  SYS_GETPID,         /**< Returns the thread id, the cheapest call there
+                           is. */
+  SYS_YIELD,          /**< Gives the CPU to the next runnable thread. */
+  SYS_SLEEP,          /**< Sleeps for EBX milliseconds. */
+  SYS_FORK,           /**< Copies the process, pages are shared
+                           copy-on-write (EBX = 0) or copied right away
+                           (EBX = 1). Returns the child's pid, in the child
+                           0. */
+  SYS_WAIT,           /**< Waits for the child with pid EBX, returns its
+                           exit code. */
+  SYS_IPC_CREATE,     /**< Opens an endpoint, returns its id (ipc.h). */
+  SYS_IPC_CLOSE,      /**< Closes the endpoint EBX the process opened. */
+  SYS_IPC_SEND,       /**< Sends to endpoint EBX and waits for the
+                           receiver, see ipc.h for the registers. */
+  SYS_IPC_SEND_ASYNC, /**< Queues a message for endpoint EBX. */
+  SYS_IPC_RECEIVE,    /**< Waits for a message on endpoint EBX. */
+  SYSCALL_COUNT
+} SyscallNumber;
+
+/**
+ * @brief Registers of the program at the call, lowest address first.
+ *
+ * @details The stub pushes the general purpose registers, the part from
+ * eip on is what `int 0x80` pushes when it switches to the kernel stack.
+ * The result is written to eax and the stubs restore the program from
+ * the frame, so a call can also change where the program continues.
+ */
+typedef struct {
+  uint32_t ebx, ecx, edx, esi, edi, ebp, eax; /**< Saved by the stub. */
+  uint32_t eip, cs, eflags, esp, ss;          /**< The interrupt frame. */
+} SyscallFrame;
+
+/**
+ * @brief Implementation of one call.
+ */
+typedef uint32_t (*SyscallFunction)(SyscallFrame *frame);
+
+/**
+ * @brief Installs both gates on the calling CPU.
+ *
+ * @param kernelStackSlot The ESP0 field of the CPU's TSS (gdtLoadTss()).
+ */
+void syscall_init(uint32_t *kernelStackSlot);
+
+/**
+ * @brief Returns whether programs may use `sysenter`.
+ *
+ * @return true If the CPU has SYSENTER/SYSEXIT and syscall_init() ran.
+ */
+bool syscall_sysenter_available(void);
+
+/**
+ * @brief Runs the call a frame asks for and stores the result in it.
+ *
+ * @param frame The program's registers.
+ * @details Called by the entry stubs. Ends the process instead of
+ * returning to it if the thread was killed.
+ */
+void syscall_dispatch(SyscallFrame *frame);
+
+/**
+ * @brief Runs a call without entering or leaving ring 3.
+ *
+ * @param frame The registers of a pretended program.
+ * @return uint32_t The result.
+ * @details For measuring the cost of the call itself against the gates.
+ */
+uint32_t syscall_call(SyscallFrame *frame);
+
+#endif
@@ -0,0 +1,237 @@
+#include "taskpool.h"
+#include "cpu.h"
+#include "kmem.h"
+#include "percpu.h"
+#include "sched.h"
+#include "smp.h"
+#include <stddef.h>
+
+#define TASK_DEQUE_MASK (TASK_DEQUE_SIZE - 1)
+
+_Static_assert((TASK_DEQUE_SIZE & TASK_DEQUE_MASK) == 0,
+               "TASK_DEQUE_SIZE must be a power of two");
+
+// Chase-Lev deque: the owner pushes and pops at bottom, thieves take from
+// top. Indices only grow, slots are index & TASK_DEQUE_MASK. top and bottom
+// get their own cache lines, they are written by different CPUs.
+typedef struct {
+  volatile int32_t top __attribute__((aligned(64)));
+  volatile int32_t bottom __attribute__((aligned(64)));
+  Task *volatile slots[TASK_DEQUE_SIZE];
+} TaskDeque;
+
+static TaskDeque deques[SMP_MAX_CPUS];
+static uint32_t workers = 1;
+
+static bool deque_push(TaskDeque *deque, Task *task) {
+  int32_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+  int32_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  if (bottom - top >= TASK_DEQUE_SIZE) {
+    return false;
+  }
+  deque->slots[bottom & TASK_DEQUE_MASK] = task;
+  // the slot has to be visible before the thieves see the new bottom
+  __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+static Task *deque_pop(TaskDeque *deque) {
+  int32_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+  __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+  // store-load ordering: a thief either sees the smaller bottom or we see
+  // its larger top (mfence on x86)
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  int32_t top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+  if (top > bottom) {
+    // was empty
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  Task *task = deque->slots[bottom & TASK_DEQUE_MASK];
+  if (top == bottom) {
+    // the last task, race the thieves for it
+    if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+      task = NULL;
+    }
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+  }
+  return task;
+}
+
+static Task *deque_steal(TaskDeque *deque) {
+  int32_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  int32_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+  if (top >= bottom) {
+    return NULL;
+  }
+  Task *task = deque->slots[top & TASK_DEQUE_MASK];
+  // another thief or the owner may have taken it meanwhile
+  if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                   __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    return NULL;
+  }
+  return task;
+}
+
+static void task_run(Task *task) {
+  TaskGroup *group = task->group;
+  task->function(task->arg);
+  this_cpu_inc(tasksRun);
+  __atomic_sub_fetch(&group->pending, 1, __ATOMIC_RELEASE);
+}
+
+// one task from the own deque or stolen from another CPU
+static bool run_one(void) {
+  uint32_t self = this_cpu_read(index);
+
+  // owner operations must not interleave with another thread on this CPU
+  preempt_disable();
+  Task *task = deque_pop(&deques[self]);
+  preempt_enable();
+  if (task != NULL) {
+    task_run(task);
+    return true;
+  }
+
+  uint32_t cpus = smp_cpu_count();
+  for (uint32_t i = 1; i < cpus; i++) {
+    uint32_t victim = (self + i) % cpus;
+    task = deque_steal(&deques[victim]);
+    if (task != NULL) {
+      this_cpu_inc(tasksStolen);
+      task_run(task);
+      return true;
+    }
+  }
+  return false;
+}
+
+void taskpool_init(void) {
+  workers = smp_online_count();
+  if (workers > 1) {
+    smp_set_idle_work(run_one);
+  }
+}
+
+uint32_t taskpool_workers(void) { return workers; }
+
+void task_group_init(TaskGroup *group) { group->pending = 0; }
+
+void task_spawn(TaskGroup *group, Task *task, TaskFunction function,
+                void *arg) {
+  task->function = function;
+  task->arg = arg;
+  task->group = group;
+  __atomic_add_fetch(&group->pending, 1, __ATOMIC_RELAXED);
+
+  preempt_disable();
+  bool queued = deque_push(&deques[this_cpu_read(index)], task);
+  preempt_enable();
+  if (!queued) {
+    task_run(task);
+    return;
+  }
+  smp_kick_idle();
+}
+
+void task_sync(TaskGroup *group) {
+  while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) != 0) {
+    if (!run_one()) {
+      cpu_relax();
+    }
+  }
+}
+
+typedef struct {
+  uint32_t start;
+  uint32_t end;
+  uint32_t grain;
+  ParallelForBody body;
+  void *arg;
+} ParallelRange;
+
+// every split hands the upper half to a thief and keeps halving the lower
+static void parallel_range(void *arg) {
+  const ParallelRange *range = arg;
+  if (range->end - range->start <= range->grain) {
+    range->body(range->start, range->end, range->arg);
+    return;
+  }
+  uint32_t middle = range->start + (range->end - range->start) / 2;
+  ParallelRange lower = *range;
+  ParallelRange upper = *range;
+  lower.end = middle;
+  upper.start = middle;
+
+  TaskGroup group;
+  Task task;
+  task_group_init(&group);
+  task_spawn(&group, &task, parallel_range, &upper);
+  parallel_range(&lower);
+  task_sync(&group);
+}
+
+void parallel_for(uint32_t start, uint32_t end, uint32_t grain,
+                  ParallelForBody body, void *arg) {
+  if (end <= start) {
+    return;
+  }
+  if (grain == 0) {
+    grain = (end - start) / (workers * 8);
+    if (grain == 0) {
+      grain = 1;
+    }
+  }
+  ParallelRange range = {start, end, grain, body, arg};
+  parallel_range(&range);
+}
+
+// the bulk helpers split their buffers into chunks of this many bytes
+#define TASK_BULK_CHUNK 16384
+
+typedef struct {
+  uint8_t *data;
+  size_t length;
+  uint8_t value;
+  volatile uint32_t sum;
+} BulkRange;
+
+static void memset_chunks(uint32_t start, uint32_t end, void *arg) {
+  BulkRange *bulk = arg;
+  size_t from = (size_t)start * TASK_BULK_CHUNK;
+  size_t to = (size_t)end * TASK_BULK_CHUNK;
+  if (to > bulk->length) {
+    to = bulk->length;
+  }
+  memsetOS(bulk->data + from, bulk->value, to - from);
+}
+
+static void checksum_chunks(uint32_t start, uint32_t end, void *arg) {
+  BulkRange *bulk = arg;
+  size_t from = (size_t)start * TASK_BULK_CHUNK;
+  size_t to = (size_t)end * TASK_BULK_CHUNK;
+  if (to > bulk->length) {
+    to = bulk->length;
+  }
+  uint32_t sum = checksum8OS(bulk->data + from, to - from);
+  // the low byte of the total does not depend on the order of the adds
+  __atomic_add_fetch(&bulk->sum, sum, __ATOMIC_RELAXED);
+}
+
+static uint32_t bulk_chunks(size_t length) {
+  return (uint32_t)((length + TASK_BULK_CHUNK - 1) / TASK_BULK_CHUNK);
+}
+
+void parallel_memset(void *dest, uint8_t value, size_t length) {
+  BulkRange bulk = {dest, length, value, 0};
+  parallel_for(0, bulk_chunks(length), 1, memset_chunks, &bulk);
+}
+
+uint8_t parallel_checksum8(const void *data, size_t length) {
+  BulkRange bulk = {(uint8_t *)data, length, 0, 0};
+  parallel_for(0, bulk_chunks(length), 1, checksum_chunks, &bulk);
+  return (uint8_t)bulk.sum;
+}
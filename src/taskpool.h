@@ -0,0 +1,130 @@
+#ifndef TASKPOOL_H
+#define TASKPOOL_H
+
+/**
+ * @file taskpool.h
+ * @brief Work-stealing task pool across all online CPUs.
+ *
+ * Every CPU owns a Chase-Lev deque. task_spawn() pushes onto the spawning
+ * CPU's deque, the owner pops from the bottom (newest first, cache warm)
+ * while other CPUs steal from the top (oldest first, usually the biggest
+ * pieces of a recursive split). Application processors steal from their
+ * idle loop, a CPU waiting in task_sync() runs and steals tasks until its
+ * group is done, so nobody blocks on work that is still queued.
+ *
+ * Tasks run with whatever interrupt state their CPU has, on the APs that
+ * is disabled. They must not sleep or use the scheduler, and like all
+ * kernel code they only touch the FPU between kernel_fpu_begin() and
+ * kernel_fpu_end(), which the kmem routines already do.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief Capacity of each CPU's deque, a power of two. */
+#define TASK_DEQUE_SIZE 256
+
+/**
+ * @brief A function run as a task.
+ */
+typedef void (*TaskFunction)(void *arg);
+
+/**
+ * @brief Tasks that are waited for together, see task_sync().
+ */
+typedef struct {
+  volatile uint32_t pending; /**< Spawned tasks not finished yet. */
+} TaskGroup;
+
+/**
+ * @brief One spawned task, owned by the spawner until task_sync() returns.
+ */
+typedef struct {
+  TaskFunction function; /**< What to run. */
+  void *arg;             /**< Passed to function. */
+  TaskGroup *group;      /**< Notified when the task finished. */
+} Task;
+
+/**
+ * @brief The body of parallel_for(), runs the iterations [start, end).
+ */
+typedef void (*ParallelForBody)(uint32_t start, uint32_t end, void *arg);
+
+/**
+ * @brief Lets the application processors steal from the pool.
+ *
+ * @details Call after smp_init(). Before that (or with one CPU) tasks still
+ * work, they are all run by the CPU that syncs.
+ */
+void taskpool_init(void);
+
+/**
+ * @brief Returns how many CPUs take part in running tasks.
+ *
+ * @return uint32_t The number of workers, at least 1.
+ */
+uint32_t taskpool_workers(void);
+
+/**
+ * @brief Prepares an empty task group.
+ *
+ * @param group The group.
+ */
+void task_group_init(TaskGroup *group);
+
+/**
+ * @brief Queues a task on the calling CPU.
+ *
+ * @param group The group task_sync() waits on.
+ * @param task Storage for the task, must stay valid until task_sync().
+ * @param function What to run.
+ * @param arg Passed to function.
+ * @details If the deque is full the task runs right away instead.
+ */
+void task_spawn(TaskGroup *group, Task *task, TaskFunction function,
+                void *arg);
+
+/**
+ * @brief Runs and steals tasks until all tasks of the group finished.
+ *
+ * @param group The group.
+ */
+void task_sync(TaskGroup *group);
+
+/**
+ * @brief Runs body over [start, end) in chunks of at least grain iterations.
+ *
+ * @param start First iteration.
+ * @param end One past the last iteration.
+ * @param grain Smallest chunk worth a task, 0 picks one per worker times 8.
+ * @param body Called for every chunk, possibly on several CPUs at once.
+ * @param arg Passed to body.
+ * @details The range is split in halves recursively, each split spawns one
+ * half, so idle CPUs steal big chunks first and the balancing needs no
+ * hand-rolled partitioning.
+ */
+void parallel_for(uint32_t start, uint32_t end, uint32_t grain,
+                  ParallelForBody body, void *arg);
+
+/**
+ * @brief Fills memory with a byte value on all workers.
+ *
+ * @param dest The memory.
+ * @param value The byte value.
+ * @param length The number of bytes.
+ * @details Runs memsetOS() per chunk. Worth it for buffers of a few hundred
+ * KiB and more.
+ */
+void parallel_memset(void *dest, uint8_t value, size_t length);
+
+/**
+ * @brief Sums up bytes modulo 256 on all workers, like checksum8OS().
+ *
+ * @param data The memory.
+ * @param length The number of bytes.
+ * @return uint8_t The sum of all bytes modulo 256.
+ */
+uint8_t parallel_checksum8(const void *data, size_t length);
+
+#endif
@@ -1,5 +1,6 @@
 #include "terminal.h"
 #include "commandHandler.h"
+#include "jobs.h"
 #include "printOS.h"
 #include "shutdown.h"
 #include "str.h"
@@ -112,6 +113,10 @@ void initShowTerminal() {
 }
 
 void terminalWriteLine(char *str) {
+  // background jobs write into their own buffer, merged by jobs_poll()
+  if (jobs_capture_line(str)) {
+    return;
+  }
   terminalAddStr(str);
   showTerminal();
 }
@@ -191,3 +196,13 @@ void keyPressedForTerminal(KeyCode keycode) {
   // TODO: print the full line not the start!
   screenWriteLine(cmdLine, VGA_HEIGHT - 1);
 }
+
+// types a command into the command line and runs it, like a user would
+void terminalRunCommand(const char *command) {
+  for (size_t i = 0; command[i] != '\0' && currCmdIndex < COMMAND_LINE_WIDTH;
+       i++) {
+    cmdLine[currCmdIndex++] = command[i];
+    screenWriteLine(cmdLine, VGA_HEIGHT - 1);
+  }
+  keyPressedForTerminal(KEY_ENTER);
+}
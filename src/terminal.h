@@ -18,6 +18,15 @@
  */
 void keyPressedForTerminal(KeyCode keycode);
 
+/**
+ * @brief Types a command into the command line and runs it.
+ *
+ * @param command The command, e.g. "sysinfo".
+ * @details Goes through the same echo, redraw and command handler path as
+ * keyboard input, used for scripted runs such as the PGO training workload.
+ */
+void terminalRunCommand(const char *command);
+
 /** 
  * @brief Initializes the terminal interface.
  *
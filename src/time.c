@@ -1,18 +1,56 @@
 #include "time.h"
+#include "cpu.h"
+#include "events.h"
+#include "hpet.h"
+#include "interrupts.h"
 #include "io.h"
+#include "lapic.h"
+#include "sched.h"
+#include "softirq.h"
+#include "spinlock.h"
 #include "str.h"
+#include "terminal.h"
 
 #define PIT_CH0_PORT  0x40
+#define PIT_CH2_PORT  0x42
 #define PIT_CMD_PORT  0x43
 #define PIT_INPUT_HZ  1193182u
 
-#define PIC1_DATA     0x21  // master PIC IMR (mask) register
+#define PIT_GATE_PORT 0x61  // bit 0: channel 2 gate, bit 1: speaker, bit 5: OUT2
+#define PIT_GATE_CH2  0x01
+#define PIT_SPEAKER   0x02
+#define PIT_OUT2      0x20
+
+#define CPUID1_EDX_TSC (1u << 4)
+#define CPUID_EXT_EDX_INVARIANT_TSC (1u << 8)
+
+#define MAX_CLOCK_SOURCES 4
+#define MAX_EVENT_SOURCES 4
 
 static volatile uint64_t g_ticks = 0;
+// i386 reads the 64-bit counter in two halves, the timer may tick in between
+static SeqCount g_ticks_seq = SEQCOUNT_INIT;
 static uint32_t          g_hz    = 0;  // actual tick rate after programming
+static uint64_t          g_tsc_hz = 0; // calibrated TSC frequency
+
+// registered clock and event sources
+static ClockSource       *g_clocks[MAX_CLOCK_SOURCES];
+static int                g_num_clocks = 0;
+static const EventSource *g_events[MAX_EVENT_SOURCES];
+static int                g_num_events = 0;
+
+// clock_ns() reads the best clock source relative to a base taken when it
+// was selected, so switching sources never makes time jump
+static ClockSource       *g_clock = NULL;
+static uint64_t           g_clock_base = 0;
+static uint64_t           g_clock_base_ns = 0;
 
-static inline void sti(void) { __asm__ volatile("sti"); }
-static inline void hlt(void) { __asm__ volatile("hlt"); }
+// the event source driving the tick and the callback of a PIT driven tick
+static const EventSource *g_tick = NULL;
+static TimerEventCallback g_pit_callback = NULL;
+
+// optional work done on every tick (used to generate benchmark load)
+static TimerEventCallback g_tick_hook = NULL;
 
 // ----------------------- small helpers --------------------------------------
 
@@ -44,8 +82,311 @@ static uint64_t ceil_mul_div_u64(uint64_t ms, uint32_t hz, uint32_t c /*=1000*/)
     return q * b1 + ( (r * b1 + c1 - 1) / c1 );
 }
 
+// Busy-waits on PIT channel 2 for at most one full countdown (~54 ms).
+// Channel 2 is gated through port 0x61, so this works with interrupts off
+// and does not disturb the channel 0 tick.
+static void pit_delay_once(uint16_t count) {
+    uint8_t gate = inb(PIT_GATE_PORT);
+    // gate low and speaker off while the counter is loaded
+    outb(PIT_GATE_PORT, gate & ~(PIT_GATE_CH2 | PIT_SPEAKER));
+    // channel 2, lobyte/hibyte, mode 0 (interrupt on terminal count)
+    outb(PIT_CMD_PORT, 0xB0);
+    outb(PIT_CH2_PORT, (uint8_t)(count & 0xFF));
+    outb(PIT_CH2_PORT, (uint8_t)(count >> 8));
+    // raising the gate starts the countdown, OUT2 goes high at zero
+    outb(PIT_GATE_PORT, (gate & ~PIT_SPEAKER) | PIT_GATE_CH2);
+    while (!(inb(PIT_GATE_PORT) & PIT_OUT2)) {
+    }
+    outb(PIT_GATE_PORT, gate);
+}
+
+static uint64_t cycles_to_ns(uint64_t cycles, uint64_t frequency) {
+    // split so that the multiplication cannot overflow
+    return (cycles / frequency) * 1000000000ull +
+           ((cycles % frequency) * 1000000000ull) / frequency;
+}
+
+static uint64_t tsc_read(void) {
+    return rdtsc();
+}
+
+static uint64_t tick_read(void) {
+    uint32_t seq;
+    uint64_t ticks;
+    do {
+        seq = seqcount_read_begin(&g_ticks_seq);
+        ticks = g_ticks;
+    } while (seqcount_read_retry(&g_ticks_seq, seq));
+    return ticks;
+}
+
+static bool tsc_invariant(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0x80000000, 0, &eax, &ebx, &ecx, &edx);
+    if (eax < 0x80000007) return false;
+    cpuid(0x80000007, 0, &eax, &ebx, &ecx, &edx);
+    return (edx & CPUID_EXT_EDX_INVARIANT_TSC) != 0;
+}
+
+static bool pit_start_periodic(uint32_t hz, TimerEventCallback callback) {
+    g_pit_callback = callback;
+    pit_init(hz);
+    irq_unmask(IRQ_BASE + 0);
+    return true;
+}
+
+static bool lapic_start_periodic(uint32_t hz, TimerEventCallback callback) {
+    lapic_timer_start_periodic(hz, callback);
+    return lapic_timer_mode() != LAPIC_TIMER_OFF;
+}
+
+static ClockSource tscClockSource = {
+    .name = "tsc", .read = tsc_read, .frequency = 0, .rating = 150};
+
+static ClockSource tickClockSource = {
+    .name = "tick", .read = tick_read, .frequency = 0, .rating = 1};
+
+static const EventSource pitEventSource = {
+    .name = "pit", .rating = 10, .usesIrq0 = true,
+    .startPeriodic = pit_start_periodic, .oneshotUs = NULL};
+
+static EventSource lapicEventSource = {
+    .name = "lapic", .rating = 100, .usesIrq0 = false,
+    .startPeriodic = lapic_start_periodic, .oneshotUs = lapic_timer_oneshot_us};
+
 // ----------------------- public API -----------------------------------------
 
+void pit_delay_us(uint32_t us) {
+    // a single countdown covers at most 0xFFFF PIT cycles
+    const uint32_t max_chunk_us = 50000u;
+    while (us > 0) {
+        uint32_t chunk = us > max_chunk_us ? max_chunk_us : us;
+        uint32_t count = (uint32_t)(((uint64_t)PIT_INPUT_HZ * chunk) / 1000000u);
+        if (count == 0) count = 1;
+        pit_delay_once((uint16_t)count);
+        us -= chunk;
+    }
+}
+
+void clocksource_register(ClockSource *source) {
+    if (source == NULL || source->frequency == 0) return;
+    if (g_num_clocks < MAX_CLOCK_SOURCES) {
+        g_clocks[g_num_clocks++] = source;
+    }
+    if (g_clock == NULL || source->rating > g_clock->rating) {
+        uint32_t flags = irq_save();
+        uint64_t now = clock_ns();
+        g_clock_base = source->read();
+        g_clock_base_ns = now;
+        g_clock = source;
+        irq_restore(flags);
+    }
+}
+
+void eventsource_register(const EventSource *source) {
+    if (source == NULL || g_num_events >= MAX_EVENT_SOURCES) return;
+    g_events[g_num_events++] = source;
+}
+
+const ClockSource *clocksource_current(void) {
+    return g_clock;
+}
+
+const EventSource *eventsource_tick(void) {
+    return g_tick;
+}
+
+uint64_t clock_ns(void) {
+    ClockSource *clock = g_clock;
+    if (clock == NULL) return 0;
+    return g_clock_base_ns +
+           cycles_to_ns(clock->read() - g_clock_base, clock->frequency);
+}
+
+void tsc_calibrate(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID1_EDX_TSC)) {
+        g_tsc_hz = 0;
+        return;
+    }
+
+    // the HPET is a far better reference than the PIT, use it when present
+    if (hpet_available()) {
+        uint64_t window = hpet_frequency() / 100;
+        uint64_t hpet_start = hpet_counter();
+        uint64_t tsc_start = rdtsc();
+        uint64_t hpet_end;
+        do {
+            hpet_end = hpet_counter();
+        } while (hpet_end - hpet_start < window);
+        uint64_t tsc_end = rdtsc();
+        g_tsc_hz = ((tsc_end - tsc_start) * hpet_frequency()) /
+                   (hpet_end - hpet_start);
+        return;
+    }
+
+    // take the shortest of a few runs, a longer one means we were disturbed
+    uint64_t best = 0;
+    for (int i = 0; i < 3; i++) {
+        uint64_t start = rdtsc();
+        pit_delay_us(10000);
+        uint64_t delta = rdtsc() - start;
+        if (best == 0 || delta < best) best = delta;
+    }
+    g_tsc_hz = best * 100;
+}
+
+uint64_t tsc_hz(void) {
+    return g_tsc_hz;
+}
+
+// IRQ0 is shared between the PIT and the HPET legacy replacement route
+static void timer_irq0(registers_t *regs, void *ctx) {
+    (void)regs;
+    (void)ctx;
+    if (hpet_owns_irq0()) {
+        hpet_irq();
+    } else if (g_pit_callback != NULL) {
+        g_pit_callback();
+    }
+}
+
+void timer_init(uint32_t hz) {
+    if (hz == 0) hz = 1000;
+
+    irq_register(IRQ_BASE + 0, timer_irq0, NULL);
+    irq_set_name(IRQ_BASE + 0, "timer");
+
+    eventsource_register(&pitEventSource);
+    hpet_init(); // registers itself as clock and event source
+
+    tsc_calibrate();
+    if (g_tsc_hz) {
+        tscClockSource.frequency = g_tsc_hz;
+        // a TSC that may change speed or stop in idle is worse than the HPET
+        tscClockSource.rating = tsc_invariant() ? 300 : 150;
+        clocksource_register(&tscClockSource);
+    }
+
+    if (lapic_init() && lapic_timer_calibrate()) {
+        if (lapic_timer_has_tsc_deadline()) {
+            lapicEventSource.name = "lapic-tsc-deadline";
+        }
+        eventsource_register(&lapicEventSource);
+    }
+
+    // start the tick on the best rated event source that accepts it
+    bool used[MAX_EVENT_SOURCES] = {false};
+    for (int n = 0; n < g_num_events && g_tick == NULL; n++) {
+        int best = -1;
+        for (int i = 0; i < g_num_events; i++) {
+            if (!used[i] && (best < 0 || g_events[i]->rating > g_events[best]->rating)) {
+                best = i;
+            }
+        }
+        used[best] = true;
+        g_hz = hz; // pit_init() overwrites this with the achieved rate
+        if (g_events[best]->startPeriodic(hz, timer_irq)) {
+            g_tick = g_events[best];
+        }
+    }
+
+    // mask IRQ0 so the PIT does not deliver a second tick stream
+    if (g_tick != NULL && !g_tick->usesIrq0) {
+        irq_mask(IRQ_BASE + 0);
+    }
+
+    tickClockSource.frequency = g_hz;
+    clocksource_register(&tickClockSource);
+}
+
+bool timer_oneshot_us(uint32_t us, TimerEventCallback callback) {
+    // the tick source first (cheapest, e.g. a TSC deadline), then any other
+    for (int i = -1; i < g_num_events; i++) {
+        const EventSource *source = i < 0 ? g_tick : g_events[i];
+        if (source == NULL || source->oneshotUs == NULL) continue;
+        if (i >= 0 && source == g_tick) continue;
+        if (source->oneshotUs(us, callback)) return true;
+    }
+    return false;
+}
+
+void timer_set_tick_hook(TimerEventCallback hook) {
+    g_tick_hook = hook;
+}
+
+const char *timer_source_name(void) {
+    return g_tick != NULL ? g_tick->name : "none";
+}
+
+
+// appends "<label><value><unit>" to a line buffer
+static void append_number(char *line, const char *label, uint64_t value,
+                          const char *unit) {
+    char num[32];
+    uint64ToDecimalString(value, num);
+    concat(line, label, line);
+    concat(line, num, line);
+    concat(line, unit, line);
+}
+
+void printClocksToTerminal(void) {
+    char line[256];
+
+    terminalWriteLine("--- Clock Sources ---");
+    for (int i = 0; i < g_num_clocks; i++) {
+        concat("  ", g_clocks[i]->name, line);
+        append_number(line, ": ", g_clocks[i]->frequency, " Hz");
+        append_number(line, ", rating ", (uint64_t)g_clocks[i]->rating, "");
+        if (g_clocks[i] == g_clock) concat(line, " (current)", line);
+        terminalWriteLine(line);
+    }
+
+    terminalWriteLine("--- Event Sources ---");
+    for (int i = 0; i < g_num_events; i++) {
+        concat("  ", g_events[i]->name, line);
+        append_number(line, ": rating ", (uint64_t)g_events[i]->rating, "");
+        if (g_events[i]->oneshotUs != NULL) concat(line, ", one-shot", line);
+        if (g_events[i] == g_tick) concat(line, " (tick)", line);
+        terminalWriteLine(line);
+    }
+
+    line[0] = '\0';
+    append_number(line, "Tick rate: ", g_hz, " Hz");
+    terminalWriteLine(line);
+
+    if (!g_tsc_hz) {
+        terminalWriteLine("TSC: not available");
+        return;
+    }
+    line[0] = '\0';
+    append_number(line, "TSC (calibrated): ", g_tsc_hz, " Hz");
+    terminalWriteLine(line);
+
+    if (!hpet_available()) return;
+
+    // measure the TSC again over a longer HPET window and report the drift
+    uint64_t window = hpet_frequency() / 10;
+    uint64_t hpet_start = hpet_counter();
+    uint64_t tsc_start = rdtsc();
+    uint64_t hpet_end;
+    do {
+        hpet_end = hpet_counter();
+    } while (hpet_end - hpet_start < window);
+    uint64_t measured = ((rdtsc() - tsc_start) * hpet_frequency()) /
+                        (hpet_end - hpet_start);
+
+    line[0] = '\0';
+    append_number(line, "TSC vs HPET (100 ms): ", measured, " Hz");
+    terminalWriteLine(line);
+    uint64_t diff = measured > g_tsc_hz ? measured - g_tsc_hz : g_tsc_hz - measured;
+    line[0] = '\0';
+    append_number(line, measured >= g_tsc_hz ? "Drift: +" : "Drift: -",
+                  (diff * 1000000ull) / g_tsc_hz, " ppm");
+    terminalWriteLine(line);
+}
+
 void pit_init(uint32_t hz_requested) {
     // 1) Program PIT: channel 0, access lobyte/hibyte, mode 2 (rate generator)
     outb(PIT_CMD_PORT, 0x34);
@@ -59,12 +400,37 @@ void pit_init(uint32_t hz_requested) {
 }
 
 void timer_irq(void) {
-    // Called from your isrHandler on vector 32 (IRQ0 after remap)
+    // Called from isrHandler on vector 32 (IRQ0 after remap) or from the
+    // Local APIC timer on LAPIC_TIMER_VECTOR
+    seqcount_write_begin(&g_ticks_seq);
     g_ticks++;
+    seqcount_write_end(&g_ticks_seq);
+
+    // a 32-bit HPET counter is extended in software and has to be read at
+    // least once per wrap (~42 s at 100 MHz), doing it every 1024 ticks is
+    // plenty
+    if (((uint32_t)g_ticks & 1023u) == 0 && hpet_available()) {
+        hpet_counter();
+    }
+
+    if (g_tick_hook != NULL) {
+        g_tick_hook();
+    }
+
+    // frame updates of the main loop, only while a visual mode wants them
+    events_tick();
+
+    // slice accounting and sleeper wakeups, the switch itself happens on
+    // the way out of the interrupt
+    sched_tick();
 }
 
 uint64_t timer_ticks(void) {
-    return g_ticks;
+    return tick_read();
+}
+
+uint64_t timer_ms_to_ticks(uint64_t ms) {
+    return ceil_mul_div_u64(ms, g_hz, 1000u);
 }
 
 // ms = floor(ticks * 1000 / g_hz), computed safely in 64-bit
@@ -76,7 +442,7 @@ uint64_t timer_ms(void) {
     uint32_t b1 = 1000u / g;   // ≤ 1000
     uint32_t c1 = g_hz  / g;   // typically small (e.g., if g_hz=1000 -> c1=1)
 
-    uint64_t t = g_ticks;
+    uint64_t t = tick_read();
     uint64_t q = t / c1;
     uint64_t r = t % c1;
 
@@ -87,10 +453,18 @@ uint64_t timer_ms(void) {
 // Simple blocking sleep: halts the CPU between ticks (requires interrupts on)
 void timer_sleep_ms(uint64_t ms) {
     if (!g_hz) return;
-    uint64_t end = g_ticks + ceil_mul_div_u64(ms, g_hz, 1000u);
-    sti(); // ensure we wake from HLT on timer IRQs
-    while (g_ticks < end) {
-        hlt();
+    // with threads, sleeping gives the CPU to someone else
+    if (sched_active()) {
+        thread_sleep_ms(ms);
+        return;
+    }
+    uint64_t end = tick_read() + ceil_mul_div_u64(ms, g_hz, 1000u);
+    irq_enable(); // ensure we wake from HLT on timer IRQs
+    while (tick_read() < end) {
+        softirq_run();
+        irq_disable();
+        sched_idle_halt(); // books the wait as idle time
+        irq_enable();
     }
 }
 
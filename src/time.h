@@ -9,9 +9,134 @@
  * and for converting milliseconds to seconds.
  */
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
+/**
+ * @brief Callback type invoked when a timer event fires.
+ */
+typedef void (*TimerEventCallback)(void);
+
+/**
+ * @brief A free running counter that can be used to tell time.
+ */
+typedef struct {
+  const char *name;       /**< Short name, e.g. "tsc" or "hpet". */
+  uint64_t (*read)(void); /**< Returns the current counter value. */
+  uint64_t frequency;     /**< Counter ticks per second. */
+  int rating;             /**< Higher is better; the best source is used. */
+} ClockSource;
+
+/**
+ * @brief A device that can raise timer interrupts.
+ */
+typedef struct {
+  const char *name; /**< Short name, e.g. "lapic" or "pit". */
+  int rating;       /**< Higher is better; the best source drives the tick. */
+  bool usesIrq0;    /**< Delivers its interrupts on the legacy IRQ0 line. */
+  bool (*startPeriodic)(uint32_t hz, TimerEventCallback callback); /**< Starts a periodic timer. */
+  bool (*oneshotUs)(uint32_t us, TimerEventCallback callback); /**< Arms a one-shot timer, may be NULL. */
+} EventSource;
+
+/**
+ * @brief Registers a clock source.
+ *
+ * @param source The clock source, must stay valid forever.
+ * @details If the new source has a higher rating than the current one,
+ * clock_ns() switches to it without jumping.
+ */
+void clocksource_register(ClockSource *source);
+
+/**
+ * @brief Registers an event source that can drive the system tick.
+ *
+ * @param source The event source, must stay valid forever.
+ */
+void eventsource_register(const EventSource *source);
+
+/**
+ * @brief Returns the clock source used by clock_ns().
+ *
+ * @return const ClockSource* The current clock source, or NULL.
+ */
+const ClockSource *clocksource_current(void);
+
+/**
+ * @brief Returns the event source that drives the system tick.
+ *
+ * @return const EventSource* The tick source, or NULL before timer_init().
+ */
+const EventSource *eventsource_tick(void);
+
+/**
+ * @brief Monotonic nanoseconds since the first clock source was registered.
+ *
+ * @return uint64_t Nanoseconds, read from the best clock source.
+ */
+uint64_t clock_ns(void);
+
+/**
+ * @brief Initialize the system tick with the best available timer.
+ *
+ * @param hz The desired tick frequency in Hertz.
+ * @details Registers the PIT, HPET, TSC and Local APIC as clock and event
+ * sources and starts the tick on the best rated event source. The TSC is
+ * calibrated against the HPET when present, against the PIT otherwise.
+ */
+void timer_init(uint32_t hz);
+
+/**
+ * @brief Arms a one-shot timer on the best event source that supports it.
+ *
+ * @param us The delay in microseconds.
+ * @param callback Called once from interrupt context on expiry.
+ * @return true If some event source accepted the timer.
+ */
+bool timer_oneshot_us(uint32_t us, TimerEventCallback callback);
+
+/**
+ * @brief Installs a function that runs on every timer tick.
+ *
+ * @param hook The function to call from interrupt context, NULL to remove.
+ */
+void timer_set_tick_hook(TimerEventCallback hook);
+
+/**
+ * @brief Returns a printable name of the active tick source.
+ *
+ * @return const char* The tick source name.
+ */
+const char *timer_source_name(void);
+
+/**
+ * @brief Prints the registered clock and event sources to the terminal.
+ *
+ * @details Also cross-checks the calibrated TSC frequency against the HPET.
+ */
+void printClocksToTerminal(void);
+
+/**
+ * @brief Busy-waits using PIT channel 2.
+ *
+ * @param us The number of microseconds to wait.
+ * @details Works with interrupts disabled and without a running tick, which
+ * makes it suitable for calibrating other clocks.
+ */
+void pit_delay_us(uint32_t us);
+
+/**
+ * @brief Measures the TSC frequency against the PIT.
+ */
+void tsc_calibrate(void);
+
+/**
+ * @brief Returns the calibrated TSC frequency.
+ *
+ * @return uint64_t TSC ticks per second, 0 if the CPU has no TSC.
+ */
+uint64_t tsc_hz(void);
+
 /**
  * @brief Initialize the Programmable Interrupt Timer (PIT).
  *
@@ -26,6 +151,14 @@ void pit_init(uint32_t hz);
  */
 uint64_t timer_ticks(void); // raw ticks since pit_init()
 
+/**
+ * @brief Convert milliseconds to timer ticks, rounding up.
+ *
+ * @param ms The duration in milliseconds.
+ * @return uint64_t The number of ticks covering at least ms milliseconds.
+ */
+uint64_t timer_ms_to_ticks(uint64_t ms);
+
 /** * @brief Get the current time in milliseconds.
  *
  * @return uint64_t The current time in milliseconds since the PIT was initialized.
@@ -0,0 +1,72 @@
+; trampoline.asm - real-mode entry of the application processors
+
+; An AP starts in 16-bit real mode at the page the startup IPI named, so this
+; code is never run where it is linked: smp_init() copies the bytes between
+; ap_trampoline_start and ap_trampoline_end to TRAMPOLINE_BASE and fills in
+; the parameter block at the end. All addresses are computed relative to
+; that copy. TRAMPOLINE_BASE must match SMP_TRAMPOLINE_BASE in smp.h.
+;
+; The code enables protected mode with a flat GDT of its own (same selectors
+; as the kernel's), switches to the stack from the parameter block and calls
+; the C entry, which loads the real GDT and IDT. Paging stays off in here,
+; the C entry turns it on with the kernel's directory (paging_cpu_init()).
+
+TRAMPOLINE_BASE equ 0x7000
+
+%define TRAMPOLINE_ADDR(label) (TRAMPOLINE_BASE + (label - ap_trampoline_start))
+
+CR0_PE    equ 1 << 0
+CR0_CD_NW equ (1 << 30) | (1 << 29) ; caching is off after INIT
+
+section .rodata
+align 16
+global ap_trampoline_start
+global ap_trampoline_end
+global ap_trampoline_stack
+global ap_trampoline_entry
+
+bits 16
+ap_trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    lgdt [TRAMPOLINE_ADDR(trampoline_gdtr)]
+
+    mov eax, cr0
+    and eax, ~CR0_CD_NW
+    or eax, CR0_PE
+    mov cr0, eax
+    jmp dword 0x08:TRAMPOLINE_ADDR(trampoline_protected)
+
+bits 32
+trampoline_protected:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+    mov esp, [TRAMPOLINE_ADDR(ap_trampoline_stack)]
+    call [TRAMPOLINE_ADDR(ap_trampoline_entry)]
+.halt:                  ; the entry does not return
+    cli
+    hlt
+    jmp .halt
+
+align 8
+trampoline_gdt:
+    dq 0                    ; null
+    dq 0x00CF9A000000FFFF   ; 0x08: flat 32-bit code, ring 0
+    dq 0x00CF92000000FFFF   ; 0x10: flat 32-bit data, ring 0
+trampoline_gdtr:
+    dw trampoline_gdtr - trampoline_gdt - 1
+    dd TRAMPOLINE_ADDR(trampoline_gdt)
+
+; parameter block, written by smp_init() for every AP it starts
+align 4
+ap_trampoline_stack:
+    dd 0                ; initial esp
+ap_trampoline_entry:
+    dd 0                ; void entry(void)
+ap_trampoline_end:
@@ -0,0 +1,257 @@
+#include "user.h"
+#include "cpu.h"
+#include "gdt.h"
+#include "interrupts.h"
+#include "ipc.h"
+#include "percpu.h"
+#include <stddef.h>
+
+#define PAGE_FAULT_VECTOR 14
+// error code bits of a page fault
+#define PF_PRESENT 0x1 // the page was mapped, it was an access violation
+#define PF_WRITE 0x2   // the access was a write
+
+// in syscall.asm
+extern void user_enter(uint32_t eip, uint32_t esp) __attribute__((noreturn));
+extern void user_resume(const SyscallFrame *frame) __attribute__((noreturn));
+
+// the .user section, see linker.ld: linked for USER_BASE, loaded behind the
+// kernel's data
+extern uint8_t user_image_start[];
+extern uint8_t user_image_end[];
+extern uint8_t user_image_load[];
+
+static UserProcess processes[THREAD_MAX];
+static bool available = false;
+
+// writes to copy-on-write pages, by the program or by a system call on its
+// behalf, everything else is fatal as before
+static void user_page_fault(registers_t *regs, void *ctx) {
+  (void)ctx;
+  Thread *self = thread_current();
+  if ((regs->err_code & (PF_PRESENT | PF_WRITE)) == (PF_PRESENT | PF_WRITE) &&
+      self != NULL && self->space != NULL &&
+      as_cow_fault(self->space, read_cr2())) {
+    return;
+  }
+  irq_unhandled(PAGE_FAULT_VECTOR, regs);
+}
+
+void user_init(void) {
+  if (available || !paging_enabled()) {
+    return;
+  }
+  uint32_t *kernelStackSlot = gdtLoadTss(this_cpu_read(index));
+  this_cpu_write(tssEsp0, kernelStackSlot);
+  syscall_init(kernelStackSlot);
+  irq_register(PAGE_FAULT_VECTOR, user_page_fault, NULL);
+  irq_set_name(PAGE_FAULT_VECTOR, "page-fault");
+  available = true;
+}
+
+bool user_available(void) { return available; }
+
+// takes a free slot, NULL if all are used
+static UserProcess *process_alloc(void) {
+  UserProcess *proc = NULL;
+  uint32_t flags = irq_save();
+  for (uint32_t i = 0; i < THREAD_MAX; i++) {
+    if (!processes[i].used) {
+      proc = &processes[i];
+      proc->used = true;
+      break;
+    }
+  }
+  irq_restore(flags);
+  if (proc == NULL) {
+    return NULL;
+  }
+
+  proc->space = NULL;
+  proc->thread = NULL;
+  proc->pid = 0;
+  proc->parent = NULL;
+  proc->entry = 0;
+  proc->stackTop = USER_STACK_TOP;
+  proc->exitCode = 0;
+  proc->detached = false;
+  completion_init(&proc->exited);
+  return proc;
+}
+
+UserProcess *user_process_create(void) {
+  if (!available) {
+    return NULL;
+  }
+  UserProcess *proc = process_alloc();
+  if (proc == NULL) {
+    return NULL;
+  }
+  proc->space = as_create();
+  if (proc->space == NULL ||
+      !as_map_zeroed(proc->space,
+                     USER_STACK_TOP - USER_STACK_PAGES * PAGE_SIZE,
+                     USER_STACK_PAGES, PTE_WRITABLE)) {
+    user_process_release(proc);
+    return NULL;
+  }
+  return proc;
+}
+
+bool user_process_map_builtin(UserProcess *proc) {
+  uint32_t size = (uint32_t)(user_image_end - user_image_start);
+  for (uint32_t offset = 0; offset < size; offset += PAGE_SIZE) {
+    if (!as_map(proc->space, (uint32_t)user_image_start + offset,
+                (uint32_t)user_image_load + offset, PTE_BORROWED)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// first code of a process' thread, schedule() already loaded its address
+// space and pointed ESP0 at the top of this stack
+static void user_thread_start(void *arg) {
+  UserProcess *proc = arg;
+  user_enter(proc->entry, proc->stackTop);
+}
+
+// first code of a forked child, continues where its parent made the call
+static void user_fork_start(void *arg) {
+  UserProcess *proc = arg;
+  user_resume(&proc->resume);
+}
+
+// creates the thread of a process, it runs once the caller allows preemption
+static bool process_thread_create(UserProcess *proc, const char *name,
+                                  ThreadEntry entry) {
+  // the thread must not run before it knows its address space
+  preempt_disable();
+  Thread *thread = thread_create(name, entry, proc);
+  if (thread != NULL) {
+    thread->space = proc->space;
+    thread->process = proc;
+    proc->thread = thread;
+    proc->pid = thread->id;
+  }
+  preempt_enable();
+  return thread != NULL;
+}
+
+bool user_process_start(UserProcess *proc, const char *name, uint32_t entry,
+                        const uint32_t *args, uint32_t argCount) {
+  if (argCount > USER_MAX_ARGS) {
+    return false;
+  }
+  // the stack frames are fresh and reachable through the identity map
+  uint32_t top = as_lookup(proc->space, USER_STACK_TOP - PAGE_SIZE);
+  uint32_t *sp = (uint32_t *)((top & ~(PAGE_SIZE - 1)) + PAGE_SIZE);
+  for (uint32_t i = argCount; i > 0; i--) {
+    *--sp = args[i - 1];
+  }
+  proc->entry = entry;
+  proc->stackTop = USER_STACK_TOP - argCount * sizeof(uint32_t);
+  return process_thread_create(proc, name, user_thread_start);
+}
+
+void user_process_release(UserProcess *proc) {
+  ipc_process_exit(proc);
+  as_destroy(proc->space);
+  proc->space = NULL;
+  proc->used = false;
+}
+
+int32_t user_process_wait(UserProcess *proc) {
+  if (!wait_for_completion(&proc->exited)) {
+    // the process may not stop before its next system call, it frees its
+    // slot itself then
+    uint32_t flags = irq_save();
+    bool done = completion_done(&proc->exited);
+    if (!done) {
+      proc->detached = true;
+      thread_kill(proc->thread);
+    }
+    irq_restore(flags);
+    if (!done) {
+      return USER_EXIT_KILLED;
+    }
+  }
+  int32_t code = proc->exitCode;
+  proc->used = false;
+  return code;
+}
+
+uint32_t user_fork(const SyscallFrame *frame, bool eager) {
+  Thread *self = thread_current();
+  UserProcess *parent = self->process;
+  UserProcess *child = process_alloc();
+  if (child == NULL) {
+    return SYSCALL_ERROR;
+  }
+  child->space = as_fork(parent->space, eager);
+  if (child->space == NULL) {
+    user_process_release(child);
+    return SYSCALL_ERROR;
+  }
+  child->parent = parent;
+  child->entry = frame->eip;
+  child->stackTop = frame->esp;
+  child->resume = *frame;
+  child->resume.eax = 0;
+  if (!process_thread_create(child, self->name, user_fork_start)) {
+    user_process_release(child);
+    return SYSCALL_ERROR;
+  }
+  return child->pid;
+}
+
+uint32_t user_wait_child(uint32_t pid) {
+  UserProcess *self = thread_current()->process;
+  UserProcess *child = NULL;
+  uint32_t flags = irq_save();
+  for (uint32_t i = 0; i < THREAD_MAX; i++) {
+    if (processes[i].used && processes[i].parent == self &&
+        processes[i].pid == pid) {
+      child = &processes[i];
+      break;
+    }
+  }
+  irq_restore(flags);
+  if (child == NULL) {
+    return SYSCALL_ERROR;
+  }
+  return (uint32_t)user_process_wait(child);
+}
+
+void user_exit(int32_t code) {
+  irq_disable();
+  Thread *self = thread_current();
+  UserProcess *proc = self->process;
+  // nobody waits for the children any more
+  for (uint32_t i = 0; i < THREAD_MAX; i++) {
+    UserProcess *child = &processes[i];
+    if (child->used && child->parent == proc) {
+      child->parent = NULL;
+      if (completion_done(&child->exited)) {
+        child->used = false;
+      } else {
+        child->detached = true;
+      }
+    }
+  }
+  ipc_process_exit(proc);
+  // the kernel directory maps everything the thread touches from here on
+  self->space = NULL;
+  self->process = NULL;
+  as_switch(NULL);
+  as_destroy(proc->space);
+  proc->space = NULL;
+  proc->exitCode = code;
+  complete_all(&proc->exited);
+  if (proc->detached) {
+    proc->used = false;
+  }
+  thread_exit();
+}
+
+void user_fault(uint8_t vector) { user_exit(USER_EXIT_FAULT(vector)); }
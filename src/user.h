@@ -0,0 +1,168 @@
+#ifndef USER_H
+#define USER_H
+
+/**
+ * @file user.h
+ * @brief User programs: ring 3 processes in their own address space.
+ *
+ * A process is one thread that runs in ring 3 with its own ::AddressSpace.
+ * It can only reach its own pages, and the kernel checks every pointer it
+ * passes in. Kernel memory, port I/O and privileged instructions fault,
+ * and any exception from ring 3 ends the process, not the system (see
+ * user_fault()). That makes it safe to run code that is not trusted, e.g.
+ * benchmark programs. Like all threads, processes run on the BSP.
+ *
+ * The programs built into the kernel (userprogs.asm) are linked for
+ * USER_BASE and mapped there read-only, the processes running them share
+ * the frames of the kernel image.
+ *
+ * A process can fork: the child gets a copy-on-write copy of the address
+ * space (as_fork()) and continues from the same system call, which
+ * returns 0 to it. Page faults on copy-on-write pages are resolved by the
+ * vector 14 handler user_init() installs. Children whose parent ended
+ * free their slot themselves.
+ */
+
+#include "paging.h"
+#include "sched.h"
+#include "sync.h"
+#include "syscall.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @brief Initial stack pointer of a process, arguments go below. */
+#define USER_STACK_TOP USER_END
+
+/** @brief Pages of the user stack. */
+#define USER_STACK_PAGES 4
+
+/** @brief Most arguments user_process_start() puts on the stack. */
+#define USER_MAX_ARGS 8
+
+/** @brief Exit code of a process that was killed. */
+#define USER_EXIT_KILLED (-1)
+
+/** @brief Exit code of a process ended by a CPU exception. */
+#define USER_EXIT_FAULT(vector) (-256 - (int32_t)(vector))
+
+/** @brief Whether an exit code is a USER_EXIT_FAULT(). */
+#define USER_EXIT_IS_FAULT(code) ((code) <= -256 && (code) > -256 - 32)
+
+/** @brief The exception vector of a USER_EXIT_FAULT() exit code. */
+#define USER_EXIT_VECTOR(code) ((uint8_t)(-256 - (code)))
+
+/**
+ * @brief A user program and its resources.
+ */
+typedef struct UserProcess {
+  AddressSpace *space;        /**< Its pages, NULL once it exited. */
+  Thread *thread;             /**< The thread running it. */
+  uint32_t pid;               /**< Id of the thread, stays valid after it. */
+  struct UserProcess *parent; /**< The process that forked it, or NULL. */
+  uint32_t entry;             /**< First instruction. */
+  uint32_t stackTop;          /**< Initial ESP, the arguments start there. */
+  SyscallFrame resume;        /**< Registers a forked child starts with. */
+  volatile int32_t exitCode;  /**< Valid once exited completed. */
+  Completion exited;          /**< Completed when the process ends. */
+  bool detached;              /**< Nobody waits, the process frees its slot. */
+  bool used;                  /**< Slot taken. */
+} UserProcess;
+
+/**
+ * @brief Loads the BSP's TSS and installs the system call gates.
+ *
+ * @details Needs paging_init(), without paging user mode stays off. Also
+ * installs the page fault handler for copy-on-write.
+ */
+void user_init(void);
+
+/**
+ * @brief Returns whether user programs can run.
+ *
+ * @return true If user_init() succeeded.
+ */
+bool user_available(void);
+
+/**
+ * @brief Creates a process with an empty address space and a stack.
+ *
+ * @return UserProcess* The process, NULL without user mode or memory.
+ * @details Map the program, then user_process_start().
+ */
+UserProcess *user_process_create(void);
+
+/**
+ * @brief Maps the programs built into the kernel at USER_BASE.
+ *
+ * @param proc A process that was not started yet.
+ * @return true If mapped.
+ */
+bool user_process_map_builtin(UserProcess *proc);
+
+/**
+ * @brief Starts a process in ring 3.
+ *
+ * @param proc The process.
+ * @param name Thread name shown by ps.
+ * @param entry User address of the first instruction.
+ * @param args Copied to the stack, args[0] ends up at [ESP].
+ * @param argCount Up to USER_MAX_ARGS.
+ * @return true If started, else release the process.
+ */
+bool user_process_start(UserProcess *proc, const char *name, uint32_t entry,
+                        const uint32_t *args, uint32_t argCount);
+
+/**
+ * @brief Frees a process that was never started.
+ *
+ * @param proc The process.
+ */
+void user_process_release(UserProcess *proc);
+
+/**
+ * @brief Waits until a process ended and frees it.
+ *
+ * @param proc A started process.
+ * @return int32_t Its exit code, USER_EXIT_KILLED if the waiting thread was
+ * killed, the process is then killed as well.
+ */
+int32_t user_process_wait(UserProcess *proc);
+
+/**
+ * @brief Forks the running process.
+ *
+ * @param frame The system call of the parent, the child returns from a
+ * copy of it.
+ * @param eager Copy all pages now instead of copy-on-write.
+ * @return uint32_t The child's pid, SYSCALL_ERROR without a free slot or
+ * memory.
+ */
+uint32_t user_fork(const SyscallFrame *frame, bool eager);
+
+/**
+ * @brief Waits until a child of the running process ended and frees it.
+ *
+ * @param pid The child's pid, from user_fork().
+ * @return uint32_t Its exit code, SYSCALL_ERROR if it is no child.
+ */
+uint32_t user_wait_child(uint32_t pid);
+
+/**
+ * @brief Ends the running process.
+ *
+ * @param code The exit code.
+ * @details Frees the address space right away, the thread is gone once
+ * it switched away for the last time.
+ */
+void user_exit(int32_t code) __attribute__((noreturn));
+
+/**
+ * @brief Ends the running process because of an exception in ring 3.
+ *
+ * @param vector The exception vector.
+ * @details Called by the interrupt dispatcher for exceptions no handler
+ * resolved.
+ */
+void user_fault(uint8_t vector) __attribute__((noreturn));
+
+#endif
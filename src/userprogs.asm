@@ -0,0 +1,240 @@
+; userprogs.asm - programs built into the kernel that run in ring 3
+;
+; They live in the .user section, which linker.ld links for USER_BASE and
+; user.c maps read-only into the address space of every process running
+; one of them. They only touch their own stack and reach the kernel through
+; system calls (syscall.h). The arguments given to user_process_start() are
+; on the stack, the first one at [esp].
+
+; call numbers, see syscall.h
+%define SYS_EXIT 0
+%define SYS_WRITE 1
+%define SYS_GETPID 2
+%define SYS_FORK 5
+%define SYS_WAIT 6
+%define SYS_IPC_SEND 9
+%define SYS_IPC_SEND_ASYNC 10
+%define SYS_IPC_RECEIVE 11
+%define SYSCALL_ERROR -1
+
+; identity mapped kernel memory, below the kernel image
+%define KERNEL_ADDRESS 0x00100000
+
+; heap of the fork benchmark, see forkbench.c
+%define FORK_HEAP 0x50000000
+
+; pages the IPC benchmark moves, and the window receiving them, see ipc.h
+; and ipcbench.c
+%define IPC_BUFFER 0x60000000
+%define IPC_MAX_PAGES 1024
+%define IPC_PAGES_MASK 0xFFF
+
+section .user progbits alloc exec nowrite align=16
+
+; Times round trips of the cheapest system call.
+; [esp] = round trips, at least 1, [esp + 4] = 0 for int 0x80, 1 for
+; sysenter. Exits with the average TSC cycles per round trip.
+global user_syscall_bench
+user_syscall_bench:
+    mov ebp, [esp]          ; round trips
+    mov ebx, ebp            ; counts down, both gates preserve EBX and EBP
+    cmp dword [esp + 4], 0
+    jne .sysenter
+    rdtsc
+    mov esi, eax
+    mov edi, edx
+.int80_loop:
+    mov eax, SYS_GETPID
+    int 0x80
+    dec ebx
+    jnz .int80_loop
+    jmp .done
+.sysenter:
+    rdtsc
+    mov esi, eax
+    mov edi, edx
+.sysenter_loop:
+    mov eax, SYS_GETPID
+    mov ecx, esp            ; sysexit continues at EDX with ESP = ECX
+    mov edx, .sysenter_return
+    sysenter
+.sysenter_return:
+    dec ebx
+    jnz .sysenter_loop
+.done:
+    rdtsc
+    sub eax, esi
+    sbb edx, edi
+    div ebp                 ; average over all round trips
+    mov ebx, eax
+    mov eax, SYS_EXIT
+    int 0x80
+
+; Tries one thing a program must not be able to do, selected by [esp]:
+; 0 read kernel memory, 1 write kernel memory, 2 disable interrupts,
+; 3 read an I/O port, 4 have the kernel read kernel memory for it.
+; The kernel is expected to end the process with an exception (0-3) or to
+; refuse the call (4), then the program exits with 1. Exit code 0 means the
+; attempt went through.
+global user_isolation_probe
+user_isolation_probe:
+    mov eax, [esp]
+    cmp eax, 0
+    jne .write
+    mov eax, [KERNEL_ADDRESS]
+    jmp .went_through
+.write:
+    cmp eax, 1
+    jne .cli
+    mov dword [KERNEL_ADDRESS], 0
+    jmp .went_through
+.cli:
+    cmp eax, 2
+    jne .port
+    cli
+    jmp .went_through
+.port:
+    cmp eax, 3
+    jne .syscall
+    in al, 0x60
+    jmp .went_through
+.syscall:
+    mov eax, SYS_WRITE
+    mov ebx, KERNEL_ADDRESS
+    mov esi, 16
+    int 0x80
+    cmp eax, SYSCALL_ERROR
+    jne .went_through
+    mov ebx, 1
+    mov eax, SYS_EXIT
+    int 0x80
+.went_through:
+    xor ebx, ebx
+    mov eax, SYS_EXIT
+    int 0x80
+
+; Forks and times it.
+; [esp] = pages mapped at FORK_HEAP, at least 1, [esp + 4] = 0 to share
+; them copy-on-write, 1 to copy them right away, [esp + 8] = what to exit
+; with: 0 the TSC cycles of the fork call in the parent, 1 the average
+; cycles the child needs to write to one page of the heap.
+global user_fork_bench
+user_fork_bench:
+    mov ebp, [esp]          ; heap pages
+    rdtsc
+    mov esi, eax
+    mov edi, edx
+    mov eax, SYS_FORK
+    mov ebx, [esp + 4]
+    int 0x80
+    test eax, eax
+    jz .child
+    cmp eax, SYSCALL_ERROR
+    je .failed
+    mov ebx, eax            ; the child's pid, for SYS_WAIT
+    rdtsc
+    sub eax, esi            ; far below 2^32 cycles
+    push eax
+    mov eax, SYS_WAIT
+    int 0x80
+    pop ebx                 ; the fork's cycles
+    cmp dword [esp + 8], 0
+    je .exit
+    mov ebx, eax            ; the child's result
+    jmp .exit
+.failed:
+    mov ebx, SYSCALL_ERROR
+.exit:
+    mov eax, SYS_EXIT
+    int 0x80
+.child:
+    rdtsc
+    mov esi, eax
+    mov edi, edx
+    mov ebx, FORK_HEAP
+    mov ecx, ebp
+.touch:
+    mov [ebx], ecx          ; the first write to a shared page faults
+    add ebx, 4096
+    dec ecx
+    jnz .touch
+    rdtsc
+    sub eax, esi
+    sbb edx, edi
+    div ebp                 ; average over all pages
+    mov ebx, eax
+    mov eax, SYS_EXIT
+    int 0x80
+
+; One side of a ping-pong over two IPC endpoints.
+; [esp] = round trips, at least 1, [esp + 4] = endpoint to send to,
+; [esp + 8] = endpoint to receive from, [esp + 12] = pages moved with every
+; message, from and to IPC_BUFFER (0 = registers only), [esp + 16] = 1 to
+; send asynchronously, [esp + 20] = 0 to start by sending (ping), 1 to
+; start by receiving (pong). Writes to every page it receives. The ping
+; side exits with the average TSC cycles per round trip, the pong side
+; with 0.
+global user_ipc_bench
+user_ipc_bench:
+    push dword [esp]        ; round trips left
+    rdtsc
+    push edx
+    push eax                ; [esp] start, [esp + 8] left, arguments above
+    cmp dword [esp + 32], 0
+    jne .receive
+.send:
+    mov ebx, [esp + 16]
+    mov esi, [esp + 8]      ; a word of payload, the round trips left
+    mov ebp, [esp + 24]     ; address | count, the pages came back here
+    test ebp, ebp
+    jz .send_call
+    or ebp, IPC_BUFFER
+.send_call:
+    mov eax, SYS_IPC_SEND
+    cmp dword [esp + 28], 0
+    je .send_gate
+    mov eax, SYS_IPC_SEND_ASYNC
+.send_gate:
+    int 0x80
+    cmp eax, SYSCALL_ERROR
+    je .failed
+    cmp dword [esp + 32], 0
+    je .receive             ; ping waits for the answer
+    dec dword [esp + 8]
+    jz .done
+.receive:
+    mov ebx, [esp + 20]
+    mov ebp, IPC_BUFFER | IPC_MAX_PAGES
+    mov eax, SYS_IPC_RECEIVE
+    int 0x80
+    cmp eax, SYSCALL_ERROR
+    je .failed
+    mov ecx, ebp            ; pages received
+    and ecx, IPC_PAGES_MASK
+    jz .received
+    mov edi, IPC_BUFFER
+.touch:
+    mov [edi], ecx          ; the pages are this process' own now
+    add edi, 4096
+    dec ecx
+    jnz .touch
+.received:
+    cmp dword [esp + 32], 0
+    jne .send               ; pong answers
+    dec dword [esp + 8]
+    jnz .send
+.done:
+    xor ebx, ebx
+    cmp dword [esp + 32], 0
+    jne .exit
+    rdtsc
+    sub eax, [esp]
+    sbb edx, [esp + 4]
+    div dword [esp + 12]    ; average over all round trips
+    mov ebx, eax
+    jmp .exit
+.failed:
+    mov ebx, SYSCALL_ERROR
+.exit:
+    mov eax, SYS_EXIT
+    int 0x80
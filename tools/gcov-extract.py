@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+"""Turns the gcov dump of a kernel training run back into .gcda files.
+
+The kernel (src/gcov.c) writes every object's profile to the serial port:
+
+    gcov-begin <path of the .gcda file>
+    <hex data, 32 bytes per line>
+    gcov-end <number of bytes>
+
+Everything else in the log (boot messages, ...) is ignored. The .gcda
+files are written to the recorded paths, next to the instrumented objects,
+where -fprofile-use looks for them.
+
+usage: gcov-extract.py <serial log>
+"""
+
+import os
+import sys
+
+
+def extract(log_path):
+    written = 0
+    path = None
+    data = bytearray()
+    with open(log_path, "r", errors="replace") as log:
+        for raw in log:
+            line = raw.strip()
+            if line.startswith("gcov-begin "):
+                path = line[len("gcov-begin "):]
+                data = bytearray()
+            elif line.startswith("gcov-end ") and path is not None:
+                expected = int(line.split()[1])
+                if expected != len(data):
+                    sys.exit("%s: got %d bytes, expected %d (truncated log?)"
+                             % (path, len(data), expected))
+                os.makedirs(os.path.dirname(path) or ".", exist_ok=True)
+                with open(path, "wb") as out:
+                    out.write(data)
+                written += 1
+                path = None
+            elif path is not None:
+                data += bytes.fromhex(line)
+    if path is not None:
+        sys.exit("%s: dump ended without gcov-end (truncated log?)" % path)
+    return written
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit("usage: gcov-extract.py <serial log>")
+    count = extract(sys.argv[1])
+    if count == 0:
+        sys.exit("no profile found in %s, was the kernel built with "
+                 "make pgo-gen and shut down cleanly?" % sys.argv[1])
+    print("wrote %d .gcda files" % count)
+
+
+if __name__ == "__main__":
+    main()